@@ -25,6 +25,19 @@ HEADERS += \
 SOURCES += \
     ../src/scanner.c \
     ../src/cache.c \
+    ../src/workpool.c \
+    ../src/uring.c \
+    ../src/inodeset.c \
+    ../src/dirstore.c \
+    ../src/dirtree.c \
+    ../src/filestore.c \
+    ../src/crc32c.c \
+    ../src/catalog.c \
+    ../src/history.c \
+    ../src/server.c \
+    ../src/order.c \
+    ../src/estimate.c \
+    ../src/stream.c \
     backend_interface.c
 
 # Assembly object file
@@ -1,67 +1,110 @@
 #include "backend_interface.h"
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
 
-// Include the actual C backend (DirInfo already included via header)
+// Include the actual C backend (DirStore already included via header)
 #include "../src/cache.h"
+#include "../src/server.h"
+#include "../src/estimate.h"
+#include "../src/stream.h"
+#include <pthread.h>
 
 // Global variables for the backend
-static DirInfo* g_dirs = NULL;
-static int g_max_dirs = 0;
-static int g_dir_count = 0;
-static int g_file_count = 0;
-static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
-// Progress mirrors from scanner
-extern const char* scanner_progress_get_path(void);
-extern uint64_t scanner_progress_get_bytes(void);
+static DirStore* g_store = NULL;
+static uint64_t g_dir_count = 0;
+static uint64_t g_file_count = 0;
+// Token of the scan in progress, shared by every scan of the backend
+static ScanControl* g_control = NULL;
+// Directories completed by the scan in progress, for the GUI thread
+static ScanStream* g_stream = NULL;
+// Query server asked first for scans (server.h), "" when not used
+static char g_server_socket[1024] = "";
+// Last progress snapshot, kept for the rates between polls (GUI thread only)
+static ScanProgress g_progress;
+// Expected totals of the scan in progress, set by the scanning thread
+static ScanEstimate g_estimate;
+static pthread_mutex_t g_estimate_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_percent = 0;
+static double g_eta_seconds = -1.0;
 
 int backend_init(void) {
     // Initialize cache system
-    return cache_init();
+    int status = cache_init();
+    if (!g_control) g_control = scan_control_create();
+    if (!g_stream) g_stream = stream_create(BACKEND_STREAM_DEPTH, BACKEND_STREAM_MIN_SIZE);
+    const char *server = getenv("DISKSCOUT_SERVER");
+    if (server) backend_use_server(server[0] ? server : NULL);
+    return status;
+}
+
+int backend_use_server(const char* socket_path) {
+    if (!socket_path) return server_default_socket(g_server_socket, sizeof(g_server_socket));
+    size_t len = strlen(socket_path);
+    if (len >= sizeof(g_server_socket)) return -1;
+    memcpy(g_server_socket, socket_path, len + 1);
+    return 0;
 }
 
 void backend_cleanup(void) {
-    if (g_dirs) { free(g_dirs); g_dirs = NULL; }
+    if (g_store) { dirstore_free(g_store); g_store = NULL; }
+    scan_control_free(g_control);
+    g_control = NULL;
+    stream_free(g_stream);
+    g_stream = NULL;
     cache_cleanup();
-    pthread_mutex_destroy(&g_mutex);
 }
 
 int backend_scan_directory(const char* path, 
-                          DirInfo** dirs, 
-                          int* dir_count, 
+                          DirStore** store, 
+                          uint64_t* dir_count, 
                           uint64_t* total_size, 
-                          int* total_file_count) {
+                          uint64_t* total_alloc, 
+                          uint64_t* total_file_count) {
     
     // Reset global state
-    if (g_dirs) {
-        free(g_dirs);
-        g_dirs = NULL;
+    if (g_store) {
+        dirstore_free(g_store);
+        g_store = NULL;
     }
-    g_max_dirs = 0;
     g_dir_count = 0;
     g_file_count = 0;
     
-    // Initialize directory array
-    g_max_dirs = INITIAL_MAX_DIRS;
-    g_dirs = (DirInfo*)malloc(g_max_dirs * sizeof(DirInfo));
-    if (!g_dirs) {
+    scan_control_reset(g_control);
+    // Nothing of an earlier scan left for the GUI to take
+    stream_release(stream_take(g_stream));
+
+    // A running server answers from its loaded snapshot without a scan
+    if (g_server_socket[0]) {
+        g_store = server_fetch_store(g_server_socket, path);
+        if (g_store) {
+            const DirRecord* totals = dirstore_totals(g_store);
+            g_dir_count = dirstore_count(g_store);
+            g_file_count = totals->files;
+            *store = g_store;
+            *dir_count = g_dir_count;
+            *total_size = totals->size;
+            *total_alloc = totals->alloc_size;
+            *total_file_count = g_file_count;
+            return 1;
+        }
+    }
+
+    // Perform scan on the work-stealing pool (one worker per CPU), keeping
+    // every directory for the treemap and sunburst views.
+    // The scanner's progress snapshot follows it (backend_get_progress()).
+    // A cancelled scan still returns what it found (backend_scan_incomplete()).
+    // Directories are streamed as they complete (backend_take_streamed()).
+    ScanOptions opts = { .retain = SCAN_RETAIN_DIRS, .control = g_control, .stream = g_stream };
+    pthread_mutex_lock(&g_estimate_lock);
+    estimate_begin(&g_estimate, path);
+    pthread_mutex_unlock(&g_estimate_lock);
+    uint64_t total = scan_directory(path, &opts, &g_store, NULL, &g_dir_count, &g_file_count, total_alloc);
+    if (!g_store) {
         return 0; // Failed to allocate
     }
     
-    // Reset progress counters
-    extern void scanner_progress_reset(void);
-    scanner_progress_reset();
-
-    // Perform scan
-    uint64_t total = scan_directory(path, g_dirs, &g_dir_count, &g_file_count, &g_mutex, &g_max_dirs);
-    // If the scanner grew the array, fetch the new pointer
-    extern DirInfo* scanner_current_dirs(void);
-    DirInfo* current = scanner_current_dirs();
-    if (current) g_dirs = current;
-    
     // Return results
-    *dirs = g_dirs;
+    *store = g_store;
     *dir_count = g_dir_count;
     *total_size = total;
     *total_file_count = g_file_count;
@@ -72,80 +115,151 @@ int backend_scan_directory(const char* path,
     return 1; // Success
 }
 
+void backend_cancel_scan(void) {
+    scan_control_cancel(g_control);
+}
+
+void backend_pause_scan(int paused) {
+    scan_control_pause(g_control, paused);
+}
+
+int backend_scan_paused(void) {
+    return scan_control_paused(g_control);
+}
+
+int backend_scan_incomplete(void) {
+    return scan_control_incomplete(g_control);
+}
+
+uint64_t backend_scan_unreadable(void) {
+    return scan_control_unreadable(g_control);
+}
+
+StreamEntry* backend_take_streamed(void) {
+    return stream_take(g_stream);
+}
+
+void backend_free_streamed(StreamEntry* entries) {
+    stream_release(entries);
+}
+
 // Expose lightweight progress data to GUI
 int backend_get_progress_percent(void) {
-    // Percent is not tracked precisely in backend; return files-based rough progress if available
-    // Without a known total, return 0..99 while running; GUI can cap visually.
-    // Here we use bytes scanned modulo to produce a non-zero moving value.
-    uint64_t b = scanner_progress_get_bytes();
-    if (b == 0) return 0;
-    // Cheap heuristic: scale down to 0..95
-    return (int)((b % (100ULL * 1024ULL * 1024ULL)) / (1024ULL * 1024ULL));
+    return g_percent;
+}
+
+double backend_get_eta_seconds(void) {
+    return g_eta_seconds;
+}
+
+void backend_get_progress(BackendProgress* progress) {
+    scanner_progress_snapshot(&g_progress);
+    pthread_mutex_lock(&g_estimate_lock);
+    g_percent = (int)(estimate_update(&g_estimate, &g_progress, &g_eta_seconds) * 100.0);
+    pthread_mutex_unlock(&g_estimate_lock);
+    progress->percent = g_percent;
+    progress->eta_seconds = g_eta_seconds;
+    progress->running = g_progress.running;
+    progress->elapsed = g_progress.elapsed;
+    progress->files = g_progress.files;
+    progress->dirs = g_progress.dirs;
+    progress->bytes = g_progress.bytes;
+    progress->dirs_pending = g_progress.dirs_pending;
+    progress->files_per_sec = g_progress.files_per_sec;
+    progress->bytes_per_sec = g_progress.bytes_per_sec;
+    progress->workers = g_progress.num_workers;
+    progress->workers_listing = 0;
+    progress->workers_paused = 0;
+    int shown = g_progress.num_workers < SCAN_PROGRESS_MAX_WORKERS ? g_progress.num_workers
+                                                                   : SCAN_PROGRESS_MAX_WORKERS;
+    for (int i = 0; i < shown; i++) {
+        if (g_progress.worker_state[i] == SCAN_WORKER_LISTING) progress->workers_listing++;
+        if (g_progress.worker_state[i] == SCAN_WORKER_PAUSED) progress->workers_paused++;
+    }
 }
 
 const char* backend_get_progress_path(void) {
-    return scanner_progress_get_path();
+    return g_progress.path;
+}
+
+void backend_get_counts(uint64_t* files, uint64_t* dirs) {
+    if (files) *files = g_progress.files;
+    if (dirs) *dirs = g_progress.dirs;
 }
 
-void backend_get_counts(int* files, int* dirs) {
-    if (files) *files = g_file_count;
-    if (dirs) *dirs = g_dir_count;
+void backend_get_dir_counts(const DirStore* store, uint64_t index, BackendDirCounts* counts) {
+    const DirRecord* rec = index == DIRSTORE_NONE ? dirstore_totals(store) : dirstore_get(store, index);
+    counts->files = rec->files;
+    counts->dirs = rec->dirs;
+    counts->inodes = rec->inodes;
+    counts->direct_files = rec->direct_files;
+    counts->direct_dirs = rec->direct_dirs;
 }
 
-void backend_free_dirs(DirInfo* dirs) {
-    if (!dirs) return;
-    if (dirs == g_dirs) {
-        free(g_dirs);
-        g_dirs = NULL;
-        return;
+void backend_free_store(DirStore* store) {
+    if (!store) return;
+    if (store == g_store) {
+        g_store = NULL;
     }
-    free(dirs);
+    dirstore_free(store);
 }
 
 int backend_load_cache(const char* path, 
-                      DirInfo** dirs, 
-                      int* dir_count, 
+                      DirStore** store, 
+                      uint64_t* dir_count, 
                       uint64_t* total_size, 
-                      int* total_file_count) {
+                      uint64_t* total_alloc, 
+                      uint64_t* total_file_count) {
     
     // Reset global state
-    if (g_dirs) {
-        free(g_dirs);
-        g_dirs = NULL;
+    if (g_store) {
+        dirstore_free(g_store);
+        g_store = NULL;
     }
-    g_max_dirs = 0;
     g_dir_count = 0;
     g_file_count = 0;
     
-    // Initialize directory array for cache loading
-    g_max_dirs = INITIAL_MAX_DIRS;
-    g_dirs = (DirInfo*)malloc(g_max_dirs * sizeof(DirInfo));
-    if (!g_dirs) {
-        return 0; // Failed to allocate
-    }
+    // Load cache (the store is sized by what the cache holds)
+    ScanOptions opts = { .retain = SCAN_RETAIN_DIRS };
+    int result = cache_load(path, &opts, &g_store, NULL, total_size, total_alloc, &g_file_count);
     
-    // Load cache
-    int result = cache_load(path, g_dirs, &g_dir_count, total_size, &g_file_count);
+    if (result == 2) {
+        // Bring it up to date: only changed directories are listed again
+        DirStore* prev = g_store;
+        uint64_t relisted = 0;
+        scan_control_reset(g_control);
+        opts.control = g_control;
+        *total_size = scan_revalidate(path, &opts, prev, NULL, &g_store, NULL,
+                                      &g_dir_count, &g_file_count, total_alloc, &relisted);
+        opts.control = NULL;
+        dirstore_free(prev);
+        if (!g_store) return 0;
+        if (relisted > 0 && !scan_control_incomplete(g_control)) {
+            cache_save(path, &opts, g_store, NULL, *total_size, *total_alloc, g_file_count, 0);
+        }
+        result = 1;
+    }
     
     if (result == 1) {
-        *dirs = g_dirs;
+        g_dir_count = dirstore_count(g_store);
+        *store = g_store;
         *dir_count = g_dir_count;
         *total_file_count = g_file_count;
         return 1; // Success
     }
     
     // Cache load failed
-    if (g_dirs) { free(g_dirs); g_dirs = NULL; }
     return 0; // Failed
 }
 
 int backend_save_cache(const char* path, 
-                      const DirInfo* dirs, 
-                      int dir_count, 
+                      const DirStore* store, 
                       uint64_t total_size, 
-                      int total_file_count) {
+                      uint64_t total_alloc, 
+                      uint64_t total_file_count) {
     
     // Save cache
-    cache_save(path, dirs, dir_count, total_size, total_file_count);
+    ScanOptions opts = { .retain = SCAN_RETAIN_DIRS };
+    cache_save(path, &opts, store, NULL, total_size, total_alloc, total_file_count, 0);
     return 1; // Success
 }
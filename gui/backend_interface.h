@@ -7,8 +7,9 @@
 extern "C" {
 #endif
 
-// Use the C backend's DirInfo definition
+// Use the C backend's DirStore definition
 #include "../src/scanner.h"
+#include "../src/stream.h"
 
 // Initialize the backend
 int backend_init(void);
@@ -16,34 +17,99 @@ int backend_init(void);
 // Cleanup the backend
 void backend_cleanup(void);
 
+// Answer scans from the query server on `socket_path` (NULL: the default
+// socket) when it has a snapshot, scanning otherwise. Also set by
+// backend_init() from DISKSCOUT_SERVER ("" for the default). Returns 0 or -1.
+int backend_use_server(const char* socket_path);
+
 // Scan a directory and return results
 int backend_scan_directory(const char* path,
-                           DirInfo** dirs,
-                           int* dir_count,
+                           DirStore** store,
+                           uint64_t* dir_count,
                            uint64_t* total_size,
-                           int* total_file_count);
+                           uint64_t* total_alloc,
+                           uint64_t* total_file_count);
+
+// Cancel or pause the scan (or revalidation) in progress, from any thread.
+// A cancelled scan still completes with what it found so far; workers stop
+// before their next directory.
+void backend_cancel_scan(void);
+void backend_pause_scan(int paused);
+int backend_scan_paused(void);
+
+// 1 if the last scan was cancelled before it covered the whole tree
+int backend_scan_incomplete(void);
+
+// Directories the last scan could not open or read
+uint64_t backend_scan_unreadable(void);
+
+// Directories of the running scan streamed to the GUI: the children of the
+// scanned root and their children, and deeper ones of at least 1 MB
+#define BACKEND_STREAM_DEPTH 2
+#define BACKEND_STREAM_MIN_SIZE (1024 * 1024)
 
-// Free directory array
-void backend_free_dirs(DirInfo* dirs);
+// Directories the scan in progress completed since the last call, oldest
+// first (NULL when none; one polling thread). Each one's totals cover its
+// whole subtree. Free the list with backend_free_streamed().
+StreamEntry* backend_take_streamed(void);
+void backend_free_streamed(StreamEntry* entries);
+
+// Free a directory store
+void backend_free_store(DirStore* store);
 
 // Load from cache
 int backend_load_cache(const char* path,
-                       DirInfo** dirs,
-                       int* dir_count,
+                       DirStore** store,
+                       uint64_t* dir_count,
                        uint64_t* total_size,
-                       int* total_file_count);
+                       uint64_t* total_alloc,
+                       uint64_t* total_file_count);
 
 // Save to cache
 int backend_save_cache(const char* path,
-                       const DirInfo* dirs,
-                       int dir_count,
+                       const DirStore* store,
                        uint64_t total_size,
-                       int total_file_count);
+                       uint64_t total_alloc,
+                       uint64_t total_file_count);
+
+// Entry counts of one directory of a store
+typedef struct {
+    uint64_t files;         // regular files in the subtree
+    uint64_t dirs;          // directories in the subtree, itself excluded
+    uint64_t inodes;        // inodes in the subtree, itself included
+    uint64_t direct_files;  // regular files listed directly in it
+    uint64_t direct_dirs;   // subdirectories listed directly in it
+} BackendDirCounts;
+
+// Counts of record `index` (DIRSTORE_NONE: the scanned root)
+void backend_get_dir_counts(const DirStore* store, uint64_t index, BackendDirCounts* counts);
+
+// Live progress of the running scan, from the scanner's lock-free snapshot
+typedef struct {
+    int running;            // 1 while a scan runs
+    double elapsed;         // seconds since it started
+    uint64_t files;         // regular files counted so far
+    uint64_t dirs;          // directories finished
+    uint64_t bytes;         // logical bytes counted
+    uint64_t dirs_pending;  // directories queued but not finished
+    double files_per_sec;   // since the previous backend_get_progress()
+    double bytes_per_sec;
+    int workers;            // scan workers, of which
+    int workers_listing;    // listing a directory
+    int workers_paused;     // held by backend_pause_scan()
+    int percent;            // 0..100, never decreasing during a scan (estimate.h)
+    double eta_seconds;     // time left, -1 while unknown
+} BackendProgress;
 
-// Live progress API for GUI polling
+// Live progress API for GUI polling (one polling thread). backend_get_progress()
+// takes a new snapshot; the other calls read the last one. The percent and
+// time left compare it with the last cached scan of the path, or with the
+// space and inodes in use on its volume.
+void backend_get_progress(BackendProgress* progress);
 int backend_get_progress_percent(void);
+double backend_get_eta_seconds(void);
 const char* backend_get_progress_path(void);
-void backend_get_counts(int* files, int* dirs);
+void backend_get_counts(uint64_t* files, uint64_t* dirs);
 
 #ifdef __cplusplus
 }
@@ -13,6 +13,10 @@
 #include <QDebug>
 #include "backend_interface.h"
 
+// While a scan streams in, the treemap and sunburst are rebuilt at most this
+// often (the tree view takes new rows on every progress tick)
+static constexpr int kStreamFrameMs = 500;
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , centralWidget(nullptr)
@@ -25,6 +29,8 @@ MainWindow::MainWindow(QWidget *parent)
     , pathComboBox(nullptr)
     , scanButton(nullptr)
     , refreshButton(nullptr)
+    , pauseButton(nullptr)
+    , stopButton(nullptr)
     , viewModeButton(nullptr)
     , statusBar(nullptr)
     , progressBar(nullptr)
@@ -32,6 +38,7 @@ MainWindow::MainWindow(QWidget *parent)
     , sizeLabel(nullptr)
     , fileCountLabel(nullptr)
     , totalSize(0)
+    , totalAlloc(0)
     , totalFileCount(0)
     , totalDirCount(0)
     , scanThread(nullptr)
@@ -65,10 +72,20 @@ MainWindow::~MainWindow()
     settings.setValue("geometry", saveGeometry());
     settings.setValue("windowState", saveState());
     
-    if (scanThread && scanThread->isRunning()) {
-        scanThread->terminate();
-        scanThread->wait();
-    }
+    stopScan();
+}
+
+// Cancel the running scan and wait for it; its workers stop before their
+// next directory, so this takes about one directory listing. Its results
+// are dropped.
+void MainWindow::stopScan()
+{
+    if (!scanThread || !scanThread->isRunning()) return;
+    disconnect(scanThread, nullptr, this, nullptr);
+    // Cancelled again while waiting: a scan only just starting resets the token
+    do {
+        ScannerWrapper::cancelScan();
+    } while (!scanThread->wait(100));
 }
 
 void MainWindow::setupUI()
@@ -233,6 +250,14 @@ void MainWindow::setupToolBar()
     refreshButton = new QPushButton("Refresh", this);
     refreshButton->setIcon(QIcon(":/icons/refresh.png"));
     
+    // Pause / stop buttons, usable while a scan runs
+    pauseButton = new QPushButton("Pause", this);
+    pauseButton->setCheckable(true);
+    pauseButton->setEnabled(false);
+    stopButton = new QPushButton("Stop", this);
+    stopButton->setToolTip("Stop the scan and show what was found so far");
+    stopButton->setEnabled(false);
+    
     // View mode button
     viewModeButton = new QPushButton("Sunburst", this);
     viewModeButton->setCheckable(true);
@@ -245,6 +270,8 @@ void MainWindow::setupToolBar()
     topToolBar->addWidget(browseButton);
     topToolBar->addWidget(scanButton);
     topToolBar->addWidget(refreshButton);
+    topToolBar->addWidget(pauseButton);
+    topToolBar->addWidget(stopButton);
     topToolBar->addSeparator();
     topToolBar->addWidget(viewModeButton);
 }
@@ -276,6 +303,9 @@ void MainWindow::setupConnections()
     connect(scanButton, &QPushButton::clicked, this, &MainWindow::onScanClicked);
     connect(browseButton, &QPushButton::clicked, this, &MainWindow::onBrowseClicked);
     connect(refreshButton, &QPushButton::clicked, this, &MainWindow::onScanClicked);
+    connect(pauseButton, &QPushButton::toggled, this, &MainWindow::onPauseToggled);
+    // Stopped scans complete (with partial results) through onScanCompleted
+    connect(stopButton, &QPushButton::clicked, this, []() { ScannerWrapper::cancelScan(); });
     connect(pathComboBox, &QComboBox::currentTextChanged, this, &MainWindow::onPathChanged);
     connect(pathComboBox, &QComboBox::editTextChanged, this, &MainWindow::onPathChanged);
     if (pathComboBox->lineEdit()) {
@@ -306,18 +336,37 @@ void MainWindow::setupConnections()
     progressTimer = new QTimer(this);
     connect(progressTimer, &QTimer::timeout, [this]() {
         if (scanThread && scanThread->isRunning()) {
+            // One snapshot per tick; the percent and path below read it
+            BackendProgress snap;
+            backend_get_progress(&snap);
+            // Until the scan has started the snapshot is the previous one's
+            if (!snap.running) return;
             int progress = ScannerWrapper::getScanProgress();
             if (progress <= 0) {
-                // fallback to backend bytes-based heuristic percent
-                progress = backend_get_progress_percent();
+                // fallback to the backend's estimate against the volume or last snapshot
+                progress = snap.percent;
             }
             progressBar->setValue(qBound(0, progress, 99));
+            QString eta;
+            if (snap.eta_seconds >= 0) {
+                const qint64 left = static_cast<qint64>(snap.eta_seconds + 0.5);
+                eta = left >= 3600 ? QString(" (about %1 h %2 min left)").arg(left / 3600).arg(left / 60 % 60)
+                    : left >= 60 ? QString(" (about %1 min left)").arg((left + 30) / 60)
+                    : QString(" (less than a minute left)");
+            }
             QString p = ScannerWrapper::getProgressPath();
-            if (!p.isEmpty()) {
-                statusLabel->setText(QString("Scanning: %1").arg(p));
+            if (ScannerWrapper::isScanPaused()) {
+                statusLabel->setText("Paused");
+            } else if (!p.isEmpty()) {
+                statusLabel->setText(QString("Scanning%1: %2").arg(eta).arg(p));
             } else {
-                statusLabel->setText("Scanning...");
+                statusLabel->setText(QString("Scanning...%1").arg(eta));
             }
+            fileCountLabel->setText(QString("Files: %1 (%2/s) | Dirs: %3 (%4 queued) | Workers: %5/%6 busy")
+                                    .arg(snap.files).arg(static_cast<qulonglong>(snap.files_per_sec))
+                                    .arg(snap.dirs).arg(snap.dirs_pending)
+                                    .arg(snap.workers_listing).arg(snap.workers));
+            applyStreamed();
         }
     });
 }
@@ -350,14 +399,21 @@ void MainWindow::onScanClicked()
     // Create and start scan thread
     // Stop any previous scan safely
     if (scanThread) {
-        if (scanThread->isRunning()) {
-            ScannerWrapper::cancelScan();
-            scanThread->quit();
-            scanThread->wait();
-        }
+        stopScan();
         if (scanThread) scanThread->deleteLater();
         scanThread = nullptr; // QPointer resets automatically if deleted elsewhere
     }
+    // The stopped scan's last directories are not this one's
+    backend_free_streamed(backend_take_streamed());
+    fileSystemModel->beginStreaming(currentPath);
+    if (sortProxy) sortProxy->invalidate();
+    directories.clear();
+    totalSize = 0;
+    sunburstWidget->setRootPath(currentPath);
+    sunburstWidget->updateData(directories, totalSize, false);
+    treemapWidget->updateData(directories, totalSize, false);
+    streamFrameClock.start();
+    streamViewsStale = false;
 
     scanThread = new ScanThread(currentPath, this);
     connect(scanThread, &ScanThread::scanCompleted, this, &MainWindow::onScanCompleted, Qt::QueuedConnection);
@@ -366,6 +422,9 @@ void MainWindow::onScanClicked()
     // Do NOT auto-delete on finished; we delete after consuming results
     
     scanThread->start();
+    pauseButton->setChecked(false);
+    pauseButton->setEnabled(true);
+    stopButton->setEnabled(true);
     if (progressTimer) progressTimer->start(100); // Update progress every 100ms
 }
 
@@ -405,19 +464,33 @@ void MainWindow::onScanCompleted()
     progressBar->setVisible(false);
     scanButton->setEnabled(true);
     refreshButton->setEnabled(true);
+    pauseButton->setChecked(false);
+    pauseButton->setEnabled(false);
+    stopButton->setEnabled(false);
     
     // Pull results from thread
+    bool incomplete = false;
+    uint64_t unreadable = 0;
     if (scanThread) {
         directories = scanThread->getDirectories();
         totalSize = scanThread->getTotalSize();
+        totalAlloc = scanThread->getTotalAlloc();
         totalFileCount = scanThread->getTotalFileCount();
         totalDirCount = scanThread->getTotalDirCount();
+        incomplete = scanThread->isIncomplete();
+        unreadable = scanThread->getUnreadable();
+        // Superseded by the full results
+        backend_free_streamed(backend_take_streamed());
         // Safe cleanup
         scanThread->deleteLater();
         scanThread = nullptr;
     }
-    statusLabel->setText("Scan completed");
-    sizeLabel->setText(QString("Total: %1").arg(formatSize(totalSize)));
+    QString status = incomplete ? "Scan stopped: partial results" : "Scan completed";
+    if (unreadable > 0) {
+        status += QString(" (%1 folders could not be read)").arg(static_cast<qulonglong>(unreadable));
+    }
+    statusLabel->setText(status);
+    sizeLabel->setText(QString("Total: %1 (allocated %2)").arg(formatSize(totalSize)).arg(formatSize(totalAlloc)));
     fileCountLabel->setText(QString("Files: %1 | Dirs: %2").arg(totalFileCount).arg(totalDirCount));
     
     updateView();
@@ -428,12 +501,20 @@ void MainWindow::onScanProgress(int progress)
     progressBar->setValue(progress);
 }
 
+void MainWindow::onPauseToggled(bool paused)
+{
+    ScannerWrapper::pauseScan(paused);
+}
+
 void MainWindow::onScanError(const QString& error)
 {
     progressTimer->stop();
     progressBar->setVisible(false);
     scanButton->setEnabled(true);
     refreshButton->setEnabled(true);
+    pauseButton->setChecked(false);
+    pauseButton->setEnabled(false);
+    stopButton->setEnabled(false);
     
     statusLabel->setText("Scan failed");
     QMessageBox::critical(this, "Scan Error", error);
@@ -446,14 +527,7 @@ void MainWindow::onScanError(const QString& error)
 void MainWindow::closeEvent(QCloseEvent* event)
 {
     // Ensure thread stops cleanly to avoid the app hanging on exit
-    if (scanThread && scanThread->isRunning()) {
-        ScannerWrapper::cancelScan();
-        scanThread->quit();
-        if (!scanThread->wait(3000)) {
-            scanThread->terminate();
-            scanThread->wait();
-        }
-    }
+    stopScan();
     QMainWindow::closeEvent(event);
 }
 
@@ -592,6 +666,27 @@ void MainWindow::updateView()
     treemapWidget->updateData(directories, totalSize);
 }
 
+// Rows for the directories the running scan completed since the last tick;
+// the views follow at a bounded rate, without restarting their animation
+void MainWindow::applyStreamed()
+{
+    std::vector<ScannerWrapper::DirectoryInfo> completed;
+    ScannerWrapper::takeStreamed(completed);
+    if (!completed.empty()) {
+        fileSystemModel->applyStreamed(completed);
+        streamViewsStale = true;
+    }
+    if (!streamViewsStale || streamFrameClock.elapsed() < kStreamFrameMs)
+        return;
+    directories = fileSystemModel->directoryData();
+    totalSize = fileSystemModel->getTotalSize();
+    sizeLabel->setText(QString("Total so far: %1").arg(formatSize(totalSize)));
+    sunburstWidget->updateData(directories, totalSize, false);
+    treemapWidget->updateData(directories, totalSize, false);
+    streamFrameClock.start();
+    streamViewsStale = false;
+}
+
 void MainWindow::applyLanguage()
 {
     // Very lightweight runtime text switching (no .qm yet)
@@ -600,18 +695,24 @@ void MainWindow::applyLanguage()
         viewModeButton->setText(rightPanel->currentWidget() == sunburstWidget ? "Rosácea" : "Mapa de Árvores");
         scanButton->setText("Escanear");
         refreshButton->setText("Atualizar");
+        pauseButton->setText("Pausar");
+        stopButton->setText("Parar");
         topToolBar->setWindowTitle("Barra Principal");
         langEnglishAction->setChecked(false); langPortugueseAction->setChecked(true); langSpanishAction->setChecked(false);
     } else if (appLanguage == LangSpanish) {
         viewModeButton->setText(rightPanel->currentWidget() == sunburstWidget ? "Roseta" : "Mapa de Árboles");
         scanButton->setText("Escanear");
         refreshButton->setText("Actualizar");
+        pauseButton->setText("Pausar");
+        stopButton->setText("Detener");
         topToolBar->setWindowTitle("Barra Principal");
         langEnglishAction->setChecked(false); langPortugueseAction->setChecked(false); langSpanishAction->setChecked(true);
     } else {
         viewModeButton->setText(rightPanel->currentWidget() == sunburstWidget ? "Sunburst" : "Treemap");
         scanButton->setText("Scan");
         refreshButton->setText("Refresh");
+        pauseButton->setText("Pause");
+        stopButton->setText("Stop");
         topToolBar->setWindowTitle("Main Toolbar");
         langEnglishAction->setChecked(true); langPortugueseAction->setChecked(false); langSpanishAction->setChecked(false);
     }
@@ -699,11 +800,16 @@ void ScanThread::run()
     try {
         resultDirectories.clear();
         resultTotalSize = 0;
+        resultTotalAlloc = 0;
         resultFileCount = 0;
         resultDirCount = 0;
+        resultIncomplete = false;
+        resultUnreadable = 0;
         
         // Perform fresh scan (disable cache for now to ensure data correctness)
-        if (ScannerWrapper::scanDirectory(scanPath, resultDirectories, resultTotalSize, resultFileCount, resultDirCount)) {
+        if (ScannerWrapper::scanDirectory(scanPath, resultDirectories, resultTotalSize, resultTotalAlloc, resultFileCount, resultDirCount)) {
+            resultIncomplete = ScannerWrapper::lastScanIncomplete();
+            resultUnreadable = ScannerWrapper::lastScanUnreadable();
             emit scanCompleted();
         } else {
             emit scanError("Failed to scan directory");
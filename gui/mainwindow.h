@@ -22,6 +22,7 @@
 #include <QDateTime>
 #include <QFileInfo>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QCloseEvent>
 #include <QStorageInfo>
 #include <QPointer>
@@ -53,6 +54,7 @@ private slots:
     void onScanCompleted();
     void onScanProgress(int progress);
     void onScanError(const QString& error);
+    void onPauseToggled(bool paused);
     void onTreeSelectionChanged();
     void onContextMenuRequested(const QPoint& pos);
     void onOpenInExplorer();
@@ -67,6 +69,8 @@ private:
     void setupStatusBar();
     void setupConnections();
     void updateView();
+    void applyStreamed();
+    void stopScan();
     void showContextMenu(const QPoint& pos);
     QString formatSize(uint64_t bytes);
     void closeEvent(QCloseEvent* event) override;
@@ -88,6 +92,8 @@ private:
     QPushButton* browseButton;
     QPushButton* scanButton;
     QPushButton* refreshButton;
+    QPushButton* pauseButton;
+    QPushButton* stopButton;
     QPushButton* viewModeButton;
     
     // Status bar
@@ -100,6 +106,7 @@ private:
     // Data
     std::vector<ScannerWrapper::DirectoryInfo> directories;
     uint64_t totalSize;
+    uint64_t totalAlloc;
     int totalFileCount;
     int totalDirCount;
     QString currentPath;
@@ -107,6 +114,8 @@ private:
     // Threading
     QPointer<ScanThread> scanThread;
     QTimer* progressTimer;
+    QElapsedTimer streamFrameClock;   // since the views last showed streamed rows
+    bool streamViewsStale = false;    // rows streamed in since then
     
     // Actions
     QAction* scanAction;
@@ -142,8 +151,11 @@ public:
     ScanThread(const QString& path, QObject* parent = nullptr);
     const std::vector<ScannerWrapper::DirectoryInfo>& getDirectories() const { return resultDirectories; }
     uint64_t getTotalSize() const { return resultTotalSize; }
+    uint64_t getTotalAlloc() const { return resultTotalAlloc; }
     int getTotalFileCount() const { return resultFileCount; }
     int getTotalDirCount() const { return resultDirCount; }
+    bool isIncomplete() const { return resultIncomplete; }
+    uint64_t getUnreadable() const { return resultUnreadable; }
     
 signals:
     void scanCompleted();
@@ -157,8 +169,11 @@ private:
     QString scanPath;
     std::vector<ScannerWrapper::DirectoryInfo> resultDirectories;
     uint64_t resultTotalSize = 0;
+    uint64_t resultTotalAlloc = 0;
     int resultFileCount = 0;
     int resultDirCount = 0;
+    bool resultIncomplete = false;    // cancelled: results cover part of the tree
+    uint64_t resultUnreadable = 0;    // directories that could not be read
 };
 
 #endif // MAINWINDOW_H
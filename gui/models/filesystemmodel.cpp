@@ -3,6 +3,11 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QDebug>
+#include <QStringList>
+
+extern "C" {
+#include "order.h"
+}
 
 FileSystemModel::FileSystemModel(QObject *parent)
     : QAbstractItemModel(parent)
@@ -52,7 +57,7 @@ int FileSystemModel::rowCount(const QModelIndex &parent) const
 int FileSystemModel::columnCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
-    return 6; // Bar, %, Name, Size, Contents, Modified
+    return 8; // Bar, %, Name, Size, Contents, Modified, Allocated, Ratio
 }
 
 QVariant FileSystemModel::data(const QModelIndex &index, int role) const
@@ -81,9 +86,13 @@ QVariant FileSystemModel::data(const QModelIndex &index, int role) const
         case 3: // Size
             return formatSize(node->info.size);
         case 4: // Contents
-            return QString("%1 items").arg(node->info.dirCount);
+            return QString("%1 items").arg(node->info.fileCount + node->info.dirCount);
         case 5: // Modified
             return QFileInfo(node->info.path).lastModified().toString("yyyy-MM-dd hh:mm");
+        case 6: // Allocated
+            return formatSize(node->info.allocSize);
+        case 7: // Allocated / logical (< 1 sparse, > 1 slack)
+            return QString::number(scanner_alloc_ratio(node->info.size, node->info.allocSize), 'f', 2) + "x";
         }
         break;
     case FileRoles::SizeRole:
@@ -91,7 +100,16 @@ QVariant FileSystemModel::data(const QModelIndex &index, int role) const
     case FileRoles::ModifiedRole:
         return modifiedFor(node->info.path);
     case FileRoles::ContentsRole:
-        return node->info.dirCount;
+        return node->info.fileCount + node->info.dirCount;
+    case FileRoles::AllocSizeRole:
+        return QVariant::fromValue<qulonglong>(node->info.allocSize);
+    case FileRoles::AllocRatioRole:
+        return scanner_alloc_ratio(node->info.size, node->info.allocSize);
+    case FileRoles::SortRankRole:
+        if (index.column() == 2) { // Name: compared as text
+            return QVariant();
+        }
+        return QVariant::fromValue<qulonglong>(sortRank(node, index.column()));
         
     case Qt::DecorationRole:
         if (index.column() == 2) {
@@ -116,10 +134,16 @@ QVariant FileSystemModel::data(const QModelIndex &index, int role) const
         return 0;
         
     case Qt::ToolTipRole:
-        return QString("Path: %1\nSize: %2\nType: %3")
+        return QString("Path: %1\nSize: %2\nAllocated: %3\nType: %4\n"
+                       "Files: %5 (%6 directly)\nFolders: %7 (%8 directly)")
                 .arg(node->info.path)
                 .arg(formatSize(node->info.size))
-                .arg(QFileInfo(node->info.path).isDir() ? "Directory" : "File");
+                .arg(formatSize(node->info.allocSize))
+                .arg(QFileInfo(node->info.path).isDir() ? "Directory" : "File")
+                .arg(node->info.fileCount)
+                .arg(node->info.directFiles)
+                .arg(node->info.dirCount)
+                .arg(node->info.directDirs);
     }
 
     return QVariant();
@@ -135,6 +159,8 @@ QVariant FileSystemModel::headerData(int section, Qt::Orientation orientation, i
         case 3: return "Size";
         case 4: return "Contents";
         case 5: return "Modified";
+        case 6: return "Allocated";
+        case 7: return "Alloc Ratio";
         }
     }
     return QVariant();
@@ -155,6 +181,8 @@ void FileSystemModel::setDirectoryData(const std::vector<ScannerWrapper::Directo
     this->totalSize = totalSize;
     delete rootNode;
     rootNode = new TreeNode();
+    resetSortRanks();
+    streamIndex.clear();
     
     buildTree(directories);
     
@@ -166,10 +194,122 @@ void FileSystemModel::clear()
     beginResetModel();
     delete rootNode;
     rootNode = new TreeNode();
+    resetSortRanks();
+    streamIndex.clear();
     totalSize = 0;
     endResetModel();
 }
 
+void FileSystemModel::beginStreaming(const QString& rootPath)
+{
+    clear();
+    streamRoot = rootPath;
+    while (streamRoot.endsWith('/') || streamRoot.endsWith('\\')) {
+        streamRoot.chop(1);
+    }
+}
+
+void FileSystemModel::applyStreamed(const std::vector<ScannerWrapper::DirectoryInfo>& completed)
+{
+    if (completed.empty())
+        return;
+
+    // New rows go after the current ones, and are only linked in between
+    // beginInsertRows() and endInsertRows()
+    std::vector<TreeNode*> added;
+    auto nodeAt = [&](size_t seq) {
+        return seq < nodes.size() ? nodes[seq] : added[seq - nodes.size()];
+    };
+    // Add to a row and every row above it (completion is bottom-up, so
+    // none of those has its own totals yet)
+    auto addUp = [&](int seq, uint64_t size, uint64_t allocSize, int files, int dirs) {
+        for (int s = seq; s >= 0; s = nodeAt(s)->info.parent) {
+            ScannerWrapper::DirectoryInfo& info = nodeAt(s)->info;
+            info.size += size;
+            info.allocSize += allocSize;
+            info.fileCount += files;
+            info.dirCount += dirs;
+        }
+        totalSize += size;
+    };
+
+    for (const auto& entry : completed) {
+        TreeNode* node = nullptr;
+        auto known = streamIndex.constFind(entry.path);
+        if (known != streamIndex.constEnd()) {
+            node = nodeAt(*known);
+        } else {
+            // Up to the nearest row already there (or the root), then create
+            // the missing ones downward
+            QStringList missing{entry.path};
+            int parent = -1;
+            bool inside = true;
+            for (QString p = entry.path;;) {
+                const int cut = qMax(p.lastIndexOf('/'), p.lastIndexOf('\\'));
+                if (cut < 0) { inside = false; break; }
+                p.truncate(cut);
+                if (p == streamRoot) break;
+                if (p.length() <= streamRoot.length()) { inside = false; break; }
+                auto it = streamIndex.constFind(p);
+                if (it != streamIndex.constEnd()) { parent = static_cast<int>(*it); break; }
+                missing.append(p);
+            }
+            if (!inside)
+                continue;   // left over from another scan
+
+            for (int i = missing.size() - 1; i >= 0; --i) {
+                node = new TreeNode();
+                node->info.path = missing[i];
+                node->info.parent = parent;
+                node->parent = rootNode;
+                node->row = static_cast<int>(rootNode->children.size() + added.size());
+                node->seq = nodes.size() + added.size();
+                added.push_back(node);
+                streamIndex.insert(missing[i], node->seq);
+                addUp(parent, 0, 0, 0, 1);
+                parent = static_cast<int>(node->seq);
+            }
+        }
+
+        // Its own totals replace what had added up below it
+        ScannerWrapper::DirectoryInfo& info = node->info;
+        const uint64_t size = entry.size - info.size;
+        const uint64_t allocSize = entry.allocSize - info.allocSize;
+        const int files = entry.fileCount - info.fileCount;
+        const int dirs = entry.dirCount - info.dirCount;
+        info.directFiles = entry.directFiles;
+        info.directDirs = entry.directDirs;
+        addUp(static_cast<int>(node->seq), size, allocSize, files, dirs);
+    }
+
+    const int first = static_cast<int>(rootNode->children.size());
+    if (!added.empty()) {
+        beginInsertRows(QModelIndex(), first, first + static_cast<int>(added.size()) - 1);
+        for (TreeNode* node : added) {
+            rootNode->children.push_back(node);
+            nodes.push_back(node);
+        }
+        endInsertRows();
+    }
+    // Sizes moved, and percentages with the total
+    for (auto& ranks : sortRanks) {
+        ranks.clear();
+    }
+    if (first > 0) {
+        emit dataChanged(index(0, 0), index(first - 1, columnCount() - 1));
+    }
+}
+
+std::vector<ScannerWrapper::DirectoryInfo> FileSystemModel::directoryData() const
+{
+    std::vector<ScannerWrapper::DirectoryInfo> directories;
+    directories.reserve(nodes.size());
+    for (const TreeNode* node : nodes) {
+        directories.push_back(node->info);
+    }
+    return directories;
+}
+
 QString FileSystemModel::getPath(const QModelIndex& index) const
 {
     if (!index.isValid())
@@ -210,8 +350,59 @@ void FileSystemModel::buildTree(const std::vector<ScannerWrapper::DirectoryInfo>
         node->info = directories[i];
         node->parent = rootNode;
         node->row = static_cast<int>(i);
+        node->seq = nodes.size();
         rootNode->children.push_back(node);
+        nodes.push_back(node);
+    }
+}
+
+void FileSystemModel::resetSortRanks()
+{
+    nodes.clear();
+    for (auto& ranks : sortRanks) {
+        ranks.clear();
+    }
+}
+
+uint64_t FileSystemModel::sortRank(const TreeNode* node, int column) const
+{
+    std::vector<uint64_t>& ranks = sortRanks[column];
+    if (ranks.size() != nodes.size()) {
+        // One key per node, sorted once; comparisons then read positions
+        std::vector<uint64_t> keys(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const ScannerWrapper::DirectoryInfo& info = nodes[i]->info;
+            switch (column) {
+            case 4: // Contents
+                keys[i] = uint64_t(info.fileCount) + uint64_t(info.dirCount);
+                break;
+            case 5: { // Modified (stat once per node here, not per comparison)
+                const QDateTime modified = modifiedFor(info.path);
+                keys[i] = modified.isValid() ? uint64_t(modified.toMSecsSinceEpoch()) ^ (1ULL << 63) : 0;
+                break;
+            }
+            case 6: // Allocated
+                keys[i] = info.allocSize;
+                break;
+            case 7: // Allocated / logical ratio
+                keys[i] = order_double_key(scanner_alloc_ratio(info.size, info.allocSize));
+                break;
+            default: // Bar, %, Size
+                keys[i] = info.size;
+                break;
+            }
+        }
+        std::vector<uint64_t> perm(nodes.size());
+        ranks.assign(nodes.size(), 0);
+        if (order_keys(keys.data(), keys.size(), 0, perm.data()) == 0) {
+            for (size_t i = 0; i < perm.size(); ++i) {
+                ranks[perm[i]] = i;
+            }
+        } else {
+            ranks = keys;   // out of memory: the keys order the same way
+        }
     }
+    return node->seq < ranks.size() ? ranks[node->seq] : 0;
 }
 
 FileSystemModel::TreeNode* FileSystemModel::findNode(const QModelIndex& index) const
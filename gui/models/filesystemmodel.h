@@ -8,6 +8,8 @@
 #include <QColor>
 #include <QDateTime>
 #include <QFileInfo>
+#include <QHash>
+#include <vector>
 
 #include "../scanner_wrapper.h"
 
@@ -34,6 +36,18 @@ public:
     // Custom methods
     void setDirectoryData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize);
     void clear();
+    
+    // While a scan of `rootPath` runs: empty the model, then add rows as
+    // directories complete (each with its whole subtree's totals). A row is
+    // also made for every directory between the root and a streamed one,
+    // holding what has completed below it until its own entry arrives.
+    // Rows are inserted, and existing ones updated, without a reset.
+    void beginStreaming(const QString& rootPath);
+    void applyStreamed(const std::vector<ScannerWrapper::DirectoryInfo>& completed);
+    
+    // Every row, parents first with parent indices, and the total they add up to
+    std::vector<ScannerWrapper::DirectoryInfo> directoryData() const;
+    uint64_t getTotalSize() const { return totalSize; }
     QString getPath(const QModelIndex& index) const;
     uint64_t getSize(const QModelIndex& index) const;
     QColor getColor(const QModelIndex& index) const;
@@ -45,8 +59,9 @@ private:
         std::vector<TreeNode*> children;
         TreeNode* parent;
         int row;
+        size_t seq;             // position in `nodes`
         
-        TreeNode() : parent(nullptr), row(0) {}
+        TreeNode() : parent(nullptr), row(0), seq(0) {}
         ~TreeNode() {
             for (auto child : children) {
                 delete child;
@@ -56,7 +71,15 @@ private:
     
     TreeNode* rootNode;
     uint64_t totalSize;
+    std::vector<TreeNode*> nodes;                       // every node but the root
+    mutable std::vector<uint64_t> sortRanks[8];         // per column, by seq; empty until sorted on
+    QString streamRoot;                                 // scanned path, no trailing separator
+    QHash<QString, size_t> streamIndex;                 // streamed path -> seq
     
+    // Position of `node` in ascending order of `column`, the order being
+    // built (radix sort, order.h) the first time the column is sorted on
+    uint64_t sortRank(const TreeNode* node, int column) const;
+    void resetSortRanks();
     void buildTree(const std::vector<ScannerWrapper::DirectoryInfo>& directories);
     TreeNode* findNode(const QModelIndex& index) const;
     QColor getFileTypeColor(const QString& path) const;
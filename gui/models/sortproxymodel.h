@@ -2,14 +2,16 @@
 #define SORTPROXYMODEL_H
 
 #include <QSortFilterProxyModel>
-#include <QDateTime>
 
 // Roles provided by FileSystemModel for proper sorting
 namespace FileRoles {
     enum {
         SizeRole = Qt::UserRole + 1,
         ModifiedRole,
-        ContentsRole
+        ContentsRole,
+        AllocSizeRole,
+        AllocRatioRole,
+        SortRankRole            // position in the column's precomputed order
     };
 }
 
@@ -26,28 +28,17 @@ protected:
         if (!sourceModel() || !source_left.isValid() || !source_right.isValid()) {
             return QSortFilterProxyModel::lessThan(source_left, source_right);
         }
-        const int col = source_left.column();
-        if (col == 3) { // Size (shifted by 2 due to bar + % column)
-            const QVariant av = sourceModel()->data(source_left, FileRoles::SizeRole);
-            const QVariant bv = sourceModel()->data(source_right, FileRoles::SizeRole);
-            const quint64 a = av.isValid() ? av.toULongLong() : 0ULL;
-            const quint64 b = bv.isValid() ? bv.toULongLong() : 0ULL;
-            return a < b;
-        } else if (col == 4) { // Contents
-            const int a = sourceModel()->data(source_left, FileRoles::ContentsRole).toInt();
-            const int b = sourceModel()->data(source_right, FileRoles::ContentsRole).toInt();
-            return a < b;
-        } else if (col == 5) { // Modified
-            const QVariant av = sourceModel()->data(source_left, FileRoles::ModifiedRole);
-            const QVariant bv = sourceModel()->data(source_right, FileRoles::ModifiedRole);
-            const QDateTime a = av.isValid() ? av.toDateTime() : QDateTime();
-            const QDateTime b = bv.isValid() ? bv.toDateTime() : QDateTime();
-            return a.toMSecsSinceEpoch() < b.toMSecsSinceEpoch();
+        // Numeric columns: positions in the source model's order for the
+        // column, computed once per column rather than per comparison
+        const QVariant a = sourceModel()->data(source_left, FileRoles::SortRankRole);
+        const QVariant b = sourceModel()->data(source_right, FileRoles::SortRankRole);
+        if (a.isValid() && b.isValid()) {
+            return a.toULongLong() < b.toULongLong();
         }
         // Name - fallback to display text
-        const QString a = sourceModel()->data(source_left, Qt::DisplayRole).toString();
-        const QString b = sourceModel()->data(source_right, Qt::DisplayRole).toString();
-        return a.localeAwareCompare(b) < 0;
+        const QString left = sourceModel()->data(source_left, Qt::DisplayRole).toString();
+        const QString right = sourceModel()->data(source_right, Qt::DisplayRole).toString();
+        return left.localeAwareCompare(right) < 0;
     }
 };
 
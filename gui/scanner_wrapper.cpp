@@ -6,49 +6,44 @@
 // Include C backend headers
 extern "C" {
     #include "backend_interface.h"
+    #include "../src/dirtree.h"
 }
 
 // Global variables for progress tracking
 static int g_scanProgress = 0;
-static bool g_cancelScan = false;
 
 bool ScannerWrapper::scanDirectory(const QString& path, 
                                    std::vector<DirectoryInfo>& directories,
                                    uint64_t& totalSize,
+                                   uint64_t& totalAlloc,
                                    int& totalFileCount,
                                    int& totalDirCount) {
     
     // Reset progress
     g_scanProgress = 0;
-    g_cancelScan = false;
     
     // Convert QString to C string
     QByteArray pathBytes = path.toUtf8();
     const char* cPath = pathBytes.constData();
     
     // Use backend interface
-    DirInfo* dirs = nullptr;
-    int dirCount = 0;
-    int fileCount = 0;
+    DirStore* store = nullptr;
+    uint64_t dirCount = 0;
+    uint64_t fileCount = 0;
     
-    if (!backend_scan_directory(cPath, &dirs, &dirCount, &totalSize, &fileCount)) {
+    if (!backend_scan_directory(cPath, &store, &dirCount, &totalSize, &totalAlloc, &fileCount)) {
         qDebug() << "Failed to scan directory";
         return false;
     }
     
     // Convert results to C++ format
-    directories.clear();
-    directories.reserve(dirCount);
-    
-    for (int i = 0; i < dirCount; ++i) {
-        directories.push_back(convertDirInfo(dirs[i]));
-    }
+    convertStore(store, directories);
     
-    totalFileCount = fileCount;
-    totalDirCount = dirCount;
+    totalFileCount = static_cast<int>(fileCount);
+    totalDirCount = static_cast<int>(dirCount);
     
     // Cleanup (guard null)
-    if (dirs) backend_free_dirs(dirs);
+    if (store) backend_free_store(store);
     
     return true;
 }
@@ -56,6 +51,7 @@ bool ScannerWrapper::scanDirectory(const QString& path,
 bool ScannerWrapper::loadCache(const QString& path,
                               std::vector<DirectoryInfo>& directories,
                               uint64_t& totalSize,
+                              uint64_t& totalAlloc,
                               int& totalFileCount,
                               int& totalDirCount) {
     
@@ -64,28 +60,23 @@ bool ScannerWrapper::loadCache(const QString& path,
     const char* cPath = pathBytes.constData();
     
     // Use backend interface
-    DirInfo* dirs = nullptr;
-    int dirCount = 0;
-    int fileCount = 0;
+    DirStore* store = nullptr;
+    uint64_t dirCount = 0;
+    uint64_t fileCount = 0;
     
-    if (!backend_load_cache(cPath, &dirs, &dirCount, &totalSize, &fileCount)) {
+    if (!backend_load_cache(cPath, &store, &dirCount, &totalSize, &totalAlloc, &fileCount)) {
         qDebug() << "Failed to load cache";
         return false;
     }
     
     // Convert results to C++ format
-    directories.clear();
-    directories.reserve(dirCount);
+    convertStore(store, directories);
     
-    for (int i = 0; i < dirCount; ++i) {
-        directories.push_back(convertDirInfo(dirs[i]));
-    }
-    
-    totalFileCount = fileCount;
-    totalDirCount = dirCount;
+    totalFileCount = static_cast<int>(fileCount);
+    totalDirCount = static_cast<int>(dirCount);
     
     // Cleanup (guard null)
-    if (dirs) backend_free_dirs(dirs);
+    if (store) backend_free_store(store);
     
     return true;
 }
@@ -93,6 +84,7 @@ bool ScannerWrapper::loadCache(const QString& path,
 bool ScannerWrapper::saveCache(const QString& path,
                               const std::vector<DirectoryInfo>& directories,
                               uint64_t totalSize,
+                              uint64_t totalAlloc,
                               int totalFileCount,
                               int totalDirCount) {
     Q_UNUSED(totalDirCount);
@@ -102,21 +94,17 @@ bool ScannerWrapper::saveCache(const QString& path,
     const char* cPath = pathBytes.constData();
     
     // Convert C++ data to C format
-    DirInfo* dirs = (DirInfo*)malloc(directories.size() * sizeof(DirInfo));
-    if (!dirs) {
+    DirStore* store = convertToStore(path, directories);
+    if (!store) {
         qDebug() << "Failed to allocate memory for cache save";
         return false;
     }
     
-    for (size_t i = 0; i < directories.size(); ++i) {
-        dirs[i] = convertToDirInfo(directories[i]);
-    }
-    
     // Save cache
-    const int ok = backend_save_cache(cPath, dirs, directories.size(), totalSize, totalFileCount);
+    const int ok = backend_save_cache(cPath, store, totalSize, totalAlloc, totalFileCount);
     
     // Cleanup
-    free(dirs);
+    dirstore_free(store);
     return ok == 1;
 }
 
@@ -142,24 +130,108 @@ QString ScannerWrapper::getProgressPath() {
 }
 
 void ScannerWrapper::cancelScan() {
-    g_cancelScan = true;
-}
-
-ScannerWrapper::DirectoryInfo ScannerWrapper::convertDirInfo(const DirInfo& dirInfo) {
-    DirectoryInfo result;
-    result.path = QString::fromUtf8(dirInfo.path);
-    result.size = dirInfo.size;
-    // C backend DirInfo only has path + size; file/dir counts are aggregate-level in C
-    result.fileCount = 0;
-    result.dirCount = 0;
-    return result;
-}
-
-DirInfo ScannerWrapper::convertToDirInfo(const DirectoryInfo& dirInfo) {
-    DirInfo result;
-    strncpy(result.path, dirInfo.path.toUtf8().constData(), sizeof(result.path) - 1);
-    result.path[sizeof(result.path) - 1] = '\0';
-    result.size = dirInfo.size;
-    // C backend DirInfo has no per-dir file/dir counts
-    return result;
-}
\ No newline at end of file
+    backend_cancel_scan();
+}
+
+void ScannerWrapper::pauseScan(bool paused) {
+    backend_pause_scan(paused ? 1 : 0);
+}
+
+bool ScannerWrapper::isScanPaused() {
+    return backend_scan_paused() != 0;
+}
+
+bool ScannerWrapper::lastScanIncomplete() {
+    return backend_scan_incomplete() != 0;
+}
+
+uint64_t ScannerWrapper::lastScanUnreadable() {
+    return backend_scan_unreadable();
+}
+
+void ScannerWrapper::takeStreamed(std::vector<DirectoryInfo>& completed) {
+    completed.clear();
+    StreamEntry* entries = backend_take_streamed();
+    for (const StreamEntry* e = entries; e; e = e->next) {
+        DirectoryInfo info(QString::fromUtf8(e->path), e->size, e->alloc_size,
+                           static_cast<int>(e->files), static_cast<int>(e->dirs));
+        info.directFiles = static_cast<int>(e->direct_files);
+        info.directDirs = static_cast<int>(e->direct_dirs);
+        completed.push_back(info);
+    }
+    backend_free_streamed(entries);
+}
+
+void ScannerWrapper::convertStore(const DirStore* store, std::vector<DirectoryInfo>& directories) {
+    directories.clear();
+    if (!store) return;
+    
+    // The tree numbers directories breadth-first; node 0 is the scanned root
+    // itself, which is not listed
+    DirTree* tree = dirtree_build(store, 0, 0, 0);
+    if (!tree) return;
+    
+    directories.reserve(tree->count - 1);
+    for (uint64_t node = 1; node < tree->count; ++node) {
+        const uint64_t parent = tree->parent[node];
+        char* path = dirstore_path(store, tree->record[node]);
+        DirectoryInfo result;
+        result.path = QString::fromUtf8(path ? path : "");
+        result.size = tree->size[node];
+        result.allocSize = tree->alloc_size[node];
+        BackendDirCounts counts;
+        backend_get_dir_counts(store, tree->record[node], &counts);
+        result.fileCount = static_cast<int>(counts.files);
+        result.dirCount = static_cast<int>(counts.dirs);
+        result.directFiles = static_cast<int>(counts.direct_files);
+        result.directDirs = static_cast<int>(counts.direct_dirs);
+        result.parent = parent == 0 ? -1 : static_cast<int>(parent - 1);
+        directories.push_back(result);
+        free(path);
+    }
+    dirtree_free(tree);
+}
+
+DirStore* ScannerWrapper::convertToStore(const QString& root, const std::vector<DirectoryInfo>& directories) {
+    DirStore* store = dirstore_create(root.toUtf8().constData());
+    if (!store) return nullptr;
+    
+    // Name of `path` below `base` ("" if it is not below it)
+    auto relative = [](const QString& path, const QString& base) -> QString {
+        if (!path.startsWith(base) || path.length() <= base.length()) return QString();
+        if (base.endsWith('/')) return path.mid(base.length());
+        return path.at(base.length()) == '/' ? path.mid(base.length() + 1) : QString();
+    };
+    
+    // Entries hang off their listed parent when it came first; otherwise off
+    // the root, with every component in between as part of the name
+    const QString rootPath = QDir::cleanPath(root);
+    std::vector<uint64_t> indexOf(directories.size(), DIRSTORE_NONE);
+    for (size_t i = 0; i < directories.size(); ++i) {
+        const DirectoryInfo& dir = directories[i];
+        const QString path = QDir::cleanPath(dir.path);
+        
+        uint64_t parent = DIRSTORE_NONE;
+        QString name;
+        if (dir.parent >= 0 && static_cast<size_t>(dir.parent) < i && indexOf[dir.parent] != DIRSTORE_NONE) {
+            name = relative(path, QDir::cleanPath(directories[dir.parent].path));
+            if (!name.isEmpty()) parent = indexOf[dir.parent];
+        }
+        if (parent == DIRSTORE_NONE) name = relative(path, rootPath);
+        if (name.isEmpty()) continue;
+        
+        const QString nativeName = QDir::toNativeSeparators(name);
+        indexOf[i] = dirstore_add(store, parent, nativeName.toUtf8().constData(), dir.size, dir.allocSize);
+        if (indexOf[i] == DIRSTORE_NONE) {
+            dirstore_free(store);
+            return nullptr;
+        }
+        DirRecord* rec = dirstore_get(store, indexOf[i]);
+        rec->files = static_cast<uint64_t>(dir.fileCount);
+        rec->dirs = static_cast<uint64_t>(dir.dirCount);
+        rec->inodes = rec->files + rec->dirs + 1;
+        rec->direct_files = static_cast<uint32_t>(dir.directFiles);
+        rec->direct_dirs = static_cast<uint32_t>(dir.directDirs);
+    }
+    return store;
+}
@@ -18,18 +18,23 @@ public:
     struct DirectoryInfo {
         QString path;
         uint64_t size;
-        int fileCount;
-        int dirCount;
+        uint64_t allocSize;     // bytes allocated on disk
+        int fileCount;          // files in the subtree
+        int dirCount;           // subdirectories in the subtree
+        int directFiles;        // files listed directly in it
+        int directDirs;         // subdirectories listed directly in it
+        int parent;             // index of the parent entry (listed earlier), -1 under the root
         
-        DirectoryInfo() : size(0), fileCount(0), dirCount(0) {}
-        DirectoryInfo(const QString& p, uint64_t s, int fc, int dc) 
-            : path(p), size(s), fileCount(fc), dirCount(dc) {}
+        DirectoryInfo() : size(0), allocSize(0), fileCount(0), dirCount(0), directFiles(0), directDirs(0), parent(-1) {}
+        DirectoryInfo(const QString& p, uint64_t s, uint64_t a, int fc, int dc, int par = -1) 
+            : path(p), size(s), allocSize(a), fileCount(fc), dirCount(dc), directFiles(0), directDirs(0), parent(par) {}
     };
     
     // Scan directory and return results
     static bool scanDirectory(const QString& path, 
                              std::vector<DirectoryInfo>& directories,
                              uint64_t& totalSize,
+                             uint64_t& totalAlloc,
                              int& totalFileCount,
                              int& totalDirCount);
     
@@ -37,6 +42,7 @@ public:
     static bool loadCache(const QString& path,
                          std::vector<DirectoryInfo>& directories,
                          uint64_t& totalSize,
+                         uint64_t& totalAlloc,
                          int& totalFileCount,
                          int& totalDirCount);
     
@@ -44,6 +50,7 @@ public:
     static bool saveCache(const QString& path,
                          const std::vector<DirectoryInfo>& directories,
                          uint64_t totalSize,
+                         uint64_t totalAlloc,
                          int totalFileCount,
                          int totalDirCount);
     
@@ -57,15 +64,31 @@ public:
     static int getScanProgress();
     static QString getProgressPath();
     
-    // Cancel current scan
+    // Cancel current scan; it stops before its next directory and returns
+    // what it found so far
     static void cancelScan();
     
+    // Hold / resume the current scan's workers
+    static void pauseScan(bool paused);
+    static bool isScanPaused();
+    
+    // True if the last scan was cancelled before covering the whole tree
+    static bool lastScanIncomplete();
+    
+    // Directories the last scan could not open or read
+    static uint64_t lastScanUnreadable();
+    
+    // Directories the running scan completed since the last call, oldest
+    // first, each with its whole subtree's totals (parent left at -1)
+    static void takeStreamed(std::vector<DirectoryInfo>& completed);
+    
 private:
-    // Convert C DirInfo to C++ DirectoryInfo
-    static DirectoryInfo convertDirInfo(const DirInfo& dirInfo);
+    // Convert every record of a C DirStore to C++ DirectoryInfo, breadth-first
+    // (parents before children) with parent indices
+    static void convertStore(const DirStore* store, std::vector<DirectoryInfo>& directories);
     
-    // Convert C++ DirectoryInfo to C DirInfo
-    static DirInfo convertToDirInfo(const DirectoryInfo& dirInfo);
+    // Build a C DirStore rooted at `root` from C++ DirectoryInfo (caller frees it)
+    static DirStore* convertToStore(const QString& root, const std::vector<DirectoryInfo>& directories);
 };
 
 #endif // SCANNER_WRAPPER_H
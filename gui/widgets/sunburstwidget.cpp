@@ -56,7 +56,8 @@ SunburstWidget::~SunburstWidget()
     }
 }
 
-void SunburstWidget::updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize)
+void SunburstWidget::updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize,
+                                bool animate)
 {
     Q_UNUSED(totalSize);
     buildSunburstTree(directories);
@@ -73,10 +74,12 @@ void SunburstWidget::updateData(const std::vector<ScannerWrapper::DirectoryInfo>
     }
     updateLayout();
     
-    // Start animation
-    isAnimating = true;
-    animationProgress = 0.0;
-    animationTimer->start(16); // ~60 FPS
+    if (animate) {
+        // Start animation
+        isAnimating = true;
+        animationProgress = 0.0;
+        animationTimer->start(16); // ~60 FPS
+    }
     
     update();
 }
@@ -212,13 +215,45 @@ void SunburstWidget::buildSunburstTree(const std::vector<ScannerWrapper::Directo
     rootNode.size = 0;
     rootNode.depth = 0;
 
+    // Entries come parents first with the index of their parent entry, so the
+    // hierarchy is linked by index. Children vectors are sized up front: node
+    // pointers stay valid while the tree fills in.
+    auto parentOf = [&](size_t i) -> int {
+        int p = directories[i].parent;
+        return (p >= 0 && static_cast<size_t>(p) < i) ? p : -1;
+    };
+    std::vector<int> childCount(directories.size(), 0);
+    int rootChildren = 0;
+    for (size_t i = 0; i < directories.size(); ++i) {
+        int p = parentOf(i);
+        if (p >= 0) childCount[p]++; else rootChildren++;
+    }
+    rootNode.children.reserve(rootChildren);
+
     QString base = normalizePath(rootPath);
-    for (const auto& d : directories) {
-        rootNode.size += d.size;
-        QString p = normalizePath(d.path);
-        if (!base.isEmpty() && p.startsWith(base)) p = p.mid(base.length());
-        QStringList parts = p.split('/', Qt::SkipEmptyParts);
-        addPath(rootNode, parts, 0, d.size, normalizePath(d.path), base);
+    std::vector<SunburstNode*> nodes(directories.size(), nullptr);
+    for (size_t i = 0; i < directories.size(); ++i) {
+        const auto& d = directories[i];
+        int p = parentOf(i);
+        SunburstNode& parent = p >= 0 ? *nodes[p] : rootNode;
+        QString parentPath = p >= 0 ? normalizePath(directories[p].path) : base;
+        QString name = normalizePath(d.path);
+        if (!parentPath.isEmpty() && name.startsWith(parentPath)) name = name.mid(parentPath.length());
+        while (name.startsWith('/')) name.remove(0, 1);
+        if (p < 0) rootNode.size += d.size;
+
+        // Full paths grow from the scanned root's path
+        QString accum = p >= 0 ? parent.fullPath : base;
+        SunburstNode child;
+        child.name = name;
+        child.fullPath = accum.isEmpty() ? name : (accum + "/" + name);
+        child.size = d.size;
+        child.depth = parent.depth + 1;
+        child.parent = &parent;
+        setNodeColor(child);
+        child.children.reserve(childCount[i]);
+        parent.children.push_back(std::move(child));
+        nodes[i] = &parent.children.back();
     }
 
     // Color assignment: vivid for first level, tints deeper
@@ -601,30 +636,3 @@ void SunburstWidget::updateAnimation()
     
     update();
 }
-
-void SunburstWidget::addPath(SunburstNode& root, const QStringList& parts, int idx, uint64_t size, const QString& leafFullPath, const QString& accumFullPath)
-{
-    if (idx >= parts.size()) return;
-    const QString &part = parts[idx];
-
-    // Find or create child
-    for (auto &ch : root.children) {
-        if (ch.name == part) {
-            ch.size += size;
-            QString nextAccum = accumFullPath.isEmpty() ? part : (accumFullPath + "/" + part);
-            addPath(ch, parts, idx+1, size, leafFullPath, nextAccum);
-            return;
-        }
-    }
-    SunburstNode child;
-    child.name = part;
-    QString nextAccum = accumFullPath.isEmpty() ? part : (accumFullPath + "/" + part);
-    child.fullPath = nextAccum;
-    child.size = size;
-    child.depth = root.depth + 1;
-    child.parent = &root;
-    setNodeColor(child);
-    root.children.push_back(child);
-    // Recurse deeper
-    addPath(root.children.back(), parts, idx+1, size, leafFullPath, nextAccum);
-}
@@ -24,7 +24,10 @@ public:
     explicit SunburstWidget(QWidget *parent = nullptr);
     ~SunburstWidget();
 
-    void updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize);
+    // Rebuild from `directories`; without `animate` the view changes in place
+    // (refinements of a running scan)
+    void updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize,
+                    bool animate = true);
     void setRootPath(const QString& path);
     void resetView();
     void zoomToPath(const QString& path);
@@ -79,7 +82,6 @@ private:
     void updateLayout();
     void calculateNodeAngles(SunburstNode& node, double startAngle, double spanAngle);
     void setNodeColor(SunburstNode& node);
-    void addPath(SunburstNode& root, const QStringList& parts, int idx, uint64_t size, const QString& leafFullPath, const QString& accumFullPath);
     int getMaxDepth(const SunburstNode& node) const;
     void drawBreadcrumbs(QPainter& painter);
     std::vector<QString> buildBreadcrumbPaths() const;
@@ -74,16 +74,23 @@ TreemapWidget::~TreemapWidget()
     }
 }
 
-void TreemapWidget::updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize)
+void TreemapWidget::updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize,
+                               bool animate)
 {
     Q_UNUSED(totalSize);
+    // Node pointers do not survive the rebuild: the selection is found again by path
+    const QString selectedPath = selectedNode ? selectedNode->fullPath : QString();
+    hoveredNode = nullptr;
     buildTreemapTree(directories);
+    selectedNode = selectedPath.isEmpty() ? nullptr : findByFullPath(rootNode, selectedPath);
     updateLayout();
     
-    // Start animation
-    isAnimating = true;
-    animationProgress = 0.0;
-    animationTimer->start(16); // ~60 FPS
+    if (animate) {
+        // Start animation
+        isAnimating = true;
+        animationProgress = 0.0;
+        animationTimer->start(16); // ~60 FPS
+    }
     
     update();
 }
@@ -250,13 +257,44 @@ void TreemapWidget::buildTreemapTree(const std::vector<ScannerWrapper::Directory
     rootNode.isVisible = true;
     rootNode.parent = nullptr;
     
+    // Entries come parents first with the index of their parent entry, so the
+    // hierarchy is linked by index. Children vectors are sized up front: node
+    // pointers stay valid while the tree fills in.
+    auto parentOf = [&](size_t i) -> int {
+        int p = directories[i].parent;
+        return (p >= 0 && static_cast<size_t>(p) < i) ? p : -1;
+    };
+    std::vector<int> childCount(directories.size(), 0);
+    int rootChildren = 0;
+    for (size_t i = 0; i < directories.size(); ++i) {
+        int p = parentOf(i);
+        if (p >= 0) childCount[p]++; else rootChildren++;
+    }
+    rootNode.children.reserve(rootChildren);
+
     QString base = normalizePath(rootPath);
-    for (const auto& d : directories) {
-        rootNode.size += d.size;
-        QString p = normalizePath(d.path);
-        if (!base.isEmpty() && p.startsWith(base)) p = p.mid(base.length());
-        QStringList parts = p.split('/', Qt::SkipEmptyParts);
-        addPath(rootNode, parts, 0, d.size, normalizePath(d.path));
+    std::vector<TreemapNode*> nodes(directories.size(), nullptr);
+    for (size_t i = 0; i < directories.size(); ++i) {
+        const auto& d = directories[i];
+        int p = parentOf(i);
+        TreemapNode& parent = p >= 0 ? *nodes[p] : rootNode;
+        QString parentPath = p >= 0 ? normalizePath(directories[p].path) : base;
+        QString name = normalizePath(d.path);
+        if (!parentPath.isEmpty() && name.startsWith(parentPath)) name = name.mid(parentPath.length());
+        while (name.startsWith('/')) name.remove(0, 1);
+        if (p < 0) rootNode.size += d.size;
+
+        TreemapNode child;
+        child.name = name;
+        child.fullPath = parent.fullPath.isEmpty() ? name : (parent.fullPath + "/" + name);
+        child.size = d.size;
+        child.depth = parent.depth + 1;
+        child.isVisible = true;
+        child.parent = &parent;
+        setNodeColor(child);
+        child.children.reserve(childCount[i]);
+        parent.children.push_back(std::move(child));
+        nodes[i] = &parent.children.back();
     }
     fixParentPointers(rootNode);
     assignColors();
@@ -590,30 +628,6 @@ QString TreemapWidget::normalizePath(const QString& p) const
     return s;
 }
 
-void TreemapWidget::addPath(TreemapNode& parent, const QStringList& parts, int index, uint64_t size, const QString& fullPath)
-{
-    if (index >= parts.size()) return;
-    const QString &part = parts[index];
-    // Find or create child
-    for (auto &ch : parent.children) {
-        if (ch.name == part) {
-            ch.size += size;
-            addPath(ch, parts, index+1, size, fullPath);
-            return;
-        }
-    }
-    TreemapNode child;
-    child.name = part;
-    child.fullPath = parent.fullPath.isEmpty() ? part : (parent.fullPath + "/" + part);
-    child.size = size;
-    child.depth = parent.depth + 1;
-    child.isVisible = true;
-    child.parent = &parent;
-    setNodeColor(child);
-    parent.children.push_back(child);
-    addPath(parent.children.back(), parts, index+1, size, fullPath);
-}
-
 void TreemapWidget::fixParentPointers(TreemapNode& node)
 {
     for (auto &ch : node.children) {
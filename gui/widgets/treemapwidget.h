@@ -24,7 +24,10 @@ public:
     explicit TreemapWidget(QWidget *parent = nullptr);
     ~TreemapWidget();
 
-    void updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize);
+    // Rebuild from `directories`; without `animate` the view changes in place
+    // (refinements of a running scan)
+    void updateData(const std::vector<ScannerWrapper::DirectoryInfo>& directories, uint64_t totalSize,
+                    bool animate = true);
     void setRootPath(const QString& path);
     void resetView();
 
@@ -74,7 +77,6 @@ private:
     std::vector<Qt::BrushStyle> patternStyles; // hatch patterns for contrast
     
     void buildTreemapTree(const std::vector<ScannerWrapper::DirectoryInfo>& directories);
-    void addPath(TreemapNode& parent, const QStringList& parts, int index, uint64_t size, const QString& fullPath);
     void fixParentPointers(TreemapNode& node);
     void drawTreemap(QPainter& painter);
     void drawNode(QPainter& painter, const TreemapNode& node, int depthLimit = 4);
@@ -3,7 +3,15 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "cache.h"
+#include "catalog.h"
+#include "history.h"
+#include "crc32c.h"
+#include "dirtree.h"
+#include "varint.h"
+#include "workpool.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -11,10 +19,15 @@
 #else
 #include <unistd.h>
 #include <pwd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
 #endif
 
 // Global cache directory path
 static char cache_dir_path[1024] = {0};
+static uint64_t cache_budget = CACHE_DEFAULT_BUDGET;
+static int cache_history_enabled = 1;
 
 // Initialize cache system
 int cache_init(void) {
@@ -30,23 +43,221 @@ int cache_init(void) {
     return 0;
 }
 
-// Generate cache file path for a specific scan path
-static void get_cache_file_path(const char* scan_path, char* cache_file_path, size_t max_len) {
-    // Create a hash of the scan path for the filename
-    uint32_t hash = 0;
-    const char* p = scan_path;
-    while (*p) {
-        hash = hash * 31 + *p;
-        p++;
+static int cache_is_separator(char c) {
+#ifdef _WIN32
+    return c == '\\' || c == '/';
+#else
+    return c == '/';
+#endif
+}
+
+// 1 if `path` is strictly below directory `root`
+static int cache_path_within(const char* root, const char* path) {
+    size_t len = strlen(root);
+    if (len == 0 || strncmp(path, root, len) != 0) return 0;
+    if (cache_is_separator(root[len - 1])) return path[len] != '\0';
+    return cache_is_separator(path[len]) && path[len + 1] != '\0';
+}
+
+int cache_normalize_path(const char* path, char* out, size_t out_len) {
+#ifdef _WIN32
+    DWORD len = GetFullPathNameA(path, (DWORD)out_len, out, NULL);
+    if (len == 0 || len >= out_len) {
+        return -1;
+    }
+#else
+    char *resolved = realpath(path, NULL);
+    if (!resolved) {
+        return -1;
     }
+    size_t len = strlen(resolved);
+    if (len >= out_len) {
+        free(resolved);
+        return -1;
+    }
+    memcpy(out, resolved, len + 1);
+    free(resolved);
+#endif
     
-    // Convert to positive and create filename
-    uint32_t positive_hash = hash & 0x7FFFFFFF;
-    // Ensure we never overflow the destination buffer
-    // Reserve space for separator, prefix, hash, extension and terminator
-    // Worst-case length: cache_dir_path + "/cache_" + 8 hex + ".db" + \0
-    snprintf(cache_file_path, max_len, "%s/cache_%08x.db", cache_dir_path, positive_hash);
-    cache_file_path[max_len - 1] = '\0';
+    // No trailing separator, except for a root ("/", "C:\\")
+    size_t end = strlen(out);
+    while (end > 1 && cache_is_separator(out[end - 1]) && !(end == 3 && out[1] == ':')) {
+        out[--end] = '\0';
+    }
+    return 0;
+}
+
+// Name of probe `slot` for a normalized root: a 64-bit FNV-1a hash of the
+// path, plus the slot
+static void cache_file_name(const char* root, int slot, char* name, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char* p = root; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+    }
+    snprintf(name, len, "cache_%016llx.db", (unsigned long long)(hash + (uint64_t)slot));
+}
+
+// Root (and, if `out` is not NULL, header) recorded in a cache file, header
+// and root only read; 0 if it is a valid file of this version
+static int cache_file_root(const char* path, char* root, size_t len, CacheHeader* out) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    CacheHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+             header.magic == CACHE_MAGIC && header.version == CACHE_VERSION &&
+             header.root_len < len && fread(root, 1, header.root_len, file) == header.root_len;
+    fclose(file);
+    if (!ok) {
+        return -1;
+    }
+    uint32_t header_crc = header.header_crc;
+    header.header_crc = 0;
+    root[header.root_len] = '\0';
+    if (crc32c(crc32c(0, &header, sizeof(header)), root, header.root_len) != header_crc) {
+        return -1;
+    }
+    if (out) *out = header;
+    return 0;
+}
+
+// Generation of the valid snapshot in a cache file, 0 if there is none
+static uint64_t cache_file_generation(const char* path) {
+    char root[MAX_PATH_LEN];
+    CacheHeader header;
+    return cache_file_root(path, root, sizeof(root), &header) == 0 ? header.generation : 0;
+}
+
+// Path of the file holding the snapshot of normalized `root`: the probe that
+// recorded this root. To save one (`for_write`) without such a probe, the
+// first that is free or holds no valid snapshot. Returns 0, or -1 if none.
+static int cache_locate(const char* root, int for_write, char* path, size_t len) {
+    if (cache_dir_path[0] == '\0') {
+        return -1;
+    }
+    char name[64];
+    char stored[MAX_PATH_LEN];
+    int free_slot = -1;
+    for (int slot = 0; slot < CACHE_PROBES; slot++) {
+        cache_file_name(root, slot, name, sizeof(name));
+        snprintf(path, len, "%s/%s", cache_dir_path, name);
+        if (cache_file_root(path, stored, sizeof(stored), NULL) != 0) {
+            if (free_slot < 0) free_slot = slot;
+        } else if (strcmp(stored, root) == 0) {
+            return 0;
+        }
+    }
+    if (!for_write || free_slot < 0) {
+        return -1;
+    }
+    cache_file_name(root, free_slot, name, sizeof(name));
+    snprintf(path, len, "%s/%s", cache_dir_path, name);
+    return 0;
+}
+
+// File name part of a cache file path
+static const char* cache_file_base(const char* path) {
+    const char* base = path;
+    for (const char* p = path; *p; p++) {
+        if (cache_is_separator(*p)) base = p + 1;
+    }
+    return base;
+}
+
+// History file of a cache file: cache_<hash>.db -> cache_<hash>.hist.db
+static void cache_history_name(const char* cache_file_path, char* path, size_t len) {
+    size_t base = strlen(cache_file_path) - 3;
+    snprintf(path, len, "%.*s.hist.db", (int)base, cache_file_path);
+}
+
+int cache_snapshot_file(const char* scan_path, char* path, size_t len) {
+    char root[MAX_PATH_LEN];
+    if (!scan_path || cache_normalize_path(scan_path, root, sizeof(root)) != 0) {
+        return -1;
+    }
+    return cache_locate(root, 0, path, len);
+}
+
+int cache_history_file(const char* scan_path, char* path, size_t len) {
+    char root[MAX_PATH_LEN];
+    char cache_file_path[1024];
+    if (!scan_path || cache_normalize_path(scan_path, root, sizeof(root)) != 0 ||
+        cache_locate(root, 0, cache_file_path, sizeof(cache_file_path)) != 0) {
+        return -1;
+    }
+    cache_history_name(cache_file_path, path, len);
+    return 0;
+}
+
+void cache_set_budget(uint64_t bytes) {
+    cache_budget = bytes;
+}
+
+void cache_set_history(int enabled) {
+    cache_history_enabled = enabled;
+}
+
+// Claim file of a watched root: cache_<hash>.watch, locked by the daemon.
+// Returns 0, or -1 if it does not fit in `len`.
+static int cache_watch_name(const char* root, char* path, size_t len) {
+    char name[64];
+    cache_file_name(root, 0, name, sizeof(name));
+    int n = snprintf(path, len, "%s/%.*s.watch", cache_dir_path, (int)(strlen(name) - 3), name);
+    return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+int cache_watch_begin(const char* scan_path) {
+#ifdef _WIN32
+    (void)scan_path;
+    return -1;
+#else
+    char root[MAX_PATH_LEN];
+    char path[1024];
+    if (cache_dir_path[0] == '\0' || cache_normalize_path(scan_path, root, sizeof(root)) != 0 ||
+        cache_watch_name(root, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+void cache_watch_end(int handle) {
+#ifndef _WIN32
+    if (handle >= 0) {
+        close(handle);                // releases the flock; the file stays for the next one
+    }
+#else
+    (void)handle;
+#endif
+}
+
+// 1 while a daemon holds the claim on normalized `root`
+static int cache_is_watched(const char* root) {
+#ifdef _WIN32
+    (void)root;
+    return 0;
+#else
+    char path[1024];
+    if (cache_watch_name(root, path, sizeof(path)) != 0) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    int watched = flock(fd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+    close(fd);
+    return watched;
+#endif
 }
 
 // Get cache directory path
@@ -102,32 +313,8 @@ int cache_ensure_directory_exists(void) {
     return 0;
 }
 
-// Calculate simple checksum for cache entry
-uint32_t cache_calculate_checksum(const char* path, time_t mtime) {
-    uint32_t checksum = 0;
-    const char* p = path;
-    
-    // Simple hash of path
-    while (*p) {
-        checksum = checksum * 31 + *p;
-        p++;
-    }
-    
-    // Include modification time
-    checksum ^= (uint32_t)mtime;
-    
-    return checksum;
-}
-
-// Check if cache is valid for given path
-int cache_is_valid(const char* scan_path) {
-    if (!scan_path || cache_dir_path[0] == '\0') {
-        return 0;
-    }
-    
-    char cache_file_path[1024];
-    get_cache_file_path(scan_path, cache_file_path, sizeof(cache_file_path));
-    
+// 1 if the cache file is newer than the last change to `path`
+static int cache_file_is_current(const char* cache_file_path, const char* scan_path) {
     // Check if cache file exists
     struct stat cache_stat;
     if (stat(cache_file_path, &cache_stat) != 0) {
@@ -144,193 +331,1168 @@ int cache_is_valid(const char* scan_path) {
     return cache_stat.st_mtime >= scan_stat.st_mtime;
 }
 
-// Load cache for given scan path
-int cache_load(const char* scan_path, DirInfo* dirs, int* dir_count, uint64_t* total_size, int* file_count) {
-    if (!scan_path || !dirs || !dir_count || !total_size || !file_count) {
-        return -1;
-    }
-    
-    if (!cache_is_valid(scan_path)) {
-        return 0; // Cache not valid
+// Check if cache is valid for given path
+int cache_is_valid(const char* scan_path) {
+    char root[MAX_PATH_LEN];
+    if (!scan_path || cache_normalize_path(scan_path, root, sizeof(root)) != 0) {
+        return 0;
     }
     
     char cache_file_path[1024];
-    get_cache_file_path(scan_path, cache_file_path, sizeof(cache_file_path));
-    
+    if (cache_locate(root, 0, cache_file_path, sizeof(cache_file_path)) != 0) {
+        return 0;
+    }
+    return cache_file_is_current(cache_file_path, root);
+}
+
+
+// A block of the file, located when the view is opened
+typedef struct {
+    CacheBlock head;
+    const unsigned char *payload;
+    uint64_t first;                   // index of its first entry (or file block)
+    CacheViewEntry *entries;          // decoded on first use (CACHE_BLOCK_DIRS)
+    char *names;
+    int state;                        // 0 not decoded yet, 1 decoded, -1 corrupt
+} ViewBlock;
+
+struct CacheView {
+    char *root;                       // normalized scanned path
+    char file_path[1024];
+    CacheHeader header;
 #ifdef _WIN32
-    HANDLE hFile = CreateFileA(cache_file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) return -1;
-    HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (!hMap) { CloseHandle(hFile); return -1; }
-    void *view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
-    if (!view) { CloseHandle(hMap); CloseHandle(hFile); return -1; }
-    const unsigned char *p = (const unsigned char *)view;
-    const unsigned char *end = p + GetFileSize(hFile, NULL);
-    if ((size_t)(end - p) < sizeof(CacheHeader)) { UnmapViewOfFile(view); CloseHandle(hMap); CloseHandle(hFile); return -1; }
-    const CacheHeader *headerp = (const CacheHeader *)p; p += sizeof(CacheHeader);
-    CacheHeader header = *headerp;
-#else
-    FILE* file = fopen(cache_file_path, "rb");
-    if (!file) {
+    HANDLE file;
+    HANDLE map;
+#endif
+    const unsigned char *base;        // the mapped file
+    size_t size;
+    ViewBlock *blocks;                // CACHE_BLOCK_DIRS blocks first, then CACHE_BLOCK_FILES
+    size_t num_blocks;
+    size_t dir_blocks;
+};
+
+static uint32_t cache_block_crc(const CacheBlock *block, const void *payload) {
+    CacheBlock head = *block;
+    head.crc = 0;
+    return crc32c(crc32c(0, &head, sizeof(head)), payload, block->bytes);
+}
+
+// Decode the entry at *pp, front-coded against `name` (the previous name of
+// the block, *name_len bytes), which receives this entry's name. Returns 0 or -1.
+static int cache_decode_entry(const unsigned char **pp, const unsigned char *end, uint64_t index,
+                              uint64_t entry_count, char *name, uint64_t *name_len, CacheViewEntry *entry) {
+    const unsigned char *p = *pp;
+    uint64_t shared, suffix;
+    if (!(p = varint_get(p, end, &shared)) || shared > *name_len ||
+        !(p = varint_get(p, end, &suffix)) || suffix > (uint64_t)(end - p) ||
+        shared + suffix >= MAX_PATH_LEN) {
         return -1;
     }
-    CacheHeader header;
-    if (fread(&header, sizeof(CacheHeader), 1, file) != 1) {
-        fclose(file);
+    memcpy(name + shared, p, suffix);
+    p += suffix;
+    *name_len = shared + suffix;
+    name[*name_len] = '\0';
+
+    uint64_t parent, children, first_child = 0;
+    uint64_t size, alloc_delta, files, dirs, inode_delta, direct_files, direct_dirs;
+    if (!(p = varint_get(p, end, &parent)) ||
+        !(p = varint_get(p, end, &children)) ||
+        (children > 0 && !(p = varint_get(p, end, &first_child))) ||
+        !(p = varint_get(p, end, &size)) ||
+        !(p = varint_get(p, end, &alloc_delta)) ||
+        !(p = varint_get(p, end, &files)) ||
+        !(p = varint_get(p, end, &dirs)) ||
+        !(p = varint_get(p, end, &inode_delta)) ||
+        !(p = varint_get(p, end, &direct_files)) ||
+        !(p = varint_get(p, end, &direct_dirs)) ||
+        (size_t)(end - p) < sizeof(entry->rec.stamp)) {
+        return -1;
+    }
+
+    // Breadth-first order: parents come before their children. Entries
+    // reference each other by index, so one bad link invalidates the file.
+    if (parent > index || first_child > entry_count - index ||
+        children > entry_count - index - first_child ||
+        (children > 0 && first_child == 0)) {
+        return -1;
+    }
+    memset(entry, 0, sizeof(*entry));
+    memcpy(&entry->rec.stamp, p, sizeof(entry->rec.stamp));
+    p += sizeof(entry->rec.stamp);
+    entry->rec.parent = parent == 0 ? DIRSTORE_NONE : index - parent;
+    entry->rec.size = size;
+    entry->rec.alloc_size = size + (uint64_t)zigzag_decode(alloc_delta);
+    entry->rec.files = files;
+    entry->rec.dirs = dirs;
+    entry->rec.inodes = files + dirs + (uint64_t)zigzag_decode(inode_delta);
+    entry->rec.direct_files = (uint32_t)direct_files;
+    entry->rec.direct_dirs = (uint32_t)direct_dirs;
+    entry->name = name;
+    entry->first_child = index + first_child;
+    entry->children = children;
+    *pp = p;
+    return 0;
+}
+
+// Decode the file block at *pp; its directory is an entry index or DIRSTORE_NONE
+static int cache_decode_file_block(const unsigned char **pp, const unsigned char *end, uint64_t entry_count,
+                                   uint64_t *dir, uint32_t *count, const unsigned char **data, uint32_t *bytes) {
+    const unsigned char *p = *pp;
+    uint64_t slot, entries, len;
+    if (!(p = varint_get(p, end, &slot)) || slot > entry_count ||
+        !(p = varint_get(p, end, &entries)) || entries > UINT32_MAX ||
+        !(p = varint_get(p, end, &len)) || len > (uint64_t)(end - p)) {
         return -1;
     }
+    *dir = slot == 0 ? DIRSTORE_NONE : slot - 1;
+    *count = (uint32_t)entries;
+    *data = p;
+    *bytes = (uint32_t)len;
+    *pp = p + len;
+    return 0;
+}
+
+// Threshold that decides what a scan with `opts` retains
+static uint64_t cache_retain_threshold(const ScanOptions* opts, ScanRetain retain) {
+    uint64_t min_size = opts ? opts->min_size : 0;
+    if (retain == SCAN_RETAIN_LARGE) return min_size ? min_size : 1024 * 1024;
+    if (retain == SCAN_RETAIN_FILES) return min_size;
+    return 0;
+}
+
+static int cache_view_map(CacheView *view, const char *path) {
+#ifdef _WIN32
+    // Shared for deletion: a save may rename its new snapshot over this one
+    view->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (view->file == INVALID_HANDLE_VALUE) {
+        errno = GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EIO;
+        return -1;
+    }
+    view->size = GetFileSize(view->file, NULL);
+    view->map = CreateFileMappingA(view->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!view->map) return -1;
+    view->base = MapViewOfFile(view->map, FILE_MAP_READ, 0, 0, 0);
+    if (!view->base) return -1;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    view->base = base;
+    view->size = (size_t)st.st_size;
 #endif
-    
-    // Validate cache header
-    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+    return 0;
+}
+
+void cache_view_close(CacheView* view) {
+    if (!view) return;
+    for (size_t b = 0; b < view->num_blocks; b++) {
+        free(view->blocks[b].entries);
+        free(view->blocks[b].names);
+    }
+    free(view->blocks);
 #ifdef _WIN32
-        UnmapViewOfFile(view);
-        CloseHandle(hMap);
-        CloseHandle(hFile);
+    if (view->base) UnmapViewOfFile(view->base);
+    if (view->map) CloseHandle(view->map);
+    if (view->file != INVALID_HANDLE_VALUE) CloseHandle(view->file);
 #else
-        fclose(file);
+    if (view->base) munmap((void *)view->base, view->size);
 #endif
-        return -1;
+    free(view->root);
+    free(view);
+}
+
+// Locate every block from their headers alone; payloads are not touched
+static int cache_view_index(CacheView *view) {
+    size_t max_blocks = 0;
+    uint64_t entries = 0, file_blocks = 0;
+    for (size_t off = sizeof(CacheHeader) + view->header.root_len; off < view->size; ) {
+        if (view->size - off < sizeof(CacheBlock)) return -1;
+        ViewBlock block;
+        memset(&block, 0, sizeof(block));
+        memcpy(&block.head, view->base + off, sizeof(CacheBlock));
+        off += sizeof(CacheBlock);
+        if (block.head.bytes > view->size - off || block.head.count == 0) return -1;
+        block.payload = view->base + off;
+        off += block.head.bytes;
+
+        if (block.head.kind == CACHE_BLOCK_DIRS && view->dir_blocks == view->num_blocks) {
+            block.first = entries;
+            entries += block.head.count;
+            view->dir_blocks++;
+        } else if (block.head.kind == CACHE_BLOCK_FILES) {
+            block.first = file_blocks;
+            file_blocks += block.head.count;
+        } else {
+            return -1;
+        }
+        if (view->num_blocks == max_blocks) {
+            max_blocks = max_blocks ? max_blocks * 2 : 64;
+            ViewBlock *grown = realloc(view->blocks, max_blocks * sizeof(ViewBlock));
+            if (!grown) return -1;
+            view->blocks = grown;
+        }
+        view->blocks[view->num_blocks++] = block;
+    }
+    return entries == view->header.entry_count && file_blocks == view->header.file_blocks &&
+           view->header.root_children <= entries ? 0 : -1;
+}
+
+CacheView* cache_view_open(const char* scan_path, const ScanOptions* opts, int* result) {
+    *result = -1;
+    if (!scan_path) {
+        return NULL;
     }
+    ScanRetain want = opts ? opts->retain : SCAN_RETAIN_LARGE;
     
-    // Read cache entries
-    *dir_count = 0;
-    *total_size = header.total_size;
-    *file_count = header.file_count;
+    // A save still running in the background may be writing this very file
+    cache_save_wait();
     
-    for (uint32_t i = 0; i < header.entry_count; i++) {
-        CacheEntry entry;
+    char root[MAX_PATH_LEN];
+    if (cache_normalize_path(scan_path, root, sizeof(root)) != 0) {
+        snprintf(root, sizeof(root), "%s", scan_path);
+    }
+    
+    CacheView *view = calloc(1, sizeof(CacheView));
+    if (!view) return NULL;
 #ifdef _WIN32
-        if ((size_t)(end - p) < sizeof(CacheEntry)) break;
-        memcpy(&entry, p, sizeof(CacheEntry));
-        p += sizeof(CacheEntry);
-#else
-        if (fread(&entry, sizeof(CacheEntry), 1, file) != 1) {
-            break;
-        }
+    view->file = INVALID_HANDLE_VALUE;
 #endif
+    size_t root_len = strlen(root) + 1;
+    view->root = malloc(root_len);
+    if (!view->root) {
+        cache_view_close(view);
+        return NULL;
+    }
+    // No snapshot of this root is a miss: none saved yet, one in an older
+    // format (cache_locate() passes over those), or removed since
+    if (cache_locate(root, 0, view->file_path, sizeof(view->file_path)) != 0) {
+        *result = 0;
+        cache_view_close(view);
+        return NULL;
+    }
+    if (cache_view_map(view, view->file_path) != 0) {
+        if (errno == ENOENT) *result = 0;
+        cache_view_close(view);
+        return NULL;
+    }
+    memcpy(view->root, root, root_len);
+    
+    // Validate cache header, and that it is a snapshot of this very root
+    // (the file was picked by a hash of it)
+    CacheHeader *header = &view->header;
+    if (view->size < sizeof(CacheHeader)) {
+        cache_view_close(view);
+        return NULL;
+    }
+    memcpy(header, view->base, sizeof(CacheHeader));
+    uint32_t header_crc = header->header_crc;
+    header->header_crc = 0;
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION) {
+        *result = 0;
+        cache_view_close(view);
+        return NULL;
+    }
+    if (header->root_len > view->size - sizeof(CacheHeader) ||
+        crc32c(crc32c(0, header, sizeof(CacheHeader)), view->base + sizeof(CacheHeader),
+               header->root_len) != header_crc) {
+        cache_view_close(view);
+        return NULL;
+    }
+    header->header_crc = header_crc;
+    if (header->root_len != root_len - 1 || memcmp(view->base + sizeof(CacheHeader), root, root_len - 1) != 0) {
+        *result = 0;
+        cache_view_close(view);
+        return NULL;
+    }
+    
+    // The cached scan must have kept at least what is asked for: more
+    // retained, or the same with a threshold no coarser
+    if (header->retain < (uint32_t)want ||
+        (header->retain == (uint32_t)want && header->min_size > cache_retain_threshold(opts, want))) {
+        *result = 0;
+        cache_view_close(view);
+        return NULL;
+    }
+    
+    // A cache of every directory is revalidated directory by directory,
+    // unless a daemon keeps it current; otherwise the whole cache must be
+    // newer than the scanned root
+    int watched = header->retain >= SCAN_RETAIN_DIRS && cache_is_watched(root);
+    int revalidate = header->retain >= SCAN_RETAIN_DIRS && !watched;
+    if (!revalidate && !watched && !cache_file_is_current(view->file_path, root)) {
+        *result = 0;
+        cache_view_close(view);
+        return NULL;
+    }
+    
+    if (cache_view_index(view) != 0) {
+        cache_view_close(view);
+        return NULL;
+    }
+    *result = revalidate ? 2 : 1;
+    catalog_touch(cache_dir_path, cache_file_base(view->file_path), root, 0, 0, 0);
+    return view;
+}
+
+const CacheHeader* cache_view_header(const CacheView* view) {
+    return &view->header;
+}
+
+// Decode a CACHE_BLOCK_DIRS block into its entry array
+static int cache_view_decode(CacheView *view, ViewBlock *block) {
+    if (cache_block_crc(&block->head, block->payload) != block->head.crc) return -1;
+    
+    uint32_t count = block->head.count;
+    block->entries = malloc(count * sizeof(CacheViewEntry));
+    uint64_t *name_off = malloc(count * sizeof(uint64_t));
+    size_t names_cap = 4096, names_len = 0;
+    block->names = malloc(names_cap);
+    if (!block->entries || !name_off || !block->names) {
+        free(name_off);
+        return -1;
+    }
+    
+    const unsigned char *p = block->payload;
+    const unsigned char *end = p + block->head.bytes;
+    char name[MAX_PATH_LEN];
+    uint64_t name_len = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        if (cache_decode_entry(&p, end, block->first + n, view->header.entry_count,
+                               name, &name_len, &block->entries[n]) != 0) {
+            free(name_off);
+            return -1;
+        }
+        if (names_len + name_len + 1 > names_cap) {
+            while (names_len + name_len + 1 > names_cap) names_cap *= 2;
+            char *grown = realloc(block->names, names_cap);
+            if (!grown) {
+                free(name_off);
+                return -1;
+            }
+            block->names = grown;
+        }
+        memcpy(block->names + names_len, name, name_len + 1);
+        name_off[n] = names_len;
+        names_len += name_len + 1;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        block->entries[n].name = block->names + name_off[n];
+    }
+    free(name_off);
+    return p == end ? 0 : -1;
+}
+
+int cache_view_entry(CacheView* view, uint64_t index, CacheViewEntry* entry) {
+    const CacheHeader *header = &view->header;
+    if (index == DIRSTORE_NONE) {
+        memset(entry, 0, sizeof(*entry));
+        entry->rec.size = header->total_size;
+        entry->rec.alloc_size = header->total_alloc;
+        entry->rec.parent = DIRSTORE_NONE;
+        entry->rec.files = header->file_count;
+        entry->rec.dirs = header->dir_total;
+        entry->rec.inodes = header->inode_total;
+        entry->rec.direct_files = header->root_files;
+        entry->rec.direct_dirs = header->root_dirs;
+        entry->rec.stamp = header->root_stamp;
+        entry->name = view->root;
+        entry->first_child = 0;
+        entry->children = header->root_children;
+        return 0;
+    }
+    if (index >= header->entry_count) return -1;
+    
+    // Last block starting at or before `index`
+    size_t lo = 0, hi = view->dir_blocks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (view->blocks[mid].first <= index) lo = mid; else hi = mid;
+    }
+    ViewBlock *block = &view->blocks[lo];
+    if (block->state == 0) {
+        block->state = cache_view_decode(view, block) == 0 ? 1 : -1;
+    }
+    if (block->state != 1) return -1;
+    *entry = block->entries[index - block->first];
+    return 0;
+}
+
+uint64_t cache_view_find(CacheView* view, const char* path) {
+    size_t root_len = strlen(view->root);
+    if (strncmp(path, view->root, root_len) != 0) return CACHE_VIEW_MISSING;
+    const char *p = path + root_len;
+    if (*p && !cache_is_separator(*p) && root_len > 0 && !cache_is_separator(view->root[root_len - 1])) {
+        return CACHE_VIEW_MISSING;  // "/data2" is not under "/data"
+    }
+    
+    // One child listing per path component
+    uint64_t node = DIRSTORE_NONE;
+    for (;;) {
+        while (cache_is_separator(*p)) p++;
+        if (!*p) return node;
+        size_t len = 0;
+        while (p[len] && !cache_is_separator(p[len])) len++;
+        
+        CacheViewEntry parent, child;
+        if (cache_view_entry(view, node, &parent) != 0) return CACHE_VIEW_MISSING;
+        uint64_t found = CACHE_VIEW_MISSING;
+        for (uint64_t c = parent.first_child; c < parent.first_child + parent.children; c++) {
+            if (cache_view_entry(view, c, &child) != 0) return CACHE_VIEW_MISSING;
+            if (strncmp(child.name, p, len) == 0 && child.name[len] == '\0') {
+                found = c;
+                break;
+            }
+        }
+        if (found == CACHE_VIEW_MISSING) return CACHE_VIEW_MISSING;
+        node = found;
+        p += len;
+    }
+}
+
+static uint64_t cache_view_add(DirStore *store, uint64_t parent, const CacheViewEntry *entry) {
+    uint64_t index = dirstore_add(store, parent, entry->name, entry->rec.size, entry->rec.alloc_size);
+    if (index == DIRSTORE_NONE) return DIRSTORE_NONE;
+    DirRecord *rec = dirstore_get(store, index);
+    rec->files = entry->rec.files;
+    rec->dirs = entry->rec.dirs;
+    rec->inodes = entry->rec.inodes;
+    rec->direct_files = entry->rec.direct_files;
+    rec->direct_dirs = entry->rec.direct_dirs;
+    rec->stamp = entry->rec.stamp;
+    return index;
+}
+
+// Totals come from the header
+static void cache_view_totals(CacheView *view, DirStore *store) {
+    CacheViewEntry root;
+    cache_view_entry(view, DIRSTORE_NONE, &root);
+    DirRecord *totals = dirstore_totals(store);
+    *totals = root.rec;
+    totals->name_off = UINT64_MAX;
+}
+
+DirStore* cache_view_subset(CacheView* view, uint32_t depth) {
+    DirStore *subset = dirstore_create(view->root);
+    if (!subset) return NULL;
+    cache_view_totals(view, subset);
+    
+    // Breadth-first order makes the entries down to `depth` a prefix of the
+    // file, so parent indices carry over unchanged
+    uint64_t level = 0, end = depth > 0 ? view->header.root_children : 0;
+    for (uint32_t d = 1; d < depth && level < end; d++) {
+        uint64_t next = end;
+        CacheViewEntry entry;
+        for (uint64_t i = level; i < end; i++) {
+            if (cache_view_entry(view, i, &entry) != 0) {
+                dirstore_free(subset);
+                return NULL;
+            }
+            if (entry.children > 0) next = entry.first_child + entry.children;
+        }
+        level = end;
+        end = next;
+    }
+    CacheViewEntry entry;
+    for (uint64_t i = 0; i < end; i++) {
+        if (cache_view_entry(view, i, &entry) != 0 ||
+            cache_view_add(subset, entry.rec.parent, &entry) != i) {
+            dirstore_free(subset);
+            return NULL;
+        }
+    }
+    
+    // The busiest entry below that, with the parents leading to it
+    uint64_t *chain = NULL;
+    size_t chain_len = 0, chain_cap = 0;
+    int failed = 0;
+    uint64_t parent = view->header.busiest;
+    while (!failed && parent != DIRSTORE_NONE && parent >= end) {
+        if (chain_len == chain_cap) {
+            chain_cap = chain_cap ? chain_cap * 2 : 64;
+            uint64_t *grown = realloc(chain, chain_cap * sizeof(uint64_t));
+            failed = !grown;
+            if (failed) break;
+            chain = grown;
+        }
+        chain[chain_len++] = parent;
+        failed = cache_view_entry(view, parent, &entry) != 0;
+        parent = entry.rec.parent;
+    }
+    while (!failed && chain_len > 0) {
+        failed = cache_view_entry(view, chain[--chain_len], &entry) != 0 ||
+                 (parent = cache_view_add(subset, parent, &entry)) == DIRSTORE_NONE;
+    }
+    free(chain);
+    if (failed) {
+        dirstore_free(subset);
+        return NULL;
+    }
+    return subset;
+}
+
+const char* cache_view_root(const CacheView* view) {
+    return view->root;
+}
+
+CacheView* cache_view_open_covering(const char* scan_path, const ScanOptions* opts, int* result,
+                                    uint64_t* entry) {
+    *entry = DIRSTORE_NONE;
+    CacheView *view = cache_view_open(scan_path, opts, result);
+    char path[MAX_PATH_LEN];
+    if (view || !scan_path || cache_normalize_path(scan_path, path, sizeof(path)) != 0) {
+        return view;
+    }
+    
+    // No usable cache of its own: try the catalog's roots above it, closest
+    // first. Only caches of every directory qualify, as they hold the
+    // subtree exactly as a scan of it would and are revalidated (or kept
+    // current by a daemon).
+    CatalogEntry *entries;
+    size_t count;
+    if (catalog_read(cache_dir_path, &entries, &count) != 0) {
+        return NULL;
+    }
+    for (;;) {
+        size_t best = count, best_len = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t len = strlen(entries[i].root);
+            if (len > best_len && cache_path_within(entries[i].root, path)) {
+                best = i;
+                best_len = len;
+            }
+        }
+        if (best == count) break;
         
-        // Validate checksum
-        uint32_t expected_checksum = cache_calculate_checksum(entry.path, entry.mtime);
-        if (entry.checksum != expected_checksum) {
-            continue; // Skip invalid entry
+        int found;
+        view = cache_view_open(entries[best].root, opts, &found);
+        for (size_t i = 0; i < count; i++) {
+            if (i != best && strcmp(entries[i].root, entries[best].root) == 0) entries[i].root[0] = '\0';
+        }
+        entries[best].root[0] = '\0';                         // tried
+        uint64_t index = view && cache_view_header(view)->retain >= SCAN_RETAIN_DIRS ?
+                         cache_view_find(view, path) : CACHE_VIEW_MISSING;
+        if (index != CACHE_VIEW_MISSING && index != DIRSTORE_NONE) {
+            catalog_free(entries, count);
+            *entry = index;
+            *result = found;
+            return view;
         }
+        cache_view_close(view);
+    }
+    catalog_free(entries, count);
+    return NULL;
+}
+
+// One depth of a subtree: view entries [lo, hi) become records base ..
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t base;
+} SubtreeLevel;
+
+int cache_view_subtree(CacheView* view, uint64_t entry, const char* root, DirStore** store, FileStore** files) {
+    *store = NULL;
+    if (files) *files = NULL;
+    CacheViewEntry top;
+    if (entry == DIRSTORE_NONE || cache_view_entry(view, entry, &top) != 0) {
+        return -1;
+    }
+    int with_files = files && view->header.retain == SCAN_RETAIN_FILES;
+    
+    DirStore *sub = dirstore_create(root);
+    FileStore *sub_files = with_files ? filestore_create(1, view->header.min_size) : NULL;
+    SubtreeLevel *levels = NULL;
+    size_t num_levels = 0, max_levels = 0;
+    int ok = sub && (sub_files || !with_files) && dirstore_begin_parallel(sub, 1) == 0;
+    
+    // Breadth-first order: the descendants at each depth are one contiguous
+    // range, the children of the range above
+    uint64_t lo = top.first_child, hi = top.first_child + top.children, base = 0;
+    while (ok && lo < hi) {
+        if (num_levels == max_levels) {
+            max_levels = max_levels ? max_levels * 2 : 16;
+            SubtreeLevel *grown = realloc(levels, max_levels * sizeof(SubtreeLevel));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            levels = grown;
+        }
+        SubtreeLevel *level = &levels[num_levels++];
+        const SubtreeLevel *above = num_levels > 1 ? level - 1 : NULL;
+        level->lo = lo;
+        level->hi = hi;
+        level->base = base;
         
-        // Copy to result arrays
-        strncpy(dirs[*dir_count].path, entry.path, MAX_PATH_LEN);
-        dirs[*dir_count].size = entry.size;
-        (*dir_count)++;
-        // Do NOT add to totals here; totals already loaded from header
+        uint64_t next_lo = 0, next_hi = 0;
+        for (uint64_t i = lo; ok && i < hi; i++) {
+            CacheViewEntry e;
+            uint64_t ref;
+            DirRecord *rec = NULL;
+            ok = cache_view_entry(view, i, &e) == 0 &&
+                 (above ? e.rec.parent >= above->lo && e.rec.parent < above->hi : e.rec.parent == entry) &&
+                 (rec = dirstore_writer_add(sub, 0, e.name, &ref)) != NULL;
+            if (!ok) break;
+            uint64_t name_off = rec->name_off;
+            *rec = e.rec;
+            rec->name_off = name_off;
+            rec->parent = above ? DIRSTORE_REF(0, above->base + e.rec.parent - above->lo) : DIRSTORE_NONE;
+            if (e.children > 0) {
+                if (next_hi == 0) next_lo = e.first_child;
+                next_hi = e.first_child + e.children;
+            }
+        }
+        base += hi - lo;
+        lo = next_lo;
+        hi = next_hi;
     }
     
-#ifdef _WIN32
-    UnmapViewOfFile(view);
-    CloseHandle(hMap);
-    CloseHandle(hFile);
-#else
-    fclose(file);
-#endif
-    return 1; // Cache loaded successfully
+    // File blocks are stored in entry order, the subtree's among them
+    for (size_t b = view->dir_blocks; ok && sub_files && b < view->num_blocks; b++) {
+        const ViewBlock *block = &view->blocks[b];
+        ok = cache_block_crc(&block->head, block->payload) == block->head.crc;
+        const unsigned char *p = block->payload;
+        const unsigned char *end = p + block->head.bytes;
+        size_t level = 0;
+        for (uint32_t n = 0; ok && n < block->head.count; n++) {
+            uint64_t dir;
+            uint32_t count, bytes;
+            const unsigned char *data;
+            ok = cache_decode_file_block(&p, end, view->header.entry_count, &dir, &count, &data, &bytes) == 0;
+            if (!ok || dir == DIRSTORE_NONE) continue;
+            if (dir == entry) {
+                ok = filestore_add_block(sub_files, 0, DIRSTORE_NONE, count, data, bytes) == 0;
+                continue;
+            }
+            while (level < num_levels && levels[level].hi <= dir) level++;
+            if (level == num_levels || dir < levels[level].lo) continue;
+            ok = filestore_add_block(sub_files, 0, DIRSTORE_REF(0, levels[level].base + dir - levels[level].lo),
+                                     count, data, bytes) == 0;
+        }
+    }
+    free(levels);
+    
+    ok = ok && dirstore_splice(sub) == 0 && (!sub_files || filestore_finish(sub_files, sub) == 0);
+    if (!ok) {
+        filestore_free(sub_files);
+        dirstore_free(sub);
+        return -1;
+    }
+    DirRecord *totals = dirstore_totals(sub);
+    *totals = top.rec;
+    totals->parent = DIRSTORE_NONE;
+    totals->name_off = UINT64_MAX;
+    *store = sub;
+    if (files) *files = sub_files;
+    return 0;
 }
 
-// Save cache for given scan path
-int cache_save(const char* scan_path, const DirInfo* dirs, int dir_count, uint64_t total_size, int file_count) {
-    if (!scan_path || !dirs || dir_count <= 0) {
+// A full load: the blocks are split into one contiguous range per part, and
+// each part is decoded by one task into its own DirStore / FileStore writer
+typedef struct {
+    CacheView *view;
+    DirStore *store;
+    FileStore *files;
+    int parts;
+    size_t *dir_start;                // first block of each part (parts + 1 values)
+    size_t *file_start;
+    uint64_t *entry_start;            // first entry of each part (parts + 1 values)
+    atomic_int failed;
+} ViewLoad;
+
+typedef struct {
+    ViewLoad *load;
+    int part;
+} ViewLoadTask;
+
+// Writer reference of an entry (DIRSTORE_NONE stays DIRSTORE_NONE)
+static uint64_t view_load_ref(const ViewLoad *load, uint64_t index) {
+    if (index == DIRSTORE_NONE) return DIRSTORE_NONE;
+    int lo = 0, hi = load->parts;
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (load->entry_start[mid] <= index) lo = mid; else hi = mid;
+    }
+    return DIRSTORE_REF(lo, index - load->entry_start[lo]);
+}
+
+static int view_load_part(ViewLoad *load, int part) {
+    CacheView *view = load->view;
+    char name[MAX_PATH_LEN];
+    for (size_t b = load->dir_start[part]; b < load->dir_start[part + 1]; b++) {
+        const ViewBlock *block = &view->blocks[b];
+        if (cache_block_crc(&block->head, block->payload) != block->head.crc) return -1;
+        const unsigned char *p = block->payload;
+        const unsigned char *end = p + block->head.bytes;
+        uint64_t name_len = 0;
+        for (uint32_t n = 0; n < block->head.count; n++) {
+            CacheViewEntry entry;
+            uint64_t ref;
+            if (cache_decode_entry(&p, end, block->first + n, view->header.entry_count,
+                                   name, &name_len, &entry) != 0) {
+                return -1;
+            }
+            DirRecord *rec = dirstore_writer_add(load->store, part, name, &ref);
+            if (!rec) return -1;
+            uint64_t name_off = rec->name_off;
+            *rec = entry.rec;
+            rec->name_off = name_off;
+            rec->parent = view_load_ref(load, entry.rec.parent);
+        }
+        if (p != end) return -1;
+    }
+    for (size_t b = load->file_start[part]; load->files && b < load->file_start[part + 1]; b++) {
+        const ViewBlock *block = &view->blocks[b];
+        if (cache_block_crc(&block->head, block->payload) != block->head.crc) return -1;
+        const unsigned char *p = block->payload;
+        const unsigned char *end = p + block->head.bytes;
+        for (uint32_t n = 0; n < block->head.count; n++) {
+            uint64_t dir;
+            uint32_t count, bytes;
+            const unsigned char *data;
+            if (cache_decode_file_block(&p, end, view->header.entry_count, &dir, &count, &data, &bytes) != 0 ||
+                filestore_add_block(load->files, part, view_load_ref(load, dir), count, data, bytes) != 0) {
+                return -1;
+            }
+        }
+        if (p != end) return -1;
+    }
+    return 0;
+}
+
+static void view_load_task(WorkPool *pool, int worker, void *arg) {
+    (void)pool;
+    (void)worker;
+    ViewLoadTask *task = (ViewLoadTask *)arg;
+    if (view_load_part(task->load, task->part) != 0) {
+        atomic_store(&task->load->failed, 1);
+    }
+}
+
+// Split blocks [begin, end) into `parts` ranges of about the same payload
+static void view_split(const CacheView *view, size_t begin, size_t end, int parts, size_t *start) {
+    uint64_t total = 0, seen = 0;
+    for (size_t b = begin; b < end; b++) total += view->blocks[b].head.bytes;
+    size_t b = begin;
+    for (int k = 0; k < parts; k++) {
+        start[k] = b;
+        uint64_t goal = total * (uint64_t)(k + 1) / (uint64_t)parts;
+        while (b < end && seen < goal) seen += view->blocks[b++].head.bytes;
+    }
+    start[parts] = end;
+}
+
+int cache_view_load(CacheView* view, const ScanOptions* opts, DirStore** store, FileStore** files) {
+    *store = NULL;
+    if (files) *files = NULL;
+    int with_files = files && view->header.retain == SCAN_RETAIN_FILES;
+    
+    int parts = scanner_thread_count(opts);
+    size_t file_blocks = view->num_blocks - view->dir_blocks;
+    size_t most = view->dir_blocks > file_blocks ? view->dir_blocks : file_blocks;
+    if ((size_t)parts > most) parts = most > 0 ? (int)most : 1;
+    
+    ViewLoad load;
+    memset(&load, 0, sizeof(load));
+    load.view = view;
+    load.parts = parts;
+    atomic_init(&load.failed, 0);
+    load.store = dirstore_create(view->root);
+    load.files = with_files ? filestore_create(parts, view->header.min_size) : NULL;
+    load.dir_start = malloc((size_t)(parts + 1) * sizeof(size_t));
+    load.file_start = malloc((size_t)(parts + 1) * sizeof(size_t));
+    load.entry_start = malloc((size_t)(parts + 1) * sizeof(uint64_t));
+    ViewLoadTask *tasks = malloc((size_t)parts * sizeof(ViewLoadTask));
+    WorkPool *pool = workpool_create(parts, NULL);
+    int ok = load.store && (load.files || !with_files) && load.dir_start && load.file_start &&
+             load.entry_start && tasks && pool && dirstore_begin_parallel(load.store, parts) == 0;
+    
+    if (ok) {
+        view_split(view, 0, view->dir_blocks, parts, load.dir_start);
+        view_split(view, view->dir_blocks, view->num_blocks, parts, load.file_start);
+        for (int k = 0; k <= parts; k++) {
+            size_t b = load.dir_start[k];
+            load.entry_start[k] = b < view->dir_blocks ? view->blocks[b].first : view->header.entry_count;
+        }
+        for (int k = 0; k < parts; k++) {
+            tasks[k].load = &load;
+            tasks[k].part = k;
+            workpool_push(pool, k, view_load_task, &tasks[k]);
+        }
+        workpool_run(pool);
+        ok = !atomic_load(&load.failed) && dirstore_splice(load.store) == 0 &&
+             dirstore_count(load.store) == view->header.entry_count &&
+             (!load.files || filestore_finish(load.files, load.store) == 0);
+    }
+    if (pool) workpool_destroy(pool);
+    free(tasks);
+    free(load.dir_start);
+    free(load.file_start);
+    free(load.entry_start);
+    if (!ok) {
+        filestore_free(load.files);
+        dirstore_free(load.store);
         return -1;
     }
     
+    cache_view_totals(view, load.store);
+    *store = load.store;
+    if (files) *files = load.files;
+    return 0;
+}
+
+// Load cache for given scan path
+int cache_load(const char* scan_path, const ScanOptions* opts, DirStore** store, FileStore** files,
+               uint64_t* total_size, uint64_t* total_alloc, uint64_t* file_count) {
+    if (!scan_path || !store || !total_size || !total_alloc || !file_count) {
+        return -1;
+    }
+    *store = NULL;
+    if (files) *files = NULL;
+    ScanOptions want = {0};
+    if (opts) want = *opts;
+    if (want.retain == SCAN_RETAIN_FILES && !files) want.retain = SCAN_RETAIN_DIRS;
+    
+    int result;
+    uint64_t entry;
+    CacheView *view = cache_view_open_covering(scan_path, &want, &result, &entry);
+    if (!view) {
+        return result;
+    }
+    char root[MAX_PATH_LEN];
+    if (cache_normalize_path(scan_path, root, sizeof(root)) != 0) {
+        snprintf(root, sizeof(root), "%s", scan_path);
+    }
+    if ((entry == DIRSTORE_NONE ? cache_view_load(view, &want, store, files) :
+                                  cache_view_subtree(view, entry, root, store, files)) != 0) {
+        cache_view_close(view);
+        return -1;
+    }
+    const DirRecord *totals = dirstore_totals(*store);
+    *total_size = totals->size;
+    *total_alloc = totals->alloc_size;
+    *file_count = totals->files;
+    cache_view_close(view);
+    return result; // Cache loaded successfully
+}
+
+// Builds one block's payload in memory and writes it out behind its
+// CacheBlock header once it reaches CACHE_BLOCK_SIZE
+typedef struct {
+    FILE *file;
+    uint32_t kind;
+    uint32_t count;
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    const char *prev_name;            // front coding base, NULL at a block start
+    size_t prev_len;
+    int failed;
+} CacheEncoder;
+
+static unsigned char* encoder_reserve(CacheEncoder *enc, size_t extra) {
+    if (enc->len + extra > enc->cap) {
+        size_t cap = enc->cap ? enc->cap : CACHE_BLOCK_SIZE * 2;
+        while (cap < enc->len + extra) cap *= 2;
+        unsigned char *grown = realloc(enc->buf, cap);
+        if (!grown) {
+            enc->failed = 1;
+            return NULL;
+        }
+        enc->buf = grown;
+        enc->cap = cap;
+    }
+    return enc->buf + enc->len;
+}
+
+static void encoder_flush(CacheEncoder *enc) {
+    if (enc->failed || enc->count == 0) return;
+    CacheBlock block = { enc->kind, enc->count, (uint32_t)enc->len, 0 };
+    block.crc = cache_block_crc(&block, enc->buf);
+    if (fwrite(&block, sizeof(CacheBlock), 1, enc->file) != 1 ||
+        fwrite(enc->buf, 1, enc->len, enc->file) != enc->len) {
+        enc->failed = 1;
+    }
+    enc->count = 0;
+    enc->len = 0;
+    enc->prev_name = NULL;
+    enc->prev_len = 0;
+}
+
+// Close the block once it is full
+static void encoder_next(CacheEncoder *enc, unsigned char *p) {
+    enc->len = (size_t)(p - enc->buf);
+    enc->count++;
+    if (enc->len >= CACHE_BLOCK_SIZE) encoder_flush(enc);
+}
+
+// Entry `index` is tree node index + 1
+static void encode_dir(CacheEncoder *enc, const DirTree *tree, const DirStore *store, uint64_t index) {
+    uint64_t node = index + 1;
+    const DirRecord *rec = dirstore_get(store, tree->record[node]);
+    const char *name = dirstore_name(store, tree->record[node]);
+    uint64_t parent = tree->parent[node];
+    uint64_t children = tree->child_start[node + 1] - tree->child_start[node];
+    size_t len = strlen(name);
+    size_t shared = 0;
+    while (shared < len && shared < enc->prev_len && name[shared] == enc->prev_name[shared]) {
+        shared++;
+    }
+    unsigned char *p = encoder_reserve(enc, (len - shared) + 12 * VARINT_MAX + sizeof(rec->stamp));
+    if (!p) return;
+    
+    p += varint_put(p, shared);
+    p += varint_put(p, len - shared);
+    memcpy(p, name + shared, len - shared);
+    p += len - shared;
+    p += varint_put(p, parent == 0 ? 0 : node - parent);
+    p += varint_put(p, children);
+    if (children > 0) p += varint_put(p, tree->child_start[node] - node);
+    p += varint_put(p, rec->size);
+    p += varint_put(p, zigzag_encode((int64_t)(rec->alloc_size - rec->size)));
+    p += varint_put(p, rec->files);
+    p += varint_put(p, rec->dirs);
+    p += varint_put(p, zigzag_encode((int64_t)(rec->inodes - rec->files - rec->dirs)));
+    p += varint_put(p, rec->direct_files);
+    p += varint_put(p, rec->direct_dirs);
+    memcpy(p, &rec->stamp, sizeof(rec->stamp));
+    p += sizeof(rec->stamp);
+    
+    enc->prev_name = name;
+    enc->prev_len = len;
+    encoder_next(enc, p);
+}
+
+static void encode_file_block(CacheEncoder *enc, uint64_t dir, const FileBlock *block) {
+    unsigned char *p = encoder_reserve(enc, 3 * VARINT_MAX + block->bytes);
+    if (!p) return;
+    p += varint_put(p, dir == DIRSTORE_NONE ? 0 : dir + 1);
+    p += varint_put(p, block->count);
+    p += varint_put(p, block->bytes);
+    memcpy(p, block + 1, block->bytes);
+    p += block->bytes;
+    encoder_next(enc, p);
+}
+
+// Encode and write the cache file; the caller has waited for any background save
+static int cache_write_file(const char* scan_path, const ScanOptions* opts, const DirStore* store, const FileStore* files,
+                            uint64_t total_size, uint64_t total_alloc, uint64_t file_count, double scan_seconds) {
+    char root[MAX_PATH_LEN];
     char cache_file_path[1024];
-    get_cache_file_path(scan_path, cache_file_path, sizeof(cache_file_path));
+    if (cache_normalize_path(scan_path, root, sizeof(root)) != 0 ||
+        cache_locate(root, 1, cache_file_path, sizeof(cache_file_path)) != 0) {
+        return -1;
+    }
+    ScanRetain retain = opts ? opts->retain : SCAN_RETAIN_LARGE;
+    if (retain == SCAN_RETAIN_FILES && !files) retain = SCAN_RETAIN_DIRS;
+    
+    // Entries are written breadth-first (tree node n is entry n - 1); one
+    // thread, the report runs meanwhile
+    DirTree *tree = dirtree_build(store, total_size, total_alloc, 1);
+    if (!tree) {
+        return -1;
+    }
+    uint64_t count = tree->count - 1;
+    
+    // The entry with the most files directly in it, and the file blocks:
+    // slot 0 is the root's, slot i + 1 entry i's
+    const DirRecord *totals = dirstore_totals(store);
+    uint64_t busiest = DIRSTORE_NONE;
+    uint32_t busiest_files = totals->direct_files;
+    uint64_t file_blocks = 0;
+    for (uint64_t node = 0; node <= count; node++) {
+        if (node > 0 && dirstore_get(store, tree->record[node])->direct_files > busiest_files) {
+            busiest = node - 1;
+            busiest_files = dirstore_get(store, tree->record[node])->direct_files;
+        }
+        if (retain == SCAN_RETAIN_FILES && filestore_block(files, tree->record[node])) file_blocks++;
+    }
     
+    // Written aside (one temporary per process, so concurrent saves of the
+    // same root do not mix) and renamed over the old file once complete: a
+    // reader opens either snapshot whole, never a partial one, and a view
+    // still mapping the old file keeps reading it unchanged
+    char temp_path[1024 + 32];
 #ifdef _WIN32
-    HANDLE hFile = CreateFileA(cache_file_path, GENERIC_WRITE|GENERIC_READ, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) return -1;
+    snprintf(temp_path, sizeof(temp_path), "%s.%lu.tmp", cache_file_path, (unsigned long)GetCurrentProcessId());
 #else
-    FILE* file = fopen(cache_file_path, "wb");
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", cache_file_path, (long)getpid());
+#endif
+    FILE *file = fopen(temp_path, "wb");
     if (!file) {
+        dirtree_free(tree);
         return -1;
     }
-#endif
     
-    // Get scan path modification time
-    struct stat scan_stat;
-    time_t scan_mtime = time(NULL);
-    if (stat(scan_path, &scan_stat) == 0) {
-        scan_mtime = scan_stat.st_mtime;
-    }
-    
-    // Write cache header
-    CacheHeader header = {
-        .magic = CACHE_MAGIC,
-        .version = CACHE_VERSION,
-        .entry_count = (uint32_t)dir_count,
-        .total_size = total_size,
-        .file_count = (uint32_t)file_count,
-        .created_at = time(NULL),
-        .last_updated = time(NULL)
-    };
+    // Write cache header (zeroed first so padding does not reach the CRC)
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.entry_count = count;
+    header.total_size = total_size;
+    header.total_alloc = total_alloc;
+    header.file_count = file_count;
+    header.retain = (uint32_t)retain;
+    header.min_size = cache_retain_threshold(opts, retain);
+    header.file_blocks = file_blocks;
+    header.dir_total = totals->dirs;
+    header.inode_total = totals->inodes;
+    header.root_files = totals->direct_files;
+    header.root_dirs = totals->direct_dirs;
+    header.root_stamp = totals->stamp;
+    header.root_children = tree->child_start[1] - tree->child_start[0];
+    header.busiest = busiest;
+    header.root_len = strlen(root);
+    header.created_at = time(NULL);
+    header.last_updated = header.created_at;
+    header.generation = cache_file_generation(cache_file_path) + 1;
+    header.header_crc = crc32c(crc32c(0, &header, sizeof(header)), root, header.root_len);
+    
+    CacheEncoder enc;
+    memset(&enc, 0, sizeof(enc));
+    enc.file = file;
+    enc.kind = CACHE_BLOCK_DIRS;
+    if (fwrite(&header, sizeof(CacheHeader), 1, file) != 1 ||
+        fwrite(root, 1, header.root_len, file) != header.root_len) {
+        enc.failed = 1;
+    }
+    
+    // Directory entries
+    for (uint64_t i = 0; i < count && !enc.failed; i++) {
+        encode_dir(&enc, tree, store, i);
+    }
+    encoder_flush(&enc);
+    
+    // File blocks with their directory as an entry index
+    enc.kind = CACHE_BLOCK_FILES;
+    for (uint64_t node = 0; file_blocks > 0 && node <= count && !enc.failed; node++) {
+        const FileBlock *block = filestore_block(files, tree->record[node]);
+        if (block) encode_file_block(&enc, node == 0 ? DIRSTORE_NONE : node - 1, block);
+    }
+    encoder_flush(&enc);
+    free(enc.buf);
+    dirtree_free(tree);
     
+    if (fclose(file) != 0) {
+        enc.failed = 1;
+    }
 #ifdef _WIN32
-    DWORD totalSize = sizeof(CacheHeader) + (DWORD)(dir_count * sizeof(CacheEntry));
-    HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, 0, totalSize, NULL);
-    if (!hMap) { CloseHandle(hFile); return -1; }
-    void *view = MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, totalSize);
-    if (!view) { CloseHandle(hMap); CloseHandle(hFile); return -1; }
-    unsigned char *p = (unsigned char *)view;
-    memcpy(p, &header, sizeof(CacheHeader));
-    p += sizeof(CacheHeader);
+    if (!enc.failed && !MoveFileExA(temp_path, cache_file_path, MOVEFILE_REPLACE_EXISTING)) {
 #else
-    if (fwrite(&header, sizeof(CacheHeader), 1, file) != 1) {
-        fclose(file);
+    if (!enc.failed && rename(temp_path, cache_file_path) != 0) {
+#endif
+        enc.failed = 1;
+    }
+    if (enc.failed) {
+        remove(temp_path);
         return -1;
     }
-#endif
     
-    // Write cache entries
-    for (int i = 0; i < dir_count; i++) {
-        CacheEntry entry = {
-            .size = dirs[i].size,
-            .mtime = scan_mtime,
-            .file_count = (uint32_t)file_count,
-            .dir_count = (uint32_t)dir_count,
-            .checksum = cache_calculate_checksum(dirs[i].path, scan_mtime)
-        };
-        
-        strncpy(entry.path, dirs[i].path, MAX_PATH_LEN);
-        entry.path[MAX_PATH_LEN - 1] = '\0';
-        
-    #ifdef _WIN32
-        memcpy(p, &entry, sizeof(CacheEntry));
-        p += sizeof(CacheEntry);
-    #else
-        if (fwrite(&entry, sizeof(CacheEntry), 1, file) != 1) {
-            fclose(file);
-            return -1;
-        }
-    #endif
+    // The root's series of snapshots grows by this one (a delta against the
+    // last); a history that cannot be written does not fail the save
+    char history_path[1024];
+    cache_history_name(cache_file_path, history_path, sizeof(history_path));
+    if (cache_history_enabled && history_append(history_path, root, store, (int64_t)header.created_at) == 0) {
+        catalog_touch(cache_dir_path, cache_file_base(history_path), root, 0, 0, 0);
     }
     
-#ifdef _WIN32
-    UnmapViewOfFile(view);
-    CloseHandle(hMap);
-    CloseHandle(hFile);
+    // Listed in the catalog, older snapshots evicted to stay in budget
+    catalog_touch(cache_dir_path, cache_file_base(cache_file_path), root,
+                  (uint64_t)(scan_seconds * 1000.0), 1, cache_budget);
     return 0;
-#else
-    fclose(file);
+}
+
+// The save running in the background, if save_pending
+typedef struct {
+    char scan_path[MAX_PATH_LEN];
+    ScanOptions opts;
+    int has_opts;
+    const DirStore *store;
+    const FileStore *files;
+    uint64_t total_size;
+    uint64_t total_alloc;
+    uint64_t file_count;
+    double scan_seconds;
+    int result;
+} CacheSaveJob;
+
+static CacheSaveJob save_job;
+static pthread_t save_thread;
+static int save_pending = 0;
+
+static void* cache_save_thread(void *arg) {
+    CacheSaveJob *job = (CacheSaveJob *)arg;
+    job->result = cache_write_file(job->scan_path, job->has_opts ? &job->opts : NULL, job->store, job->files,
+                                   job->total_size, job->total_alloc, job->file_count, job->scan_seconds);
+    return NULL;
+}
+
+// Save cache for given scan path
+int cache_save(const char* scan_path, const ScanOptions* opts, const DirStore* store, const FileStore* files,
+               uint64_t total_size, uint64_t total_alloc, uint64_t file_count, double scan_seconds) {
+    if (!scan_path || !store) {
+        return -1;
+    }
+    cache_save_wait();
+    return cache_write_file(scan_path, opts, store, files, total_size, total_alloc, file_count, scan_seconds);
+}
+
+int cache_save_async(const char* scan_path, const ScanOptions* opts, const DirStore* store, const FileStore* files,
+                     uint64_t total_size, uint64_t total_alloc, uint64_t file_count, double scan_seconds) {
+    if (!scan_path || !store || strlen(scan_path) >= MAX_PATH_LEN) {
+        return -1;
+    }
+    cache_save_wait();
+    
+    strcpy(save_job.scan_path, scan_path);
+    save_job.has_opts = opts != NULL;
+    if (opts) save_job.opts = *opts;
+    save_job.store = store;
+    save_job.files = files;
+    save_job.total_size = total_size;
+    save_job.total_alloc = total_alloc;
+    save_job.file_count = file_count;
+    save_job.scan_seconds = scan_seconds;
+    save_job.result = -1;
+    if (pthread_create(&save_thread, NULL, cache_save_thread, &save_job) != 0) {
+        return -1;
+    }
+    save_pending = 1;
     return 0;
-#endif
+}
+
+int cache_save_wait(void) {
+    if (!save_pending) {
+        return 0;
+    }
+    pthread_join(save_thread, NULL);
+    save_pending = 0;
+    return save_job.result;
 }
 
 // Invalidate cache for given path
 void cache_invalidate(const char* scan_path) {
     if (scan_path && cache_dir_path[0] != '\0') {
+        cache_save_wait();
+        char root[MAX_PATH_LEN];
         char cache_file_path[1024];
-        get_cache_file_path(scan_path, cache_file_path, sizeof(cache_file_path));
-        unlink(cache_file_path);
+        if (cache_normalize_path(scan_path, root, sizeof(root)) == 0 &&
+            cache_locate(root, 0, cache_file_path, sizeof(cache_file_path)) == 0) {
+            unlink(cache_file_path);
+        }
     }
 }
 
 // Cleanup cache system
 void cache_cleanup(void) {
-    // Nothing to cleanup for now
+    // Never leave a half-written cache behind
+    cache_save_wait();
 }
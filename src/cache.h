@@ -6,42 +6,164 @@
 #include "scanner.h"
 
 // Cache file format version
-#define CACHE_VERSION 2
+#define CACHE_VERSION 11
 #define CACHE_MAGIC 0x4449534B  // "DISK" in hex
 
-// Cache file structure
+// Cache file structure: a CacheHeader, the normalized path of the scanned
+// root (root_len bytes, no terminator), then blocks of at most about
+// CACHE_BLOCK_SIZE payload bytes, each a CacheBlock followed by its payload.
+// CACHE_BLOCK_DIRS blocks hold the entry_count recorded directories
+// breadth-first from the root (its children are entries 0 .. root_children
+// - 1), the children of every entry contiguous and largest first:
+//   name front-coded against the previous entry of the block (varint shared
+//   prefix length, varint suffix length, suffix bytes),
+//   varint parent: 0 under the root, else index - parent,
+//   varint children, then if any varint first_child - index,
+//   varint size, varint zigzag(alloc_size - size),
+//   varint files, varint dirs, varint zigzag(inodes - files - dirs),
+//   varint direct_files, varint direct_dirs, 8-byte stamp.
+// With SCAN_RETAIN_FILES, CACHE_BLOCK_FILES blocks follow with the
+// file_blocks FileStore blocks: varint directory (0 for the root, else entry
+// index + 1), varint count, varint bytes, then the encoded bytes.
+// Every block and the header (with the root) carry a CRC-32C; a mismatch
+// rejects the file, and so does a root other than the one asked for.
+// Files are named by a 64-bit hash of the root; on a collision the next
+// CACHE_PROBES names are tried. The cache directory's catalog (catalog.h)
+// lists them, and saves keep the directory within cache_set_budget().
+#define CACHE_BLOCK_SIZE (64 * 1024)
+#define CACHE_BLOCK_DIRS 1
+#define CACHE_BLOCK_FILES 2
+#define CACHE_PROBES 4
+#define CACHE_DEFAULT_BUDGET (1024ULL * 1024 * 1024)
+
 typedef struct {
-    char path[MAX_PATH_LEN];
-    uint64_t size;
-    time_t mtime;           // Directory modification time
-    uint32_t file_count;
-    uint32_t dir_count;
-    uint32_t checksum;      // Simple checksum for integrity
-} CacheEntry;
+    uint32_t kind;          // CACHE_BLOCK_*
+    uint32_t count;         // Entries (or file blocks) in the payload
+    uint32_t bytes;         // Payload bytes after this header
+    uint32_t crc;           // CRC-32C of this header (crc as 0) and the payload
+} CacheBlock;
 
 typedef struct {
     uint32_t magic;         // Cache file signature
     uint32_t version;       // Cache format version
-    uint32_t entry_count;   // Number of cache entries
+    uint64_t entry_count;   // Number of cache entries
     uint64_t total_size;    // Total size of all files
-    uint32_t file_count;    // Total number of files
+    uint64_t total_alloc;   // Total allocated size of all files
+    uint64_t file_count;    // Total number of files
+    uint32_t retain;        // ScanRetain of the scan
+    uint32_t header_crc;    // CRC-32C of the header with this field as 0
+    uint64_t min_size;      // Threshold the scan used (see ScanOptions.min_size)
+    uint64_t file_blocks;   // FileStore blocks after the entries
+    uint64_t dir_total;     // Directories below the root
+    uint64_t inode_total;   // Inodes below the root, itself included
+    uint32_t root_files;    // Files directly in the root
+    uint32_t root_dirs;     // Directories directly in the root
+    uint64_t root_stamp;    // The root's DirRecord.stamp
+    uint64_t root_children; // Entries directly under the root
+    uint64_t busiest;       // Entry with the most files directly in it,
+                            // DIRSTORE_NONE if none has more than the root
+    uint64_t root_len;      // Bytes of the root path after the header
     time_t created_at;      // When cache was created
     time_t last_updated;    // When cache was last updated
+    uint64_t generation;    // Snapshots of this root published so far, this one
+                            // included (saves racing each other may share one)
 } CacheHeader;
 
 // Cache management functions
 int cache_init(void);
 void cache_cleanup(void);
 const char* cache_get_path(void);
+// Total size the cache directory is kept within (0: no limit)
+void cache_set_budget(uint64_t bytes);
+// Whether saves append to the root's history (default 1)
+void cache_set_history(int enabled);
 
 // Cache operations
-int cache_load(const char* scan_path, DirInfo* dirs, int* dir_count, uint64_t* total_size, int* file_count);
-int cache_save(const char* scan_path, const DirInfo* dirs, int dir_count, uint64_t total_size, int file_count);
+// cache_load creates *store (caller frees it with dirstore_free) and, if
+// `files` is not NULL and opts asks for files, *files. A cache that retained
+// less than `opts` asks for is a miss. Returns 1 for a usable cache, 2 for a
+// cache of every directory that must be brought up to date with
+// scan_revalidate(), 0 for a miss and -1 on error.
+int cache_load(const char* scan_path, const ScanOptions* opts, DirStore** store, FileStore** files,
+               uint64_t* total_size, uint64_t* total_alloc, uint64_t* file_count);
+// `files` may be NULL (nothing but directories retained); `scan_seconds`,
+// how long the scan took (0 if unknown), goes to the catalog
+int cache_save(const char* scan_path, const ScanOptions* opts, const DirStore* store, const FileStore* files,
+               uint64_t total_size, uint64_t total_alloc, uint64_t file_count, double scan_seconds);
+// cache_save() on a background thread: returns once the save is started (0,
+// or -1 if it could not be). `store` and `files` must stay alive and
+// unchanged until cache_save_wait(), which returns the save's result (0 if
+// none was pending). cache_cleanup() also waits for it.
+int cache_save_async(const char* scan_path, const ScanOptions* opts, const DirStore* store, const FileStore* files,
+                     uint64_t total_size, uint64_t total_alloc, uint64_t file_count, double scan_seconds);
+int cache_save_wait(void);
 int cache_is_valid(const char* scan_path);
+// Canonical spelling of `path` (absolute, symlinks and "." / ".." resolved,
+// no trailing separator), the one caches are keyed by. Returns 0 or -1.
+int cache_normalize_path(const char* path, char* out, size_t out_len);
+
+// In-place access to a cache file. The file is memory-mapped and a block is
+// decoded, and its CRC checked, only when an entry in it is first asked for,
+// so opening and querying cost the same whatever the snapshot size.
+// Entries are numbered in file order; DIRSTORE_NONE stands for the root.
+// A view is used by one thread at a time.
+typedef struct CacheView CacheView;
+
+#define CACHE_VIEW_MISSING (UINT64_MAX - 1)
+
+typedef struct {
+    DirRecord rec;          // parent as an entry index; name_off unused
+    const char* name;       // valid while the view is open
+    uint64_t first_child;   // children: first_child .. first_child + children - 1
+    uint64_t children;
+} CacheViewEntry;
+
+// Same checks and *result as cache_load(); the view is returned for 1 and 2,
+// NULL otherwise
+CacheView* cache_view_open(const char* scan_path, const ScanOptions* opts, int* result);
+void cache_view_close(CacheView* view);
+const CacheHeader* cache_view_header(const CacheView* view);
+// 0, or -1 for an index out of range or a corrupt block
+int cache_view_entry(CacheView* view, uint64_t index, CacheViewEntry* entry);
+// Entry of `path` (the scanned root followed by recorded names), DIRSTORE_NONE
+// for the root itself, CACHE_VIEW_MISSING when not recorded
+uint64_t cache_view_find(CacheView* view, const char* path);
+// Store of the entries down to `depth` below the root (1: its children), plus
+// the busiest entry and its parents; NULL on error. Enough for a report of
+// the largest top-level directories without decoding the rest.
+DirStore* cache_view_subset(CacheView* view, uint32_t depth);
+// Decode everything, blocks spread over the scan's worker count. Creates
+// *store and, if `files` is not NULL and the cache has them, *files.
+// Returns 0 or -1.
+int cache_view_load(CacheView* view, const ScanOptions* opts, DirStore** store, FileStore** files);
+// Normalized path the view's snapshot was taken of
+const char* cache_view_root(const CacheView* view);
+// As cache_view_open(), but without a usable cache of its own `scan_path` may
+// be served from the cache of every directory that recorded it of the
+// closest ancestor in the catalog: *entry then receives its entry there (DIRSTORE_NONE for a cache
+// of `scan_path` itself), and *result is 2 (revalidate), or 1 for a watched one.
+CacheView* cache_view_open_covering(const char* scan_path, const ScanOptions* opts, int* result,
+                                    uint64_t* entry);
+// Store (and files, as for cache_view_load()) of the subtree at `entry`,
+// rooted at `root`: the records a scan of that directory would have made.
+// Returns 0 or -1.
+int cache_view_subtree(CacheView* view, uint64_t entry, const char* root, DirStore** store, FileStore** files);
 void cache_invalidate(const char* scan_path);
+// Cache file holding scan_path's snapshot (a save replaces it with a new
+// file). Returns 0, or -1 without one.
+int cache_snapshot_file(const char* scan_path, char* path, size_t len);
+// History file (history.h) of scan_path's snapshots, one appended per save
+// and readable with history_list() / history_diff() and the normalized
+// path. Returns 0, or -1 without a cache of scan_path.
+int cache_history_file(const char* scan_path, char* path, size_t len);
+// Claim scan_path for a daemon keeping its cache current (watch.h): until
+// cache_watch_end(), cache_view_open() answers from a cache of every
+// directory without asking for a revalidation. Returns a handle, or -1 if
+// another process holds the claim (or on error).
+int cache_watch_begin(const char* scan_path);
+void cache_watch_end(int handle);
 
 // Utility functions
-uint32_t cache_calculate_checksum(const char* path, time_t mtime);
 int cache_ensure_directory_exists(void);
 
 #endif
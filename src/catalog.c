@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "catalog.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+
+#define CATALOG_MAGIC "# DiskScout cache index 1"
+#define CATALOG_LINE_MAX (3 * 4096 + 128)   // an escaped root can triple in length
+#define CATALOG_TEMP_SECONDS 3600              // age of a temporary left by a save that died
+#define CATALOG_TOUCH_SECONDS 600              // a read's last use is not rewritten more often
+
+typedef struct {
+    CatalogEntry *entries;
+    size_t count;
+    size_t cap;
+} Catalog;
+
+static void catalog_path(const char *dir, const char *name, char *out, size_t len) {
+    snprintf(out, len, "%s/%s", dir, name);
+}
+
+// Snapshot file names: cache_*.db
+static int catalog_is_snapshot(const char *name) {
+    size_t len = strlen(name);
+    return len > 9 && len < sizeof(((CatalogEntry *)0)->file) &&
+           strncmp(name, "cache_", 6) == 0 && strcmp(name + len - 3, ".db") == 0;
+}
+
+static int catalog_is_temporary(const char *name) {
+    size_t len = strlen(name);
+    return len > 10 && strncmp(name, "cache_", 6) == 0 && strcmp(name + len - 4, ".tmp") == 0;
+}
+
+static CatalogEntry* catalog_add(Catalog *cat, const char *file, const char *root) {
+    if (cat->count == cat->cap) {
+        size_t cap = cat->cap ? cat->cap * 2 : 16;
+        CatalogEntry *grown = realloc(cat->entries, cap * sizeof(CatalogEntry));
+        if (!grown) return NULL;
+        cat->entries = grown;
+        cat->cap = cap;
+    }
+    CatalogEntry *entry = &cat->entries[cat->count];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->file, sizeof(entry->file), "%s", file);
+    entry->root = strdup(root);
+    if (!entry->root) return NULL;
+    cat->count++;
+    return entry;
+}
+
+static void catalog_remove(Catalog *cat, size_t i) {
+    free(cat->entries[i].root);
+    cat->entries[i] = cat->entries[--cat->count];
+}
+
+// Roots are written with '\\', tab and newline escaped
+static void catalog_put_root(FILE *f, const char *root) {
+    for (const char *p = root; *p; p++) {
+        if (*p == '\\') fputs("\\\\", f);
+        else if (*p == '\t') fputs("\\t", f);
+        else if (*p == '\n') fputs("\\n", f);
+        else fputc(*p, f);
+    }
+}
+
+static void catalog_get_root(char *s) {
+    char *out = s;
+    for (const char *p = s; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            *out++ = *p == 't' ? '\t' : *p == 'n' ? '\n' : *p;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+static int catalog_load(const char *dir, Catalog *cat) {
+    memset(cat, 0, sizeof(*cat));
+    char path[1024];
+    catalog_path(dir, CATALOG_FILE, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;                 // no index yet
+
+    char *line = malloc(CATALOG_LINE_MAX);
+    if (!line) {
+        fclose(f);
+        return -1;
+    }
+    int ok = fgets(line, CATALOG_LINE_MAX, f) && strncmp(line, CATALOG_MAGIC, strlen(CATALOG_MAGIC)) == 0;
+    while (ok && fgets(line, CATALOG_LINE_MAX, f)) {
+        // file \t bytes \t last used \t scan ms \t root; anything else is skipped
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n') continue;
+        line[len - 1] = '\0';
+        char *field[5];
+        field[0] = line;
+        int n = 1;
+        for (char *p = line; *p && n < 5; p++) {
+            if (*p == '\t') {
+                *p = '\0';
+                field[n++] = p + 1;
+            }
+        }
+        if (n < 5 || !catalog_is_snapshot(field[0])) continue;
+        catalog_get_root(field[4]);
+        CatalogEntry *entry = catalog_add(cat, field[0], field[4]);
+        if (!entry) {
+            ok = 0;
+            break;
+        }
+        entry->bytes = strtoull(field[1], NULL, 10);
+        entry->last_used = strtoll(field[2], NULL, 10);
+        entry->scan_ms = strtoull(field[3], NULL, 10);
+    }
+    free(line);
+    fclose(f);
+    if (!ok && cat->count > 0) return -1;
+    return 0;
+}
+
+// Write a new index and move it over the old one
+static int catalog_store(const char *dir, const Catalog *cat) {
+    char path[1024], tmp[1024];
+    catalog_path(dir, CATALOG_FILE, path, sizeof(path));
+    catalog_path(dir, CATALOG_FILE ".tmp", tmp, sizeof(tmp));
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+    fprintf(f, "%s\n", CATALOG_MAGIC);
+    for (size_t i = 0; i < cat->count; i++) {
+        const CatalogEntry *e = &cat->entries[i];
+        fprintf(f, "%s\t%llu\t%lld\t%llu\t", e->file, (unsigned long long)e->bytes,
+                (long long)e->last_used, (unsigned long long)e->scan_ms);
+        catalog_put_root(f, e->root);
+        fputc('\n', f);
+    }
+    if (fclose(f) != 0) {
+        remove(tmp);
+        return -1;
+    }
+#ifdef _WIN32
+    if (!MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(tmp, path) != 0) {
+#endif
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void catalog_release(Catalog *cat) {
+    catalog_free(cat->entries, cat->count);
+    memset(cat, 0, sizeof(*cat));
+}
+
+// Exclusive lock on the directory's index, across processes
+#ifdef _WIN32
+typedef HANDLE CatalogLock;
+#else
+typedef int CatalogLock;
+#endif
+
+// Take the lock; without `wait`, -1 at once if another process holds it
+static int catalog_lock(const char *dir, CatalogLock *lock, int wait) {
+    char path[1024];
+    catalog_path(dir, CATALOG_FILE ".lock", path, sizeof(path));
+#ifdef _WIN32
+    *lock = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (*lock == INVALID_HANDLE_VALUE) return -1;
+    OVERLAPPED at;
+    memset(&at, 0, sizeof(at));
+    DWORD flags = LOCKFILE_EXCLUSIVE_LOCK | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    if (!LockFileEx(*lock, flags, 0, 1, 0, &at)) {
+        CloseHandle(*lock);
+        return -1;
+    }
+#else
+    *lock = open(path, O_RDWR | O_CREAT, 0644);
+    if (*lock < 0) return -1;
+    if (flock(*lock, wait ? LOCK_EX : LOCK_EX | LOCK_NB) != 0) {
+        close(*lock);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static void catalog_unlock(CatalogLock lock) {
+#ifdef _WIN32
+    CloseHandle(lock);
+#else
+    close(lock);                      // releases the flock
+#endif
+}
+
+// Drop entries whose file is gone, refresh sizes, adopt unlisted snapshots
+// (root unknown, last used when written), delete stale temporaries
+static int catalog_sweep(const char *dir, Catalog *cat) {
+    char path[1024];
+    struct stat st;
+    for (size_t i = 0; i < cat->count; ) {
+        catalog_path(dir, cat->entries[i].file, path, sizeof(path));
+        if (stat(path, &st) != 0) {
+            catalog_remove(cat, i);
+            continue;
+        }
+        cat->entries[i].bytes = (uint64_t)st.st_size;
+        i++;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (catalog_is_temporary(ent->d_name)) {
+            catalog_path(dir, ent->d_name, path, sizeof(path));
+            if (stat(path, &st) == 0 && (int64_t)st.st_mtime < (int64_t)time(NULL) - CATALOG_TEMP_SECONDS) {
+                remove(path);
+            }
+            continue;
+        }
+        if (!catalog_is_snapshot(ent->d_name)) continue;
+        size_t i = 0;
+        while (i < cat->count && strcmp(cat->entries[i].file, ent->d_name) != 0) i++;
+        if (i < cat->count) continue;
+        catalog_path(dir, ent->d_name, path, sizeof(path));
+        if (stat(path, &st) != 0) continue;
+        CatalogEntry *entry = catalog_add(cat, ent->d_name, "");
+        if (!entry) {
+            closedir(d);
+            return -1;
+        }
+        entry->bytes = (uint64_t)st.st_size;
+        entry->last_used = (int64_t)st.st_mtime;
+    }
+    closedir(d);
+    return 0;
+}
+
+// Delete least recently used snapshots until the total fits
+static void catalog_evict(const char *dir, Catalog *cat, const char *keep, uint64_t budget) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < cat->count; i++) total += cat->entries[i].bytes;
+    while (total > budget) {
+        size_t oldest = cat->count;
+        for (size_t i = 0; i < cat->count; i++) {
+            if (strcmp(cat->entries[i].file, keep) == 0) continue;
+            if (oldest == cat->count || cat->entries[i].last_used < cat->entries[oldest].last_used) {
+                oldest = i;
+            }
+        }
+        if (oldest == cat->count) break;
+        char path[1024];
+        catalog_path(dir, cat->entries[oldest].file, path, sizeof(path));
+        remove(path);
+        total -= cat->entries[oldest].bytes;
+        catalog_remove(cat, oldest);
+    }
+}
+
+int catalog_read(const char *dir, CatalogEntry **entries, size_t *count) {
+    Catalog cat;
+    if (catalog_load(dir, &cat) != 0) {
+        catalog_release(&cat);
+        return -1;
+    }
+    *entries = cat.entries;
+    *count = cat.count;
+    return 0;
+}
+
+void catalog_free(CatalogEntry *entries, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(entries[i].root);
+    }
+    free(entries);
+}
+
+int catalog_touch(const char *dir, const char *file, const char *root, uint64_t scan_ms,
+                  int saved, uint64_t budget) {
+    if (!catalog_is_snapshot(file)) return -1;
+    if (!saved) {
+        // Reads only move the last use: not when it is recent (looked up
+        // without the lock, as the index is replaced whole), and not by
+        // waiting on a writer
+        Catalog cat;
+        int recent = 0;
+        if (catalog_load(dir, &cat) == 0) {
+            for (size_t i = 0; i < cat.count && !recent; i++) {
+                const CatalogEntry *e = &cat.entries[i];
+                recent = strcmp(e->file, file) == 0 && strcmp(e->root, root) == 0 &&
+                         (int64_t)time(NULL) - e->last_used < CATALOG_TOUCH_SECONDS;
+            }
+        }
+        catalog_release(&cat);
+        if (recent) return 0;
+    }
+    CatalogLock lock;
+    if (catalog_lock(dir, &lock, saved) != 0) return saved ? -1 : 0;
+
+    Catalog cat;
+    int ok = catalog_load(dir, &cat) == 0;
+    size_t i = 0;
+    while (ok && i < cat.count && strcmp(cat.entries[i].file, file) != 0) i++;
+    CatalogEntry *entry = NULL;
+    if (ok && i < cat.count) {
+        entry = &cat.entries[i];
+        char *copy = strcmp(entry->root, root) != 0 ? strdup(root) : NULL;
+        if (copy) {
+            free(entry->root);
+            entry->root = copy;
+        }
+    } else if (ok) {
+        entry = catalog_add(&cat, file, root);
+    }
+    ok = entry != NULL;
+
+    if (ok) {
+        entry->last_used = (int64_t)time(NULL);
+        char path[1024];
+        struct stat st;
+        catalog_path(dir, file, path, sizeof(path));
+        if (stat(path, &st) == 0) entry->bytes = (uint64_t)st.st_size;
+        if (saved) {
+            entry->scan_ms = scan_ms;
+            ok = catalog_sweep(dir, &cat) == 0;
+            if (ok && budget > 0) catalog_evict(dir, &cat, file, budget);
+        }
+    }
+    ok = ok && catalog_store(dir, &cat) == 0;
+    catalog_release(&cat);
+    catalog_unlock(lock);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,39 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Index of the snapshots in the cache directory: one text line per file
+// with the root it was taken of, its size, when it was last used and how
+// long its scan took. Saves keep the directory within a byte budget by
+// deleting the least recently used snapshots. Updates hold a lock file, so
+// several processes may share the directory.
+
+#define CATALOG_FILE "index"
+
+typedef struct {
+    char file[64];          // snapshot name within the cache directory
+    char *root;             // normalized scanned path ("" if unknown)
+    uint64_t bytes;
+    int64_t last_used;      // seconds since the epoch
+    uint64_t scan_ms;       // scan duration, 0 if unknown
+} CatalogEntry;
+
+// Read the index of `dir`: *entries (catalog_free()) and *count, empty if
+// there is none yet. Returns 0 or -1.
+int catalog_read(const char *dir, CatalogEntry **entries, size_t *count);
+void catalog_free(CatalogEntry *entries, size_t count);
+
+// Record a use of `file`, a snapshot of `root`. With `saved` the file was
+// just written: its size and scan time are updated, entries whose file is
+// gone are dropped, snapshots missing from the index are adopted, and the
+// least recently used ones (never `file`) are deleted until the total is
+// within `budget` bytes (0: no limit). Without `saved` the last use is
+// only rewritten when it is over ten minutes old and the index is not
+// locked by another process at the time, so reads never wait on a writer.
+// Returns 0 or -1.
+int catalog_touch(const char *dir, const char *file, const char *root, uint64_t scan_ms,
+                  int saved, uint64_t budget);
+
+#endif
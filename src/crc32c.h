@@ -0,0 +1,17 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli), the checksum of the cache blocks.
+// Uses the CPU's CRC instruction when there is one (SSE 4.2 on x86-64,
+// the CRC extension on ARMv8), a table otherwise; both give the same value.
+
+// Extend `crc` (0 to start) over `len` bytes
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+// 1 if the hardware instruction is used
+int crc32c_hardware(void);
+
+#endif
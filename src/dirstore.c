@@ -0,0 +1,359 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dirstore.h"
+
+#define CHUNK_SHIFT 12
+#define CHUNK_RECORDS (1u << CHUNK_SHIFT)         // 4096 records = 288 KB per chunk
+#define POOL_BLOCK_SIZE (64 * 1024)               // string pool block
+#define REF_LOCAL_MASK ((1ULL << DIRSTORE_REF_SHIFT) - 1)
+
+#ifdef _WIN32
+#define PATH_SEP '\\'
+#else
+#define PATH_SEP '/'
+#endif
+
+// One append stream: its own record chunks and its own string block
+typedef struct {
+    DirRecord **chunks;
+    size_t num_chunks;
+    size_t max_chunks;
+    uint64_t count;
+    char *block;                      // string block being filled
+    uint64_t block_base;              // pool offset of `block`
+    size_t block_used;
+} DirWriter;
+
+struct DirStore {
+    char *root;
+    DirRecord totals;                 // the root's sizes and counts
+    DirWriter main;                   // the store's records (and single-writer appends)
+    DirWriter *writers;               // parallel building only
+    int num_writers;
+
+    // Kept after dirstore_splice() to resolve writer references: per writer,
+    // records in full chunks, index of its first full-chunk record and of
+    // its first tail record
+    uint64_t *ref_full;
+    uint64_t *ref_full_base;
+    uint64_t *ref_tail_base;
+    int num_refs;
+
+    // String pool, shared: blocks are reserved under the lock, then filled
+    // without it by the writer that owns them
+    pthread_mutex_t pool_lock;
+    char **blocks;
+    size_t num_blocks;
+    size_t max_blocks;
+};
+
+DirStore* dirstore_create(const char *root) {
+    DirStore *store = calloc(1, sizeof(DirStore));
+    if (!store) return NULL;
+
+    size_t len = strlen(root) + 1;
+    store->root = malloc(len);
+    if (!store->root) {
+        free(store);
+        return NULL;
+    }
+    memcpy(store->root, root, len);
+    store->totals.parent = DIRSTORE_NONE;
+    store->totals.name_off = UINT64_MAX;
+    pthread_mutex_init(&store->pool_lock, NULL);
+    return store;
+}
+
+static void writer_free(DirWriter *w) {
+    for (size_t i = 0; i < w->num_chunks; i++) {
+        free(w->chunks[i]);
+    }
+    free(w->chunks);
+    memset(w, 0, sizeof(*w));
+}
+
+void dirstore_free(DirStore *store) {
+    if (!store) return;
+    writer_free(&store->main);
+    for (int i = 0; i < store->num_writers; i++) {
+        writer_free(&store->writers[i]);
+    }
+    free(store->writers);
+    free(store->ref_full);
+    free(store->ref_full_base);
+    free(store->ref_tail_base);
+    for (size_t i = 0; i < store->num_blocks; i++) {
+        free(store->blocks[i]);
+    }
+    free(store->blocks);
+    pthread_mutex_destroy(&store->pool_lock);
+    free(store->root);
+    free(store);
+}
+
+// Reserve a fresh pool block for `w`
+static int pool_new_block(DirStore *store, DirWriter *w) {
+    char *block = malloc(POOL_BLOCK_SIZE);
+    if (!block) return -1;
+
+    pthread_mutex_lock(&store->pool_lock);
+    if (store->num_blocks == store->max_blocks) {
+        size_t new_max = store->max_blocks ? store->max_blocks * 2 : 16;
+        char **grown = realloc(store->blocks, new_max * sizeof(char *));
+        if (!grown) {
+            pthread_mutex_unlock(&store->pool_lock);
+            free(block);
+            return -1;
+        }
+        store->blocks = grown;
+        store->max_blocks = new_max;
+    }
+    size_t index = store->num_blocks++;
+    store->blocks[index] = block;
+    pthread_mutex_unlock(&store->pool_lock);
+
+    w->block = block;
+    w->block_base = (uint64_t)index * POOL_BLOCK_SIZE;
+    w->block_used = 0;
+    return 0;
+}
+
+// Copy a name into the writer's block. Returns its pool offset or UINT64_MAX.
+static uint64_t pool_add(DirStore *store, DirWriter *w, const char *name) {
+    size_t len = strlen(name);
+    if (len > POOL_BLOCK_SIZE - 1) len = POOL_BLOCK_SIZE - 1; // longer than any path component
+
+    if (!w->block || w->block_used + len + 1 > POOL_BLOCK_SIZE) {
+        if (pool_new_block(store, w) != 0) return UINT64_MAX;
+    }
+    uint64_t off = w->block_base + w->block_used;
+    memcpy(w->block + w->block_used, name, len);
+    w->block[w->block_used + len] = '\0';
+    w->block_used += len + 1;
+    return off;
+}
+
+// Next free record of the writer (chunk allocated on demand)
+static DirRecord* writer_next(DirWriter *w) {
+    size_t chunk = (size_t)(w->count >> CHUNK_SHIFT);
+    if (chunk == w->num_chunks) {
+        if (w->num_chunks == w->max_chunks) {
+            size_t new_max = w->max_chunks ? w->max_chunks * 2 : 16;
+            DirRecord **grown = realloc(w->chunks, new_max * sizeof(DirRecord *));
+            if (!grown) return NULL;
+            w->chunks = grown;
+            w->max_chunks = new_max;
+        }
+        DirRecord *records = malloc(CHUNK_RECORDS * sizeof(DirRecord));
+        if (!records) return NULL;
+        w->chunks[w->num_chunks++] = records;
+    }
+    return &w->chunks[chunk][w->count & (CHUNK_RECORDS - 1)];
+}
+
+static DirRecord* writer_add(DirStore *store, DirWriter *w, const char *name) {
+    DirRecord *rec = writer_next(w);
+    if (!rec) return NULL;
+    uint64_t off = pool_add(store, w, name);
+    if (off == UINT64_MAX) return NULL;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->parent = DIRSTORE_NONE;
+    rec->name_off = off;
+    w->count++;
+    return rec;
+}
+
+uint64_t dirstore_add(DirStore *store, uint64_t parent, const char *name,
+                      uint64_t size, uint64_t alloc_size) {
+    DirRecord *rec = writer_add(store, &store->main, name);
+    if (!rec) return DIRSTORE_NONE;
+    rec->size = size;
+    rec->alloc_size = alloc_size;
+    rec->parent = parent;
+    return store->main.count - 1;
+}
+
+uint64_t dirstore_count(const DirStore *store) {
+    return store->main.count;
+}
+
+const char* dirstore_root(const DirStore *store) {
+    return store->root;
+}
+
+DirRecord* dirstore_totals(const DirStore *store) {
+    return (DirRecord *)&store->totals;
+}
+
+DirRecord* dirstore_get(const DirStore *store, uint64_t index) {
+    return &store->main.chunks[index >> CHUNK_SHIFT][index & (CHUNK_RECORDS - 1)];
+}
+
+const char* dirstore_name(const DirStore *store, uint64_t index) {
+    uint64_t off = dirstore_get(store, index)->name_off;
+    return store->blocks[off / POOL_BLOCK_SIZE] + off % POOL_BLOCK_SIZE;
+}
+
+char* dirstore_path(const DirStore *store, uint64_t index) {
+    size_t root_len = strlen(store->root);
+    while (root_len > 1 && (store->root[root_len - 1] == '/' || store->root[root_len - 1] == '\\')) {
+        root_len--; // root given with a trailing separator
+    }
+
+    size_t len = root_len;
+    for (uint64_t i = index; i != DIRSTORE_NONE; i = dirstore_get(store, i)->parent) {
+        len += strlen(dirstore_name(store, i)) + 1;
+    }
+
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+
+    // Fill from the end: name, separator, parent name, ..., root
+    char *p = out + len;
+    *p = '\0';
+    for (uint64_t i = index; i != DIRSTORE_NONE; i = dirstore_get(store, i)->parent) {
+        const char *name = dirstore_name(store, i);
+        size_t nlen = strlen(name);
+        p -= nlen;
+        memcpy(p, name, nlen);
+        *--p = PATH_SEP;
+    }
+    memcpy(out, store->root, root_len);
+    if (root_len == 1 && out[0] == PATH_SEP) {
+        // "/" + "/usr": drop the doubled separator
+        memmove(out + 1, out + 2, len - 1);
+    }
+    return out;
+}
+
+int dirstore_is_ancestor(const DirStore *store, uint64_t ancestor, uint64_t index) {
+    for (uint64_t i = index; i != DIRSTORE_NONE; i = dirstore_get(store, i)->parent) {
+        if (i == ancestor) return 1;
+    }
+    return 0;
+}
+
+uint64_t dirstore_memory(const DirStore *store) {
+    return (uint64_t)store->main.num_chunks * CHUNK_RECORDS * sizeof(DirRecord) +
+           (uint64_t)store->num_blocks * POOL_BLOCK_SIZE;
+}
+
+int dirstore_begin_parallel(DirStore *store, int num_writers) {
+    if (store->main.count > 0 || store->writers) return -1;
+    store->writers = calloc((size_t)num_writers, sizeof(DirWriter));
+    if (!store->writers) return -1;
+    store->num_writers = num_writers;
+    return 0;
+}
+
+DirRecord* dirstore_writer_add(DirStore *store, int writer, const char *name, uint64_t *ref) {
+    DirWriter *w = &store->writers[writer];
+    DirRecord *rec = writer_add(store, w, name);
+    if (!rec) return NULL;
+    *ref = DIRSTORE_REF(writer, w->count - 1);
+    return rec;
+}
+
+uint64_t dirstore_resolve_ref(const DirStore *store, uint64_t ref) {
+    if (ref == DIRSTORE_NONE) return DIRSTORE_NONE;
+    int w = (int)(ref >> DIRSTORE_REF_SHIFT);
+    if (w >= store->num_refs) return DIRSTORE_NONE;
+    uint64_t local = ref & REF_LOCAL_MASK;
+    return local < store->ref_full[w] ? store->ref_full_base[w] + local
+                                      : store->ref_tail_base[w] + (local - store->ref_full[w]);
+}
+
+int dirstore_splice(DirStore *store) {
+    int n = store->num_writers;
+    uint64_t *full = malloc((size_t)n * sizeof(uint64_t));
+    uint64_t *full_base = malloc((size_t)n * sizeof(uint64_t));
+    uint64_t *tail_base = malloc((size_t)n * sizeof(uint64_t));
+    if (!full || !full_base || !tail_base) {
+        free(full);
+        free(full_base);
+        free(tail_base);
+        return -1;
+    }
+
+    // Full chunks keep their place in line; the partial last chunks of all
+    // writers are packed behind them
+    size_t full_chunks = 0;
+    uint64_t tail_records = 0;
+    for (int w = 0; w < n; w++) {
+        full[w] = store->writers[w].count & ~(uint64_t)(CHUNK_RECORDS - 1);
+        full_base[w] = (uint64_t)full_chunks << CHUNK_SHIFT;
+        full_chunks += (size_t)(store->writers[w].count >> CHUNK_SHIFT);
+        tail_records += store->writers[w].count & (CHUNK_RECORDS - 1);
+    }
+    uint64_t tail_start = (uint64_t)full_chunks << CHUNK_SHIFT;
+    uint64_t total = tail_start + tail_records;
+    size_t num_chunks = full_chunks + (size_t)((tail_records + CHUNK_RECORDS - 1) >> CHUNK_SHIFT);
+
+    DirWriter *main = &store->main;
+    main->chunks = malloc((num_chunks ? num_chunks : 1) * sizeof(DirRecord *));
+    if (!main->chunks) {
+        free(full);
+        free(full_base);
+        free(tail_base);
+        return -1;
+    }
+    main->max_chunks = num_chunks ? num_chunks : 1;
+    for (size_t c = full_chunks; c < num_chunks; c++) {
+        main->chunks[c] = malloc(CHUNK_RECORDS * sizeof(DirRecord));
+        if (!main->chunks[c]) {
+            main->num_chunks = c; // only the tail chunks are owned yet
+            for (size_t k = full_chunks; k < c; k++) free(main->chunks[k]);
+            free(main->chunks);
+            memset(main, 0, sizeof(*main));
+            free(full);
+            free(full_base);
+            free(tail_base);
+            return -1;
+        }
+    }
+
+    size_t next_chunk = 0;
+    uint64_t tail_pos = tail_start;
+    for (int w = 0; w < n; w++) {
+        DirWriter *wr = &store->writers[w];
+        size_t wfull = (size_t)(wr->count >> CHUNK_SHIFT);
+        for (size_t c = 0; c < wfull; c++) {
+            main->chunks[next_chunk++] = wr->chunks[c];
+        }
+
+        tail_base[w] = tail_pos;
+        uint64_t wtail = wr->count & (CHUNK_RECORDS - 1);
+        const DirRecord *src = wtail ? wr->chunks[wfull] : NULL;
+        for (uint64_t copied = 0; copied < wtail; ) {
+            // The packed tail may straddle a chunk boundary
+            uint64_t room = CHUNK_RECORDS - (tail_pos & (CHUNK_RECORDS - 1));
+            uint64_t take = wtail - copied < room ? wtail - copied : room;
+            memcpy(&main->chunks[tail_pos >> CHUNK_SHIFT][tail_pos & (CHUNK_RECORDS - 1)],
+                   src + copied, (size_t)take * sizeof(DirRecord));
+            copied += take;
+            tail_pos += take;
+        }
+
+        if (wtail) free(wr->chunks[wfull]);
+        free(wr->chunks);
+    }
+    main->num_chunks = num_chunks;
+    main->count = total;
+
+    free(store->writers);
+    store->writers = NULL;
+    store->num_writers = 0;
+    store->ref_full = full;
+    store->ref_full_base = full_base;
+    store->ref_tail_base = tail_base;
+    store->num_refs = n;
+
+    // Writer-local parent references -> record indices
+    for (uint64_t i = 0; i < total; i++) {
+        DirRecord *rec = dirstore_get(store, i);
+        rec->parent = dirstore_resolve_ref(store, rec->parent);
+    }
+    return 0;
+}
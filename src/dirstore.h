@@ -0,0 +1,80 @@
+#ifndef DIRSTORE_H
+#define DIRSTORE_H
+
+#include <stdint.h>
+
+// Compact store of scanned directories.
+// A record holds the sizes and entry counts, the index of its parent record
+// and the offset of its name (one path component) in a string pool; full
+// paths are rebuilt on demand from the parent chain. Records live in fixed-size chunks that never
+// move, so a record pointer stays valid while the store grows.
+
+#define DIRSTORE_NONE UINT64_MAX      // parent of directories directly under the root
+
+typedef struct {
+    uint64_t size;                    // logical bytes
+    uint64_t alloc_size;              // allocated bytes
+    uint64_t parent;                  // record index or DIRSTORE_NONE
+    uint64_t name_off;                // name offset in the string pool
+    uint64_t files;                   // regular files in the subtree
+    uint64_t dirs;                    // directories in the subtree, itself excluded
+    uint64_t inodes;                  // every inode in the subtree (files, directories,
+                                      // links, devices...), itself included
+    uint32_t direct_files;            // regular files listed directly in it
+    uint32_t direct_dirs;             // subdirectories listed directly in it
+    uint64_t stamp;                   // fingerprint of the directory's identity and
+                                      // timestamps when listed (0: unknown)
+} DirRecord;
+
+typedef struct DirStore DirStore;
+
+// `root` is the scanned path, the prefix of every rebuilt path
+DirStore* dirstore_create(const char *root);
+void dirstore_free(DirStore *store);
+
+// Append a record (single writer). Returns its index, DIRSTORE_NONE when out of memory.
+uint64_t dirstore_add(DirStore *store, uint64_t parent, const char *name,
+                      uint64_t size, uint64_t alloc_size);
+
+uint64_t dirstore_count(const DirStore *store);
+const char* dirstore_root(const DirStore *store);
+
+// Sizes and counts of the scanned root itself, which has no record
+// (parent and name_off unused)
+DirRecord* dirstore_totals(const DirStore *store);
+DirRecord* dirstore_get(const DirStore *store, uint64_t index);
+const char* dirstore_name(const DirStore *store, uint64_t index);
+
+// Full path of a record (malloc'd, caller frees)
+char* dirstore_path(const DirStore *store, uint64_t index);
+
+// 1 if `ancestor` is `index` or one of its parents
+int dirstore_is_ancestor(const DirStore *store, uint64_t ancestor, uint64_t index);
+
+// Bytes held by records and names
+uint64_t dirstore_memory(const DirStore *store);
+
+// Parallel building: every writer appends to its own chunks and reserves
+// string pool blocks for itself, so appends never contend. Records get a
+// writer-local reference; parent fields may hold such references (or
+// DIRSTORE_NONE) until dirstore_splice() turns them into indices.
+#define DIRSTORE_REF_SHIFT 40
+#define DIRSTORE_REF(writer, local) (((uint64_t)(writer) << DIRSTORE_REF_SHIFT) | (uint64_t)(local))
+
+// Prepare `num_writers` writers on an empty store. Returns 0 or -1.
+int dirstore_begin_parallel(DirStore *store, int num_writers);
+
+// Append for `writer` (only that writer's thread may call this). Returns the
+// record, whose parent and sizes the caller fills in, or NULL when out of
+// memory. *ref receives its writer-local reference.
+DirRecord* dirstore_writer_add(DirStore *store, int writer, const char *name, uint64_t *ref);
+
+// Join the writers' chunks into the store (full chunks are moved, partial
+// tails packed) and resolve parent references to indices. Returns 0 or -1.
+int dirstore_splice(DirStore *store);
+
+// Index of the record behind a writer reference kept elsewhere (valid after
+// dirstore_splice(); DIRSTORE_NONE stays DIRSTORE_NONE)
+uint64_t dirstore_resolve_ref(const DirStore *store, uint64_t ref);
+
+#endif
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dirtree.h"
+#include "workpool.h"
+
+// Passes over fewer nodes than this stay on the calling thread
+#define DIRTREE_PARALLEL_MIN 65536
+
+// A record waiting to be placed, keyed by its size
+typedef struct {
+    uint64_t key;
+    uint64_t record;
+    const char *name;
+} TreeSlot;
+
+// Descending by size; ties go by name, so the layout does not depend on the
+// order the records were stored in (which varies with scan threads and
+// between a scan and a loaded cache)
+static int compare_slots(const void *a, const void *b) {
+    const TreeSlot *sa = (const TreeSlot *)a;
+    const TreeSlot *sb = (const TreeSlot *)b;
+    if (sa->key != sb->key) return sa->key < sb->key ? 1 : -1;
+    int names = strcmp(sa->name, sb->name);
+    if (names != 0) return names;
+    if (sa->record != sb->record) return sa->record < sb->record ? -1 : 1;
+    return 0;
+}
+
+// Run fn over [begin, end), split in one range per worker
+typedef void (*RangeFn)(uint64_t begin, uint64_t end, void *arg);
+
+typedef struct {
+    RangeFn fn;
+    void *arg;
+    uint64_t begin;
+    uint64_t end;
+} RangeTask;
+
+static void range_task(WorkPool *pool, int worker, void *arg) {
+    (void)pool;
+    (void)worker;
+    RangeTask *task = (RangeTask *)arg;
+    task->fn(task->begin, task->end, task->arg);
+}
+
+static void parallel_for(int num_threads, uint64_t begin, uint64_t end, RangeFn fn, void *arg) {
+    if (num_threads <= 1 || end - begin < DIRTREE_PARALLEL_MIN) {
+        fn(begin, end, arg);
+        return;
+    }
+    WorkPool *pool = workpool_create(num_threads, NULL);
+    RangeTask *tasks = malloc((size_t)num_threads * sizeof(RangeTask));
+    if (!pool || !tasks) {
+        if (pool) workpool_destroy(pool);
+        free(tasks);
+        fn(begin, end, arg);
+        return;
+    }
+    uint64_t step = (end - begin + (uint64_t)num_threads - 1) / (uint64_t)num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        uint64_t lo = begin + step * (uint64_t)i;
+        uint64_t hi = lo + step < end ? lo + step : end;
+        tasks[i].fn = fn;
+        tasks[i].arg = arg;
+        tasks[i].begin = lo < end ? lo : end;
+        tasks[i].end = hi;
+        workpool_push(pool, i, range_task, &tasks[i]);
+    }
+    workpool_run(pool);
+    workpool_destroy(pool);
+    free(tasks);
+}
+
+// Sort the children of every parent slot in [begin, end)
+typedef struct {
+    TreeSlot *slots;
+    const uint64_t *start;
+} SortPass;
+
+static void sort_children(uint64_t begin, uint64_t end, void *arg) {
+    SortPass *pass = (SortPass *)arg;
+    for (uint64_t s = begin; s < end; s++) {
+        uint64_t n = pass->start[s + 1] - pass->start[s];
+        if (n > 1) qsort(pass->slots + pass->start[s], (size_t)n, sizeof(TreeSlot), compare_slots);
+    }
+}
+
+// own = subtree - recorded children
+static void split_own(uint64_t begin, uint64_t end, void *arg) {
+    DirTree *tree = (DirTree *)arg;
+    for (uint64_t n = begin; n < end; n++) {
+        uint64_t size = 0, alloc = 0;
+        for (uint64_t c = tree->child_start[n]; c < tree->child_start[n + 1]; c++) {
+            size += tree->size[c];
+            alloc += tree->alloc_size[c];
+        }
+        tree->own_size[n] = tree->size[n] > size ? tree->size[n] - size : 0;
+        tree->own_alloc[n] = tree->alloc_size[n] > alloc ? tree->alloc_size[n] - alloc : 0;
+    }
+}
+
+// subtree = own + children (children are on the next level, already done)
+static void sum_children(uint64_t begin, uint64_t end, void *arg) {
+    DirTree *tree = (DirTree *)arg;
+    for (uint64_t n = begin; n < end; n++) {
+        uint64_t size = tree->own_size[n], alloc = tree->own_alloc[n];
+        for (uint64_t c = tree->child_start[n]; c < tree->child_start[n + 1]; c++) {
+            size += tree->size[c];
+            alloc += tree->alloc_size[c];
+        }
+        tree->size[n] = size;
+        tree->alloc_size[n] = alloc;
+    }
+}
+
+void dirtree_free(DirTree *tree) {
+    if (!tree) return;
+    free(tree->record);
+    free(tree->parent);
+    free(tree->child_start);
+    free(tree->size);
+    free(tree->alloc_size);
+    free(tree->own_size);
+    free(tree->own_alloc);
+    free(tree->level_start);
+    free(tree);
+}
+
+DirTree* dirtree_build(const DirStore *store, uint64_t total_size, uint64_t total_alloc,
+                       int num_threads) {
+    uint64_t records = dirstore_count(store);
+    uint64_t nodes = records + 1;
+    if (num_threads <= 0) num_threads = workpool_cpu_count();
+
+    DirTree *tree = calloc(1, sizeof(DirTree));
+    if (!tree) return NULL;
+    tree->num_threads = num_threads;
+    tree->record = malloc(nodes * sizeof(uint64_t));
+    tree->parent = malloc(nodes * sizeof(uint64_t));
+    tree->child_start = malloc((nodes + 1) * sizeof(uint64_t));
+    tree->size = malloc(nodes * sizeof(uint64_t));
+    tree->alloc_size = malloc(nodes * sizeof(uint64_t));
+    tree->own_size = malloc(nodes * sizeof(uint64_t));
+    tree->own_alloc = malloc(nodes * sizeof(uint64_t));
+    tree->level_start = malloc((nodes + 1) * sizeof(uint64_t));
+
+    // Children grouped by parent in store order: slot 0 is the root, record
+    // r is slot r + 1
+    uint64_t *start = calloc(nodes + 1, sizeof(uint64_t));
+    uint64_t *cursor = malloc(nodes * sizeof(uint64_t));
+    TreeSlot *slots = malloc((records ? records : 1) * sizeof(TreeSlot));
+    if (!tree->record || !tree->parent || !tree->child_start || !tree->size ||
+        !tree->alloc_size || !tree->own_size || !tree->own_alloc || !tree->level_start ||
+        !start || !cursor || !slots) {
+        free(start);
+        free(cursor);
+        free(slots);
+        dirtree_free(tree);
+        return NULL;
+    }
+
+    for (uint64_t r = 0; r < records; r++) {
+        uint64_t p = dirstore_get(store, r)->parent;
+        start[(p < records ? p + 1 : 0) + 1]++;
+    }
+    for (uint64_t s = 0; s < nodes; s++) {
+        start[s + 1] += start[s];
+        cursor[s] = start[s];
+    }
+    for (uint64_t r = 0; r < records; r++) {
+        const DirRecord *rec = dirstore_get(store, r);
+        uint64_t s = rec->parent < records ? rec->parent + 1 : 0;
+        slots[cursor[s]].key = rec->size;
+        slots[cursor[s]].record = r;
+        slots[cursor[s]].name = dirstore_name(store, r);
+        cursor[s]++;
+    }
+    free(cursor);
+
+    SortPass sort_pass = { slots, start };
+    parallel_for(num_threads, 0, nodes, sort_children, &sort_pass);
+
+    // Breadth-first numbering: appending the children of each node in turn
+    // makes every child range (and every level) contiguous
+    tree->record[0] = DIRSTORE_NONE;
+    tree->parent[0] = DIRTREE_NONE;
+    tree->size[0] = total_size;
+    tree->alloc_size[0] = total_alloc;
+    tree->level_start[0] = 0;
+    tree->num_levels = 1;
+    uint64_t tail = 1;
+    uint64_t level_end = 1;
+    for (uint64_t head = 0; head < tail; head++) {
+        if (head == level_end) {
+            tree->level_start[tree->num_levels++] = head;
+            level_end = tail;
+        }
+        tree->child_start[head] = tail;
+        uint64_t s = head == 0 ? 0 : tree->record[head] + 1;
+        for (uint64_t k = start[s]; k < start[s + 1]; k++) {
+            const DirRecord *rec = dirstore_get(store, slots[k].record);
+            tree->record[tail] = slots[k].record;
+            tree->parent[tail] = head;
+            tree->size[tail] = rec->size;
+            tree->alloc_size[tail] = rec->alloc_size;
+            tail++;
+        }
+    }
+    // Records whose parent chain loops never get reached (only a corrupt
+    // cache could hold those)
+    tree->count = tail;
+    tree->child_start[tail] = tail;
+    tree->level_start[tree->num_levels] = tail;
+    free(start);
+    free(slots);
+
+    parallel_for(num_threads, 0, tree->count, split_own, tree);
+    return tree;
+}
+
+void dirtree_rollup(DirTree *tree) {
+    for (uint32_t d = tree->num_levels; d-- > 0; ) {
+        parallel_for(tree->num_threads, tree->level_start[d], tree->level_start[d + 1],
+                     sum_children, tree);
+    }
+}
+
+uint64_t dirtree_child_count(const DirTree *tree, uint64_t node) {
+    return tree->child_start[node + 1] - tree->child_start[node];
+}
+
+uint32_t dirtree_depth(const DirTree *tree, uint64_t node) {
+    // Levels are contiguous and ascending: binary search their starts
+    uint32_t lo = 0, hi = tree->num_levels;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (tree->level_start[mid] <= node) lo = mid; else hi = mid;
+    }
+    return lo;
+}
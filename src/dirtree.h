@@ -0,0 +1,46 @@
+#ifndef DIRTREE_H
+#define DIRTREE_H
+
+#include <stdint.h>
+#include "dirstore.h"
+
+// Compressed-sparse-row view of a DirStore.
+// Nodes are numbered breadth-first from the scanned root (node 0), so the
+// children of a node and every depth level are contiguous node ranges:
+// subtree sums, child listings and per-level (du --max-depth) queries are
+// plain array scans with no path strings involved. Children are ordered by
+// decreasing size.
+
+#define DIRTREE_NONE UINT64_MAX
+
+typedef struct {
+    uint64_t count;                   // nodes, the root included
+    uint64_t *record;                 // node -> store record (DIRSTORE_NONE for the root)
+    uint64_t *parent;                 // node -> parent node (DIRTREE_NONE for the root)
+    uint64_t *child_start;            // children of n: child_start[n] .. child_start[n + 1] - 1
+    uint64_t *size;                   // subtree totals
+    uint64_t *alloc_size;
+    uint64_t *own_size;               // subtree minus recorded children (loose files and
+    uint64_t *own_alloc;              // directories too small to be recorded)
+    uint64_t *level_start;            // nodes at depth d: level_start[d] .. level_start[d + 1] - 1
+    uint32_t num_levels;
+    int num_threads;                  // workers for the parallel passes
+} DirTree;
+
+// Build the tree of `store`; the root gets the scan totals. Per-node passes
+// run on `num_threads` workers (0 = one per CPU) when the tree is large.
+// Returns NULL when out of memory.
+DirTree* dirtree_build(const DirStore *store, uint64_t total_size, uint64_t total_alloc,
+                       int num_threads);
+void dirtree_free(DirTree *tree);
+
+// Recompute every subtree total from the own sizes, deepest level first
+// (one pass over the nodes). Call after changing own_size / own_alloc.
+void dirtree_rollup(DirTree *tree);
+
+uint64_t dirtree_child_count(const DirTree *tree, uint64_t node);
+
+// Depth of `node` (0 for the root)
+uint32_t dirtree_depth(const DirTree *tree, uint64_t node);
+
+#endif
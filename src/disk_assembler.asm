@@ -1,9 +1,7 @@
 section .text 
     global quick_add
-    global compare_sizes 
     global fast_strcmp_dot
     global fast_strcmp_dotdot
-    global atomic_inc_file_count
     global fast_should_skip
     global fast_wstrcmp_dot
     global fast_wstrcmp_dotdot
@@ -17,20 +15,6 @@ quick_add:
     lock add qword [rcx], rdx        ; atomic *total += value
     ret 
 
-; int compare_sizes(const void *a, const void *b)
-; compare sizes of two structs DirInfo to qsort 
-; decrecent order (bigger first)
-; Windows x64 calling convention: rcx = DirInfo pointer a, rdx = DirInfo pointer b
-; return: rax = difference (if a > b = negative, if b > a = positive)
-compare_sizes: 
-    ; 'size' field offset in DirInfo struct 
-    ; char path[4096] + uint64_t size
-    ; size is in offset 4096
-
-    mov rax, [rdx + 4096]           ; rax = b->size 
-    sub rax, [rcx + 4096]           ; rax = b->size - a->size
-    ret                             ; returns the difference
-
 ; int fast_strcmp_dot(const char *str)
 ; fast check if string equals "."
 ; Windows x64: rcx = string pointer
@@ -100,13 +84,6 @@ fast_wstrcmp_dotdot:
     xor rax, rax
     ret
 
-; void atomic_inc_file_count(int *file_count)
-; Atomic increment of file counter without mutex
-; Windows x64: rcx = pointer to file_count
-atomic_inc_file_count: 
-    lock inc dword[rcx]             ; atomic (*file_count)++
-    ret 
-
 ; int fast_should_skip(const char *name)
 ; fast dffirectory name chacking against skip list
 ; Windows x64: rcx = directory name pointer 
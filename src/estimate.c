@@ -0,0 +1,109 @@
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/statvfs.h>
+#endif
+#include "estimate.h"
+#include "cache.h"
+
+// Nothing is said about the time left before this much is done
+#define ESTIMATE_MIN_FRACTION 0.01
+#define ESTIMATE_MIN_SECONDS 2.0
+// Held below this until the scan ends
+#define ESTIMATE_MAX_RUNNING 0.99
+
+// Totals of the last cached scan covering `path`; 0 or -1 without one
+static int estimate_from_snapshot(ScanEstimate *est, const char *path) {
+    ScanOptions any = {0};
+    int result;
+    uint64_t entry;
+    CacheView *view = cache_view_open_covering(path, &any, &result, &entry);
+    if (!view) return -1;
+
+    int status = 0;
+    if (entry == DIRSTORE_NONE) {
+        const CacheHeader *header = cache_view_header(view);
+        est->bytes = header->total_size;
+        est->inodes = header->file_count + header->dir_total;
+    } else {
+        CacheViewEntry e;
+        if (cache_view_entry(view, entry, &e) == 0) {
+            est->bytes = e.rec.size;
+            est->inodes = e.rec.files + e.rec.dirs;
+        } else {
+            status = -1;
+        }
+    }
+    cache_view_close(view);
+    return status == 0 && (est->bytes || est->inodes) ? 0 : -1;
+}
+
+// Space and inodes in use on the volume holding `path`; 0 or -1
+static int estimate_from_filesystem(ScanEstimate *est, const char *path) {
+#ifdef _WIN32
+    wchar_t wpath[MAX_PATH_LEN];
+    ULARGE_INTEGER avail, total, free_bytes;
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH_LEN) <= 0 ||
+        !GetDiskFreeSpaceExW(wpath, &avail, &total, &free_bytes)) {
+        return -1;
+    }
+    est->bytes = total.QuadPart - free_bytes.QuadPart;
+    est->inodes = 0;
+#else
+    struct statvfs vfs;
+    if (statvfs(path, &vfs) != 0) return -1;
+    est->bytes = (uint64_t)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+    // Some filesystems allocate inodes on demand and report none
+    est->inodes = vfs.f_files > vfs.f_ffree ? (uint64_t)(vfs.f_files - vfs.f_ffree) : 0;
+#endif
+    return est->bytes || est->inodes ? 0 : -1;
+}
+
+void estimate_begin(ScanEstimate *est, const char *path) {
+    memset(est, 0, sizeof(*est));
+    if (estimate_from_snapshot(est, path) == 0) {
+        est->source = ESTIMATE_SNAPSHOT;
+    } else if (estimate_from_filesystem(est, path) == 0) {
+        est->source = ESTIMATE_FILESYSTEM;
+    } else {
+        est->bytes = 0;
+        est->inodes = 0;
+    }
+}
+
+static double estimate_part(uint64_t done, uint64_t expected) {
+    if (expected == 0) return -1.0;
+    return done >= expected ? 1.0 : (double)done / (double)expected;
+}
+
+double estimate_update(ScanEstimate *est, const ScanProgress *snap, double *eta_seconds) {
+    if (eta_seconds) *eta_seconds = -1.0;
+    if (!snap->running) {
+        // Finished (not just about to start): whatever was expected, it is
+        // all there is
+        if (est->started) est->fraction = 1.0;
+        return est->fraction;
+    }
+    est->started = 1;
+
+    double by_bytes = estimate_part(snap->bytes, est->bytes);
+    double by_inodes = estimate_part(snap->files + snap->dirs, est->inodes);
+    double fraction;
+    if (by_bytes >= 0.0 && by_inodes >= 0.0) {
+        fraction = (by_bytes + by_inodes) / 2.0;
+    } else if (by_bytes >= 0.0) {
+        fraction = by_bytes;
+    } else if (by_inodes >= 0.0) {
+        fraction = by_inodes;
+    } else {
+        return est->fraction;
+    }
+    if (fraction > ESTIMATE_MAX_RUNNING) fraction = ESTIMATE_MAX_RUNNING;
+    if (fraction > est->fraction) est->fraction = fraction;
+
+    if (eta_seconds && est->fraction >= ESTIMATE_MIN_FRACTION && snap->elapsed >= ESTIMATE_MIN_SECONDS) {
+        *eta_seconds = snap->elapsed * (1.0 - est->fraction) / est->fraction;
+    }
+    return est->fraction;
+}
@@ -0,0 +1,36 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdint.h>
+#include "scanner.h"
+
+// How far a running scan has come. The expected totals are the last cached
+// snapshot's for the scanned directory (its own cache, or its record in an
+// ancestor's), else what the filesystem reports in use (statvfs; an upper
+// bound below a mount point, and no inode count on Windows). The fraction
+// is the mean of the bytes and inodes fractions, held below 1 until the
+// scan ends and never reported lower than before; the time left assumes
+// the remaining part goes at the average pace so far.
+
+typedef enum {
+    ESTIMATE_NONE = 0,                // nothing to compare against
+    ESTIMATE_FILESYSTEM,              // used space and inodes of the volume
+    ESTIMATE_SNAPSHOT                 // totals of the last cached scan
+} EstimateSource;
+
+typedef struct {
+    EstimateSource source;
+    uint64_t bytes;                   // expected logical (snapshot) or used bytes, 0 unknown
+    uint64_t inodes;                  // expected files + directories, 0 unknown
+    double fraction;                  // last reported, 0..1
+    int started;                      // the scan was seen running
+} ScanEstimate;
+
+// Expected totals for a scan of `path` (cache_init() first for snapshots)
+void estimate_begin(ScanEstimate *est, const char *path);
+
+// Fraction done for a progress snapshot of that scan; *eta_seconds (may be
+// NULL) receives the seconds left, -1 when not known yet
+double estimate_update(ScanEstimate *est, const ScanProgress *snap, double *eta_seconds);
+
+#endif
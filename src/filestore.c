@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include "filestore.h"
+#include "varint.h"
+
+#define FILE_CHUNK_SIZE (1024 * 1024)    // blocks are packed into chunks of this size
+
+// One append stream: the directory being listed is encoded into `scratch`,
+// then copied as a whole block into the current chunk
+typedef struct {
+    unsigned char *scratch;
+    size_t scratch_len;
+    size_t scratch_cap;
+    uint32_t scratch_count;
+    uint64_t other_count;             // files folded so far in this directory
+    uint64_t other_size;
+    uint64_t other_alloc;
+
+    unsigned char **chunks;
+    size_t *chunk_used;
+    size_t num_chunks;
+    size_t max_chunks;
+    size_t chunk_cap;                 // capacity of the last chunk
+    uint64_t entries;
+} FileWriter;
+
+struct FileStore {
+    FileWriter *writers;
+    int num_writers;
+    uint64_t fold_below;
+
+    // Built by filestore_finish()
+    const FileBlock **by_dir;
+    uint64_t dir_count;
+    const FileBlock *root;
+};
+
+FileStore* filestore_create(int num_writers, uint64_t fold_below) {
+    FileStore *files = calloc(1, sizeof(FileStore));
+    if (!files) return NULL;
+    files->writers = calloc((size_t)num_writers, sizeof(FileWriter));
+    if (!files->writers) {
+        free(files);
+        return NULL;
+    }
+    files->num_writers = num_writers;
+    files->fold_below = fold_below;
+    return files;
+}
+
+void filestore_free(FileStore *files) {
+    if (!files) return;
+    for (int i = 0; i < files->num_writers; i++) {
+        FileWriter *w = &files->writers[i];
+        for (size_t c = 0; c < w->num_chunks; c++) {
+            free(w->chunks[c]);
+        }
+        free(w->chunks);
+        free(w->chunk_used);
+        free(w->scratch);
+    }
+    free(files->writers);
+    free(files->by_dir);
+    free(files);
+}
+
+static int scratch_reserve(FileWriter *w, size_t extra) {
+    if (w->scratch_len + extra <= w->scratch_cap) return 0;
+    size_t cap = w->scratch_cap ? w->scratch_cap : 4096;
+    while (cap < w->scratch_len + extra) cap *= 2;
+    unsigned char *grown = realloc(w->scratch, cap);
+    if (!grown) return -1;
+    w->scratch = grown;
+    w->scratch_cap = cap;
+    return 0;
+}
+
+// Encode an entry into the writer's scratch (name NULL: other bucket)
+static int scratch_put(FileWriter *w, const char *name, size_t name_len,
+                       uint64_t count, uint64_t size, uint64_t alloc_size) {
+    if (scratch_reserve(w, name_len + 3 * VARINT_MAX) != 0) return -1;
+    unsigned char *p = w->scratch + w->scratch_len;
+    p += varint_put(p, name_len);
+    if (name) {
+        memcpy(p, name, name_len);
+        p += name_len;
+    } else {
+        p += varint_put(p, count);
+    }
+    p += varint_put(p, size);
+    p += varint_put(p, alloc_size / 512);
+    w->scratch_len = (size_t)(p - w->scratch);
+    w->scratch_count++;
+    return 0;
+}
+
+int filestore_add(FileStore *files, int writer, const char *name, uint64_t size, uint64_t alloc_size) {
+    FileWriter *w = &files->writers[writer];
+    if (size < files->fold_below) {
+        w->other_count++;
+        w->other_size += size;
+        w->other_alloc += alloc_size;
+        return 0;
+    }
+    size_t len = strlen(name);
+    if (len == 0) return 0;
+    return scratch_put(w, name, len, 1, size, alloc_size);
+}
+
+int filestore_copy(FileStore *files, int writer, const FileBlock *block) {
+    FileWriter *w = &files->writers[writer];
+    if (!block) return 0;
+    if (scratch_reserve(w, block->bytes) != 0) return -1;
+    memcpy(w->scratch + w->scratch_len, block + 1, block->bytes);
+    w->scratch_len += block->bytes;
+    w->scratch_count += block->count;
+    return 0;
+}
+
+// Room for `bytes` at 8-byte alignment in the writer's current chunk
+static unsigned char* writer_alloc(FileWriter *w, size_t bytes) {
+    bytes = (bytes + 7) & ~(size_t)7;
+    if (w->num_chunks == 0 || w->chunk_used[w->num_chunks - 1] + bytes > w->chunk_cap) {
+        if (w->num_chunks == w->max_chunks) {
+            size_t new_max = w->max_chunks ? w->max_chunks * 2 : 16;
+            unsigned char **chunks = realloc(w->chunks, new_max * sizeof(unsigned char *));
+            if (!chunks) return NULL;
+            w->chunks = chunks;
+            size_t *used = realloc(w->chunk_used, new_max * sizeof(size_t));
+            if (!used) return NULL;
+            w->chunk_used = used;
+            w->max_chunks = new_max;
+        }
+        // A directory larger than a chunk gets a chunk of its own
+        size_t cap = bytes > FILE_CHUNK_SIZE ? bytes : FILE_CHUNK_SIZE;
+        unsigned char *chunk = malloc(cap);
+        if (!chunk) return NULL;
+        w->chunks[w->num_chunks] = chunk;
+        w->chunk_used[w->num_chunks] = 0;
+        w->num_chunks++;
+        w->chunk_cap = cap;
+    }
+    size_t *used = &w->chunk_used[w->num_chunks - 1];
+    unsigned char *p = w->chunks[w->num_chunks - 1] + *used;
+    *used += bytes;
+    return p;
+}
+
+static FileBlock* writer_block(FileWriter *w, uint64_t dir, uint32_t count,
+                               const void *data, size_t bytes) {
+    FileBlock *block = (FileBlock *)writer_alloc(w, sizeof(FileBlock) + bytes);
+    if (!block) return NULL;
+    block->dir = dir;
+    block->count = count;
+    block->bytes = (uint32_t)bytes;
+    memcpy(block + 1, data, bytes);
+    w->entries += count;
+    return block;
+}
+
+FileBlock* filestore_end_dir(FileStore *files, int writer) {
+    FileWriter *w = &files->writers[writer];
+    if (w->other_count > 0) {
+        scratch_put(w, NULL, 0, w->other_count, w->other_size, w->other_alloc);
+    }
+
+    FileBlock *block = NULL;
+    if (w->scratch_count > 0) {
+        block = writer_block(w, FILESTORE_UNSET, w->scratch_count, w->scratch, w->scratch_len);
+    }
+    w->scratch_len = 0;
+    w->scratch_count = 0;
+    w->other_count = 0;
+    w->other_size = 0;
+    w->other_alloc = 0;
+    return block;
+}
+
+static int filestore_index(FileStore *files, uint64_t dir_count) {
+    free(files->by_dir);
+    files->by_dir = calloc(dir_count ? dir_count : 1, sizeof(FileBlock *));
+    if (!files->by_dir) return -1;
+    files->dir_count = dir_count;
+    files->root = NULL;
+
+    for (int i = 0; i < files->num_writers; i++) {
+        FileWriter *w = &files->writers[i];
+        for (size_t c = 0; c < w->num_chunks; c++) {
+            for (size_t off = 0; off < w->chunk_used[c]; ) {
+                const FileBlock *block = (const FileBlock *)(w->chunks[c] + off);
+                off += (sizeof(FileBlock) + block->bytes + 7) & ~(size_t)7;
+                if (block->dir == DIRSTORE_NONE) {
+                    files->root = block;
+                } else if (block->dir < dir_count) {
+                    files->by_dir[block->dir] = block;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int filestore_finish(FileStore *files, const DirStore *store) {
+    for (int i = 0; i < files->num_writers; i++) {
+        FileWriter *w = &files->writers[i];
+        free(w->scratch);
+        w->scratch = NULL;
+        w->scratch_cap = 0;
+        for (size_t c = 0; c < w->num_chunks; c++) {
+            for (size_t off = 0; off < w->chunk_used[c]; ) {
+                FileBlock *block = (FileBlock *)(w->chunks[c] + off);
+                off += (sizeof(FileBlock) + block->bytes + 7) & ~(size_t)7;
+                if (block->dir != FILESTORE_UNSET) {
+                    block->dir = dirstore_resolve_ref(store, block->dir);
+                }
+            }
+        }
+    }
+    return filestore_index(files, dirstore_count(store));
+}
+
+int filestore_add_block(FileStore *files, int writer, uint64_t dir, uint32_t count,
+                        const void *data, uint32_t bytes) {
+    // Decode the whole block once: it must hold exactly `count` entries
+    FileIter it = { (const unsigned char *)data, (const unsigned char *)data + bytes };
+    FileEntry entry;
+    uint32_t n = 0;
+    while (n <= count && filestore_next(&it, &entry)) n++;
+    if (n != count || it.p != it.end) return -1;
+
+    return writer_block(&files->writers[writer], dir, count, data, bytes) ? 0 : -1;
+}
+
+const FileBlock* filestore_block(const FileStore *files, uint64_t dir) {
+    if (dir == DIRSTORE_NONE) return files->root;
+    return dir < files->dir_count ? files->by_dir[dir] : NULL;
+}
+
+void filestore_iter(const FileStore *files, uint64_t dir, FileIter *it) {
+    const FileBlock *block = filestore_block(files, dir);
+    it->p = block ? (const unsigned char *)(block + 1) : NULL;
+    it->end = block ? it->p + block->bytes : NULL;
+}
+
+int filestore_next(FileIter *it, FileEntry *entry) {
+    if (!it->p || it->p >= it->end) return 0;
+
+    const unsigned char *p = it->p;
+    uint64_t name_len, blocks;
+    if (!(p = varint_get(p, it->end, &name_len)) || name_len > (uint64_t)(it->end - p)) return 0;
+    if (name_len > 0) {
+        entry->name = (const char *)p;
+        entry->count = 1;
+        p += name_len;
+    } else {
+        entry->name = NULL;
+        if (!(p = varint_get(p, it->end, &entry->count))) return 0;
+    }
+    entry->name_len = (uint32_t)name_len;
+    if (!(p = varint_get(p, it->end, &entry->size))) return 0;
+    if (!(p = varint_get(p, it->end, &blocks))) return 0;
+    entry->alloc_size = blocks * 512;
+    it->p = p;
+    return 1;
+}
+
+uint64_t filestore_count(const FileStore *files) {
+    uint64_t entries = 0;
+    for (int i = 0; i < files->num_writers; i++) {
+        entries += files->writers[i].entries;
+    }
+    return entries;
+}
+
+uint64_t filestore_memory(const FileStore *files) {
+    uint64_t bytes = files->dir_count * sizeof(FileBlock *);
+    for (int i = 0; i < files->num_writers; i++) {
+        const FileWriter *w = &files->writers[i];
+        for (size_t c = 0; c < w->num_chunks; c++) {
+            bytes += w->chunk_used[c];
+        }
+        bytes += w->scratch_cap;
+    }
+    return bytes;
+}
+
+uint64_t filestore_fold_below(const FileStore *files) {
+    return files->fold_below;
+}
@@ -0,0 +1,80 @@
+#ifndef FILESTORE_H
+#define FILESTORE_H
+
+#include <stdint.h>
+#include "dirstore.h"
+
+// Compact store of the files of every directory (--retain files).
+// The files of one directory form a block: a FileBlock header followed by
+// one variable-length entry per file,
+//   varint name length, name bytes, varint size, varint allocated size / 512
+// so a file costs its name plus a handful of bytes. An entry with an empty
+// name is the directory's "other" bucket: files under the fold threshold,
+// stored as varint count, varint size, varint allocated size / 512.
+
+#define FILESTORE_UNSET (UINT64_MAX - 1)  // block whose directory was never recorded
+
+typedef struct {
+    uint64_t dir;                     // DirStore record (a writer reference while
+                                      // scanning), DIRSTORE_NONE for the root
+    uint32_t count;                   // entries, the other bucket included
+    uint32_t bytes;                   // encoded entry bytes after the header
+} FileBlock;
+
+// One decoded entry
+typedef struct {
+    const char *name;                 // not NUL-terminated; NULL for the other bucket
+    uint32_t name_len;
+    uint64_t count;                   // 1, or the files folded into the other bucket
+    uint64_t size;
+    uint64_t alloc_size;
+} FileEntry;
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} FileIter;
+
+typedef struct FileStore FileStore;
+
+// `fold_below`: files smaller than this go to their directory's other
+// bucket (0 keeps every file)
+FileStore* filestore_create(int num_writers, uint64_t fold_below);
+void filestore_free(FileStore *files);
+
+// Append a file of the directory `writer` is listing (only that writer's
+// thread may call this). Returns 0 or -1 when out of memory.
+int filestore_add(FileStore *files, int writer, const char *name, uint64_t size, uint64_t alloc_size);
+
+// Append the entries of a block from another store (a directory that did not
+// change since that store was built). Returns 0 or -1 when out of memory.
+int filestore_copy(FileStore *files, int writer, const FileBlock *block);
+
+// Close the directory `writer` was listing. Returns its block, whose `dir`
+// the caller sets once the directory is recorded, or NULL if it had no files.
+// The block stays at the same address for the life of the store.
+FileBlock* filestore_end_dir(FileStore *files, int writer);
+
+// After dirstore_splice(): turn block references into record indices and
+// index the blocks by directory. Returns 0 or -1.
+int filestore_finish(FileStore *files, const DirStore *store);
+
+// Append a whole encoded block for `writer` (cache loading), with `dir` a
+// DirStore writer reference or DIRSTORE_NONE. `data` holds `bytes` encoded
+// bytes; they are checked to decode to exactly `count` entries. Returns 0 or
+// -1. Call filestore_finish() when done.
+int filestore_add_block(FileStore *files, int writer, uint64_t dir, uint32_t count,
+                        const void *data, uint32_t bytes);
+
+// Block of a record (DIRSTORE_NONE for the root), NULL if it has no files
+const FileBlock* filestore_block(const FileStore *files, uint64_t dir);
+
+// Iterate over the files of a directory
+void filestore_iter(const FileStore *files, uint64_t dir, FileIter *it);
+int filestore_next(FileIter *it, FileEntry *entry);   // 1, or 0 at the end
+
+uint64_t filestore_count(const FileStore *files);     // entries, other buckets included
+uint64_t filestore_memory(const FileStore *files);    // bytes held by blocks and the index
+uint64_t filestore_fold_below(const FileStore *files);
+
+#endif
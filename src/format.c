@@ -0,0 +1,16 @@
+#include <stdio.h>
+#include "format.h"
+
+void format_size(uint64_t bytes, char *output) {
+    if (bytes >= 1099511627776ULL) {
+        snprintf(output, FORMAT_SIZE_MAX, "%.2f TB", bytes / 1099511627776.0);
+    } else if (bytes >= 1073741824) {
+        snprintf(output, FORMAT_SIZE_MAX, "%.2f GB", bytes / 1073741824.0);
+    } else if (bytes >= 1048576) {
+        snprintf(output, FORMAT_SIZE_MAX, "%.2f MB", bytes / 1048576.0);
+    } else if (bytes >= 1024) {
+        snprintf(output, FORMAT_SIZE_MAX, "%.2f KB", bytes / 1024.0);
+    } else {
+        snprintf(output, FORMAT_SIZE_MAX, "%llu B", (unsigned long long)bytes);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+
+// Human readable sizes for the report and the watch daemon's log
+
+#define FORMAT_SIZE_MAX 32            // room for any format_size() output
+
+// "1.50 GB", "512 B", ... into `output` (FORMAT_SIZE_MAX bytes)
+void format_size(uint64_t bytes, char *output);
+
+#endif
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+#include "crc32c.h"
+#include "varint.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// A snapshot in memory: items sorted by name (path relative to the root)
+typedef struct {
+    const char *name;                 // into `names`, set by list_seal()
+    uint64_t name_off;
+    uint64_t size;
+    uint64_t alloc_size;
+    uint64_t files;
+} HistoryItem;
+
+typedef struct {
+    HistoryItem *items;
+    uint64_t count;
+    uint64_t cap;
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+} HistoryList;
+
+// Growable byte buffer for payloads and whole files
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} HistoryBuf;
+
+static unsigned char* buf_reserve(HistoryBuf *buf, size_t extra) {
+    if (buf->len + extra > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 64 * 1024;
+        while (cap < buf->len + extra) cap *= 2;
+        unsigned char *grown = realloc(buf->data, cap);
+        if (!grown) return NULL;
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    return buf->data + buf->len;
+}
+
+static int buf_append(HistoryBuf *buf, const void *data, size_t len) {
+    if (len == 0) return 0;
+    unsigned char *p = buf_reserve(buf, len);
+    if (!p) return -1;
+    memcpy(p, data, len);
+    buf->len += len;
+    return 0;
+}
+
+static void list_free(HistoryList *list) {
+    free(list->items);
+    free(list->names);
+    memset(list, 0, sizeof(*list));
+}
+
+static int list_push(HistoryList *list, const char *name, size_t len,
+                     uint64_t size, uint64_t alloc_size, uint64_t files) {
+    if (list->count == list->cap) {
+        uint64_t cap = list->cap ? list->cap * 2 : 1024;
+        HistoryItem *grown = realloc(list->items, cap * sizeof(HistoryItem));
+        if (!grown) return -1;
+        list->items = grown;
+        list->cap = cap;
+    }
+    if (list->names_len + len + 1 > list->names_cap) {
+        size_t cap = list->names_cap ? list->names_cap : 64 * 1024;
+        while (cap < list->names_len + len + 1) cap *= 2;
+        char *grown = realloc(list->names, cap);
+        if (!grown) return -1;
+        list->names = grown;
+        list->names_cap = cap;
+    }
+    HistoryItem *item = &list->items[list->count++];
+    item->name = NULL;
+    item->name_off = list->names_len;
+    item->size = size;
+    item->alloc_size = alloc_size;
+    item->files = files;
+    memcpy(list->names + list->names_len, name, len);
+    list->names[list->names_len + len] = '\0';
+    list->names_len += len + 1;
+    return 0;
+}
+
+// Point the items at their names once the pool stops moving
+static void list_seal(HistoryList *list) {
+    for (uint64_t i = 0; i < list->count; i++) {
+        list->items[i].name = list->names + list->items[i].name_off;
+    }
+}
+
+static int list_copy(const HistoryList *from, HistoryList *to) {
+    memset(to, 0, sizeof(*to));
+    to->items = malloc((from->count ? from->count : 1) * sizeof(HistoryItem));
+    to->names = malloc(from->names_len ? from->names_len : 1);
+    if (!to->items || !to->names) return -1;
+    memcpy(to->items, from->items, from->count * sizeof(HistoryItem));
+    memcpy(to->names, from->names, from->names_len);
+    to->count = to->cap = from->count;
+    to->names_len = to->names_cap = from->names_len;
+    list_seal(to);
+    return 0;
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(((const HistoryItem *)a)->name, ((const HistoryItem *)b)->name);
+}
+
+// The directories of a store, the root first as ""
+static int list_from_store(const DirStore *store, HistoryList *list) {
+    memset(list, 0, sizeof(*list));
+    const DirRecord *totals = dirstore_totals(store);
+    if (list_push(list, "", 0, totals->size, totals->alloc_size, totals->files) != 0) return -1;
+    size_t root_len = strlen(dirstore_root(store));
+    uint64_t count = dirstore_count(store);
+    for (uint64_t i = 0; i < count; i++) {
+        char *path = dirstore_path(store, i);
+        if (!path) return -1;
+        const char *rel = strlen(path) > root_len ? path + root_len : "";
+        if (*rel == '/' || *rel == '\\') rel++;
+        const DirRecord *rec = dirstore_get(store, i);
+        int failed = list_push(list, rel, strlen(rel), rec->size, rec->alloc_size, rec->files) != 0;
+        free(path);
+        if (failed) return -1;
+    }
+    list_seal(list);
+    qsort(list->items, list->count, sizeof(HistoryItem), compare_items);
+    return 0;
+}
+
+// Front-coded name against the previous one of the payload
+static unsigned char* put_name(HistoryBuf *buf, const char *prev, const char *name) {
+    size_t len = strlen(name), shared = 0;
+    while (prev && shared < len && prev[shared] == name[shared]) shared++;
+    unsigned char *p = buf_reserve(buf, (len - shared) + 6 * VARINT_MAX);
+    if (!p) return NULL;
+    p += varint_put(p, shared);
+    p += varint_put(p, len - shared);
+    memcpy(p, name + shared, len - shared);
+    return p + (len - shared);
+}
+
+static void put_values(HistoryBuf *buf, unsigned char *p, const HistoryItem *item) {
+    p += varint_put(p, item->size);
+    p += varint_put(p, zigzag_encode((int64_t)(item->alloc_size - item->size)));
+    p += varint_put(p, item->files);
+    buf->len = (size_t)(p - buf->data);
+}
+
+static const unsigned char* get_name(const unsigned char *p, const unsigned char *end,
+                                     char *name, size_t name_max, size_t *name_len) {
+    uint64_t shared, suffix;
+    if (!(p = varint_get(p, end, &shared)) || shared > *name_len ||
+        !(p = varint_get(p, end, &suffix)) || suffix > (uint64_t)(end - p) ||
+        shared + suffix >= name_max) {
+        return NULL;
+    }
+    memcpy(name + shared, p, suffix);
+    *name_len = shared + suffix;
+    name[*name_len] = '\0';
+    return p + suffix;
+}
+
+static const unsigned char* get_values(const unsigned char *p, const unsigned char *end, HistoryItem *item) {
+    uint64_t alloc_delta;
+    if (!(p = varint_get(p, end, &item->size)) ||
+        !(p = varint_get(p, end, &alloc_delta)) ||
+        !(p = varint_get(p, end, &item->files))) {
+        return NULL;
+    }
+    item->alloc_size = item->size + (uint64_t)zigzag_decode(alloc_delta);
+    return p;
+}
+
+static int encode_full(const HistoryList *list, HistoryBuf *buf) {
+    const char *prev = NULL;
+    for (uint64_t i = 0; i < list->count; i++) {
+        unsigned char *p = put_name(buf, prev, list->items[i].name);
+        if (!p) return -1;
+        put_values(buf, p, &list->items[i]);
+        prev = list->items[i].name;
+    }
+    return 0;
+}
+
+// Delta ops in path order: name, then 0 (removed) or 1 and the new values
+static int put_op(HistoryBuf *buf, const char **prev, const HistoryItem *item, int removed) {
+    unsigned char *p = put_name(buf, *prev, item->name);
+    if (!p) return -1;
+    *p++ = removed ? 0 : 1;
+    if (removed) {
+        buf->len = (size_t)(p - buf->data);
+    } else {
+        put_values(buf, p, item);
+    }
+    *prev = item->name;
+    return 0;
+}
+
+static int encode_delta(const HistoryList *old, const HistoryList *cur, HistoryBuf *buf) {
+    const char *prev = NULL;
+    uint64_t i = 0, j = 0;
+    while (i < old->count || j < cur->count) {
+        int cmp = i == old->count ? 1 : j == cur->count ? -1 :
+                  strcmp(old->items[i].name, cur->items[j].name);
+        int failed = 0;
+        if (cmp < 0) {
+            failed = put_op(buf, &prev, &old->items[i++], 1);
+        } else if (cmp > 0) {
+            failed = put_op(buf, &prev, &cur->items[j++], 0);
+        } else {
+            const HistoryItem *a = &old->items[i++], *b = &cur->items[j++];
+            if (a->size != b->size || a->alloc_size != b->alloc_size || a->files != b->files) {
+                failed = put_op(buf, &prev, b, 0);
+            }
+        }
+        if (failed) return -1;
+    }
+    return 0;
+}
+
+static int decode_full(const unsigned char *p, const unsigned char *end, HistoryList *list) {
+    memset(list, 0, sizeof(*list));
+    char name[4096 * 2];
+    size_t name_len = 0;
+    while (p < end) {
+        HistoryItem item;
+        if (!(p = get_name(p, end, name, sizeof(name), &name_len)) ||
+            !(p = get_values(p, end, &item)) ||
+            list_push(list, name, name_len, item.size, item.alloc_size, item.files) != 0) {
+            return -1;
+        }
+    }
+    list_seal(list);
+    return 0;
+}
+
+// Merge the ops of a delta into `old`, giving the next snapshot
+static int apply_delta(const HistoryList *old, const unsigned char *p, const unsigned char *end,
+                       HistoryList *cur) {
+    memset(cur, 0, sizeof(*cur));
+    char name[4096 * 2];
+    size_t name_len = 0;
+    uint64_t i = 0;
+    while (p < end) {
+        HistoryItem item;
+        if (!(p = get_name(p, end, name, sizeof(name), &name_len)) || p == end) return -1;
+        int removed = *p++ == 0;
+        if (!removed && !(p = get_values(p, end, &item))) return -1;
+
+        // Unchanged paths before the op's
+        while (i < old->count && strcmp(old->items[i].name, name) < 0) {
+            const HistoryItem *o = &old->items[i++];
+            if (list_push(cur, o->name, strlen(o->name), o->size, o->alloc_size, o->files) != 0) return -1;
+        }
+        int found = i < old->count && strcmp(old->items[i].name, name) == 0;
+        if (found) i++;
+        if (removed) {
+            if (!found) return -1;
+        } else if (list_push(cur, name, name_len, item.size, item.alloc_size, item.files) != 0) {
+            return -1;
+        }
+    }
+    for (; i < old->count; i++) {
+        const HistoryItem *o = &old->items[i];
+        if (list_push(cur, o->name, strlen(o->name), o->size, o->alloc_size, o->files) != 0) return -1;
+    }
+    list_seal(cur);
+    return 0;
+}
+
+static uint32_t block_crc(const HistoryBlock *block, const void *payload) {
+    HistoryBlock head = *block;
+    head.crc = 0;
+    return crc32c(crc32c(0, &head, sizeof(head)), payload, block->bytes);
+}
+
+// A history file read whole and checked
+typedef struct {
+    HistoryBuf file;
+    HistoryHeader header;
+    const HistoryBlock **blocks;      // unaligned in `file`, copied before use
+    const unsigned char **payloads;
+} HistoryFile;
+
+static void file_free(HistoryFile *hf) {
+    free(hf->file.data);
+    free(hf->blocks);
+    free(hf->payloads);
+    memset(hf, 0, sizeof(*hf));
+}
+
+static int file_load(const char *path, const char *root, HistoryFile *hf) {
+    memset(hf, 0, sizeof(*hf));
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    unsigned char chunk[64 * 1024];
+    size_t n;
+    int ok = 1;
+    while (ok && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        ok = buf_append(&hf->file, chunk, n) == 0;
+    }
+    fclose(f);
+
+    const unsigned char *base = hf->file.data;
+    size_t size = hf->file.len;
+    size_t root_len = strlen(root);
+    ok = ok && size >= sizeof(HistoryHeader);
+    if (ok) {
+        memcpy(&hf->header, base, sizeof(HistoryHeader));
+        HistoryHeader head = hf->header;
+        head.header_crc = 0;
+        ok = head.magic == HISTORY_MAGIC && head.version == HISTORY_VERSION &&
+             head.root_len == root_len && root_len <= size - sizeof(HistoryHeader) &&
+             memcmp(base + sizeof(HistoryHeader), root, root_len) == 0 &&
+             crc32c(crc32c(0, &head, sizeof(head)), root, root_len) == hf->header.header_crc;
+    }
+    if (ok) {
+        hf->blocks = malloc((hf->header.count ? hf->header.count : 1) * sizeof(HistoryBlock *));
+        hf->payloads = malloc((hf->header.count ? hf->header.count : 1) * sizeof(unsigned char *));
+        ok = hf->blocks && hf->payloads;
+    }
+    size_t off = sizeof(HistoryHeader) + root_len;
+    for (uint32_t k = 0; ok && k < hf->header.count; k++) {
+        HistoryBlock block;
+        ok = size - off >= sizeof(HistoryBlock);
+        if (!ok) break;
+        memcpy(&block, base + off, sizeof(block));
+        hf->blocks[k] = (const HistoryBlock *)(base + off);
+        off += sizeof(HistoryBlock);
+        ok = block.bytes <= size - off && block.kind == (k == 0 ? HISTORY_FULL : HISTORY_DELTA) &&
+             block_crc(&block, base + off) == block.crc;
+        hf->payloads[k] = base + off;
+        off += block.bytes;
+    }
+    if (!ok || off != size) {
+        file_free(hf);
+        return -1;
+    }
+    return 0;
+}
+
+static HistoryBlock file_block(const HistoryFile *hf, size_t k) {
+    HistoryBlock block;
+    memcpy(&block, hf->blocks[k], sizeof(block));
+    return block;
+}
+
+// Snapshot k from snapshot k - 1 (`list`, empty for k = 0), in place
+static int file_step(const HistoryFile *hf, size_t k, HistoryList *list) {
+    HistoryBlock block = file_block(hf, k);
+    const unsigned char *p = hf->payloads[k];
+    HistoryList next;
+    int failed = block.kind == HISTORY_FULL ? decode_full(p, p + block.bytes, &next) :
+                                              apply_delta(list, p, p + block.bytes, &next);
+    list_free(list);
+    if (failed) {
+        list_free(&next);
+        return -1;
+    }
+    *list = next;
+    return 0;
+}
+
+static int put_block(HistoryBuf *out, HistoryBlock block, const HistoryBuf *payload) {
+    block.bytes = (uint32_t)payload->len;
+    block.reserved = 0;
+    block.crc = block_crc(&block, payload->data);
+    return buf_append(out, &block, sizeof(block)) == 0 && buf_append(out, payload->data, payload->len) == 0 ? 0 : -1;
+}
+
+static int write_replace(const char *path, const HistoryBuf *out) {
+    char tmp[4096 + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fwrite(out->data, 1, out->len, f) == out->len;
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp, path) == 0;
+#endif
+    if (!ok) remove(tmp);
+    return ok ? 0 : -1;
+}
+
+int history_append(const char *path, const char *root, const DirStore *store, int64_t created_at) {
+    HistoryList cur, prev, base;
+    memset(&prev, 0, sizeof(prev));
+    memset(&base, 0, sizeof(base));
+    if (list_from_store(store, &cur) != 0) {
+        list_free(&cur);
+        return -1;
+    }
+
+    // Without a readable history of this root, start a new one
+    HistoryFile hf;
+    size_t count = file_load(path, root, &hf) == 0 ? hf.header.count : 0;
+    size_t drop = count + 1 > HISTORY_DEPTH ? count + 1 - HISTORY_DEPTH : 0;
+    int ok = 1;
+    for (size_t k = 0; ok && k < count; k++) {
+        ok = file_step(&hf, k, &prev) == 0;
+        // The oldest kept snapshot becomes the new full base
+        if (ok && drop > 0 && k == drop) {
+            ok = list_copy(&prev, &base) == 0;
+        }
+    }
+    if (!ok) count = drop = 0;
+
+    HistoryBuf out, payload;
+    memset(&out, 0, sizeof(out));
+    memset(&payload, 0, sizeof(payload));
+    HistoryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.count = (uint32_t)(count - drop + 1);
+    header.root_len = strlen(root);
+    header.header_crc = crc32c(crc32c(0, &header, sizeof(header)), root, header.root_len);
+    ok = buf_append(&out, &header, sizeof(header)) == 0 && buf_append(&out, root, header.root_len) == 0;
+
+    // Kept snapshots: a rebuilt base if the oldest go, the deltas as they are
+    for (size_t k = drop; ok && k < count; k++) {
+        HistoryBlock block = file_block(&hf, k);
+        if (k == drop && drop > 0) {
+            block.kind = HISTORY_FULL;
+            payload.len = 0;
+            ok = encode_full(&base, &payload) == 0 && put_block(&out, block, &payload) == 0;
+        } else {
+            ok = buf_append(&out, hf.blocks[k], sizeof(HistoryBlock) + block.bytes) == 0;
+        }
+    }
+
+    HistoryBlock block;
+    memset(&block, 0, sizeof(block));
+    const DirRecord *totals = dirstore_totals(store);
+    block.created_at = created_at;
+    block.total_size = totals->size;
+    block.total_alloc = totals->alloc_size;
+    block.file_count = totals->files;
+    block.entries = dirstore_count(store);
+    block.kind = count - drop > 0 ? HISTORY_DELTA : HISTORY_FULL;
+    payload.len = 0;
+    ok = ok && (block.kind == HISTORY_FULL ? encode_full(&cur, &payload) : encode_delta(&prev, &cur, &payload)) == 0 &&
+         put_block(&out, block, &payload) == 0 && write_replace(path, &out) == 0;
+
+    free(out.data);
+    free(payload.data);
+    file_free(&hf);
+    list_free(&cur);
+    list_free(&prev);
+    list_free(&base);
+    return ok ? 0 : -1;
+}
+
+int history_list(const char *path, const char *root, HistoryBlock **blocks, size_t *count) {
+    HistoryFile hf;
+    if (file_load(path, root, &hf) != 0) return -1;
+    *count = hf.header.count;
+    *blocks = malloc((*count ? *count : 1) * sizeof(HistoryBlock));
+    if (!*blocks) {
+        file_free(&hf);
+        return -1;
+    }
+    for (size_t k = 0; k < *count; k++) {
+        (*blocks)[k] = file_block(&hf, k);
+        (*blocks)[k].bytes = 0;
+        (*blocks)[k].crc = 0;
+    }
+    file_free(&hf);
+    return 0;
+}
+
+static int push_change(HistoryChange **changes, size_t *count, size_t *cap,
+                       const char *name, uint64_t old_size, uint64_t new_size) {
+    if (*count == *cap) {
+        size_t grown_cap = *cap ? *cap * 2 : 256;
+        HistoryChange *grown = realloc(*changes, grown_cap * sizeof(HistoryChange));
+        if (!grown) return -1;
+        *changes = grown;
+        *cap = grown_cap;
+    }
+    HistoryChange *c = &(*changes)[*count];
+    c->path = strdup(name);
+    if (!c->path) return -1;
+    c->old_size = old_size;
+    c->new_size = new_size;
+    (*count)++;
+    return 0;
+}
+
+int history_diff(const char *path, const char *root, size_t older, size_t newer,
+                 HistoryChange **changes, size_t *count) {
+    *changes = NULL;
+    *count = 0;
+    HistoryFile hf;
+    if (file_load(path, root, &hf) != 0) return -1;
+    if (older >= hf.header.count || newer >= hf.header.count) {
+        file_free(&hf);
+        return -1;
+    }
+    if (older > newer) {
+        size_t t = older;
+        older = newer;
+        newer = t;
+    }
+
+    // Replay up to the older snapshot, keep it, go on to the newer one
+    HistoryList list, old;
+    memset(&list, 0, sizeof(list));
+    memset(&old, 0, sizeof(old));
+    int ok = 1;
+    for (size_t k = 0; ok && k <= newer; k++) {
+        ok = file_step(&hf, k, &list) == 0;
+        if (ok && k == older) ok = list_copy(&list, &old) == 0;
+    }
+
+    // One merge-join pass over both
+    size_t cap = 0;
+    uint64_t i = 0, j = 0;
+    while (ok && (i < old.count || j < list.count)) {
+        int cmp = i == old.count ? 1 : j == list.count ? -1 : strcmp(old.items[i].name, list.items[j].name);
+        if (cmp < 0) {
+            ok = push_change(changes, count, &cap, old.items[i].name, old.items[i].size, 0) == 0;
+            i++;
+        } else if (cmp > 0) {
+            ok = push_change(changes, count, &cap, list.items[j].name, 0, list.items[j].size) == 0;
+            j++;
+        } else {
+            if (old.items[i].size != list.items[j].size) {
+                ok = push_change(changes, count, &cap, list.items[j].name, old.items[i].size, list.items[j].size) == 0;
+            }
+            i++;
+            j++;
+        }
+    }
+    list_free(&list);
+    list_free(&old);
+    file_free(&hf);
+    if (!ok) {
+        history_free_changes(*changes, *count);
+        *changes = NULL;
+        *count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void history_free_changes(HistoryChange *changes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(changes[i].path);
+    }
+    free(changes);
+}
@@ -0,0 +1,71 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dirstore.h"
+
+// Rolling series of the snapshots of one root, kept next to its cache file.
+// A snapshot is the list of recorded directories sorted by path (relative
+// to the root) with their sizes and file counts. The oldest one is stored
+// whole and every later one as a delta against the one before it: the paths
+// added, changed or removed, front-coded. Listing, rebuilding a snapshot and
+// diffing two of them are merge-joins of sorted lists, linear passes.
+// Comparisons are exact for scans that record every directory; with
+// SCAN_RETAIN_LARGE a directory crossing the threshold appears or vanishes.
+//
+// File layout: HistoryHeader, the root's normalized path (root_len bytes),
+// then `count` HistoryBlock records, oldest first, each followed by its
+// payload. CRC-32C over the header with the root, and over every block.
+
+#define HISTORY_MAGIC 0x54534948  // "HIST"
+#define HISTORY_VERSION 1
+#define HISTORY_DEPTH 30          // snapshots kept per root
+#define HISTORY_FULL 1
+#define HISTORY_DELTA 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;         // snapshots in the file
+    uint32_t header_crc;    // CRC-32C of the header (this field as 0) and the root
+    uint64_t root_len;
+} HistoryHeader;
+
+typedef struct {
+    int64_t created_at;     // CacheHeader.created_at of the snapshot
+    uint64_t total_size;
+    uint64_t total_alloc;
+    uint64_t file_count;
+    uint64_t entries;       // directories in the snapshot
+    uint32_t kind;          // HISTORY_FULL or HISTORY_DELTA
+    uint32_t bytes;         // payload bytes after this header
+    uint32_t crc;           // CRC-32C of this header (crc as 0) and the payload
+    uint32_t reserved;
+} HistoryBlock;
+
+// Path change between two snapshots (sizes 0 where the path is missing)
+typedef struct {
+    char *path;             // relative to the root, "" for the root itself
+    uint64_t old_size;
+    uint64_t new_size;
+} HistoryChange;
+
+// Append the snapshot `store` (whose totals are the scan's) taken at
+// `created_at` to the history file `path` of `root`, dropping the oldest
+// beyond HISTORY_DEPTH. The file is rewritten through a temporary and a
+// rename. Returns 0 or -1.
+int history_append(const char *path, const char *root, const DirStore *store, int64_t created_at);
+
+// The snapshots of `root` in history file `path`, oldest first (each
+// block's payload fields zeroed). Caller frees *blocks. Returns 0 or -1.
+int history_list(const char *path, const char *root, HistoryBlock **blocks, size_t *count);
+
+// Every path whose size differs between snapshots `older` and `newer`
+// (indices as in history_list()), in path order; history_free_changes()
+// frees them. Returns 0 or -1.
+int history_diff(const char *path, const char *root, size_t older, size_t newer,
+                 HistoryChange **changes, size_t *count);
+void history_free_changes(HistoryChange *changes, size_t count);
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "inodeset.h"
+
+#define INODESET_SHARDS 256
+#define SHARD_INITIAL_CAPACITY 64       // power of two, allocated on first insert
+#define CACHE_LINE 64
+#define EMPTY_DEV UINT64_MAX            // never a real device number
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+} InodeKey;
+
+typedef struct {
+    pthread_mutex_t lock;
+    InodeKey *slots;
+    size_t capacity;
+    size_t count;
+    char pad[CACHE_LINE];               // keep neighbouring shards off this cache line
+} InodeShard;
+
+struct InodeSet {
+    InodeShard shards[INODESET_SHARDS];
+};
+
+// splitmix64 finalizer: inode numbers are sequential, spread them out
+static uint64_t inode_hash(uint64_t dev, uint64_t ino) {
+    uint64_t h = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 30; h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27; h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+InodeSet* inodeset_create(void) {
+    InodeSet *set = calloc(1, sizeof(InodeSet));
+    if (!set) return NULL;
+    for (int i = 0; i < INODESET_SHARDS; i++) {
+        pthread_mutex_init(&set->shards[i].lock, NULL);
+    }
+    return set;
+}
+
+void inodeset_destroy(InodeSet *set) {
+    if (!set) return;
+    for (int i = 0; i < INODESET_SHARDS; i++) {
+        pthread_mutex_destroy(&set->shards[i].lock);
+        free(set->shards[i].slots);
+    }
+    free(set);
+}
+
+static InodeKey* shard_alloc(size_t capacity) {
+    InodeKey *slots = malloc(capacity * sizeof(InodeKey));
+    if (!slots) return NULL;
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].dev = EMPTY_DEV;
+    }
+    return slots;
+}
+
+// Linear probing; the low hash bits pick the slot (the top byte picked the shard)
+static InodeKey* shard_find_slot(InodeKey *slots, size_t capacity, uint64_t h,
+                                 uint64_t dev, uint64_t ino) {
+    size_t mask = capacity - 1;
+    for (size_t i = (size_t)h & mask; ; i = (i + 1) & mask) {
+        if (slots[i].dev == EMPTY_DEV || (slots[i].dev == dev && slots[i].ino == ino)) {
+            return &slots[i];
+        }
+    }
+}
+
+// Double the table, keeping it at most 70% full (lock held)
+static int shard_grow(InodeShard *shard) {
+    size_t new_capacity = shard->capacity ? shard->capacity * 2 : SHARD_INITIAL_CAPACITY;
+    InodeKey *slots = shard_alloc(new_capacity);
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < shard->capacity; i++) {
+        InodeKey *k = &shard->slots[i];
+        if (k->dev == EMPTY_DEV) continue;
+        *shard_find_slot(slots, new_capacity, inode_hash(k->dev, k->ino), k->dev, k->ino) = *k;
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = new_capacity;
+    return 0;
+}
+
+int inodeset_insert(InodeSet *set, uint64_t dev, uint64_t ino) {
+    if (dev == EMPTY_DEV) return 1;
+
+    uint64_t h = inode_hash(dev, ino);
+    InodeShard *shard = &set->shards[h >> 56];
+    int inserted = 1;
+
+    pthread_mutex_lock(&shard->lock);
+    if ((shard->count + 1) * 10 > shard->capacity * 7 && shard_grow(shard) != 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return 1;
+    }
+    InodeKey *slot = shard_find_slot(shard->slots, shard->capacity, h, dev, ino);
+    if (slot->dev == EMPTY_DEV) {
+        slot->dev = dev;
+        slot->ino = ino;
+        shard->count++;
+    } else {
+        inserted = 0;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return inserted;
+}
@@ -0,0 +1,20 @@
+#ifndef INODESET_H
+#define INODESET_H
+
+#include <stdint.h>
+
+// Concurrent set of (device, inode) pairs shared by all scan workers.
+// The key space is split over 256 shards, each an open-addressing table
+// behind its own mutex, so two workers only contend when they hit the same
+// shard at the same moment.
+
+typedef struct InodeSet InodeSet;
+
+InodeSet* inodeset_create(void);
+void inodeset_destroy(InodeSet *set);
+
+// Add (dev, ino). Returns 1 if it was not in the set yet (including when
+// memory runs out: better count twice than drop data), 0 if already seen.
+int inodeset_insert(InodeSet *set, uint64_t dev, uint64_t ino);
+
+#endif
@@ -1,61 +1,47 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include <sys/stat.h>
 #include <stdint.h>
 #include <time.h>
+#include <signal.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 #include "scanner.h"
 #include "cache.h"
+#include "dirtree.h"
+#include "history.h"
+#include "watch.h"
+#include "server.h"
+#include "rank.h"
+#include "estimate.h"
+#include "format.h"
 
 // external assembly function for fast addition
 extern void quick_add(uint64_t *total, uint64_t value);
-// Assembly external function
-extern int compare_sizes(const void *a, const void *b);
 // New assembly optimizations
 extern int fast_strcmp_dot(const char *str);
 extern int fast_strcmp_dotdot(const char *str);
-extern void atomic_inc_file_count(int *file_count);
 extern int fast_should_skip(const char *name);
 extern void fast_path_copy(char *dest, const char *src, size_t max_len);
 
-// Global arrays - now dynamically allocated
-DirInfo *dirs = NULL;
-int max_dirs = 0;
-int dir_count = 0;
-int file_count = 0;
-
-// Formats byte size for human readability
-void format_size(uint64_t bytes, char *output) {
-    if (bytes >= 1099511627776ULL) {
-        sprintf(output, "%.2f TB", bytes / 1099511627776.0);
-    } else if (bytes >= 1073741824) {
-        sprintf(output, "%.2f GB", bytes / 1073741824.0);
-    } else if (bytes >= 1048576) {
-        sprintf(output, "%.2f MB", bytes / 1048576.0);
-    } else if (bytes >= 1024) {
-        sprintf(output, "%.2f KB", bytes / 1024.0);
-    } else {
-        sprintf(output, "%llu B", bytes);
-    }
-}
+// Scan results
+DirStore *store = NULL;
+FileStore *file_store = NULL;         // --retain files only
+uint64_t dir_count = 0;
+uint64_t file_count = 0;
 
-// Helper: treat both separators on Windows
-static int is_path_separator(char c) {
-    return c == '/' || c == '\\';
-}
+// Token of the scan in progress, cancelled by Ctrl+C
+static ScanControl *scan_control = NULL;
 
-// Returns 1 if `child` is inside `parent` (or equal)
-static int is_subpath(const char *parent, const char *child) {
-    size_t parent_len = strlen(parent);
-    if (strncmp(parent, child, parent_len) != 0) return 0;
-    // Exact match or boundary by a separator
-    char next = child[parent_len];
-    return next == '\0' || is_path_separator(next);
+// The first Ctrl+C stops the scan and the partial results are reported;
+// a second one ends the program as usual
+static void on_scan_interrupt(int sig) {
+    scan_control_cancel(scan_control);
+    signal(sig, SIG_DFL);
 }
 
 // Abbreviate very long paths with a centered ellipsis to fit a column
@@ -87,209 +73,740 @@ static void abbreviate_path(const char *input, char *output, size_t max_len) {
     output[max_len - 1] = '\0';
 }
 
-// Scans and returns main subdirectories
-int get_subdirs(const char *path, char subdirs[][MAX_PATH_LEN]) {
-    DIR *dir = opendir(path);
-    if (!dir) return 0;
-    
-    int count = 0;
-    struct dirent *entry;
-    struct stat st;
-    char fullpath[MAX_PATH_LEN];
-    
-    while ((entry = readdir(dir)) != NULL && count < MAX_THREADS) {
-        // Ignore . and ..
-        if (strcmp(entry->d_name, ".") == 0 || 
-            strcmp(entry->d_name, "..") == 0) {
+// Wall-clock seconds (clock() counts CPU time of every worker thread)
+static double wall_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+// Progress line of the running scan, printed by its own thread (the
+// workers never print) every PROGRESS_PRINT_MS
+#define PROGRESS_PRINT_MS 250
+#define PROGRESS_TICK_MS 50
+
+static atomic_int progress_stop;
+static atomic_int progress_printed;   // a line is showing, to be ended
+static ScanEstimate progress_estimate;  // set before the printer starts
+
+// "1h05m", "4m10s", "35s" ("?" for unknown)
+static void format_eta(double seconds, char *out, size_t len) {
+    if (seconds < 0) {
+        snprintf(out, len, "?");
+        return;
+    }
+    unsigned long s = (unsigned long)(seconds + 0.5);
+    if (s >= 3600) {
+        snprintf(out, len, "%luh%02lum", s / 3600, s / 60 % 60);
+    } else if (s >= 60) {
+        snprintf(out, len, "%lum%02lus", s / 60, s % 60);
+    } else {
+        snprintf(out, len, "%lus", s);
+    }
+}
+
+static void* progress_printer(void *arg) {
+    (void)arg;
+    ScanProgress *snap = calloc(1, sizeof(ScanProgress));
+    if (!snap) return NULL;
+    int ticks = 0;
+    while (!atomic_load(&progress_stop)) {
+#ifdef _WIN32
+        Sleep(PROGRESS_TICK_MS);
+#else
+        struct timespec ts = { 0, PROGRESS_TICK_MS * 1000000L };
+        nanosleep(&ts, NULL);
+#endif
+        if (++ticks % (PROGRESS_PRINT_MS / PROGRESS_TICK_MS) != 0 || atomic_load(&progress_stop)) continue;
+        scanner_progress_snapshot(snap);
+        double eta;
+        double done = estimate_update(&progress_estimate, snap, &eta);
+        char shown[40], eta_str[32];
+        abbreviate_path(snap->path, shown, sizeof(shown));
+        format_eta(eta, eta_str, sizeof(eta_str));
+        printf("\rScanning... %3.0f%% (%s left) %llu files, %llu dirs (%llu queued), %.0f files/s | %-39s",
+               done * 100.0, eta_str, (unsigned long long)snap->files, (unsigned long long)snap->dirs,
+               (unsigned long long)snap->dirs_pending, snap->files_per_sec, shown);
+        fflush(stdout);
+        atomic_store(&progress_printed, 1);
+    }
+    free(snap);
+    return NULL;
+}
+
+// Start (1) or stop (0) the progress line of a scan of `path`, ending it
+// if one was printed; returns 0 or -1
+static int progress_line(int on, const char *path) {
+    static pthread_t thread;
+    static int started = 0;
+    if (on) {
+        estimate_begin(&progress_estimate, path);
+        atomic_store(&progress_stop, 0);
+        started = pthread_create(&thread, NULL, progress_printer, NULL) == 0;
+        return started ? 0 : -1;
+    }
+    if (started) {
+        atomic_store(&progress_stop, 1);
+        pthread_join(thread, NULL);
+        started = 0;
+    }
+    if (atomic_exchange(&progress_printed, 0)) printf("\n");
+    return 0;
+}
+
+static const char* engine_name(ScanEngine engine) {
+    return engine == SCAN_ENGINE_URING ? "io_uring" : "sync";
+}
+
+// Scan `path` once per metadata engine (no cache) and compare throughput.
+// The first run warms the metadata cache: drop caches between runs
+// (echo 3 > /proc/sys/vm/drop_caches) to compare cold scans.
+static int run_bench(const char *path, const ScanOptions *base) {
+    const ScanEngine engines[] = { SCAN_ENGINE_SYNC, SCAN_ENGINE_URING };
+    const int num_engines = sizeof(engines) / sizeof(engines[0]);
+    uint64_t files[2] = {0};
+    double seconds[2] = {0};
+
+    printf("Benchmarking metadata engines on %s with %d worker threads\n",
+           path, scanner_thread_count(base));
+    for (int i = 0; i < num_engines; i++) {
+        if (!scanner_engine_available(engines[i])) continue;
+        ScanOptions opts = *base;
+        opts.engine = engines[i];
+
+        DirStore *bench_store = NULL;
+        uint64_t bench_dir_count = 0;
+        double start = wall_seconds();
+        scan_directory(path, &opts, &bench_store, NULL, &bench_dir_count, &files[i], NULL);
+        seconds[i] = wall_seconds() - start;
+        dirstore_free(bench_store);
+    }
+
+    printf("\n%-10s %12s %10s %14s\n", "Engine", "Files", "Seconds", "Files/sec");
+    for (int i = 0; i < num_engines; i++) {
+        if (!scanner_engine_available(engines[i])) {
+            printf("%-10s %12s\n", engine_name(engines[i]), "unavailable");
             continue;
         }
-        
-        // Build full path
-        snprintf(fullpath, MAX_PATH_LEN, "%s/%s", path, entry->d_name);
-        
-        if (stat(fullpath, &st) == 0 && S_ISDIR(st.st_mode)) {
-            strncpy(subdirs[count], fullpath, MAX_PATH_LEN);
-            count++;
+        printf("%-10s %12llu %10.3f %14.0f\n", engine_name(engines[i]),
+               (unsigned long long)files[i], seconds[i],
+               seconds[i] > 0 ? files[i] / seconds[i] : 0.0);
+    }
+    return 0;
+}
+
+static void format_time(int64_t when, char *output, size_t len) {
+    time_t t = (time_t)when;
+    struct tm *tm = localtime(&t);
+    if (!tm || strftime(output, len, "%Y-%m-%d %H:%M:%S", tm) == 0) {
+        snprintf(output, len, "%lld", (long long)when);
+    }
+}
+
+// Signed size change, "+1.50 MB" / "-12.00 KB"
+static void format_change(uint64_t old_size, uint64_t new_size, char *output) {
+    char size_str[32];
+    format_size(new_size >= old_size ? new_size - old_size : old_size - new_size, size_str);
+    sprintf(output, "%c%s", new_size >= old_size ? '+' : '-', size_str);
+}
+
+// Relative change of a path, 0 for one that did not exist before
+static double change_ratio(const HistoryChange *c) {
+    return c->old_size ? ((double)c->new_size - (double)c->old_size) / (double)c->old_size : 0.0;
+}
+
+static int compare_growth(const void *a, const void *b) {
+    const HistoryChange *ca = *(const HistoryChange *const *)a;
+    const HistoryChange *cb = *(const HistoryChange *const *)b;
+    int64_t da = (int64_t)(ca->new_size - ca->old_size), db = (int64_t)(cb->new_size - cb->old_size);
+    if (da != db) return da < db ? 1 : -1;
+    // Same change: the deeper directory first, so its parents are seen as covered
+    size_t la = strlen(ca->path), lb = strlen(cb->path);
+    if (la != lb) return la < lb ? 1 : -1;
+    return strcmp(ca->path, cb->path);
+}
+
+static int compare_ratio(const void *a, const void *b) {
+    double ra = change_ratio(*(const HistoryChange *const *)a);
+    double rb = change_ratio(*(const HistoryChange *const *)b);
+    if (ra != rb) return ra < rb ? 1 : -1;
+    return compare_growth(a, b);
+}
+
+// Up to `limit` changes from one end of `sorted` (the largest with
+// from_end = 0). A directory whose whole change is that of a subdirectory
+// already listed is skipped, so one growth is not listed once per parent.
+static void print_changes(const char *title, HistoryChange **sorted, size_t count, int from_end, int limit) {
+    printf("\n%s:\n", title);
+    const HistoryChange *listed[32];
+    int shown = 0;
+    for (size_t k = 0; k < count && shown < limit && shown < 32; k++) {
+        const HistoryChange *c = sorted[from_end ? count - 1 - k : k];
+        if ((c->new_size > c->old_size) == (from_end != 0)) break;
+        size_t len = strlen(c->path);
+        int covered = 0;
+        for (int i = 0; i < shown && !covered; i++) {
+            covered = strncmp(listed[i]->path, c->path, len) == 0 && listed[i]->path[len] == '/' &&
+                      listed[i]->new_size - listed[i]->old_size == c->new_size - c->old_size;
         }
+        if (covered) continue;
+        char change[40], size_str[32], path_str[64];
+        format_change(c->old_size, c->new_size, change);
+        format_size(c->new_size, size_str);
+        abbreviate_path(c->path, path_str, sizeof(path_str));
+        if (c->old_size) {
+            printf("  %12s %+8.1f%%  %10s  %s\n", change, change_ratio(c) * 100.0, size_str, path_str);
+        } else {
+            printf("  %12s %9s  %10s  %s\n", change, "new", size_str, path_str);
+        }
+        listed[shown++] = c;
     }
-    
-    closedir(dir);
-    return count;
+    if (shown == 0) printf("  (none)\n");
+}
+
+// --history / --diff N: list the cached snapshots of `path`, or compare the
+// latest with the one N saves before it (no scan)
+static int run_history(const char *path, int diff_back) {
+    char history_path[1024];
+    HistoryBlock *blocks = NULL;
+    size_t count = 0;
+    if (cache_history_file(path, history_path, sizeof(history_path)) != 0 ||
+        history_list(history_path, path, &blocks, &count) != 0 || count == 0) {
+        printf("No history for %s: scan it first.\n", path);
+        free(blocks);
+        return 1;
+    }
+    char when[32], size_str[32];
+    if (diff_back < 0) {
+        printf("History of %s (%llu snapshots, newest first):\n", path, (unsigned long long)count);
+        printf("%5s  %-19s %12s %12s %12s\n", "Back", "Taken", "Size", "Directories", "Files");
+        for (size_t k = count; k-- > 0; ) {
+            format_time(blocks[k].created_at, when, sizeof(when));
+            format_size(blocks[k].total_size, size_str);
+            printf("%5llu  %-19s %12s %12llu %12llu\n", (unsigned long long)(count - 1 - k), when, size_str,
+                   (unsigned long long)blocks[k].entries, (unsigned long long)blocks[k].file_count);
+        }
+        free(blocks);
+        return 0;
+    }
+    if ((size_t)diff_back >= count) {
+        printf("Only %llu snapshots of %s; --diff takes 1 to %llu.\n", (unsigned long long)count, path,
+               (unsigned long long)(count - 1));
+        free(blocks);
+        return 1;
+    }
+
+    size_t older = count - 1 - (size_t)diff_back, newer = count - 1;
+    HistoryChange *changes = NULL;
+    size_t num_changes = 0;
+    if (history_diff(history_path, path, older, newer, &changes, &num_changes) != 0) {
+        printf("Error: Failed to read the history of %s\n", path);
+        free(blocks);
+        return 1;
+    }
+    char when_new[32], change[40];
+    format_time(blocks[older].created_at, when, sizeof(when));
+    format_time(blocks[newer].created_at, when_new, sizeof(when_new));
+    printf("Changes in %s from %s to %s:\n", path, when, when_new);
+    format_size(blocks[newer].total_size, size_str);
+    format_change(blocks[older].total_size, blocks[newer].total_size, change);
+    printf("Total: %s (%s), %+lld files\n", size_str, change,
+           (long long)(blocks[newer].file_count - blocks[older].file_count));
+
+    // Rankings over every changed directory but the root; relative change
+    // only for directories of at least 1 MB that existed before
+    HistoryChange **by_growth = malloc((num_changes ? num_changes : 1) * sizeof(HistoryChange *));
+    HistoryChange **by_ratio = malloc((num_changes ? num_changes : 1) * sizeof(HistoryChange *));
+    size_t ranked = 0, rated = 0;
+    for (size_t i = 0; by_growth && by_ratio && i < num_changes; i++) {
+        HistoryChange *c = &changes[i];
+        if (c->path[0] == '\0') continue;
+        by_growth[ranked++] = c;
+        uint64_t larger = c->new_size > c->old_size ? c->new_size : c->old_size;
+        if (c->old_size > 0 && larger >= 1024 * 1024) by_ratio[rated++] = c;
+    }
+    if (by_growth && by_ratio) {
+        qsort(by_growth, ranked, sizeof(HistoryChange *), compare_growth);
+        qsort(by_ratio, rated, sizeof(HistoryChange *), compare_ratio);
+        print_changes("Top growers", by_growth, ranked, 0, 10);
+        print_changes("Top shrinkers", by_growth, ranked, 1, 10);
+        print_changes("Top growers by relative change", by_ratio, rated, 0, 10);
+        print_changes("Top shrinkers by relative change", by_ratio, rated, 1, 10);
+    }
+    free(by_growth);
+    free(by_ratio);
+    history_free_changes(changes, num_changes);
+    free(blocks);
+    return 0;
+}
+
+// Parse a byte count with an optional K/M/G suffix
+static uint64_t parse_size(const char *s) {
+    char *end;
+    uint64_t value = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return value << 10;
+        case 'm': case 'M': return value << 20;
+        case 'g': case 'G': return value << 30;
+        default: return value;
+    }
+}
+
+// du --max-depth style listing: `node` and its children down to max_depth,
+// largest first (children ranges are already sorted that way). With
+// retained files, a directory's files follow its subdirectories (du -a).
+static void print_tree(const DirTree *tree, const DirStore *dirs, const FileStore *files,
+                       uint64_t node, int depth, int max_depth, int rank_alloc) {
+    char size_str[32];
+    format_size(rank_alloc ? tree->alloc_size[node] : tree->size[node], size_str);
+    char *path = node == 0 ? NULL : dirstore_path(dirs, tree->record[node]);
+    printf("%10s  %*s%s\n", size_str, depth * 2, "", node == 0 ? dirstore_root(dirs) : (path ? path : "?"));
+    free(path);
+
+    if (depth >= max_depth) return;
+    for (uint64_t c = tree->child_start[node]; c < tree->child_start[node + 1]; c++) {
+        print_tree(tree, dirs, files, c, depth + 1, max_depth, rank_alloc);
+    }
+    if (!files) return;
+
+    FileIter it;
+    FileEntry entry;
+    filestore_iter(files, tree->record[node], &it);
+    while (filestore_next(&it, &entry)) {
+        format_size(rank_alloc ? entry.alloc_size : entry.size, size_str);
+        if (entry.name) {
+            printf("%10s  %*s%.*s\n", size_str, (depth + 1) * 2, "", (int)entry.name_len, entry.name);
+        } else {
+            printf("%10s  %*s<%llu smaller files>\n", size_str, (depth + 1) * 2, "",
+                   (unsigned long long)entry.count);
+        }
+    }
+}
+
+static void print_usage(const char *prog) {
+    printf("\nUsage: %s [options] <path>\n", prog);
+    printf("Options:\n");
+    printf("  -j, --threads N   worker threads (default: one per CPU)\n");
+    printf("  --no-sync         trust cached attributes on network filesystems (Linux)\n");
+    printf("  --engine E        metadata engine: sync (default) or uring (Linux io_uring)\n");
+    printf("  -L, --follow-symlinks\n");
+    printf("                    descend into symlinked directories (default: skip links)\n");
+    printf("  --by METRIC       rank directories by logical (default) or allocated size,\n");
+    printf("                    or file count\n");
+    printf("  --top N           list the N largest directories (default %d)\n", RANK_DEFAULT_TOP);
+    printf("  --nested POLICY   hide (default) or show directories inside a listed one\n");
+    printf("  --max-depth N     also list the tree down to depth N, largest first\n");
+    printf("  --retain WHAT     keep large directories (default), all dirs, or all files too\n");
+    printf("  --min-size N      large: directory threshold (default 1M); files: smaller files\n");
+    printf("                    are summed per directory (suffixes K, M, G)\n");
+    printf("  --cache-limit N   keep the cache directory within N bytes, least recently\n");
+    printf("                    used snapshots removed first (default 1G, 0: no limit)\n");
+    printf("  --history         list the cached snapshots of <path> (no scan)\n");
+    printf("  --diff N          top growers and shrinkers since N saves back (no scan)\n");
+    printf("  --watch           stay resident after the report, keeping <path>'s cache current\n");
+    printf("                    from change notifications (Linux, directories only)\n");
+    printf("  --bench           scan with every engine and compare files/sec (no cache)\n");
+    printf("Ctrl+C during a scan stops it and reports the partial results (not cached).\n");
+    printf("\n       %s serve [--socket PATH] [root...]\n", prog);
+    printf("                    answer queries from cached snapshots (Unix socket)\n");
+    printf("       %s query [--socket PATH] ROOTS | TOTALS|CHILDREN|TREE <path>\n", prog);
+    printf("                    | TOP|DIFF N <path>\n");
+    printf("Example: %s /home/user\n", prog);
+}
+
+// `serve [--socket PATH] [root...]` and `query [--socket PATH] COMMAND [n]
+// [path]` (server.h): the socket defaults to one in the cache directory
+static int run_server_command(int argc, char *argv[]) {
+    int serve = strcmp(argv[1], "serve") == 0;
+    if (cache_init() != 0) {
+        printf("Warning: Failed to initialize cache system\n");
+    }
+    char socket_path[1024];
+    int first = 2;
+    if (argc > 3 && strcmp(argv[2], "--socket") == 0) {
+        snprintf(socket_path, sizeof(socket_path), "%s", argv[3]);
+        first = 4;
+    } else if (server_default_socket(socket_path, sizeof(socket_path)) != 0) {
+        printf("Error: no default socket, pass --socket PATH\n");
+        return 1;
+    }
+    if (serve) {
+        int status = server_run(socket_path, argv + first, argc - first);
+        cache_cleanup();
+        return status == 0 ? 0 : 1;
+    }
+
+    // COMMAND, a count for TOP and DIFF, then the path (normalized here, as
+    // the server resolves it against its own working directory)
+    if (first >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    char request[SERVER_LINE_MAX];
+    char command[64];
+    snprintf(command, sizeof(command), "%s", argv[first++]);
+    if ((strcmp(command, "TOP") == 0 || strcmp(command, "DIFF") == 0) && first < argc) {
+        size_t len = strlen(command);
+        snprintf(command + len, sizeof(command) - len, " %s", argv[first++]);
+    }
+    const char *path = first < argc ? argv[first] : NULL;
+    char normalized[MAX_PATH_LEN];
+    if (path && cache_normalize_path(path, normalized, sizeof(normalized)) == 0) {
+        path = normalized;
+    }
+    if (server_format_request(request, sizeof(request), command, path) != 0) {
+        printf("Error: request too long\n");
+        return 1;
+    }
+    ServerClient *client = server_connect(socket_path);
+    if (!client) {
+        printf("Error: no server on %s (start one with: %s serve)\n", socket_path, argv[0]);
+        return 1;
+    }
+    char **lines;
+    size_t count;
+    int status = server_request(client, request, &lines, &count);
+    server_close(client);
+    if (status < 0) {
+        printf("Error: connection to %s lost\n", socket_path);
+        return 1;
+    }
+    if (status == 1) printf("Error: %s\n", count ? lines[0] : "?");
+    for (size_t i = 0; status == 0 && i < count; i++) printf("%s\n", lines[i]);
+    server_free_lines(lines, count);
+    return status == 0 ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("\nUsage: %s <path>\n", argv[0]);
-        printf("Example: %s /home/user\n", argv[0]);
+    ScanOptions opts = {0};
+    const char *scan_path = NULL;
+    int bench = 0;
+    RankKey rank_by = RANK_BY_SIZE;
+    RankNesting nesting = RANK_NESTED_HIDE;
+    int top_n = RANK_DEFAULT_TOP;
+    int max_depth = -1;
+    int history = 0;
+    int diff_back = -1;
+    int watch = 0;
+
+    if (argc > 1 && (strcmp(argv[1], "serve") == 0 || strcmp(argv[1], "query") == 0)) {
+        return run_server_command(argc, argv);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc) {
+            opts.num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-sync") == 0) {
+            opts.no_sync = 1;
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            const char *engine = argv[++i];
+            if (strcmp(engine, "sync") == 0) {
+                opts.engine = SCAN_ENGINE_SYNC;
+            } else if (strcmp(engine, "uring") == 0) {
+                opts.engine = SCAN_ENGINE_URING;
+            } else {
+                printf("Unknown engine: %s\n", engine);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-L") == 0 || strcmp(argv[i], "--follow-symlinks") == 0) {
+            opts.follow_symlinks = 1;
+        } else if (strcmp(argv[i], "--by") == 0 && i + 1 < argc) {
+            const char *metric = argv[++i];
+            if (strcmp(metric, "logical") == 0) {
+                rank_by = RANK_BY_SIZE;
+            } else if (strcmp(metric, "allocated") == 0) {
+                rank_by = RANK_BY_ALLOC;
+            } else if (strcmp(metric, "files") == 0) {
+                rank_by = RANK_BY_FILES;
+            } else {
+                printf("Unknown metric: %s\n", metric);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            top_n = atoi(argv[++i]);
+            if (top_n < 1) {
+                printf("--top takes a number of directories (at least 1)\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--nested") == 0 && i + 1 < argc) {
+            const char *policy = argv[++i];
+            if (strcmp(policy, "hide") == 0) {
+                nesting = RANK_NESTED_HIDE;
+            } else if (strcmp(policy, "show") == 0) {
+                nesting = RANK_NESTED_SHOW;
+            } else {
+                printf("Unknown nesting policy: %s\n", policy);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--retain") == 0 && i + 1 < argc) {
+            const char *retain = argv[++i];
+            if (strcmp(retain, "large") == 0) {
+                opts.retain = SCAN_RETAIN_LARGE;
+            } else if (strcmp(retain, "dirs") == 0) {
+                opts.retain = SCAN_RETAIN_DIRS;
+            } else if (strcmp(retain, "files") == 0) {
+                opts.retain = SCAN_RETAIN_FILES;
+            } else {
+                printf("Unknown retention: %s\n", retain);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--min-size") == 0 && i + 1 < argc) {
+            opts.min_size = parse_size(argv[++i]);
+        } else if (strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc) {
+            cache_set_budget(parse_size(argv[++i]));
+        } else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            max_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--history") == 0) {
+            history = 1;
+        } else if (strcmp(argv[i], "--diff") == 0 && i + 1 < argc) {
+            diff_back = atoi(argv[++i]);
+            if (diff_back < 1) {
+                printf("--diff takes a number of saves back (1: the previous one)\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            scan_path = argv[i];
+        }
+    }
+
+    if (!scan_path) {
+        print_usage(argv[0]);
         return 1;
     }
     
+    // One spelling per directory ("dir/", "a/../dir" and a symlink to it
+    // are the same scan and share its cache)
+    char normalized[MAX_PATH_LEN];
+    if (cache_normalize_path(scan_path, normalized, sizeof(normalized)) == 0) {
+        scan_path = normalized;
+    }
+
+    if (bench) {
+        return run_bench(scan_path, &opts);
+    }
+    
+    // The daemon updates directories, not the files in them
+    if (watch && opts.retain != SCAN_RETAIN_DIRS) {
+        if (opts.retain == SCAN_RETAIN_FILES) {
+            printf("Note: --watch keeps directories only\n");
+        }
+        opts.retain = SCAN_RETAIN_DIRS;
+    }
+    
     // Initialize cache system
     if (cache_init() != 0) {
         printf("Warning: Failed to initialize cache system\n");
     }
-    
-    // Initialize dynamic directory array
-    max_dirs = INITIAL_MAX_DIRS;
-    dirs = malloc(max_dirs * sizeof(DirInfo));
-    if (!dirs) {
-        printf("Error: Failed to allocate memory for directory array\n");
-        return 1;
+    if (history || diff_back > 0) {
+        return run_history(scan_path, diff_back);
     }
     
-    printf("DiskScout v2.0 (Multi-threaded + Cache) - Scanning %s\n", argv[1]);
+    printf("DiskScout v2.0 (Multi-threaded + Cache) - Scanning %s\n", scan_path);
     printf("\nGouge away the damn bloat outta your disk space!\n");
-    printf("Analyzing: %s\n", argv[1]);
+    printf("Analyzing: %s\n", scan_path);
     
     // Measures execution time
-    clock_t start_time = clock();
+    double start_time = wall_seconds();
     
     uint64_t total = 0;
-    int num_subdirs = 0;
+    uint64_t total_alloc = 0;
+    int num_threads = 0;
     
     // Check cache first
     printf("Checking cache...\n");
-    int cache_result = cache_load(argv[1], dirs, &dir_count, &total, &file_count);
+    int cache_result;
+    uint64_t subtree;
+    CacheView *view = cache_view_open_covering(scan_path, &opts, &cache_result, &subtree);
+    if (view) {
+        // A plain hit only decodes what the report shows (the top level
+        // unless nested directories are ranked too); a cache to revalidate
+        // is decoded whole, or just the part under scan_path when it is an
+        // ancestor's
+        if (subtree != DIRSTORE_NONE) {
+            printf("Found %s in the cache of %s.\n", scan_path, cache_view_root(view));
+            if (cache_view_subtree(view, subtree, scan_path, &store, &file_store) != 0) {
+                store = NULL;
+            }
+        } else if (cache_result == 1 && nesting == RANK_NESTED_HIDE) {
+            store = cache_view_subset(view, max_depth > 1 ? (uint32_t)max_depth : 1);
+        } else if (cache_view_load(view, &opts, &store, &file_store) != 0) {
+            store = NULL;
+        }
+        if (store) {
+            const DirRecord *totals = dirstore_totals(store);
+            total = totals->size;
+            total_alloc = totals->alloc_size;
+            file_count = totals->files;
+            dir_count = subtree != DIRSTORE_NONE ? dirstore_count(store) : cache_view_header(view)->entry_count;
+        } else {
+            cache_result = -1;
+        }
+        cache_view_close(view);
+    }
     
-    if (cache_result == 1) {
+    uint64_t relisted = 0;
+    int incomplete = 0;               // scan interrupted: totals cover part of the tree
+    uint64_t unreadable = 0;          // directories that could not be opened or read
+    int saving = 0;                   // 1: background save running, -1: it failed to start
+    if (cache_result >= 1) {
         printf("Cache hit! Using cached results.\n");
-        printf("Found %d directories and %d files in cache.\n", dir_count, file_count);
+        printf("Found %llu directories and %llu files in cache.\n",
+               (unsigned long long)dir_count, (unsigned long long)file_count);
     } else if (cache_result == 0) {
         printf("Cache miss or invalid. Performing fresh scan...\n");
     } else {
         printf("Cache error. Performing fresh scan...\n");
     }
     
-    // Only perform fresh scan if cache miss
+    // Only perform fresh scan if cache miss; a cache of every directory is
+    // revalidated instead (only changed directories are listed again)
     if (cache_result != 1) {
-        // Mutex for thread-safe access
-        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-        
-        // Gets main subdirectories
-        char subdirs[MAX_THREADS][MAX_PATH_LEN];
-        num_subdirs = get_subdirs(argv[1], subdirs);
-        
-        printf("Found %d top-level directories. Spawning threads...\n", num_subdirs);
-        printf("Scanning directories...\n");
-        
-        // If few subdirs, use single-threaded approach
-        if (num_subdirs == 0 || num_subdirs == 1) {
-            // Single-threaded (small directory or no subdirs)
-            total = scan_directory(argv[1], dirs, &dir_count, &file_count, &mutex, &max_dirs);
-        } else {
-            // Multi-threaded approach
-            pthread_t threads[MAX_THREADS];
-            ThreadTask tasks[MAX_THREADS];
-            int num_threads = num_subdirs < MAX_THREADS ? num_subdirs : MAX_THREADS;
-            
-            // Creates threads
-            for (int i = 0; i < num_threads; i++) {
-                strncpy(tasks[i].path, subdirs[i], MAX_PATH_LEN);
-                tasks[i].dirs = dirs;                    // Global dirs array (for reference)
-                tasks[i].dir_count = &dir_count;         // Global dir_count (for reference)
-                tasks[i].file_count = &file_count;       // Shared file counter
-                tasks[i].mutex = &mutex;                 // Shared mutex
-                tasks[i].total_size = 0;                 // Thread's total size
-                tasks[i].local_dir_count = 0;            // Initialize thread-local count
-                tasks[i].max_dirs = &max_dirs;           // Pointer to max_dirs for dynamic growth
-                tasks[i].local_dirs = malloc(INITIAL_MAX_DIRS * sizeof(DirInfo)); // Allocate heap memory
-                
-                if (!tasks[i].local_dirs) {
-                    printf("Error: Failed to allocate memory for thread %d\n", i);
-                    exit(1);
-                }
-                
-                pthread_create(&threads[i], NULL, scan_thread_worker, &tasks[i]);
-            }
-            
-            // Waits for threads to finish
-            for (int i = 0; i < num_threads; i++) {
-                pthread_join(threads[i], NULL);
-                total += tasks[i].total_size;
-            }
-            
-            // Merge all thread results into global arrays
-            merge_thread_results(tasks, num_threads, dirs, &dir_count);
-            
-            // Free allocated memory
-            for (int i = 0; i < num_threads; i++) {
-                free(tasks[i].local_dirs);
-            }
-            
-            // Scans root directory (loose files)
-            DIR *root_dir = opendir(argv[1]);
-            if (root_dir) {
-                struct dirent *entry;
-                struct stat st;
-                char fullpath[MAX_PATH_LEN];
-                
-                while ((entry = readdir(root_dir)) != NULL) {
-                    // Ignore . and ..
-                    if (strcmp(entry->d_name, ".") == 0 || 
-                        strcmp(entry->d_name, "..") == 0) {
-                        continue;
-                    }
-                    
-                    // Build full path
-                    snprintf(fullpath, MAX_PATH_LEN, "%s/%s", argv[1], entry->d_name);
-                    
-                    if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode)) {
-                        quick_add(&total, st.st_size);
-                        
-                        // Use atomic assembly function instead of mutex
-                        atomic_inc_file_count(&file_count);
-                    }
-                }
-                closedir(root_dir);
-            }
+        num_threads = scanner_thread_count(&opts);
+        if (opts.engine != SCAN_ENGINE_SYNC && !scanner_engine_available(opts.engine)) {
+            printf("Note: %s engine unavailable, using sync\n", engine_name(opts.engine));
+            opts.engine = SCAN_ENGINE_SYNC;
         }
-        
-        // Save results to cache
-        printf("Saving results to cache...\n");
-        if (cache_save(argv[1], dirs, dir_count, total, file_count) == 0) {
-            printf("Cache saved successfully.\n");
+
+        scan_control = scan_control_create();
+        opts.control = scan_control;
+        void (*prev_handler)(int) = signal(SIGINT, on_scan_interrupt);
+        progress_line(1, scan_path);
+        if (cache_result == 2) {
+            printf("Revalidating cached directories with %d worker threads (%s engine)...\n",
+                   num_threads, engine_name(opts.engine));
+            DirStore *prev = store;
+            FileStore *prev_files = file_store;
+            total = scan_revalidate(scan_path, &opts, prev, prev_files, &store, &file_store,
+                                    &dir_count, &file_count, &total_alloc, &relisted);
+            filestore_free(prev_files);
+            dirstore_free(prev);
         } else {
-            printf("Warning: Failed to save cache.\n");
+            printf("Scanning directories with %d worker threads (%s engine)...\n",
+                   num_threads, engine_name(opts.engine));
+            total = scan_directory(scan_path, &opts, &store, &file_store, &dir_count, &file_count, &total_alloc);
+        }
+        progress_line(0, NULL);
+        if (cache_result == 2) {
+            printf("%llu of %llu directories changed or new, listed again.\n",
+                   (unsigned long long)relisted, (unsigned long long)dir_count);
+        }
+        signal(SIGINT, prev_handler);
+        opts.control = NULL;
+        incomplete = scan_control_incomplete(scan_control);
+        unreadable = scan_control_unreadable(scan_control);
+        scan_control_free(scan_control);
+        scan_control = NULL;
+        if (!store) {
+            printf("Error: Failed to allocate memory for directory store\n");
+            return 1;
         }
         
-        pthread_mutex_destroy(&mutex);
+        // Save results to cache (unless revalidation of its own cache found
+        // nothing new, or the scan was interrupted) while the report is
+        // printed; the stores stay untouched until it is done
+        if (incomplete) {
+            printf("Scan interrupted: results cover only part of the tree and are not cached.\n");
+        } else if (cache_result != 2 || relisted > 0 || subtree != DIRSTORE_NONE) {
+            printf("Saving results to cache in the background...\n");
+            saving = cache_save_async(scan_path, &opts, store, file_store, total, total_alloc, file_count,
+                                      wall_seconds() - start_time) == 0 ? 1 : -1;
+        }
     } else {
-        // Cache hit - total is already correct from cache_load
+        // Cache hit - total is already correct from the cache header
         // No need to recalculate!
     }
     
-    clock_t end_time = clock();
-    double elapsed = (double)(end_time - start_time) / CLOCKS_PER_SEC;
+    double elapsed = wall_seconds() - start_time;
     
     printf("\nProcessing...\n");
     
-    // Sort directories by decreasing size
-    qsort(dirs, dir_count, sizeof(DirInfo), compare_sizes);
-
-    // Select top 20 non-overlapping directories (avoid listing children of a larger parent)
-    DirInfo top_dirs[20];
-    int top_count = 0;
-    for (int i = 0; i < dir_count && top_count < 20; i++) {
-        if (dirs[i].size == 0) continue;
-        int is_child = 0;
-        for (int k = 0; k < top_count; k++) {
-            if (is_subpath(top_dirs[k].path, dirs[i].path)) { is_child = 1; break; }
-        }
-        if (!is_child) {
-            top_dirs[top_count++] = dirs[i];
-        }
+    // The top directories by the ranked key, by default none inside another
+    // listed one. On a cache hit the store only holds the part of the cache
+    // the report needs.
+    int rank_alloc = rank_by == RANK_BY_ALLOC;
+    uint64_t rank_total = rank_by == RANK_BY_ALLOC ? total_alloc : rank_by == RANK_BY_FILES ? file_count : total;
+    uint64_t candidates = dirstore_count(store);
+    uint64_t *top_dirs = malloc((size_t)top_n * sizeof(uint64_t));
+    if (!top_dirs) {
+        printf("Error: Failed to allocate memory for ranking\n");
+        cache_cleanup();
+        dirstore_free(store);
+        return 1;
     }
+    uint64_t top_count = rank_top(store, rank_by, nesting, (uint64_t)top_n, opts.num_threads, top_dirs);
 
-    // Show top non-overlapping largest directories
-    printf("\nTop 20 Largest Directories:\n");
+    static const char *rank_names[] = { "logical size", "allocated size", "file count" };
+    printf("\nTop %d Largest Directories (by %s%s):\n", top_n, rank_names[rank_by],
+           nesting == RANK_NESTED_SHOW ? ", nested included" : "");
     const int PATH_COL_WIDTH = 70; // visual alignment for long paths
-    for (int i = 0; i < top_count; i++) {
+    printf("    %-70s %10s %10s %7s %10s\n", "", "Logical", "Allocated", "Ratio", "Files");
+    for (uint64_t i = 0; i < top_count; i++) {
         char size_str[32];
+        char alloc_str[32];
         char display_path[PATH_COL_WIDTH + 1];
-        format_size(top_dirs[i].size, size_str);
-        abbreviate_path(top_dirs[i].path, display_path, sizeof(display_path));
-        double percent = (total > 0) ? ((top_dirs[i].size * 100.0) / total) : 0.0;
-        printf("%2d. %-70s %10s (%5.1f%%)\n", i + 1, display_path, size_str, percent);
+        const DirRecord *rec = dirstore_get(store, top_dirs[i]);
+        char *path = dirstore_path(store, top_dirs[i]);
+        format_size(rec->size, size_str);
+        format_size(rec->alloc_size, alloc_str);
+        abbreviate_path(path ? path : "?", display_path, sizeof(display_path));
+        free(path);
+        uint64_t ranked = rank_key(rec, rank_by);
+        double percent = (rank_total > 0) ? ((ranked * 100.0) / rank_total) : 0.0;
+        double ratio = scanner_alloc_ratio(rec->size, rec->alloc_size);
+        printf("%2llu. %-70s %10s %10s %6.2fx %10llu (%5.1f%%)\n", (unsigned long long)(i + 1), display_path, size_str, alloc_str,
+               ratio, (unsigned long long)rec->files, percent);
+    }
+
+    free(top_dirs);
+
+    // The recorded directory holding the most files directly: millions of
+    // small files in one place hurt far more than their total size suggests
+    const DirRecord *totals = dirstore_totals(store);
+    uint64_t busiest = DIRSTORE_NONE;
+    uint32_t busiest_files = totals->direct_files;
+    for (uint64_t i = 0; i < candidates; i++) {
+        const DirRecord *rec = dirstore_get(store, i);
+        if (rec->direct_files > busiest_files) {
+            busiest = i;
+            busiest_files = rec->direct_files;
+        }
+    }
+    if (busiest_files > 0) {
+        char *path = busiest == DIRSTORE_NONE ? NULL : dirstore_path(store, busiest);
+        printf("\nMost files in one directory: %llu in %s\n", (unsigned long long)busiest_files,
+               busiest == DIRSTORE_NONE ? dirstore_root(store) : (path ? path : "?"));
+        free(path);
+    }
+
+    if (max_depth >= 0) {
+        DirTree *tree = dirtree_build(store, total, total_alloc, opts.num_threads);
+        if (tree) {
+            printf("\nDirectory tree (depth %d, by %s size):\n", max_depth,
+                   rank_alloc ? "allocated" : "logical");
+            print_tree(tree, store, file_store, 0, 0, max_depth, rank_alloc);
+            dirtree_free(tree);
+        } else {
+            printf("Warning: Failed to build directory tree\n");
+        }
     }
     
     // Get physical disk usage (Windows API - zero overhead)
@@ -298,7 +815,7 @@ int main(int argc, char *argv[]) {
     uint64_t total_bytes = 0;
     
 #ifdef _WIN32
-    if (GetDiskFreeSpaceExA(argv[1], (PULARGE_INTEGER)&free_bytes, 
+    if (GetDiskFreeSpaceExA(scan_path, (PULARGE_INTEGER)&free_bytes, 
                            (PULARGE_INTEGER)&total_bytes, NULL)) {
         physical_size = total_bytes - free_bytes;
     }
@@ -313,24 +830,70 @@ int main(int argc, char *argv[]) {
     format_size(physical_size, physical_str);
     
     printf("Logical Size: %s (scanned files + links)\n", total_str);
+    char alloc_str[32];
+    format_size(total_alloc, alloc_str);
+    printf("Allocated Size: %s (on-disk blocks, %.2fx logical)\n", alloc_str,
+           scanner_alloc_ratio(total, total_alloc));
     if (physical_size > 0) {
         printf("Physical Size: %s (actual disk usage)\n", physical_str);
     }
-    printf("Files: %d | Directories: %d\n", file_count, dir_count);
+    printf("Files: %llu | Directories: %llu (%llu recorded) | Inodes: %llu\n",
+           (unsigned long long)file_count, (unsigned long long)totals->dirs,
+           (unsigned long long)dir_count, (unsigned long long)totals->inodes);
+    if (opts.retain != SCAN_RETAIN_LARGE) {
+        char dirs_mem[32], files_mem[32];
+        format_size(dirstore_memory(store), dirs_mem);
+        printf("Retained: %llu directories in %s", (unsigned long long)dir_count, dirs_mem);
+        if (file_store) {
+            uint64_t files_bytes = filestore_memory(file_store);
+            format_size(files_bytes, files_mem);
+            printf(", %llu file entries in %s (%.1f bytes/file)", (unsigned long long)filestore_count(file_store),
+                   files_mem, file_count ? (double)files_bytes / (double)file_count : 0.0);
+        }
+        printf("\n");
+    }
     printf("Time taken: %.2f seconds.\n", elapsed);
-    if (cache_result != 1) {
-        printf("Threads used: %d\n", num_subdirs < MAX_THREADS ? num_subdirs : MAX_THREADS);
+    if (incomplete) {
+        printf("Coverage: incomplete (scan interrupted)\n");
+    }
+    if (unreadable) {
+        printf("Coverage: incomplete (%llu directories could not be read)\n", (unsigned long long)unreadable);
+    }
+    if (cache_result == 2) {
+        printf("Cache used: Yes (revalidated, %llu directories listed)\n", (unsigned long long)relisted);
+        printf("Threads used: %d\n", num_threads);
+    } else if (cache_result != 1) {
+        printf("Threads used: %d\n", num_threads);
+        if (elapsed > 0) {
+            printf("Throughput: %.0f files/sec\n", (double)file_count / elapsed);
+        }
     } else {
         printf("Cache used: Yes\n");
     }
     
+    if (saving != 0) {
+        if (saving == 1 && cache_save_wait() == 0) {
+            printf("Cache saved successfully.\n");
+        } else {
+            printf("Warning: Failed to save cache.\n");
+        }
+    }
+    
+    int status = 0;
+    if (watch && incomplete) {
+        printf("Not watching: the scan was interrupted.\n");
+    } else if (watch) {
+        filestore_free(file_store);
+        file_store = NULL;
+        status = watch_run(scan_path, &opts, &store) == 0 ? 0 : 1;
+    }
+    
     // Cleanup cache system
     cache_cleanup();
     
-    // Cleanup dynamic directory array
-    if (dirs) {
-        free(dirs);
-    }
+    // Cleanup directory and file stores
+    filestore_free(file_store);
+    dirstore_free(store);
     
-    return 0;
+    return status;
 }
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order.h"
+#include "workpool.h"
+
+// Arrays shorter than this are sorted on the calling thread
+#define ORDER_PARALLEL_MIN 65536
+#define ORDER_RADIX 256
+
+// One worker's share of a pass
+typedef struct {
+    const OrderPair *src;
+    OrderPair *dst;
+    uint64_t begin;
+    uint64_t end;
+    int shift;
+    uint64_t slots[ORDER_RADIX];      // digits counted in the share, then
+                                      // where its next pair of each digit goes
+} OrderPart;
+
+static void order_count(OrderPart *part) {
+    memset(part->slots, 0, sizeof(part->slots));
+    for (uint64_t i = part->begin; i < part->end; i++) {
+        part->slots[(part->src[i].key >> part->shift) & (ORDER_RADIX - 1)]++;
+    }
+}
+
+static void order_scatter(OrderPart *part) {
+    for (uint64_t i = part->begin; i < part->end; i++) {
+        part->dst[part->slots[(part->src[i].key >> part->shift) & (ORDER_RADIX - 1)]++] = part->src[i];
+    }
+}
+
+static void order_count_task(WorkPool *pool, int worker, void *arg) {
+    (void)pool;
+    (void)worker;
+    order_count((OrderPart *)arg);
+}
+
+static void order_scatter_task(WorkPool *pool, int worker, void *arg) {
+    (void)pool;
+    (void)worker;
+    order_scatter((OrderPart *)arg);
+}
+
+// Run `fn` on every part, on the pool when there is one
+static void order_run(WorkPool *pool, OrderPart *parts, int num_parts, WorkFn fn,
+                      void (*inline_fn)(OrderPart *)) {
+    if (!pool) {
+        for (int i = 0; i < num_parts; i++) inline_fn(&parts[i]);
+        return;
+    }
+    for (int i = 0; i < num_parts; i++) workpool_push(pool, i, fn, &parts[i]);
+    workpool_run(pool);
+}
+
+int order_sort(OrderPair *pairs, uint64_t count, int num_threads) {
+    if (count < 2) return 0;
+
+    // Bytes that differ somewhere; the others need no pass
+    uint64_t any = 0, all = UINT64_MAX;
+    for (uint64_t i = 0; i < count; i++) {
+        any |= pairs[i].key;
+        all &= pairs[i].key;
+    }
+    uint64_t varying = any ^ all;
+    if (varying == 0) return 0;
+
+    if (num_threads <= 0) num_threads = workpool_cpu_count();
+    int num_parts = count < ORDER_PARALLEL_MIN ? 1 : num_threads;
+    OrderPair *spare = malloc(count * sizeof(OrderPair));
+    OrderPart *parts = calloc((size_t)num_parts, sizeof(OrderPart));
+    if (!spare || !parts) {
+        free(spare);
+        free(parts);
+        return -1;
+    }
+    WorkPool *pool = num_parts > 1 ? workpool_create(num_parts, NULL) : NULL;
+
+    OrderPair *src = pairs, *dst = spare;
+    uint64_t step = (count + (uint64_t)num_parts - 1) / (uint64_t)num_parts;
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & (ORDER_RADIX - 1)) == 0) continue;
+        for (int i = 0; i < num_parts; i++) {
+            uint64_t lo = step * (uint64_t)i;
+            parts[i].src = src;
+            parts[i].dst = dst;
+            parts[i].begin = lo < count ? lo : count;
+            parts[i].end = lo + step < count ? lo + step : count;
+            parts[i].shift = shift;
+        }
+        order_run(pool, parts, num_parts, order_count_task, order_count);
+
+        // Digit by digit, earlier shares first: stable
+        uint64_t offset = 0;
+        for (int d = 0; d < ORDER_RADIX; d++) {
+            for (int i = 0; i < num_parts; i++) {
+                uint64_t n = parts[i].slots[d];
+                parts[i].slots[d] = offset;
+                offset += n;
+            }
+        }
+        order_run(pool, parts, num_parts, order_scatter_task, order_scatter);
+
+        OrderPair *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != pairs) memcpy(pairs, src, count * sizeof(OrderPair));
+
+    if (pool) workpool_destroy(pool);
+    free(parts);
+    free(spare);
+    return 0;
+}
+
+int order_keys(const uint64_t *keys, uint64_t count, int num_threads, uint64_t *perm) {
+    OrderPair *pairs = malloc((count ? count : 1) * sizeof(OrderPair));
+    if (!pairs) return -1;
+    for (uint64_t i = 0; i < count; i++) {
+        pairs[i].key = keys[i];
+        pairs[i].index = i;
+    }
+    if (order_sort(pairs, count, num_threads) != 0) {
+        free(pairs);
+        return -1;
+    }
+    for (uint64_t i = 0; i < count; i++) perm[i] = pairs[i].index;
+    free(pairs);
+    return 0;
+}
+
+uint64_t order_double_key(double value) {
+    if (value != value) return UINT64_MAX;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // Negatives reversed below the positives
+    return (bits >> 63) ? ~bits : bits | (1ULL << 63);
+}
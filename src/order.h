@@ -0,0 +1,30 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include <stdint.h>
+
+// Sort orders over (key, index) pairs: a stable LSD radix sort, one byte of
+// the key per pass, with the passes whose byte is the same in every key
+// skipped. Each pass counts digits per worker share, then every worker
+// scatters its share to offsets known up front, so large arrays sort on
+// all workers without locks. Views keep an order (a permutation of record
+// indices) per column and compare positions instead of values.
+
+typedef struct {
+    uint64_t key;
+    uint64_t index;
+} OrderPair;
+
+// Sort `pairs` by ascending key, equal keys keeping their order, on
+// `num_threads` workers (0 = one per CPU) when there are many. Returns 0,
+// or -1 when out of memory (pairs unchanged).
+int order_sort(OrderPair *pairs, uint64_t count, int num_threads);
+
+// Permutation of 0 .. count - 1 by ascending keys[i] (ties by i) into
+// `perm`. Returns 0 or -1.
+int order_keys(const uint64_t *keys, uint64_t count, int num_threads, uint64_t *perm);
+
+// Key of a double that sorts as the double does (NaN after everything)
+uint64_t order_double_key(double value);
+
+#endif
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rank.h"
+#include "order.h"
+#include "workpool.h"
+
+// Stores with fewer records than this are ranked on the calling thread
+#define RANK_PARALLEL_MIN 65536
+
+// A candidate, with what ties are broken on
+typedef struct {
+    uint64_t key;
+    uint64_t dirs;
+    uint64_t index;
+} RankSlot;
+
+uint64_t rank_key(const DirRecord *rec, RankKey key) {
+    switch (key) {
+        case RANK_BY_ALLOC: return rec->alloc_size;
+        case RANK_BY_FILES: return rec->files;
+        default: return rec->size;
+    }
+}
+
+// Whether a ranks before b. On a tie an enclosing directory (which has more
+// directories below it) comes first, so a parent and its only child are not
+// both listed.
+static int rank_before(const RankSlot *a, const RankSlot *b) {
+    if (a->key != b->key) return a->key > b->key;
+    if (a->dirs != b->dirs) return a->dirs > b->dirs;
+    return a->index < b->index;
+}
+
+static int compare_slots(const void *a, const void *b) {
+    const RankSlot *sa = (const RankSlot *)a;
+    const RankSlot *sb = (const RankSlot *)b;
+    if (rank_before(sa, sb)) return -1;
+    return rank_before(sb, sa) ? 1 : 0;
+}
+
+// Bounded heap with the last-ranked slot on top
+static void heap_down(RankSlot *heap, uint64_t count, uint64_t i) {
+    for (;;) {
+        uint64_t last = i, l = 2 * i + 1, r = l + 1;
+        if (l < count && rank_before(&heap[last], &heap[l])) last = l;
+        if (r < count && rank_before(&heap[last], &heap[r])) last = r;
+        if (last == i) return;
+        RankSlot t = heap[i];
+        heap[i] = heap[last];
+        heap[last] = t;
+        i = last;
+    }
+}
+
+static void heap_offer(RankSlot *heap, uint64_t *count, uint64_t cap, const RankSlot *slot) {
+    if (*count < cap) {
+        uint64_t i = (*count)++;
+        heap[i] = *slot;
+        while (i > 0 && rank_before(&heap[(i - 1) / 2], &heap[i])) {
+            RankSlot t = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = t;
+            i = (i - 1) / 2;
+        }
+    } else if (rank_before(slot, &heap[0])) {
+        heap[0] = *slot;
+        heap_down(heap, cap, 0);
+    }
+}
+
+// One worker's share of the store and its heap
+typedef struct {
+    const DirStore *store;
+    RankKey key;
+    uint64_t begin;
+    uint64_t end;
+    RankSlot *heap;                   // `cap` slots
+    uint64_t cap;
+    uint64_t count;
+} RankPart;
+
+static void rank_part(RankPart *part) {
+    part->count = 0;
+    for (uint64_t i = part->begin; i < part->end; i++) {
+        const DirRecord *rec = dirstore_get(part->store, i);
+        RankSlot slot = { rank_key(rec, part->key), rec->dirs, i };
+        if (slot.key > 0) heap_offer(part->heap, &part->count, part->cap, &slot);
+    }
+}
+
+static void rank_part_task(WorkPool *pool, int worker, void *arg) {
+    (void)pool;
+    (void)worker;
+    rank_part((RankPart *)arg);
+}
+
+// The `cap` first-ranked records with a key above 0, in rank order, into
+// `out` (room for cap * num_parts slots). Returns how many, or -1 when out
+// of memory.
+static int64_t rank_candidates(const DirStore *store, RankKey key, uint64_t cap, int num_parts,
+                               RankSlot *out) {
+    uint64_t records = dirstore_count(store);
+    RankPart *parts = calloc((size_t)num_parts, sizeof(RankPart));
+    if (!parts) return -1;
+    uint64_t step = (records + (uint64_t)num_parts - 1) / (uint64_t)num_parts;
+    for (int i = 0; i < num_parts; i++) {
+        uint64_t lo = step * (uint64_t)i;
+        parts[i].store = store;
+        parts[i].key = key;
+        parts[i].begin = lo < records ? lo : records;
+        parts[i].end = lo + step < records ? lo + step : records;
+        parts[i].heap = out + cap * (uint64_t)i;
+        parts[i].cap = cap;
+    }
+
+    WorkPool *pool = num_parts > 1 ? workpool_create(num_parts, NULL) : NULL;
+    if (pool) {
+        for (int i = 0; i < num_parts; i++) workpool_push(pool, i, rank_part_task, &parts[i]);
+        workpool_run(pool);
+        workpool_destroy(pool);
+    } else {
+        for (int i = 0; i < num_parts; i++) rank_part(&parts[i]);
+    }
+
+    // Gather the heaps at the front, then keep the overall first `cap`
+    uint64_t count = 0;
+    for (int i = 0; i < num_parts; i++) {
+        memmove(out + count, parts[i].heap, parts[i].count * sizeof(RankSlot));
+        count += parts[i].count;
+    }
+    free(parts);
+    qsort(out, count, sizeof(RankSlot), compare_slots);
+    return (int64_t)(count < cap ? count : cap);
+}
+
+static int compare_indices(const void *a, const void *b) {
+    uint64_t ia = *(const uint64_t *)a, ib = *(const uint64_t *)b;
+    return ia < ib ? -1 : ia > ib;
+}
+
+// Whether `index` or a directory above it is in the sorted `picked`
+static int rank_under_pick(const DirStore *store, const uint64_t *picked, uint64_t count, uint64_t index) {
+    for (uint64_t i = index; i != DIRSTORE_NONE; i = dirstore_get(store, i)->parent) {
+        if (bsearch(&i, picked, count, sizeof(uint64_t), compare_indices)) return 1;
+    }
+    return 0;
+}
+
+// The first `n` of `order` (records in rank order) that are not inside
+// one picked before, when nesting is hidden; `picked` has room for n.
+// Returns how many went to `out`.
+static uint64_t rank_pick(const DirStore *store, const uint64_t *order, uint64_t len, uint64_t n,
+                          uint64_t *picked, uint64_t *out) {
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < len && count < n; i++) {
+        uint64_t index = order[i];
+        if (picked) {
+            if (rank_under_pick(store, picked, count, index)) continue;
+
+            // Kept sorted for the lookups; there are only n of them
+            uint64_t at = count;
+            while (at > 0 && picked[at - 1] > index) {
+                picked[at] = picked[at - 1];
+                at--;
+            }
+            picked[at] = index;
+        }
+        out[count++] = index;
+    }
+    return count;
+}
+
+// Every record in rank order (two stable radix sorts: by directories below,
+// then by key, both descending), for a top N close to the store's size.
+// Returns how many have a key above 0, or -1 when out of memory.
+static int64_t rank_order(const DirStore *store, RankKey key, int num_threads, uint64_t *order) {
+    uint64_t records = dirstore_count(store);
+    OrderPair *pairs = malloc(records * sizeof(OrderPair));
+    if (!pairs) return -1;
+    for (uint64_t i = 0; i < records; i++) {
+        pairs[i].key = ~dirstore_get(store, i)->dirs;
+        pairs[i].index = i;
+    }
+    int ok = order_sort(pairs, records, num_threads) == 0;
+    for (uint64_t i = 0; ok && i < records; i++) {
+        pairs[i].key = ~rank_key(dirstore_get(store, pairs[i].index), key);
+    }
+    ok = ok && order_sort(pairs, records, num_threads) == 0;
+    uint64_t len = 0;
+    while (ok && len < records && pairs[len].key != UINT64_MAX) {
+        order[len] = pairs[len].index;
+        len++;
+    }
+    free(pairs);
+    return ok ? (int64_t)len : -1;
+}
+
+uint64_t rank_top(const DirStore *store, RankKey key, RankNesting nesting, uint64_t n,
+                  int num_threads, uint64_t *out) {
+    uint64_t records = dirstore_count(store);
+    if (n == 0 || records == 0) return 0;
+    if (num_threads <= 0) num_threads = workpool_cpu_count();
+    int num_parts = records < RANK_PARALLEL_MIN ? 1 : num_threads;
+
+    // Candidates (and picks, for the ancestor checks) are never more than
+    // the store holds
+    uint64_t cap = n < records ? n : records;
+    uint64_t *picked = nesting == RANK_NESTED_HIDE ? malloc(cap * sizeof(uint64_t)) : NULL;
+    uint64_t *order = malloc(records * sizeof(uint64_t));
+    if ((nesting == RANK_NESTED_HIDE && !picked) || !order) {
+        free(picked);
+        free(order);
+        return 0;
+    }
+
+    for (;;) {
+        // Heaps about as large as the store: sort it all instead
+        if (cap > records / 4) {
+            int64_t len = rank_order(store, key, num_threads, order);
+            uint64_t count = len < 0 ? 0 : rank_pick(store, order, (uint64_t)len, n, picked, out);
+            free(picked);
+            free(order);
+            return count;
+        }
+
+        RankSlot *slots = malloc(cap * (uint64_t)num_parts * sizeof(RankSlot));
+        int64_t candidates = slots ? rank_candidates(store, key, cap, num_parts, slots) : -1;
+        for (int64_t i = 0; i < candidates; i++) order[i] = slots[i].index;
+        free(slots);
+        uint64_t count = candidates < 0 ? 0 : rank_pick(store, order, (uint64_t)candidates, n, picked, out);
+
+        // Done unless skips used up a full set of candidates
+        if (candidates < 0 || count == n || (uint64_t)candidates < cap) {
+            free(picked);
+            free(order);
+            return count;
+        }
+        cap *= 2;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef RANK_H
+#define RANK_H
+
+#include <stdint.h>
+#include "dirstore.h"
+
+// Top-N selection over the records of a DirStore, mostly without sorting them.
+// Each worker keeps a bounded min-heap of record indices over its share of
+// the store; the heaps are merged and the few survivors sorted. Directories
+// inside an already listed one are recognized by walking parent links. A
+// listed directory is never smaller than one inside it, so every skipped
+// candidate lies under a pick; when skips exhaust the candidates, selection
+// runs again with twice as many. Past a quarter of the store, heaps give
+// way to one full radix order (order.h).
+
+#define RANK_DEFAULT_TOP 20
+
+typedef enum {
+    RANK_BY_SIZE = 0,                 // logical bytes
+    RANK_BY_ALLOC,                    // allocated bytes
+    RANK_BY_FILES                     // regular files in the subtree
+} RankKey;
+
+typedef enum {
+    RANK_NESTED_HIDE = 0,             // no listed directory inside another
+    RANK_NESTED_SHOW                  // plain top N, nested ones included
+} RankNesting;
+
+uint64_t rank_key(const DirRecord *rec, RankKey key);
+
+// Up to `n` records of `store` with a key above 0, largest key first (ties:
+// the one with more directories below it, then the lower index), into
+// `out`. Workers: `num_threads` (0 = one per CPU) when the store is large.
+// Returns how many were selected.
+uint64_t rank_top(const DirStore *store, RankKey key, RankNesting nesting, uint64_t n,
+                  int num_threads, uint64_t *out);
+
+#endif
@@ -1,8 +1,12 @@
 #define _FILE_OFFSET_BITS 64   // ensures 64-bit file sizes on Windows/MinGW
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE            // statx() and friends on glibc
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #ifdef _WIN32
@@ -12,26 +16,245 @@
 #endif
 #endif
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 #ifndef _WIN32
 #include <unistd.h>
 #endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
 #include "scanner.h"
+#include "workpool.h"
+#include "uring.h"
+#include "inodeset.h"
+#include "dirstore.h"
+#include "dirtree.h"
+#include "filestore.h"
+#include "stream.h"
+
+#ifdef _WIN32
+#define PATH_SEP '\\'
+#else
+#define PATH_SEP '/'
+#endif
+
+#ifdef __linux__
+// Per-worker getdents64 buffer. One call fills it with hundreds of entries,
+// so a typical directory costs open + 2 getdents64 + close.
+#define DENTS_BUF_SIZE (128 * 1024)
+
+// Kernel record layout returned by getdents64 (not exported by glibc)
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+// Live progress of the scans in this process. Each worker adds to its own
+// cache-line-sized slot, once per directory, so nothing shared is written
+// per file; readers sum the slots. The path slot is refreshed at most every
+// PROGRESS_PATH_MS by whichever worker finds it due, under a sequence count
+// so a reader never copies a half-written path.
+#define PROGRESS_SLOTS 256            // more workers share slots (still atomic)
+#define PROGRESS_PATH_MS 20
+#define SCAN_CACHE_LINE 64
+
+typedef struct {
+    _Alignas(SCAN_CACHE_LINE) _Atomic uint64_t files;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t dirs_queued;     // directories this worker queued
+    _Atomic uint64_t dirs_done;       // and finished (listed or dropped)
+    atomic_int state;                 // ScanWorkerState
+} ProgressSlot;
+
+static ProgressSlot g_progress_slots[PROGRESS_SLOTS];
+static atomic_int g_progress_workers;
+static atomic_int g_progress_running;
+static _Atomic int64_t g_progress_start_ms;
+static _Atomic int64_t g_progress_path_due_ms;
+static atomic_uint g_progress_path_seq;  // odd while the path is written
+static char g_progress_path[MAX_PATH_LEN];
+
+static int64_t scan_now_ms(void) {
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static ProgressSlot* progress_slot(int worker) {
+    return &g_progress_slots[worker % PROGRESS_SLOTS];
+}
+
+// A new scan with `num_workers` workers starts counting from zero
+static void progress_begin(int num_workers) {
+    for (int i = 0; i < PROGRESS_SLOTS; i++) {
+        ProgressSlot *slot = &g_progress_slots[i];
+        atomic_store(&slot->files, 0);
+        atomic_store(&slot->bytes, 0);
+        atomic_store(&slot->dirs_queued, 0);
+        atomic_store(&slot->dirs_done, 0);
+        atomic_store(&slot->state, SCAN_WORKER_IDLE);
+    }
+    atomic_store(&g_progress_path_due_ms, 0);
+    atomic_store(&g_progress_start_ms, scan_now_ms());
+    atomic_store(&g_progress_workers, num_workers);
+    atomic_store(&g_progress_running, 1);
+}
+
+static void progress_end(void) {
+    atomic_store(&g_progress_running, 0);
+}
+
+// Whether the path slot is due for a refresh; the worker that claims it
+// writes the next one
+static int progress_path_due(void) {
+    int64_t now = scan_now_ms();
+    int64_t due = atomic_load_explicit(&g_progress_path_due_ms, memory_order_relaxed);
+    return now >= due &&
+           atomic_compare_exchange_strong(&g_progress_path_due_ms, &due, now + PROGRESS_PATH_MS);
+}
+
+static void progress_set_path(const char *path) {
+    unsigned seq = atomic_load(&g_progress_path_seq);
+    if ((seq & 1) || !atomic_compare_exchange_strong(&g_progress_path_seq, &seq, seq + 1)) {
+        return;                       // another worker is writing it
+    }
+    size_t len = strlen(path);
+    if (len >= MAX_PATH_LEN) len = MAX_PATH_LEN - 1;
+    memcpy(g_progress_path, path, len);
+    g_progress_path[len] = '\0';
+    atomic_store_explicit(&g_progress_path_seq, seq + 2, memory_order_release);
+}
+
+// Copy of the path slot ("" if it kept changing under the reader)
+static void progress_get_path(char *out) {
+    for (int tries = 0; tries < 8; tries++) {
+        unsigned seq = atomic_load_explicit(&g_progress_path_seq, memory_order_acquire);
+        if (seq & 1) continue;
+        memcpy(out, g_progress_path, MAX_PATH_LEN);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&g_progress_path_seq, memory_order_relaxed) == seq) {
+            out[MAX_PATH_LEN - 1] = '\0';
+            return;
+        }
+    }
+    out[0] = '\0';
+}
+
+void scanner_progress_snapshot(ScanProgress *snap) {
+    double prev_elapsed = snap->elapsed;
+    uint64_t prev_files = snap->files;
+    uint64_t prev_bytes = snap->bytes;
+
+    uint64_t files = 0, bytes = 0, queued = 0, done = 0;
+    for (int i = 0; i < PROGRESS_SLOTS; i++) {
+        const ProgressSlot *slot = &g_progress_slots[i];
+        files += atomic_load_explicit(&slot->files, memory_order_relaxed);
+        bytes += atomic_load_explicit(&slot->bytes, memory_order_relaxed);
+        queued += atomic_load_explicit(&slot->dirs_queued, memory_order_relaxed);
+        done += atomic_load_explicit(&slot->dirs_done, memory_order_relaxed);
+    }
+    int workers = atomic_load(&g_progress_workers);
+    int64_t start = atomic_load(&g_progress_start_ms);
+
+    snap->running = atomic_load(&g_progress_running);
+    snap->elapsed = start ? (double)(scan_now_ms() - start) / 1000.0 : 0.0;
+    snap->files = files;
+    snap->bytes = bytes;
+    snap->dirs = done;
+    // Slots are read one after another: a directory queued and finished in
+    // between may show as done before it shows as queued
+    snap->dirs_pending = queued > done ? queued - done : 0;
+    snap->num_workers = workers;
+    int shown = workers < SCAN_PROGRESS_MAX_WORKERS ? workers : SCAN_PROGRESS_MAX_WORKERS;
+    for (int i = 0; i < shown; i++) {
+        snap->worker_state[i] = (unsigned char)atomic_load_explicit(&g_progress_slots[i].state,
+                                                                    memory_order_relaxed);
+    }
+    progress_get_path(snap->path);
+
+    // Rates over the interval since the previous snapshot, or since the scan
+    // started when there was none (or it belonged to an earlier scan)
+    if (prev_elapsed <= 0.0 || prev_elapsed >= snap->elapsed || prev_files > files || prev_bytes > bytes) {
+        prev_elapsed = 0.0;
+        prev_files = 0;
+        prev_bytes = 0;
+    }
+    double interval = snap->elapsed - prev_elapsed;
+    snap->files_per_sec = interval > 0.0 ? (double)(files - prev_files) / interval : 0.0;
+    snap->bytes_per_sec = interval > 0.0 ? (double)(bytes - prev_bytes) / interval : 0.0;
+}
+
+// How often a paused worker looks whether it may go on
+#define SCAN_PAUSE_POLL_MS 50
+
+// Flags only: a paused worker polls instead of waiting on a condition, so
+// that cancelling stays safe from a signal handler
+struct ScanControl {
+    atomic_int cancelled;
+    atomic_int paused;
+    atomic_int incomplete;            // set by the workers on dropping a directory
+    _Atomic uint64_t unreadable;      // directories that could not be opened or read
+};
+
+ScanControl* scan_control_create(void) {
+    ScanControl *ctl = malloc(sizeof(ScanControl));
+    if (!ctl) return NULL;
+    atomic_init(&ctl->cancelled, 0);
+    atomic_init(&ctl->paused, 0);
+    atomic_init(&ctl->incomplete, 0);
+    atomic_init(&ctl->unreadable, 0);
+    return ctl;
+}
+
+void scan_control_free(ScanControl *ctl) {
+    free(ctl);
+}
+
+void scan_control_cancel(ScanControl *ctl) {
+    if (ctl) atomic_store(&ctl->cancelled, 1);
+}
+
+void scan_control_pause(ScanControl *ctl, int paused) {
+    if (ctl) atomic_store(&ctl->paused, paused ? 1 : 0);
+}
+
+int scan_control_paused(const ScanControl *ctl) {
+    return ctl ? atomic_load(&ctl->paused) : 0;
+}
+
+int scan_control_incomplete(const ScanControl *ctl) {
+    return ctl ? atomic_load(&ctl->incomplete) : 0;
+}
+
+uint64_t scan_control_unreadable(const ScanControl *ctl) {
+    return ctl ? atomic_load(&ctl->unreadable) : 0;
+}
+
+void scan_control_reset(ScanControl *ctl) {
+    if (!ctl) return;
+    atomic_store(&ctl->cancelled, 0);
+    atomic_store(&ctl->paused, 0);
+    atomic_store(&ctl->incomplete, 0);
+    atomic_store(&ctl->unreadable, 0);
+}
 
-// Track the active dirs buffer in case grow_directory_array reallocates it
-static DirInfo *g_active_dirs = NULL;
-DirInfo* scanner_current_dirs(void) { return g_active_dirs; }
-// Progress globals (simple, single-process)
-static char g_progress_path[MAX_PATH_LEN] = {0};
-static uint64_t g_progress_bytes = 0;
-void scanner_progress_set_path(const char* path){ if (!path) return; strncpy(g_progress_path, path, MAX_PATH_LEN-1); g_progress_path[MAX_PATH_LEN-1] = '\0'; }
-const char* scanner_progress_get_path(void){ return g_progress_path; }
-void scanner_progress_add_bytes(uint64_t bytes){ g_progress_bytes += bytes; }
-uint64_t scanner_progress_get_bytes(void){ return g_progress_bytes; }
-void scanner_progress_reset(void){ g_progress_path[0] = '\0'; g_progress_bytes = 0; }
 // Assembly function declarations
 extern int fast_strcmp_dot(const char *str);
 extern int fast_strcmp_dotdot(const char *str);
-extern void atomic_inc_file_count(int *file_count);
 extern int fast_should_skip(const char *name);
 extern int fast_wstrcmp_dot(const wchar_t *wstr);
 extern int fast_wstrcmp_dotdot(const wchar_t *wstr);
@@ -60,19 +283,589 @@ int should_skip(const char *name) {
     return 0; // do not skip
 }
 
+
+// A directory that is queued or being scanned. Nodes form a tree through
+// `parent`; a node completes when its own listing and all of its child
+// directories are done, at which point its size and counts are folded into
+// the parent.
+// Only the entry name is stored, so depth is not bounded by a buffer.
+// Directories complete bottom-up, so a recorded child does not know its
+// parent's record yet: it waits in the parent's `recorded_children` list
+// (linked through DirRecord.parent) until the parent completes.
+// When revalidating, `prev` is the directory's node in the earlier scan.
+typedef struct ScanNode {
+    struct ScanNode *parent;
+    char *name;                       // entry name (the scan path itself for the root)
+    int depth;                        // 0 for the scan root
+    atomic_int pending;               // unfinished child directories + own listing
+    _Atomic uint64_t size;            // bytes found below this directory so far
+    _Atomic uint64_t alloc_size;      // same, in allocated bytes
+    _Atomic uint64_t file_count;      // regular files below this directory so far
+    _Atomic uint64_t dir_count;       // completed directories below it
+    _Atomic uint64_t inode_count;     // inodes below it
+    atomic_uint direct_dirs;          // completed subdirectories
+    uint32_t direct_files;            // set by the listing
+    int duplicate;                    // reached before under another name: adds nothing
+    uint64_t stamp;                   // see DirRecord.stamp
+    uint64_t prev;                    // earlier scan's node, DIRTREE_NONE if new
+    struct PrevChild *prev_children;  // its children by name while relisting
+    _Atomic(DirRecord *) recorded_children;
+    FileBlock *files;                 // files listed here (SCAN_RETAIN_FILES)
+#ifndef _WIN32
+    int fd;                           // open directory, children openat() relative to it
+    int fd_shared;                    // 1 if children may use fd (set before any spawn)
+    atomic_int fd_refs;               // children yet to open + own listing
+#endif
+} ScanNode;
+
+// A subdirectory in the earlier scan, for looking up listed names
+typedef struct PrevChild {
+    const char *name;
+    uint64_t node;
+} PrevChild;
+
+// Bytes and counts of the entries listed directly in one directory
+typedef struct {
+    uint64_t size;
+    uint64_t alloc_size;
+    uint64_t files;                   // regular files
+    uint64_t others;                  // other non-directory inodes (links not
+                                      // followed, fifos, sockets, devices)
+} ScanTotals;
+
+// Result of a relative stat, limited to what the scanner consumes
+typedef struct {
+    uint64_t size;
+    uint64_t blocks;                  // 512-byte units
+    uint64_t dev;
+    uint64_t ino;
+    uint32_t mode;
+    uint32_t nlink;
+} ScanStat;
+
+// Per-worker scratch state (only touched by its own worker)
+typedef struct {
+    char *dents_buf;                  // getdents64 buffer (Linux, allocated on first use)
+#ifdef HAVE_IO_URING
+    Uring *ring;                      // this worker's ring (SCAN_ENGINE_URING only)
+    int ring_tried;
+    const char **batch_names;         // names waiting for a batched statx
+    struct statx *batch_stx;
+    int *batch_res;
+#endif
+} ScanWorker;
+
+// Shared state of one scan_directory() call
+typedef struct {
+    ScanWorker *workers;
+    DirStore *store;                  // one writer per worker
+    uint64_t total_size;
+    uint64_t total_alloc;
+    uint64_t total_files;
 #ifdef _WIN32
-// Windows-native fast scanner using FindFirstFileExW (UTF-16) with UTF-8 API surface
-static uint64_t scan_directory_win(
-    const char *path,
-    DirInfo *dirs,
-    int *dir_count,
-    int *file_count,
-    pthread_mutex_t *mutex,
-    int *max_dirs
-) {
+    uint64_t cluster_size;            // allocation unit of the scanned volume
+#endif
+    int stat_flags;                   // extra AT_* flags for relative stats
+    int follow_symlinks;
+    ScanEngine engine;
+    ScanRetain retain;
+    uint64_t min_dir_size;            // SCAN_RETAIN_LARGE threshold
+    FileStore *files;                 // SCAN_RETAIN_FILES: one writer per worker
+    const DirStore *prev;             // scan_revalidate(): the earlier scan,
+    const FileStore *prev_files;      // its files (may be NULL)
+    DirTree *prev_tree;               // and its tree
+    _Atomic uint64_t relisted;        // directories listed (changed or new) while revalidating
+    InodeSet *inodes;                 // directories + multiply linked files seen so far
+    ScanControl *control;             // may be NULL
+    ScanStream *stream;               // may be NULL
+    int open_fd_budget;               // max directory fds kept open for children
+    atomic_int open_fds;
+} ScanContext;
+
+#ifdef HAVE_IO_URING
+// Per-worker ring size; half of it is one statx batch
+#define URING_ENTRIES 256
+#endif
+
+#if defined(__linux__) && defined(STATX_SIZE)
+#define SCAN_STATX_MASK (STATX_SIZE | STATX_BLOCKS | STATX_INO | STATX_MODE | STATX_NLINK)
+#endif
+
+// Whether the scan was cancelled; the directory being listed (or about to
+// be) is then left out and the result marked incomplete
+static int scan_cancelled(const ScanContext *ctx) {
+    ScanControl *ctl = ctx->control;
+    if (!ctl || !atomic_load_explicit(&ctl->cancelled, memory_order_relaxed)) return 0;
+    atomic_store_explicit(&ctl->incomplete, 1, memory_order_relaxed);
+    return 1;
+}
+
+// A directory (or the rest of it) could not be read: counted, for the
+// report. The scan is not incomplete for it, as scanning again would not
+// read it either. One gone since it was found, or swapped for a link that
+// is not followed, is simply not there any more.
+static void scan_unreadable(const ScanContext *ctx, int err) {
+    ScanControl *ctl = ctx->control;
+    if (!ctl || err == ENOENT || err == ENOTDIR || err == ELOOP) return;
+    atomic_fetch_add_explicit(&ctl->unreadable, 1, memory_order_relaxed);
+}
+
+// Before each directory: hold the worker while the scan is paused, then
+// report whether it was cancelled
+static int scan_stopping(const ScanContext *ctx, int worker) {
+    ScanControl *ctl = ctx->control;
+    if (!ctl) return 0;
+    if (atomic_load_explicit(&ctl->paused, memory_order_relaxed)) {
+        atomic_store_explicit(&progress_slot(worker)->state, SCAN_WORKER_PAUSED, memory_order_relaxed);
+    }
+    while (atomic_load_explicit(&ctl->paused, memory_order_relaxed) &&
+           !atomic_load_explicit(&ctl->cancelled, memory_order_relaxed)) {
+#ifdef _WIN32
+        Sleep(SCAN_PAUSE_POLL_MS);
+#else
+        struct timespec ts = { 0, SCAN_PAUSE_POLL_MS * 1000000L };
+        nanosleep(&ts, NULL);
+#endif
+    }
+    atomic_store_explicit(&progress_slot(worker)->state, SCAN_WORKER_LISTING, memory_order_relaxed);
+    return scan_cancelled(ctx);
+}
+
+static void scan_dir_task(WorkPool *pool, int worker, void *arg);
+
+int scanner_thread_count(const ScanOptions *opts) {
+    if (opts && opts->num_threads > 0) return opts->num_threads;
+    return workpool_cpu_count();
+}
+
+double scanner_alloc_ratio(uint64_t size, uint64_t alloc_size) {
+    if (size == 0) return alloc_size ? 1.0 : 0.0;
+    return (double)alloc_size / (double)size;
+}
+
+int scanner_engine_available(ScanEngine engine) {
+    if (engine == SCAN_ENGINE_URING) return uring_available();
+    return 1;
+}
+
+static char* scan_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *out = malloc(len);
+    if (out) memcpy(out, s, len);
+    return out;
+}
+
+// Rebuild the full path of a node from its parent chain (heap allocated)
+static char* scan_node_path(const ScanNode *node) {
+    size_t len = 0;
+    for (const ScanNode *n = node; n; n = n->parent) {
+        len += strlen(n->name) + 1;
+    }
+
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+
+    // Fill from the end: name, separator, parent name, ...
+    char *p = out + len;
+    *p = '\0';
+    for (const ScanNode *n = node; n; n = n->parent) {
+        size_t nlen = strlen(n->name);
+        if (n != node && nlen > 0 && (n->name[nlen - 1] == '/' || n->name[nlen - 1] == '\\')) {
+            nlen--; // root given with a trailing separator
+        }
+        p -= nlen;
+        memcpy(p, n->name, nlen);
+        if (n->parent) *--p = PATH_SEP;
+    }
+    // Shift left over any slack left by a trimmed trailing separator
+    if (p != out) memmove(out, p, strlen(p) + 1);
+    return out;
+}
+
+// Takes ownership of `name`
+static ScanNode* scan_node_new(ScanNode *parent, char *name) {
+    ScanNode *node = malloc(sizeof(ScanNode));
+    if (!node) {
+        free(name);
+        return NULL;
+    }
+    node->parent = parent;
+    node->name = name;
+    node->depth = parent ? parent->depth + 1 : 0;
+    atomic_init(&node->pending, 1);
+    atomic_init(&node->size, 0);
+    atomic_init(&node->alloc_size, 0);
+    atomic_init(&node->file_count, 0);
+    atomic_init(&node->dir_count, 0);
+    atomic_init(&node->inode_count, 0);
+    atomic_init(&node->direct_dirs, 0);
+    node->direct_files = 0;
+    node->duplicate = 0;
+    node->stamp = 0;
+    node->prev = DIRTREE_NONE;
+    node->prev_children = NULL;
+    atomic_init(&node->recorded_children, NULL);
+    node->files = NULL;
+#ifndef _WIN32
+    node->fd = -1;
+    node->fd_shared = 0;
+    atomic_init(&node->fd_refs, 1);
+#endif
+    return node;
+}
+
+static int compare_prev_children(const void *a, const void *b) {
+    return strcmp(((const PrevChild *)a)->name, ((const PrevChild *)b)->name);
+}
+
+// Queue a subdirectory as a stealable task (`prev`: its node in the earlier
+// scan, DIRTREE_NONE if none)
+static void scan_spawn(WorkPool *pool, int worker, ScanNode *parent, const char *name, uint64_t prev) {
+    ScanNode *child = scan_node_new(parent, scan_strdup(name));
+    if (!child) return;
+    child->prev = prev;
+    atomic_fetch_add(&parent->pending, 1);
+#ifndef _WIN32
+    if (parent->fd_shared) atomic_fetch_add(&parent->fd_refs, 1);
+#endif
+    atomic_fetch_add_explicit(&progress_slot(worker)->dirs_queued, 1, memory_order_relaxed);
+    workpool_push(pool, worker, scan_dir_task, child);
+}
+
+// Queue a listed subdirectory, matched by name against the earlier scan
+static void scan_spawn_child(WorkPool *pool, int worker, ScanNode *parent, const char *name) {
+    uint64_t prev = DIRTREE_NONE;
+    if (parent->prev_children) {
+        ScanContext *ctx = workpool_ctx(pool);
+        PrevChild key = { name, 0 };
+        const PrevChild *found = bsearch(&key, parent->prev_children,
+                                         (size_t)dirtree_child_count(ctx->prev_tree, parent->prev),
+                                         sizeof(PrevChild), compare_prev_children);
+        if (found) prev = found->node;
+    }
+    scan_spawn(pool, worker, parent, name, prev);
+}
+
+// Revalidation is listing `node`: index the subdirectories the earlier scan
+// knew in it by name, so the listed ones can still be reused
+static void scan_prev_index(ScanContext *ctx, ScanNode *node) {
+    if (!ctx->prev) return;
+    atomic_fetch_add(&ctx->relisted, 1);
+    if (!ctx->prev_tree || node->prev == DIRTREE_NONE) return;
+
+    const DirTree *tree = ctx->prev_tree;
+    uint64_t first = tree->child_start[node->prev];
+    uint64_t count = dirtree_child_count(tree, node->prev);
+    if (count == 0) return;
+    node->prev_children = malloc((size_t)count * sizeof(PrevChild));
+    if (!node->prev_children) return;
+    for (uint64_t i = 0; i < count; i++) {
+        node->prev_children[i].name = dirstore_name(ctx->prev, tree->record[first + i]);
+        node->prev_children[i].node = first + i;
+    }
+    qsort(node->prev_children, (size_t)count, sizeof(PrevChild), compare_prev_children);
+}
+
+// Add a finished directory to the worker's part of the store (the root
+// itself is the returned total). With SCAN_RETAIN_LARGE only directories of
+// significant size by either metric and direct children of the root are
+// kept. `sums` holds the sizes and counts to record. Returns the record or
+// NULL if not kept.
+static DirRecord* scan_record_dir(ScanContext *ctx, int worker, const ScanNode *node,
+                                  const DirRecord *sums, uint64_t *ref) {
+    uint64_t larger = sums->size > sums->alloc_size ? sums->size : sums->alloc_size;
+    if (node->depth == 0) return NULL;
+    if (ctx->retain == SCAN_RETAIN_LARGE && node->depth > 1 && larger <= ctx->min_dir_size) {
+        return NULL;
+    }
+
+    DirRecord *rec = dirstore_writer_add(ctx->store, worker, node->name, ref);
+    if (!rec) return NULL;
+    rec->size = sums->size;
+    rec->alloc_size = sums->alloc_size;
+    rec->files = sums->files;
+    rec->dirs = sums->dirs;
+    rec->inodes = sums->inodes;
+    rec->direct_files = sums->direct_files;
+    rec->direct_dirs = sums->direct_dirs;
+    rec->stamp = sums->stamp;
+    return rec;
+}
+
+// Push the chain first..last of recorded descendants onto `node`'s list
+static void scan_link_records(ScanNode *node, DirRecord *first, DirRecord *last) {
+    DirRecord *head = atomic_load(&node->recorded_children);
+    do {
+        last->parent = (uint64_t)(uintptr_t)head;
+    } while (!atomic_compare_exchange_weak(&node->recorded_children, &head, first));
+}
+
+// Give every record waiting on `node` its parent reference
+static void scan_resolve_children(ScanNode *node, uint64_t parent_ref) {
+    DirRecord *child = atomic_load(&node->recorded_children);
+    while (child) {
+        DirRecord *next = (DirRecord *)(uintptr_t)child->parent;
+        child->parent = parent_ref;
+        child = next;
+    }
+}
+
+// Drop one reference on `node`. The last reference completes the directory:
+// it is recorded, its size and counts are added to the parent and the parent
+// loses a reference in turn, so completion ripples up without any global lock.
+static void scan_node_release(ScanContext *ctx, int worker, ScanNode *node) {
+    while (node && atomic_fetch_sub(&node->pending, 1) == 1) {
+        DirRecord sums = {
+            .size = atomic_load(&node->size),
+            .alloc_size = atomic_load(&node->alloc_size),
+            .files = atomic_load(&node->file_count),
+            .dirs = atomic_load(&node->dir_count),
+            .inodes = atomic_load(&node->inode_count) + (node->duplicate ? 0 : 1),
+            .direct_files = node->direct_files,
+            .direct_dirs = atomic_load(&node->direct_dirs),
+            .stamp = node->duplicate ? 0 : node->stamp
+        };
+        uint64_t ref;
+        DirRecord *rec = scan_record_dir(ctx, worker, node, &sums, &ref);
+        if (!node->duplicate && stream_wants(ctx->stream, node->depth, sums.size)) {
+            // Pushed before the parent can complete, so before it too
+            char *path = scan_node_path(node);
+            if (path) stream_push(ctx->stream, path, &sums, node->depth);
+            free(path);
+        }
+
+        ScanNode *parent = node->parent;
+        if (node->files) {
+            node->files->dir = rec ? ref : (parent ? FILESTORE_UNSET : DIRSTORE_NONE);
+        }
+        if (rec) {
+            scan_resolve_children(node, ref);
+            if (parent) scan_link_records(parent, rec, rec);
+        } else if (parent) {
+            // Not kept: its recorded descendants hang off the nearest kept ancestor
+            DirRecord *first = atomic_load(&node->recorded_children);
+            if (first) {
+                DirRecord *last = first;
+                while (last->parent) last = (DirRecord *)(uintptr_t)last->parent;
+                scan_link_records(parent, first, last);
+            }
+        } else {
+            scan_resolve_children(node, DIRSTORE_NONE); // directly under the root
+        }
+
+        if (parent && !node->duplicate) {
+            atomic_fetch_add(&parent->size, sums.size);
+            atomic_fetch_add(&parent->alloc_size, sums.alloc_size);
+            atomic_fetch_add(&parent->file_count, sums.files);
+            atomic_fetch_add(&parent->dir_count, sums.dirs + 1);
+            atomic_fetch_add(&parent->inode_count, sums.inodes);
+            atomic_fetch_add(&parent->direct_dirs, 1);
+        } else if (!parent) {
+            ctx->total_size = sums.size;
+            ctx->total_alloc = sums.alloc_size;
+            ctx->total_files = sums.files;
+            sums.parent = DIRSTORE_NONE;
+            sums.name_off = UINT64_MAX;
+            *dirstore_totals(ctx->store) = sums;
+        }
+        free(node->name);
+        free(node);
+        node = parent;
+    }
+}
+
+#ifndef _WIN32
+// Drop a reference on a node's directory fd; the last one closes it
+// (through the worker's ring when it has one). The fd stays counted in
+// open_fds until it is really closed: a close queued on the ring only
+// happens with the worker's next batch.
+static void scan_fd_release(ScanContext *ctx, ScanWorker *wk, ScanNode *node) {
+    if (atomic_fetch_sub(&node->fd_refs, 1) == 1 && node->fd >= 0) {
+#ifdef HAVE_IO_URING
+        if (wk->ring) {
+            uring_close_async(wk->ring, node->fd, &ctx->open_fds);
+            node->fd = -1;
+            return;
+        }
+#else
+        (void)wk;
+#endif
+        close(node->fd);
+        node->fd = -1;
+        atomic_fetch_sub(&ctx->open_fds, 1);
+    }
+}
+
+// Open a node's directory relative to its parent's fd. When the parent could
+// not keep its fd (fd budget exhausted) fall back to the rebuilt full path.
+static int scan_open_node(ScanContext *ctx, ScanWorker *wk, ScanNode *node) {
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    ScanNode *parent = node->parent;
+    int fd;
+
+    // Children were classified without following links; make sure a link
+    // swapped in since then is not followed either
+    if (parent && !ctx->follow_symlinks) flags |= O_NOFOLLOW;
+
+    if (!parent) {
+        fd = open(node->name, flags);
+    } else if (parent->fd_shared) {
+        fd = openat(parent->fd, node->name, flags);
+        int err = errno;              // for the caller, past a close below
+        scan_fd_release(ctx, wk, parent);
+        errno = err;
+    } else {
+        char *path = scan_node_path(node);
+        fd = path ? open(path, flags) : -1;
+        int err = path ? errno : ENOMEM;
+        free(path);
+        errno = err;
+    }
+
+    if (fd >= 0) atomic_fetch_add(&ctx->open_fds, 1);
+    return fd;
+}
+
+#if defined(__linux__) && defined(STATX_SIZE)
+static void scan_stat_from_statx(const struct statx *stx, ScanStat *out) {
+    out->size = stx->stx_size;
+    out->blocks = stx->stx_blocks;
+    out->dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    out->ino = stx->stx_ino;
+    out->mode = stx->stx_mode;
+    out->nlink = stx->stx_nlink;
+}
+#endif
+
+// Stat `name` relative to `dirfd` (follows symlinks only if asked to).
+// Uses statx with a minimal mask where available, fstatat otherwise.
+static int scan_stat_at(ScanContext *ctx, int dirfd, const char *name, ScanStat *out) {
+#if defined(__linux__) && defined(STATX_SIZE)
+    static atomic_int statx_missing = 0;
+    if (!atomic_load(&statx_missing)) {
+        struct statx stx;
+        if (statx(dirfd, name, ctx->stat_flags, SCAN_STATX_MASK, &stx) == 0) {
+            scan_stat_from_statx(&stx, out);
+            return 0;
+        }
+        if (errno != ENOSYS) return -1;
+        atomic_store(&statx_missing, 1); // old kernel: use fstatat from now on
+    }
+#endif
+    struct stat st;
+    if (fstatat(dirfd, name, &st, ctx->follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) != 0) return -1;
+    out->size = (uint64_t)st.st_size;
+    out->blocks = (uint64_t)st.st_blocks;
+    out->dev = (uint64_t)st.st_dev;
+    out->ino = (uint64_t)st.st_ino;
+    out->mode = (uint32_t)st.st_mode;
+    out->nlink = (uint32_t)st.st_nlink;
+    return 0;
+}
+
+// Account for one stat'ed entry: directories go to the pool, regular files
+// are added to `files`, anything else only counts as an inode. A file with
+// several hard links is only counted under the first name that reaches it.
+static void scan_add_stat(WorkPool *pool, int worker, ScanNode *node,
+                          const char *name, const ScanStat *st, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+    if (S_ISDIR(st->mode)) {
+        // is directory: hand it to the pool
+        scan_spawn_child(pool, worker, node, name);
+    } else if (S_ISREG(st->mode)) {
+        if (st->nlink > 1 && ctx->inodes && !inodeset_insert(ctx->inodes, st->dev, st->ino)) {
+            return; // another name of a file already counted
+        }
+        // is file = size sum
+        files->size += st->size;
+        files->alloc_size += st->blocks * 512;
+        files->files++;
+        if (ctx->files) filestore_add(ctx->files, worker, name, st->size, st->blocks * 512);
+    } else {
+        files->others++;
+    }
+}
+
+// Fingerprint of a directory's identity and timestamps: adding, removing or
+// renaming an entry updates its mtime and ctime, replacing the directory
+// changes its inode
+static uint64_t scan_stamp(const struct stat *st) {
+    const uint64_t parts[] = {
+        (uint64_t)st->st_dev, (uint64_t)st->st_ino,
+        (uint64_t)st->st_mtime, (uint64_t)st->st_ctime,
+#ifdef __APPLE__
+        (uint64_t)st->st_mtimespec.tv_nsec, (uint64_t)st->st_ctimespec.tv_nsec
+#else
+        (uint64_t)st->st_mtim.tv_nsec, (uint64_t)st->st_ctim.tv_nsec
+#endif
+    };
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        h = (h ^ parts[i]) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+    }
+    return h ? h : 1;
+}
+
+// Stamp the directory open on node->fd and register it. Returns 1 if it was
+// already scanned under another name (followed symlink, bind mount, loop
+// back to an ancestor).
+static int scan_dir_seen(ScanContext *ctx, ScanNode *node) {
+    struct stat st;
+    if (fstat(node->fd, &st) != 0) return 0;
+    node->stamp = scan_stamp(&st);
+    if (!ctx->inodes) return 0;
+    return !inodeset_insert(ctx->inodes, (uint64_t)st.st_dev, (uint64_t)st.st_ino);
+}
+
+// Revalidation: a directory whose stamp matches the earlier scan's is not
+// listed. Its own files come from that scan and its subdirectories are
+// queued from it (each one is still checked in turn). Returns 1 if reused.
+static int scan_reuse_listing(WorkPool *pool, int worker, ScanNode *node, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+    const DirTree *tree = ctx->prev_tree;
+    if (!tree || node->prev == DIRTREE_NONE || (ctx->files && !ctx->prev_files)) return 0;
+
+    uint64_t n = node->prev;
+    const DirRecord *rec = n == 0 ? dirstore_totals(ctx->prev) : dirstore_get(ctx->prev, tree->record[n]);
+    if (rec->stamp == 0 || rec->stamp != node->stamp) return 0;
+
+    uint64_t child_inodes = 0;
+    for (uint64_t c = tree->child_start[n]; c < tree->child_start[n + 1]; c++) {
+        child_inodes += dirstore_get(ctx->prev, tree->record[c])->inodes;
+    }
+    uint64_t listed = child_inodes + rec->direct_files + 1;
+    files->size = tree->own_size[n];
+    files->alloc_size = tree->own_alloc[n];
+    files->files = rec->direct_files;
+    files->others = rec->inodes > listed ? rec->inodes - listed : 0;
+    if (ctx->files) filestore_copy(ctx->files, worker, filestore_block(ctx->prev_files, tree->record[n]));
+
+    for (uint64_t c = tree->child_start[n]; c < tree->child_start[n + 1]; c++) {
+        scan_spawn(pool, worker, node, dirstore_name(ctx->prev, tree->record[c]), c);
+    }
+    return 1;
+}
+
+#endif
+
+#ifdef _WIN32
+// Windows-native listing using FindFirstFileExW (UTF-16) with UTF-8 API surface.
+// Adds the bytes and counts of the entries directly inside `node` to `files`.
+// The allocated size is the logical size rounded up to whole clusters
+// (compressed and sparse files are not detected, that needs a call per file).
+static void scan_list_win(WorkPool *pool, int worker, ScanNode *node, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+
+    char *path = scan_node_path(node);
+    if (!path) return;
     wchar_t wpath[MAX_PATH_LEN];
     int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH_LEN);
-    if (wlen <= 0) return 0;
+    free(path);
+    if (wlen <= 0) {
+        scan_unreadable(ctx, 0);
+        return;
+    }
 
     wchar_t pattern[MAX_PATH_LEN];
     _snwprintf(pattern, MAX_PATH_LEN, L"%ls\\*", wpath);
@@ -87,12 +880,15 @@ static uint64_t scan_directory_win(
         FIND_FIRST_EX_LARGE_FETCH
     );
     if (hFind == INVALID_HANDLE_VALUE) {
-        return 0;
+        DWORD err = GetLastError();
+        if (err != ERROR_FILE_NOT_FOUND && err != ERROR_PATH_NOT_FOUND) scan_unreadable(ctx, 0);
+        return;
     }
 
-    uint64_t total_size = 0;
+    const uint64_t cluster = ctx->cluster_size;
 
     do {
+        if (scan_cancelled(ctx)) break;
         const wchar_t *nameW = ffd.cFileName;
         // skip . and .. using wide-char fast helpers
         if (fast_wstrcmp_dot(nameW) || fast_wstrcmp_dotdot(nameW)) {
@@ -106,77 +902,186 @@ static uint64_t scan_directory_win(
             continue;
         }
 
-        // Build child wide path and UTF-8 path only once
-        wchar_t childW[MAX_PATH_LEN];
-        _snwprintf(childW, MAX_PATH_LEN, L"%ls\\%ls", wpath, nameW);
-
-        char childUtf8[MAX_PATH_LEN];
-        WideCharToMultiByte(CP_UTF8, 0, childW, -1, childUtf8, MAX_PATH_LEN, NULL, NULL);
+        // Junctions and directory symlinks: the target is scanned under its
+        // own path unless links are followed
+        if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) && !ctx->follow_symlinks) {
+            files->others++;
+            continue;
+        }
 
-                if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                    // Recurse into directory
-                    scanner_progress_set_path(childUtf8);
-                    uint64_t dir_sz = scan_directory_win(childUtf8, dirs, dir_count, file_count, mutex, max_dirs);
-                    total_size += dir_sz;
+        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            scan_spawn_child(pool, worker, node, nameUtf8);
         } else {
-            scanner_progress_set_path(childUtf8);
             ULARGE_INTEGER sz; sz.LowPart = ffd.nFileSizeLow; sz.HighPart = ffd.nFileSizeHigh;
-            total_size += sz.QuadPart;
-            scanner_progress_add_bytes(sz.QuadPart);
-
-            atomic_inc_file_count(file_count);
-            if (*file_count % 1000 == 0) {
-                printf("\rScanning... %d files found, %d directories", *file_count, *dir_count);
-                fflush(stdout);
-            }
+            uint64_t alloc = (sz.QuadPart + cluster - 1) / cluster * cluster;
+            files->size += sz.QuadPart;
+            files->alloc_size += alloc;
+            files->files++;
+            if (ctx->files) filestore_add(ctx->files, worker, nameUtf8, sz.QuadPart, alloc);
         }
     } while (FindNextFileW(hFind, &ffd));
 
     FindClose(hFind);
+}
+#elif defined(__linux__)
 
-    // Store current directory result (only if significant size or top-level)
-    if (dirs && dir_count && (total_size > 1024*1024 || strchr(path, '\\') == NULL || strchr(strchr(path, '\\') + 1, '\\') == NULL)) {
-        pthread_mutex_lock(mutex);
-        // Grow array if needed
-        if (grow_directory_array(&dirs, max_dirs, *dir_count, mutex) == 0) {
-            g_active_dirs = dirs;
-            strncpy(dirs[*dir_count].path, path, MAX_PATH_LEN - 1);
-            dirs[*dir_count].path[MAX_PATH_LEN - 1] = '\0';
-            dirs[*dir_count].size = total_size;
-            (*dir_count)++;
+#ifdef HAVE_IO_URING
+// Set up the worker's ring on first use. Any failure leaves the worker on
+// the synchronous path for the rest of the scan.
+static void scan_worker_ring_init(ScanWorker *wk) {
+    wk->ring_tried = 1;
+    wk->ring = uring_create(URING_ENTRIES);
+    if (!wk->ring) return;
+
+    unsigned n = uring_batch_size(wk->ring);
+    wk->batch_names = malloc(n * sizeof(*wk->batch_names));
+    wk->batch_stx = malloc(n * sizeof(*wk->batch_stx));
+    wk->batch_res = malloc(n * sizeof(*wk->batch_res));
+    if (!wk->batch_names || !wk->batch_stx || !wk->batch_res) {
+        uring_destroy(wk->ring);
+        wk->ring = NULL;
+    }
+}
+
+static void scan_worker_ring_free(ScanWorker *wk) {
+    uring_destroy(wk->ring);
+    wk->ring = NULL;
+    free(wk->batch_names);
+    free(wk->batch_stx);
+    free(wk->batch_res);
+}
+
+// Stat the `n` queued names of `node` in one go. The names point into the
+// getdents buffer, so this must run before the next getdents64 call.
+static void scan_flush_batch(WorkPool *pool, int worker, ScanNode *node, int n, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+    ScanWorker *wk = &ctx->workers[worker];
+    ScanStat st;
+
+    if (uring_statx_batch(wk->ring, node->fd, wk->batch_names, n, ctx->stat_flags,
+                          SCAN_STATX_MASK, wk->batch_stx, wk->batch_res) != 0) {
+        // Ring broke down: redo this batch and carry on synchronously
+        scan_worker_ring_free(wk);
+        for (int i = 0; i < n; i++) {
+            if (scan_stat_at(ctx, node->fd, wk->batch_names[i], &st) == 0) {
+                scan_add_stat(pool, worker, node, wk->batch_names[i], &st, files);
+            }
         }
-        pthread_mutex_unlock(mutex);
+        return;
     }
 
-    return total_size;
+    for (int i = 0; i < n; i++) {
+        if (wk->batch_res[i] != 0) continue;
+        scan_stat_from_statx(&wk->batch_stx[i], &st);
+        scan_add_stat(pool, worker, node, wk->batch_names[i], &st, files);
+    }
 }
 #endif
 
-// main scanning function (thread safe)
-uint64_t scan_directory(
-    const char *path,
-    DirInfo *dirs,
-    int *dir_count,
-    int *file_count,
-    pthread_mutex_t *mutex,
-    int *max_dirs
-) {
-#ifdef _WIN32
-    g_active_dirs = dirs;
-    return scan_directory_win(path, dirs, dir_count, file_count, mutex, max_dirs);
+// Linux listing straight from getdents64 into the worker's buffer. d_type
+// tells directories apart without a stat; only entries that need a size
+// (regular files) or whose type is unknown/symlink are stat'ed, relative to
+// the directory fd. With the io_uring engine those stats are queued and
+// issued as one batch per getdents64 buffer instead of one at a time.
+// Adds the bytes and counts of the entries directly inside `node` to `files`.
+static void scan_list_linux(WorkPool *pool, int worker, ScanNode *node, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+    ScanWorker *wk = &ctx->workers[worker];
+    ScanStat st;
+
+    if (!wk->dents_buf) {
+        wk->dents_buf = malloc(DENTS_BUF_SIZE);
+        if (!wk->dents_buf) {
+            scan_unreadable(ctx, ENOMEM);
+            return;
+        }
+    }
+#ifdef HAVE_IO_URING
+    if (ctx->engine == SCAN_ENGINE_URING && !wk->ring_tried) {
+        scan_worker_ring_init(wk);
+    }
+    int batched = 0;
+#endif
+
+    for (;;) {
+        if (scan_cancelled(ctx)) break;
+        long nread = syscall(SYS_getdents64, node->fd, wk->dents_buf, DENTS_BUF_SIZE);
+        if (nread < 0) scan_unreadable(ctx, errno);
+        if (nread <= 0) break;
+
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(wk->dents_buf + off);
+            off += d->d_reclen;
+
+            // ignore . and .. using fast assembly functions
+            if (fast_strcmp_dot(d->d_name) || fast_strcmp_dotdot(d->d_name)) {
+                continue;
+            }
+
+            // ignore problematic directories using fast assembly function
+            if (fast_should_skip(d->d_name)) {
+                continue;
+            }
+
+            unsigned char type = d->d_type;
+            if (type == DT_DIR) {
+                // is directory: hand it to the pool, no stat needed
+                scan_spawn_child(pool, worker, node, d->d_name);
+                continue;
+            }
+            if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+                files->others++; // fifos, sockets and devices have no size
+                continue;
+            }
+            if (type == DT_LNK && !ctx->follow_symlinks) {
+                files->others++;
+                continue;
+            }
+
+            // Sizes for files; links are followed (if asked) and unknown types resolved
+#ifdef HAVE_IO_URING
+            if (wk->ring) {
+                wk->batch_names[batched++] = d->d_name;
+                if ((unsigned)batched == uring_batch_size(wk->ring)) {
+                    scan_flush_batch(pool, worker, node, batched, files);
+                    batched = 0;
+                }
+                continue;
+            }
+#endif
+            if (scan_stat_at(ctx, node->fd, d->d_name, &st) == 0) {
+                scan_add_stat(pool, worker, node, d->d_name, &st, files);
+            }
+        }
+
+#ifdef HAVE_IO_URING
+        if (batched > 0) {
+            scan_flush_batch(pool, worker, node, batched, files);
+            batched = 0;
+        }
+#endif
+    }
+}
 #else
-    DIR *dir;
-    struct dirent *entry; 
-    struct stat st; 
-    uint64_t total_size = 0;
-    char fullpath[MAX_PATH_LEN];
+// POSIX listing over the directory fd. Adds the bytes and counts of the
+// entries directly inside `node` to `files`.
+static void scan_list_posix(WorkPool *pool, int worker, ScanNode *node, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+    struct dirent *entry;
+    ScanStat st;
 
-    dir = opendir(path);
+    // fdopendir takes ownership of its fd; node->fd stays open for children
+    int list_fd = dup(node->fd);
+    DIR *dir = list_fd >= 0 ? fdopendir(list_fd) : NULL;
     if(!dir) {
-        return 0;
+        scan_unreadable(ctx, errno);
+        if (list_fd >= 0) close(list_fd);
+        return;
     }
 
     while((entry = readdir(dir)) != NULL){
+        if (scan_cancelled(ctx)) break;
+
         // ignore . and .. using fast assembly functions
         if (fast_strcmp_dot(entry->d_name) || fast_strcmp_dotdot(entry->d_name)) {
             continue;
@@ -187,119 +1092,239 @@ uint64_t scan_directory(
             continue;
         }
 
-        snprintf(fullpath, MAX_PATH_LEN, "%s/%s", path, entry->d_name);
-
-        if (stat(fullpath, &st) == 0){
-
-            if (S_ISDIR(st.st_mode)){
-                // is directory: recursively scan
-                uint64_t dir_size = scan_directory(fullpath, dirs, dir_count, file_count, mutex, max_dirs);
-
-                // add subdirectory size to current directory total
-                total_size += dir_size;
+        if (scan_stat_at(ctx, node->fd, entry->d_name, &st) == 0){
+            scan_add_stat(pool, worker, node, entry->d_name, &st, files);
+        }
+    }
 
-            } else if (S_ISREG(st.st_mode)) {
-                // is file = size sum 
-                total_size += st.st_size;
+    closedir(dir);
+}
+#endif
 
-                // Use atomic assembly function instead of mutex
-                atomic_inc_file_count(file_count);
+// List one directory and queue its subdirectories
+static void scan_list_node(WorkPool *pool, int worker, ScanNode *node, ScanTotals *files) {
+    ScanContext *ctx = workpool_ctx(pool);
+    ScanWorker *wk = &ctx->workers[worker];
 
-                // Progress indicator every 1000 files (no mutex needed for read)
-                if (*file_count % 1000 == 0) {
-                    printf("\rScanning... %d files, %d dirs | %s", *file_count, *dir_count, g_progress_path);
-                    fflush(stdout);
-                }
-            }
+    // Sampled progress path: rebuilding it for every entry would defeat the
+    // point of name-only nodes
+    if (progress_path_due()) {
+        char *path = scan_node_path(node);
+        if (path) {
+            progress_set_path(path);
+            free(path);
         }
     }
 
-    closedir(dir);
-    
-    // Store the current directory in the results array (only if significant size or top-level)
-    if (dirs && dir_count && (total_size > 1024*1024 || strchr(path, '/') == NULL || strchr(strchr(path, '/') + 1, '/') == NULL)) {
-        pthread_mutex_lock(mutex);
-        // Grow array if needed
-        if (grow_directory_array(&dirs, max_dirs, *dir_count, mutex) == 0) {
-            g_active_dirs = dirs;
-            strncpy(dirs[*dir_count].path, path, MAX_PATH_LEN - 1);
-            dirs[*dir_count].path[MAX_PATH_LEN - 1] = '\0';
-            dirs[*dir_count].size = total_size;
-            (*dir_count)++;
+#ifdef _WIN32
+    // No stamps here: revalidation lists every directory again
+    scan_prev_index(ctx, node);
+    scan_list_win(pool, worker, node, files);
+    free(node->prev_children);
+    node->prev_children = NULL;
+#else
+    node->fd = scan_open_node(ctx, wk, node);
+    if (node->fd < 0) {
+        scan_unreadable(ctx, errno);
+    } else if (scan_dir_seen(ctx, node)) {
+        // Same directory reached twice: its contents are counted once
+        node->duplicate = 1;
+        scan_fd_release(ctx, wk, node);
+    } else {
+        // Children open relative to this fd unless too many are already held
+        node->fd_shared = atomic_load(&ctx->open_fds) <= ctx->open_fd_budget;
+        if (!scan_reuse_listing(pool, worker, node, files)) {
+            scan_prev_index(ctx, node);
+#ifdef __linux__
+            scan_list_linux(pool, worker, node, files);
+#else
+            scan_list_posix(pool, worker, node, files);
+#endif
+            free(node->prev_children);
+            node->prev_children = NULL;
         }
-        pthread_mutex_unlock(mutex);
+        scan_fd_release(ctx, wk, node);
     }
-    
-    return total_size;
 #endif
-} 
+}
 
-// worker thread
-void* scan_thread_worker(void *arg) {
-    
-    ThreadTask *task = (ThreadTask *)arg;
+// Pool task: list one directory (unless the scan was cancelled), then drop
+// the listing's reference so the node can complete once its children have
+static void scan_dir_task(WorkPool *pool, int worker, void *arg) {
+    ScanContext *ctx = workpool_ctx(pool);
+    ScanNode *node = (ScanNode *)arg;
 
-    // Initialize thread-local storage
-    task->local_dir_count = 0;
+    ScanTotals files = {0, 0, 0, 0};
+    if (!scan_stopping(ctx, worker)) {
+        scan_list_node(pool, worker, node, &files);
+    } else {
+#ifndef _WIN32
+        // Dropped unopened: give back the parent fd it would have used
+        if (node->parent && node->parent->fd_shared) {
+            scan_fd_release(ctx, &ctx->workers[worker], node->parent);
+        }
+#endif
+    }
+    if (ctx->files) node->files = filestore_end_dir(ctx->files, worker);
 
-    // accumulate total per thread using thread-local storage
-    int local_max_dirs = INITIAL_MAX_DIRS;
-    task->total_size = scan_directory(task->path, task->local_dirs, &task->local_dir_count, task->file_count, task->mutex, &local_max_dirs);
+    atomic_fetch_add(&node->size, files.size);
+    atomic_fetch_add(&node->alloc_size, files.alloc_size);
+    atomic_fetch_add(&node->file_count, files.files);
+    atomic_fetch_add(&node->inode_count, files.files + files.others);
+    node->direct_files = files.files > UINT32_MAX ? UINT32_MAX : (uint32_t)files.files;
 
-    return NULL; 
+    ProgressSlot *slot = progress_slot(worker);
+    atomic_fetch_add_explicit(&slot->files, files.files, memory_order_relaxed);
+    atomic_fetch_add_explicit(&slot->bytes, files.size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&slot->dirs_done, 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->state, SCAN_WORKER_IDLE, memory_order_relaxed);
+    scan_node_release(ctx, worker, node);
 }
 
-// Dynamic array management (thread-safe)
-int grow_directory_array(DirInfo **dirs, int *max_dirs, int current_count, pthread_mutex_t *mutex) {
-    if (current_count < *max_dirs) {
-        return 0; // No need to grow
+// Release the workers' scratch buffers
+static void scan_workers_free(ScanWorker *workers, int num_workers) {
+    for (int i = 0; i < num_workers; i++) {
+        free(workers[i].dents_buf);
+#ifdef HAVE_IO_URING
+        if (workers[i].ring) scan_worker_ring_free(&workers[i]);
+#endif
     }
-    
-    // Lock mutex before growing (if provided)
-    if (mutex) {
-        pthread_mutex_lock(mutex);
-        
-        // Double-check after acquiring lock (another thread might have grown it)
-        if (current_count < *max_dirs) {
-            pthread_mutex_unlock(mutex);
-            return 0; // No need to grow
+    free(workers);
+}
+
+// main scanning function, revalidating `prev` when given
+static uint64_t scan_run(
+    const char *path,
+    const ScanOptions *opts,
+    const DirStore *prev,
+    const FileStore *prev_files,
+    DirStore **store,
+    FileStore **files,
+    uint64_t *dir_count,
+    uint64_t *file_count,
+    uint64_t *total_alloc,
+    uint64_t *relisted
+) {
+    *store = NULL;
+    if (files) *files = NULL;
+    *dir_count = 0;
+    *file_count = 0;
+    if (total_alloc) *total_alloc = 0;
+
+    int num_threads = scanner_thread_count(opts);
+    ScanContext ctx = {0};
+    atomic_init(&ctx.open_fds, 0);
+    atomic_init(&ctx.relisted, 0);
+    ctx.engine = opts ? opts->engine : SCAN_ENGINE_SYNC;
+    ctx.follow_symlinks = opts ? opts->follow_symlinks : 0;
+    ctx.retain = opts ? opts->retain : SCAN_RETAIN_LARGE;
+    ctx.min_dir_size = opts && opts->min_size ? opts->min_size : 1024 * 1024;
+    ctx.control = opts ? opts->control : NULL;
+    ctx.stream = opts ? opts->stream : NULL;
+    if (ctx.retain == SCAN_RETAIN_FILES && !files) ctx.retain = SCAN_RETAIN_DIRS;
+#ifdef __linux__
+    if (!ctx.follow_symlinks) ctx.stat_flags |= AT_SYMLINK_NOFOLLOW;
+#endif
+#if defined(__linux__) && defined(AT_STATX_DONT_SYNC)
+    if (opts && opts->no_sync) ctx.stat_flags |= AT_STATX_DONT_SYNC;
+#endif
+#ifdef _WIN32
+    // Cluster size of the volume holding `path`, for allocated sizes
+    ctx.cluster_size = 4096;
+    {
+        wchar_t wpath[MAX_PATH_LEN], wroot[MAX_PATH_LEN];
+        DWORD sectors_per_cluster, bytes_per_sector, free_clusters, total_clusters;
+        if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH_LEN) > 0 &&
+            GetVolumePathNameW(wpath, wroot, MAX_PATH_LEN) &&
+            GetDiskFreeSpaceW(wroot, &sectors_per_cluster, &bytes_per_sector,
+                              &free_clusters, &total_clusters)) {
+            ctx.cluster_size = (uint64_t)sectors_per_cluster * bytes_per_sector;
         }
     }
-    
-    // Double the size
-    int new_max = *max_dirs * 2;
-    DirInfo *new_dirs = realloc(*dirs, new_max * sizeof(DirInfo));
-    
-    if (!new_dirs) {
-        if (mutex) pthread_mutex_unlock(mutex);
-        return -1; // Failed to grow
-    }
-    
-    *dirs = new_dirs;
-    *max_dirs = new_max;
-    
-    printf("\rGrowing directory array to %d entries (current: %d)...", new_max, current_count);
-    fflush(stdout);
-    
-    if (mutex) pthread_mutex_unlock(mutex);
-    return 0;
-}
+#else
+    // Keep at most half of the fd limit open for relative lookups
+    struct rlimit rl;
+    ctx.open_fd_budget = 512;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        ctx.open_fd_budget = (int)(rl.rlim_cur / 2);
+    }
+#endif
+    ctx.workers = calloc((size_t)num_threads, sizeof(ScanWorker));
+    ctx.store = dirstore_create(path);
+    if (ctx.retain == SCAN_RETAIN_FILES) {
+        ctx.files = filestore_create(num_threads, opts->min_size);
+    }
+    if (!ctx.workers || !ctx.store || dirstore_begin_parallel(ctx.store, num_threads) != 0 ||
+        (ctx.retain == SCAN_RETAIN_FILES && !ctx.files)) {
+        filestore_free(ctx.files);
+        dirstore_free(ctx.store);
+        free(ctx.workers);
+        return 0;
+    }
+    // Without the set hard links are counted per name and loops are only
+    // stopped by not following symlinks; still better than no scan
+    ctx.inodes = inodeset_create();
 
-// Merge thread results into global arrays
-void merge_thread_results(ThreadTask *tasks, int num_threads, DirInfo *global_dirs, int *global_dir_count) {
-    *global_dir_count = 0;
-    
-    // Merge all thread-local results into global array
-    for (int i = 0; i < num_threads; i++) {
-        for (int j = 0; j < tasks[i].local_dir_count; j++) {
-            // Grow array if needed (no mutex needed here since we're in main thread)
-            if (grow_directory_array(&global_dirs, tasks[i].max_dirs, *global_dir_count, NULL) != 0) {
-                printf("Error: Failed to grow directory array\n");
-                return;
-            }
-            
-            global_dirs[*global_dir_count] = tasks[i].local_dirs[j];
-            (*global_dir_count)++;
+    // Revalidation walks the earlier scan's tree alongside the directories;
+    // without it every directory is listed
+    if (prev) {
+        const DirRecord *prev_root = dirstore_totals(prev);
+        ctx.prev = prev;
+        ctx.prev_files = prev_files;
+        ctx.prev_tree = dirtree_build(prev, prev_root->size, prev_root->alloc_size, num_threads);
+    }
+
+    WorkPool *pool = workpool_create(num_threads, &ctx);
+    if (!pool) {
+        dirtree_free(ctx.prev_tree);
+        inodeset_destroy(ctx.inodes);
+        filestore_free(ctx.files);
+        dirstore_free(ctx.store);
+        free(ctx.workers);
+        return 0;
+    }
+
+    // The root is just the first task; its loose files are counted like any
+    // other directory's
+    ScanNode *root = scan_node_new(NULL, scan_strdup(path));
+    if (root) {
+        if (ctx.prev_tree) root->prev = 0;
+        progress_begin(num_threads);
+        atomic_fetch_add(&g_progress_slots[0].dirs_queued, 1);
+        workpool_push(pool, 0, scan_dir_task, root);
+        workpool_run(pool);
+        progress_end();
+    }
+    workpool_destroy(pool);
+    dirtree_free(ctx.prev_tree);
+    inodeset_destroy(ctx.inodes);
+
+    scan_workers_free(ctx.workers, num_threads);
+    if (dirstore_splice(ctx.store) == 0) {
+        *store = ctx.store;
+        *dir_count = dirstore_count(ctx.store);
+        *file_count = ctx.total_files;
+        if (ctx.files && filestore_finish(ctx.files, ctx.store) == 0) {
+            *files = ctx.files;
+            ctx.files = NULL;
         }
+    } else {
+        dirstore_free(ctx.store);
     }
+    filestore_free(ctx.files);
+    if (total_alloc) *total_alloc = ctx.total_alloc;
+    if (relisted) *relisted = atomic_load(&ctx.relisted);
+    return ctx.total_size;
+}
+
+uint64_t scan_directory(const char *path, const ScanOptions *opts, DirStore **store, FileStore **files,
+                        uint64_t *dir_count, uint64_t *file_count, uint64_t *total_alloc) {
+    return scan_run(path, opts, NULL, NULL, store, files, dir_count, file_count, total_alloc, NULL);
+}
+
+uint64_t scan_revalidate(const char *path, const ScanOptions *opts,
+                         const DirStore *prev, const FileStore *prev_files,
+                         DirStore **store, FileStore **files, uint64_t *dir_count,
+                         uint64_t *file_count, uint64_t *total_alloc, uint64_t *relisted) {
+    return scan_run(path, opts, prev, prev_files, store, files, dir_count, file_count, total_alloc, relisted);
 }
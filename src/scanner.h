@@ -1,67 +1,156 @@
-#ifndef SCANNER_H 
-#define SCANNER_H 
+#ifndef SCANNER_H
+#define SCANNER_H
 
 #include <stdint.h>
 #include <pthread.h>
+#include "dirstore.h"
+#include "filestore.h"
 
 #define MAX_PATH_LEN 4096
-#define INITIAL_MAX_DIRS 100000
-#define MAX_THREADS 8
 
-// Struct to store directory information 
-typedef struct{
-    char path[MAX_PATH_LEN];
-    uint64_t size;
-} DirInfo;
+// How file metadata is fetched
+typedef enum {
+    SCAN_ENGINE_SYNC = 0,             // one blocking stat per entry
+    SCAN_ENGINE_URING                 // Linux: batched statx through io_uring,
+                                      // silently falls back to SYNC when unavailable
+} ScanEngine;
 
-// Struct for thread task
+// What a scan keeps besides the totals
+typedef enum {
+    SCAN_RETAIN_LARGE = 0,            // directories over min_size (1 MB by default) and the
+                                      // root's children; smaller ones only add to their parent
+    SCAN_RETAIN_DIRS,                 // every directory
+    SCAN_RETAIN_FILES                 // every directory and every file
+} ScanRetain;
+
+// Cancels or pauses a running scan from another thread. Workers look at it
+// before each directory (and between reads of a large one): after a cancel
+// every queued directory is dropped unopened, so the scan returns within
+// about one directory listing per worker, with what it found so far.
+// Pausing holds each worker before its next directory until resumed or
+// cancelled. One token serves one scan at a time; reset it between scans.
+typedef struct ScanControl ScanControl;
+
+// Completed directories handed to a viewer while the scan runs (stream.h)
+typedef struct ScanStream ScanStream;
+
+// Scan configuration
 typedef struct {
-    char path[MAX_PATH_LEN];
-    DirInfo *dirs;                    // Global dirs array (for merging)
-    int *dir_count;                   // Global dir_count (for merging)
-    int *file_count;                  // Global file_count (shared)
-    uint64_t total_size;              // Thread's total size
-    pthread_mutex_t *mutex;           // Global mutex
-    DirInfo *local_dirs;              // Thread-local directory storage (heap allocated)
-    int local_dir_count;              // Thread-local directory count
-    int *max_dirs;                    // Pointer to current max_dirs (for dynamic growth)
-} ThreadTask;
+    int num_threads;                  // Worker threads, 0 = one per online CPU
+    int no_sync;                      // Linux: AT_STATX_DONT_SYNC, use cached attributes
+                                      // on network filesystems instead of revalidating
+    ScanEngine engine;
+    int follow_symlinks;              // Descend into symlinked directories (loops and
+                                      // directories seen twice are still scanned once)
+    ScanRetain retain;
+    uint64_t min_size;                // LARGE: directory threshold (0 = 1 MB); FILES: smaller
+                                      // files go to their directory's "other" bucket
+    ScanControl *control;             // NULL: the scan always runs to the end
+    ScanStream *stream;               // NULL: results only on return
+} ScanOptions;
 
 // Checks if a directory should be skipped
 int should_skip(const char *name);
 
-// Scans a directory recursively. Thread-safe.
-// Returns total size of directory.
-// dirs and dir_count can be NULL if we only want total size
+// Scans a directory tree with a work-stealing pool: every subdirectory found
+// at any depth becomes a task any idle worker can pick up, and loose files in
+// `path` itself are counted by the same pool.
+// Returns total size of the tree; its allocated size goes to *total_alloc
+// (may be NULL). On return *store holds the recorded directories (caller
+// frees it with dirstore_free(); NULL on failure) and, with SCAN_RETAIN_FILES,
+// *files their files (filestore_free(); `files` may be NULL to skip them).
+// *file_count receives the regular files found and *dir_count the
+// directories recorded; scanner_progress_snapshot() follows a running scan.
 uint64_t scan_directory(
     const char *path,
-    DirInfo *dirs,
-    int *dir_count,
-    int *file_count,
-    pthread_mutex_t *mutex,
-    int *max_dirs
+    const ScanOptions *opts,
+    DirStore **store,
+    FileStore **files,
+    uint64_t *dir_count,
+    uint64_t *file_count,
+    uint64_t *total_alloc
+);
+
+// Bring an earlier scan of `path` up to date. `prev` must have retained every
+// directory (SCAN_RETAIN_DIRS or more); `prev_files` its files, needed for
+// SCAN_RETAIN_FILES. Every directory is still opened and stat'ed, but one
+// whose identity and timestamps match its record is not listed: its own
+// files are taken from `prev`. Only entries added, removed or renamed change
+// a directory's timestamps, so a file whose size changed in place is only
+// seen once its directory is listed again. Results as for scan_directory()
+// (new stores; `prev` is left alone); *relisted receives the number of
+// directories listed (changed or new).
+uint64_t scan_revalidate(
+    const char *path,
+    const ScanOptions *opts,
+    const DirStore *prev,
+    const FileStore *prev_files,
+    DirStore **store,
+    FileStore **files,
+    uint64_t *dir_count,
+    uint64_t *file_count,
+    uint64_t *total_alloc,
+    uint64_t *relisted
 );
 
-// Worker thread function
-void* scan_thread_worker(void *arg);
+// Number of workers scan_directory() will use for these options
+int scanner_thread_count(const ScanOptions *opts);
+
+// Allocated / logical size: below 1 for sparse (or compressed) data, above
+// 1 for block slack. 0 for an empty directory.
+double scanner_alloc_ratio(uint64_t size, uint64_t alloc_size);
+
+// 1 if `engine` really runs on this system (else SCAN_ENGINE_SYNC is used)
+int scanner_engine_available(ScanEngine engine);
 
-// Merge thread results into global arrays
-void merge_thread_results(ThreadTask *tasks, int num_threads, DirInfo *global_dirs, int *global_dir_count);
+// Scan control token (NULL when out of memory). Cancelling only stores a
+// flag, so it may be called from a signal handler.
+ScanControl* scan_control_create(void);
+void scan_control_free(ScanControl *ctl);
+void scan_control_cancel(ScanControl *ctl);
+void scan_control_pause(ScanControl *ctl, int paused);
+int scan_control_paused(const ScanControl *ctl);
+// 1 if the scan run under `ctl` was cut short: some directories were not
+// listed (or not completely), so its totals cover only part of the tree
+int scan_control_incomplete(const ScanControl *ctl);
+// Directories of that scan that could not be opened or read (permissions,
+// out of descriptors...). Left out of the totals, but the scan still counts
+// as complete: it covered everything it can read.
+uint64_t scan_control_unreadable(const ScanControl *ctl);
+// Clear the cancel, pause and incomplete flags for the next scan
+void scan_control_reset(ScanControl *ctl);
 
-// Dynamic array management
-int grow_directory_array(DirInfo **dirs, int *max_dirs, int current_count, pthread_mutex_t *mutex);
+// What a worker is doing, in a progress snapshot
+typedef enum {
+    SCAN_WORKER_IDLE = 0,             // waiting for a directory
+    SCAN_WORKER_LISTING,              // listing one
+    SCAN_WORKER_PAUSED                // held by scan_control_pause()
+} ScanWorkerState;
 
-// Expose the most recent directories buffer pointer in case a realloc moved it
-// during scanning. Callers that passed an initial buffer can query this to get
-// the final, valid pointer after the scan completes.
-DirInfo* scanner_current_dirs(void);
+#define SCAN_PROGRESS_MAX_WORKERS 64  // workers whose state a snapshot holds
+
+// Progress of the scan running in this process (or the last one). Counts
+// are added once per finished directory, so a huge directory shows up
+// when its listing ends.
+typedef struct {
+    int running;                      // 1 while a scan runs
+    double elapsed;                   // seconds since it started
+    uint64_t files;                   // regular files counted so far
+    uint64_t bytes;                   // their logical size
+    uint64_t dirs;                    // directories finished
+    uint64_t dirs_pending;            // directories queued but not finished
+    double files_per_sec;             // rates since the previous snapshot
+    double bytes_per_sec;
+    int num_workers;
+    unsigned char worker_state[SCAN_PROGRESS_MAX_WORKERS];  // ScanWorkerState of the
+                                      // first num_workers (at most the max)
+    char path[MAX_PATH_LEN];          // a directory being listed, sampled every few ms
+} ScanProgress;
 
-// Live progress helpers
-void scanner_progress_set_path(const char* path);
-const char* scanner_progress_get_path(void);
-void scanner_progress_add_bytes(uint64_t bytes);
-uint64_t scanner_progress_get_bytes(void);
-void scanner_progress_reset(void);
+// Fill `snap` without blocking the workers. Pass the same struct each time
+// (zeroed before the first call): its previous contents give the interval
+// the rates are measured over.
+void scanner_progress_snapshot(ScanProgress *snap);
 
 
 #endif
@@ -0,0 +1,862 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "server.h"
+#include "cache.h"
+#include "dirtree.h"
+#include "history.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_MAX_ROOTS 64               // snapshots kept loaded
+
+// A loaded snapshot, read by any number of clients and never modified
+typedef struct {
+    char *root;
+    DirStore *store;
+    DirTree *tree;
+    uint64_t generation;                  // CacheHeader.generation
+    int64_t created_at;
+    char file[1024];                      // its cache file, and that file's identity
+    struct stat file_stat;
+    atomic_int refs;                      // the table's and every reader's
+} ServerSnapshot;
+
+static ServerSnapshot *server_table[SERVER_MAX_ROOTS];
+static int server_table_count = 0;
+static pthread_mutex_t server_table_lock = PTHREAD_MUTEX_INITIALIZER;   // guards the table
+static pthread_mutex_t server_load_lock = PTHREAD_MUTEX_INITIALIZER;    // one load at a time
+static atomic_int server_clients;
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_on_signal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+static void server_release(ServerSnapshot *snap) {
+    if (!snap || atomic_fetch_sub(&snap->refs, 1) != 1) return;
+    dirtree_free(snap->tree);
+    dirstore_free(snap->store);
+    free(snap->root);
+    free(snap);
+}
+
+// Length of `root` if `path` is it or lies below it, else 0
+static size_t server_within(const char *root, const char *path) {
+    size_t len = strlen(root);
+    if (len == 0 || strncmp(path, root, len) != 0) return 0;
+    if (path[len] == '\0' || path[len] == '/' || root[len - 1] == '/') return len;
+    return 0;
+}
+
+// Loaded snapshot of the closest root enclosing `path`, with a reference
+static ServerSnapshot* server_find(const char *path) {
+    ServerSnapshot *best = NULL;
+    size_t best_len = 0;
+    pthread_mutex_lock(&server_table_lock);
+    for (int i = 0; i < server_table_count; i++) {
+        size_t len = server_within(server_table[i]->root, path);
+        if (len > best_len) {
+            best = server_table[i];
+            best_len = len;
+        }
+    }
+    if (best) atomic_fetch_add(&best->refs, 1);
+    pthread_mutex_unlock(&server_table_lock);
+    return best;
+}
+
+// 0 once its cache file was replaced (a file that is gone has nothing newer)
+static int server_is_current(const ServerSnapshot *snap) {
+    struct stat st;
+    if (stat(snap->file, &st) != 0) return 1;
+    return st.st_ino == snap->file_stat.st_ino && st.st_dev == snap->file_stat.st_dev &&
+           st.st_size == snap->file_stat.st_size && st.st_mtime == snap->file_stat.st_mtime &&
+           st.st_mtim.tv_nsec == snap->file_stat.st_mtim.tv_nsec;
+}
+
+// Decode the cache holding `path` (its own, or an enclosing root's) whole
+static ServerSnapshot* server_load(const char *path) {
+    // Any retention qualifies
+    ScanOptions opts = { .min_size = UINT64_MAX };
+    int result;
+    uint64_t entry;
+    CacheView *view = cache_view_open_covering(path, &opts, &result, &entry);
+    if (!view) return NULL;
+
+    ServerSnapshot *snap = calloc(1, sizeof(ServerSnapshot));
+    if (snap) snap->root = strdup(cache_view_root(view));
+    if (!snap || !snap->root || cache_snapshot_file(snap->root, snap->file, sizeof(snap->file)) != 0 ||
+        stat(snap->file, &snap->file_stat) != 0 ||
+        cache_view_load(view, &opts, &snap->store, NULL) != 0) {
+        cache_view_close(view);
+        if (snap) free(snap->root);
+        free(snap);
+        return NULL;
+    }
+    snap->generation = cache_view_header(view)->generation;
+    snap->created_at = (int64_t)cache_view_header(view)->created_at;
+    cache_view_close(view);
+
+    const DirRecord *totals = dirstore_totals(snap->store);
+    snap->tree = dirtree_build(snap->store, totals->size, totals->alloc_size, 0);
+    if (!snap->tree) {
+        dirstore_free(snap->store);
+        free(snap->root);
+        free(snap);
+        return NULL;
+    }
+    atomic_init(&snap->refs, 1);
+    return snap;
+}
+
+// Put `snap` in the table, replacing the one of the same root (or the
+// oldest when full)
+static void server_publish(ServerSnapshot *snap) {
+    ServerSnapshot *old = NULL;
+    atomic_fetch_add(&snap->refs, 1);
+    pthread_mutex_lock(&server_table_lock);
+    int slot = 0;
+    while (slot < server_table_count && strcmp(server_table[slot]->root, snap->root) != 0) slot++;
+    if (slot == server_table_count && server_table_count == SERVER_MAX_ROOTS) {
+        // Full: the oldest snapshot makes room
+        slot = 0;
+        for (int i = 1; i < server_table_count; i++) {
+            if (server_table[i]->created_at < server_table[slot]->created_at) slot = i;
+        }
+    }
+    if (slot < server_table_count) {
+        old = server_table[slot];
+    } else {
+        server_table_count++;
+    }
+    server_table[slot] = snap;
+    pthread_mutex_unlock(&server_table_lock);
+    server_release(old);
+}
+
+// Current snapshot for `path` with a reference: the loaded one, reloaded
+// if its cache file was replaced, or loaded from the cache. NULL if none.
+static ServerSnapshot* server_acquire(const char *path) {
+    ServerSnapshot *snap = server_find(path);
+    if (snap && server_is_current(snap)) return snap;
+
+    pthread_mutex_lock(&server_load_lock);
+    ServerSnapshot *again = server_find(path);
+    if (again && again != snap && server_is_current(again)) {
+        pthread_mutex_unlock(&server_load_lock);
+        server_release(snap);
+        return again;
+    }
+    server_release(again);
+    ServerSnapshot *fresh = server_load(snap ? snap->root : path);
+    if (fresh) server_publish(fresh);
+    pthread_mutex_unlock(&server_load_lock);
+    if (!fresh) return snap;          // the stale one is still the best there is
+    server_release(snap);
+    return fresh;
+}
+
+// Tree node of `path` in a snapshot, DIRTREE_NONE if not recorded
+static uint64_t server_node(const ServerSnapshot *snap, const char *path) {
+    size_t len = server_within(snap->root, path);
+    if (len == 0) return DIRTREE_NONE;
+    const DirTree *tree = snap->tree;
+    uint64_t node = 0;
+    const char *p = path + len;
+    while (*p) {
+        while (*p == '/') p++;
+        const char *end = strchr(p, '/');
+        size_t part = end ? (size_t)(end - p) : strlen(p);
+        if (part == 0) break;
+        uint64_t child = tree->child_start[node];
+        while (child < tree->child_start[node + 1]) {
+            const char *name = dirstore_name(snap->store, tree->record[child]);
+            if (strncmp(name, p, part) == 0 && name[part] == '\0') break;
+            child++;
+        }
+        if (child == tree->child_start[node + 1]) return DIRTREE_NONE;
+        node = child;
+        p += part;
+    }
+    return node;
+}
+
+static const DirRecord* server_record(const ServerSnapshot *snap, uint64_t node) {
+    uint64_t record = snap->tree->record[node];
+    return record == DIRSTORE_NONE ? dirstore_totals(snap->store) : dirstore_get(snap->store, record);
+}
+
+// Names and paths are written with '\\', tab and newline escaped
+static void server_put_escaped(FILE *out, const char *s) {
+    for (const char *p = s; *p; p++) {
+        if (*p == '\\') fputs("\\\\", out);
+        else if (*p == '\t') fputs("\\t", out);
+        else if (*p == '\n') fputs("\\n", out);
+        else fputc(*p, out);
+    }
+}
+
+static void server_unescape(char *s) {
+    char *out = s;
+    for (const char *p = s; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            *out++ = *p == 't' ? '\t' : *p == 'n' ? '\n' : *p;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+static void server_put_path(FILE *out, const ServerSnapshot *snap, uint64_t node) {
+    uint64_t record = snap->tree->record[node];
+    char *path = record == DIRSTORE_NONE ? NULL : dirstore_path(snap->store, record);
+    server_put_escaped(out, path ? path : snap->root);
+    free(path);
+}
+
+// Nodes below `node` in breadth-first order, with the line of each one's
+// parent (0: `node`); NULL when out of memory
+static uint64_t* server_subtree(const DirTree *tree, uint64_t node, uint64_t **parent_line, uint64_t *count) {
+    uint64_t cap = 1024, n = 0;
+    uint64_t *nodes = malloc(cap * sizeof(uint64_t));
+    uint64_t *lines = malloc(cap * sizeof(uint64_t));
+    for (uint64_t i = 0; nodes && lines && i <= n; i++) {
+        uint64_t from = i == 0 ? node : nodes[i - 1];
+        for (uint64_t c = tree->child_start[from]; c < tree->child_start[from + 1]; c++) {
+            if (n == cap) {
+                cap *= 2;
+                uint64_t *grown = realloc(nodes, cap * sizeof(uint64_t));
+                if (grown) nodes = grown;
+                uint64_t *grown_lines = grown ? realloc(lines, cap * sizeof(uint64_t)) : NULL;
+                if (!grown_lines) {
+                    free(nodes);
+                    nodes = NULL;
+                    break;
+                }
+                lines = grown_lines;
+            }
+            nodes[n] = c;
+            lines[n++] = i;
+        }
+    }
+    if (!nodes || !lines) {
+        free(nodes);
+        free(lines);
+        return NULL;
+    }
+    *parent_line = lines;
+    *count = n;
+    return nodes;
+}
+
+static void server_reply_totals(FILE *out, const ServerSnapshot *snap, uint64_t node) {
+    const DirRecord *rec = server_record(snap, node);
+    fprintf(out, "OK 1\n%llu\t%llu\t%llu\t%llu\t%llu\t%u\t%u\n", (unsigned long long)rec->size,
+            (unsigned long long)rec->alloc_size, (unsigned long long)rec->files,
+            (unsigned long long)rec->dirs, (unsigned long long)rec->inodes, rec->direct_files,
+            rec->direct_dirs);
+}
+
+static void server_reply_children(FILE *out, const ServerSnapshot *snap, uint64_t node) {
+    const DirTree *tree = snap->tree;
+    fprintf(out, "OK %llu\n", (unsigned long long)dirtree_child_count(tree, node));
+    for (uint64_t c = tree->child_start[node]; c < tree->child_start[node + 1]; c++) {
+        const DirRecord *rec = server_record(snap, c);
+        fprintf(out, "%llu\t%llu\t%llu\t%llu\t", (unsigned long long)rec->size,
+                (unsigned long long)rec->alloc_size, (unsigned long long)rec->files,
+                (unsigned long long)rec->dirs);
+        server_put_escaped(out, dirstore_name(snap->store, tree->record[c]));
+        fputc('\n', out);
+    }
+}
+
+// Min-heap of nodes by subtree size
+static void server_heap_down(const DirTree *tree, uint64_t *heap, size_t count, size_t i) {
+    for (;;) {
+        size_t least = i, l = 2 * i + 1, r = l + 1;
+        if (l < count && tree->size[heap[l]] < tree->size[heap[least]]) least = l;
+        if (r < count && tree->size[heap[r]] < tree->size[heap[least]]) least = r;
+        if (least == i) return;
+        uint64_t t = heap[i];
+        heap[i] = heap[least];
+        heap[least] = t;
+        i = least;
+    }
+}
+
+static void server_reply_top(FILE *out, const ServerSnapshot *snap, uint64_t node, size_t n) {
+    const DirTree *tree = snap->tree;
+    uint64_t *parent_line, count;
+    uint64_t *nodes = server_subtree(tree, node, &parent_line, &count);
+    if (!nodes) {
+        fprintf(out, "ERR out of memory\n");
+        return;
+    }
+    free(parent_line);
+    // The count comes from the client: never more than the subtree holds
+    if (n > count) n = (size_t)count;
+    uint64_t *heap = malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!heap) {
+        free(nodes);
+        fprintf(out, "ERR out of memory\n");
+        return;
+    }
+
+    // Keep the n largest, then sort them largest first by popping the heap
+    size_t kept = 0;
+    for (uint64_t i = 0; i < count && n > 0; i++) {
+        if (kept < n) {
+            heap[kept++] = nodes[i];
+            if (kept == n) {
+                for (size_t k = n / 2; k-- > 0; ) server_heap_down(tree, heap, n, k);
+            }
+        } else if (tree->size[nodes[i]] > tree->size[heap[0]]) {
+            heap[0] = nodes[i];
+            server_heap_down(tree, heap, n, 0);
+        }
+    }
+    if (kept < n) {
+        for (size_t k = kept / 2; k-- > 0; ) server_heap_down(tree, heap, kept, k);
+    }
+    for (size_t k = kept; k > 1; k--) {
+        uint64_t t = heap[0];
+        heap[0] = heap[k - 1];
+        heap[k - 1] = t;
+        server_heap_down(tree, heap, k - 1, 0);
+    }
+
+    fprintf(out, "OK %llu\n", (unsigned long long)kept);
+    for (size_t k = 0; k < kept; k++) {
+        const DirRecord *rec = server_record(snap, heap[k]);
+        fprintf(out, "%llu\t%llu\t%llu\t%llu\t", (unsigned long long)rec->size,
+                (unsigned long long)rec->alloc_size, (unsigned long long)rec->files,
+                (unsigned long long)rec->dirs);
+        server_put_path(out, snap, heap[k]);
+        fputc('\n', out);
+    }
+    free(nodes);
+    free(heap);
+}
+
+static void server_reply_tree(FILE *out, const ServerSnapshot *snap, uint64_t node) {
+    uint64_t *parent_line, count;
+    uint64_t *nodes = server_subtree(snap->tree, node, &parent_line, &count);
+    if (!nodes) {
+        fprintf(out, "ERR out of memory\n");
+        return;
+    }
+    fprintf(out, "OK %llu\n", (unsigned long long)(count + 1));
+    for (uint64_t i = 0; i <= count; i++) {
+        uint64_t n = i == 0 ? node : nodes[i - 1];
+        const DirRecord *rec = server_record(snap, n);
+        if (i == 0) {
+            fputs("-\t", out);
+        } else {
+            fprintf(out, "%llu\t", (unsigned long long)parent_line[i - 1]);
+        }
+        fprintf(out, "%llu\t%llu\t%llu\t%llu\t%llu\t%u\t%u\t", (unsigned long long)rec->size,
+                (unsigned long long)rec->alloc_size, (unsigned long long)rec->files,
+                (unsigned long long)rec->dirs, (unsigned long long)rec->inodes, rec->direct_files,
+                rec->direct_dirs);
+        uint64_t record = snap->tree->record[n];
+        server_put_escaped(out, record == DIRSTORE_NONE ? "" : dirstore_name(snap->store, record));
+        fputc('\n', out);
+    }
+    free(nodes);
+    free(parent_line);
+}
+
+static int server_compare_change(const void *a, const void *b) {
+    const HistoryChange *ca = (const HistoryChange *)a;
+    const HistoryChange *cb = (const HistoryChange *)b;
+    uint64_t da = ca->new_size > ca->old_size ? ca->new_size - ca->old_size : ca->old_size - ca->new_size;
+    uint64_t db = cb->new_size > cb->old_size ? cb->new_size - cb->old_size : cb->old_size - cb->new_size;
+    if (da != db) return da < db ? 1 : -1;
+    return strcmp(ca->path, cb->path);
+}
+
+static void server_reply_diff(FILE *out, const ServerSnapshot *snap, const char *path, size_t back) {
+    char history_path[1024];
+    HistoryBlock *blocks = NULL;
+    size_t count = 0;
+    if (cache_history_file(snap->root, history_path, sizeof(history_path)) != 0 ||
+        history_list(history_path, snap->root, &blocks, &count) != 0 || count <= back) {
+        free(blocks);
+        fprintf(out, "ERR no snapshot %llu saves back\n", (unsigned long long)back);
+        return;
+    }
+    free(blocks);
+    HistoryChange *changes;
+    size_t num_changes;
+    if (history_diff(history_path, snap->root, count - 1 - back, count - 1, &changes, &num_changes) != 0) {
+        fprintf(out, "ERR history unreadable\n");
+        return;
+    }
+
+    // Changes are relative to the root ("" for it): keep the ones under path
+    const char *rel = path + server_within(snap->root, path);
+    while (*rel == '/') rel++;
+    size_t rel_len = strlen(rel);
+    size_t kept = 0;
+    for (size_t i = 0; i < num_changes; i++) {
+        const char *p = changes[i].path;
+        if (rel_len == 0 || (strncmp(p, rel, rel_len) == 0 && (p[rel_len] == '\0' || p[rel_len] == '/'))) {
+            HistoryChange t = changes[kept];
+            changes[kept++] = changes[i];
+            changes[i] = t;
+        }
+    }
+    qsort(changes, kept, sizeof(HistoryChange), server_compare_change);
+
+    size_t root_len = strlen(snap->root);
+    const char *sep = root_len > 0 && snap->root[root_len - 1] == '/' ? "" : "/";
+    fprintf(out, "OK %llu\n", (unsigned long long)kept);
+    for (size_t i = 0; i < kept; i++) {
+        fprintf(out, "%llu\t%llu\t", (unsigned long long)changes[i].old_size,
+                (unsigned long long)changes[i].new_size);
+        server_put_escaped(out, snap->root);
+        if (changes[i].path[0]) {
+            fputs(sep, out);
+            server_put_escaped(out, changes[i].path);
+        }
+        fputc('\n', out);
+    }
+    history_free_changes(changes, num_changes);
+}
+
+static void server_reply_roots(FILE *out) {
+    pthread_mutex_lock(&server_table_lock);
+    fprintf(out, "OK %d\n", server_table_count);
+    for (int i = 0; i < server_table_count; i++) {
+        fprintf(out, "%llu\t%llu\t%lld\t", (unsigned long long)dirstore_count(server_table[i]->store),
+                (unsigned long long)server_table[i]->generation, (long long)server_table[i]->created_at);
+        server_put_escaped(out, server_table[i]->root);
+        fputc('\n', out);
+    }
+    pthread_mutex_unlock(&server_table_lock);
+}
+
+// Answer one request line
+static void server_handle(char *line, FILE *out) {
+    char *arg = strchr(line, ' ');
+    if (arg) *arg++ = '\0';
+    if (strcmp(line, "ROOTS") == 0) {
+        server_reply_roots(out);
+        return;
+    }
+
+    // Optional count, then the path
+    size_t n = 0;
+    int counted = strcmp(line, "TOP") == 0 || strcmp(line, "DIFF") == 0;
+    if (counted && arg) {
+        char *end;
+        n = (size_t)strtoull(arg, &end, 10);
+        arg = *end == ' ' ? end + 1 : NULL;
+    }
+    int known = counted || strcmp(line, "TOTALS") == 0 || strcmp(line, "CHILDREN") == 0 ||
+                strcmp(line, "TREE") == 0;
+    if (!known) {
+        fprintf(out, "ERR unknown request\n");
+        return;
+    }
+    if (!arg || !*arg) {
+        fprintf(out, "ERR missing path\n");
+        return;
+    }
+    server_unescape(arg);
+    char path[MAX_PATH_LEN];
+    if (cache_normalize_path(arg, path, sizeof(path)) != 0) {
+        snprintf(path, sizeof(path), "%s", arg);  // gone since: the snapshot may still have it
+    }
+
+    ServerSnapshot *snap = server_acquire(path);
+    uint64_t node = snap ? server_node(snap, path) : DIRTREE_NONE;
+    if (!snap) {
+        fprintf(out, "ERR no snapshot of ");
+        server_put_escaped(out, path);
+        fputc('\n', out);
+    } else if (strcmp(line, "DIFF") == 0) {
+        if (n == 0) fprintf(out, "ERR DIFF takes a number of saves back\n");
+        else server_reply_diff(out, snap, path, n);
+    } else if (node == DIRTREE_NONE) {
+        fprintf(out, "ERR not recorded: ");
+        server_put_escaped(out, path);
+        fputc('\n', out);
+    } else if (strcmp(line, "TOTALS") == 0) {
+        server_reply_totals(out, snap, node);
+    } else if (strcmp(line, "CHILDREN") == 0) {
+        server_reply_children(out, snap, node);
+    } else if (strcmp(line, "TOP") == 0) {
+        server_reply_top(out, snap, node, n);
+    } else {
+        server_reply_tree(out, snap, node);
+    }
+    server_release(snap);
+}
+
+static void* server_client_thread(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    int out_fd = dup(fd);
+    FILE *in = fdopen(fd, "r");
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    char *line = malloc(SERVER_LINE_MAX);
+    while (in && out && line && fgets(line, SERVER_LINE_MAX, in)) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+        server_handle(line, out);
+        if (fflush(out) != 0) break;
+    }
+    free(line);
+    if (in) fclose(in); else close(fd);
+    if (out) fclose(out); else if (out_fd >= 0) close(out_fd);
+    atomic_fetch_sub(&server_clients, 1);
+    return NULL;
+}
+
+int server_default_socket(char *path, size_t len) {
+    struct sockaddr_un addr;
+    int n = snprintf(path, len, "%s/%s", cache_get_path(), SERVER_SOCKET_NAME);
+    return n < 0 || (size_t)n >= len || (size_t)n >= sizeof(addr.sun_path) ? -1 : 0;
+}
+
+int server_run(const char *socket_path, char **roots, int num_roots) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("Error: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // A socket left by a server that is gone is replaced, a live one is not
+    ServerClient *probe = server_connect(socket_path);
+    if (probe) {
+        server_close(probe);
+        printf("Error: a server already answers on %s\n", socket_path);
+        return -1;
+    }
+    unlink(socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        chmod(socket_path, 0600) != 0 || listen(fd, SERVER_MAX_CLIENTS) != 0) {
+        printf("Error: cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    for (int i = 0; i < num_roots; i++) {
+        char path[MAX_PATH_LEN];
+        if (cache_normalize_path(roots[i], path, sizeof(path)) != 0) {
+            snprintf(path, sizeof(path), "%s", roots[i]);
+        }
+        ServerSnapshot *snap = server_acquire(path);
+        if (snap) {
+            printf("Loaded %s (%llu directories)\n", snap->root,
+                   (unsigned long long)dirstore_count(snap->store));
+        } else {
+            printf("Warning: no usable cache of %s, scan it first\n", path);
+        }
+        server_release(snap);
+    }
+
+    // Replies to a client that hung up must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // Client threads (and the workers they start) leave those signals to
+    // this one: only interrupting accept() below stops the server
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+
+    printf("Serving on %s, Ctrl+C to stop...\n", socket_path);
+    fflush(stdout);
+    while (!server_stop) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) continue;     // EINTR on a signal, or a client gone already
+        if (atomic_fetch_add(&server_clients, 1) >= SERVER_MAX_CLIENTS) {
+            const char busy[] = "ERR busy\n";
+            if (write(client, busy, sizeof(busy) - 1) < 0) {
+                // the client is gone anyway
+            }
+            close(client);
+            atomic_fetch_sub(&server_clients, 1);
+            continue;
+        }
+        pthread_t thread;
+        pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+        int created = pthread_create(&thread, NULL, server_client_thread, (void *)(intptr_t)client);
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+        if (created != 0) {
+            close(client);
+            atomic_fetch_sub(&server_clients, 1);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    printf("\nStopping...\n");
+    close(fd);
+    unlink(socket_path);
+
+    // Snapshots still read by a client go with the process
+    if (atomic_load(&server_clients) == 0) {
+        for (int i = 0; i < server_table_count; i++) server_release(server_table[i]);
+        server_table_count = 0;
+    }
+    return 0;
+}
+
+struct ServerClient {
+    FILE *in;
+    FILE *out;
+};
+
+ServerClient* server_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return NULL;
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return NULL;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    ServerClient *client = calloc(1, sizeof(ServerClient));
+    int out_fd = dup(fd);
+    if (client) client->in = fdopen(fd, "r");
+    if (client && client->in && out_fd >= 0) client->out = fdopen(out_fd, "w");
+    if (!client || !client->in || !client->out) {
+        if (client && client->in) fclose(client->in); else close(fd);
+        if (out_fd >= 0 && !(client && client->out)) close(out_fd);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+void server_close(ServerClient *client) {
+    if (!client) return;
+    fclose(client->in);
+    fclose(client->out);
+    free(client);
+}
+
+// One reply line without its newline (malloc'd), NULL at the end
+static char* server_read_line(ServerClient *client) {
+    char *line = malloc(SERVER_LINE_MAX);
+    if (!line || !fgets(line, SERVER_LINE_MAX, client->in)) {
+        free(line);
+        return NULL;
+    }
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+    return line;
+}
+
+// Send a request; the reply's line count for OK, -1 for ERR (*error, if not
+// NULL, gets the message) or a broken connection (*error NULL)
+static long long server_send(ServerClient *client, const char *request, char **error) {
+    if (error) *error = NULL;
+    if (fprintf(client->out, "%s\n", request) < 0 || fflush(client->out) != 0) return -1;
+    char *status = server_read_line(client);
+    if (!status) return -1;
+    long long count = -1;
+    if (strncmp(status, "OK ", 3) == 0) {
+        count = strtoll(status + 3, NULL, 10);
+    } else if (strncmp(status, "ERR", 3) == 0 && error) {
+        *error = strdup(status[3] == ' ' ? status + 4 : status + 3);
+    }
+    free(status);
+    return count;
+}
+
+int server_format_request(char *out, size_t len, const char *command, const char *path) {
+    size_t n = (size_t)snprintf(out, len, "%s", command);
+    if (n >= len) return -1;
+    if (!path) return 0;
+    if (n + 1 >= len) return -1;
+    out[n++] = ' ';
+    for (const char *p = path; *p; p++) {
+        char escaped = *p == '\\' ? '\\' : *p == '\t' ? 't' : *p == '\n' ? 'n' : 0;
+        if (n + (escaped ? 2 : 1) >= len) return -1;
+        if (escaped) {
+            out[n++] = '\\';
+            out[n++] = escaped;
+        } else {
+            out[n++] = *p;
+        }
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+int server_request(ServerClient *client, const char *request, char ***lines, size_t *count) {
+    *lines = NULL;
+    *count = 0;
+    char *error;
+    long long n = server_send(client, request, &error);
+    if (n < 0) {
+        if (!error) return -1;
+        *lines = malloc(sizeof(char *));
+        if (!*lines) {
+            free(error);
+            return -1;
+        }
+        (*lines)[0] = error;
+        *count = 1;
+        return 1;
+    }
+    *lines = malloc((n ? (size_t)n : 1) * sizeof(char *));
+    if (!*lines) return -1;
+    for (long long i = 0; i < n; i++) {
+        (*lines)[i] = server_read_line(client);
+        if (!(*lines)[i]) {
+            server_free_lines(*lines, *count);
+            *lines = NULL;
+            *count = 0;
+            return -1;
+        }
+        (*count)++;
+    }
+    return 0;
+}
+
+void server_free_lines(char **lines, size_t count) {
+    for (size_t i = 0; i < count; i++) free(lines[i]);
+    free(lines);
+}
+
+// Fields of a TREE line in place; 0 if it has all nine
+static int server_split(char *line, char **field) {
+    int n = 0;
+    field[n++] = line;
+    for (char *p = line; *p && n < 9; p++) {
+        if (*p == '\t') {
+            *p = '\0';
+            field[n++] = p + 1;
+        }
+    }
+    return n == 9 ? 0 : -1;
+}
+
+DirStore* server_fetch_store(const char *socket_path, const char *path) {
+    char normalized[MAX_PATH_LEN];
+    char request[SERVER_LINE_MAX];
+    if (cache_normalize_path(path, normalized, sizeof(normalized)) != 0 ||
+        server_format_request(request, sizeof(request), "TREE", normalized) != 0) {
+        return NULL;
+    }
+    ServerClient *client = server_connect(socket_path);
+    if (!client) return NULL;
+    long long count = server_send(client, request, NULL);
+    DirStore *store = count > 0 ? dirstore_create(normalized) : NULL;
+
+    // Line 0 is the path itself, line k record k - 1
+    for (long long i = 0; store && i < count; i++) {
+        char *line = server_read_line(client);
+        char *field[9];
+        int ok = line && server_split(line, field) == 0;
+        DirRecord *rec = NULL;
+        if (ok && i == 0) {
+            rec = dirstore_totals(store);
+            rec->parent = DIRSTORE_NONE;
+        } else if (ok) {
+            uint64_t parent = strtoull(field[0], NULL, 10);
+            server_unescape(field[8]);
+            uint64_t index = parent < (uint64_t)i ?
+                dirstore_add(store, parent == 0 ? DIRSTORE_NONE : parent - 1, field[8], 0, 0) : DIRSTORE_NONE;
+            rec = index == DIRSTORE_NONE ? NULL : dirstore_get(store, index);
+        }
+        if (rec) {
+            rec->size = strtoull(field[1], NULL, 10);
+            rec->alloc_size = strtoull(field[2], NULL, 10);
+            rec->files = strtoull(field[3], NULL, 10);
+            rec->dirs = strtoull(field[4], NULL, 10);
+            rec->inodes = strtoull(field[5], NULL, 10);
+            rec->direct_files = (uint32_t)strtoul(field[6], NULL, 10);
+            rec->direct_dirs = (uint32_t)strtoul(field[7], NULL, 10);
+            rec->stamp = 0;
+        } else {
+            dirstore_free(store);
+            store = NULL;
+        }
+        free(line);
+    }
+    server_close(client);
+    return store;
+}
+
+#else
+
+int server_default_socket(char *path, size_t len) {
+    (void)path;
+    (void)len;
+    return -1;
+}
+
+int server_run(const char *socket_path, char **roots, int num_roots) {
+    (void)roots;
+    (void)num_roots;
+    printf("Error: serving on %s needs Unix domain sockets\n", socket_path);
+    return -1;
+}
+
+ServerClient* server_connect(const char *socket_path) {
+    (void)socket_path;
+    return NULL;
+}
+
+void server_close(ServerClient *client) {
+    (void)client;
+}
+
+int server_format_request(char *out, size_t len, const char *command, const char *path) {
+    (void)out;
+    (void)len;
+    (void)command;
+    (void)path;
+    return -1;
+}
+
+int server_request(ServerClient *client, const char *request, char ***lines, size_t *count) {
+    (void)client;
+    (void)request;
+    *lines = NULL;
+    *count = 0;
+    return -1;
+}
+
+void server_free_lines(char **lines, size_t count) {
+    (void)lines;
+    (void)count;
+}
+
+DirStore* server_fetch_store(const char *socket_path, const char *path) {
+    (void)socket_path;
+    (void)path;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include "dirstore.h"
+
+// Query server (POSIX): `diskscout serve` keeps cached snapshots in memory
+// and answers requests on a Unix socket, one thread per client. A loaded
+// snapshot (store plus breadth-first DirTree) is never modified, so clients
+// read it without locks; when its cache file is replaced (a new save or a
+// --watch checkpoint) the next request loads the new one and swaps it in,
+// the old one being freed with its last reader.
+//
+// Protocol: a request is one line, the reply "OK <n>" and n lines, or
+// "ERR <message>". A connection may carry any number of requests. Fields
+// are tab-separated; names and paths come last, with '\\', tab and newline
+// escaped as \\, \t and \n. Paths are served from the loaded snapshot of
+// the closest enclosing root, loading one from the cache if needed.
+//   ROOTS                   entries, generation, created_at, root of every
+//                           loaded snapshot
+//   TOTALS <path>           size, alloc, files, dirs, inodes, direct files,
+//                           direct dirs of <path>
+//   CHILDREN <path>         size, alloc, files, dirs, name of each recorded
+//                           child, largest first
+//   TOP <n> <path>          size, alloc, files, dirs, path of the n largest
+//                           recorded directories below <path>
+//   DIFF <n> <path>         old size, new size, path of every directory under
+//                           <path> that changed since n saves back (history.h),
+//                           largest change first
+//   TREE <path>             <path> then every recorded directory below it,
+//                           breadth-first: parent line (0 for <path>, "-" for
+//                           <path> itself), size, alloc, files, dirs, inodes,
+//                           direct files, direct dirs, name
+
+#define SERVER_SOCKET_NAME "serve.sock"   // default socket, in the cache directory
+#define SERVER_MAX_CLIENTS 64
+#define SERVER_LINE_MAX (3 * 4096 + 64)   // an escaped path can triple in length
+
+// Default socket path (in cache_get_path()). Returns 0 or -1 (too long).
+int server_default_socket(char *path, size_t len);
+
+// Serve on `socket_path` until SIGINT or SIGTERM, `roots` (may be empty)
+// loaded up front. Returns 0, or -1 if the socket could not be set up.
+int server_run(const char *socket_path, char **roots, int num_roots);
+
+// Client side: a connection to a server, NULL if none answers
+typedef struct ServerClient ServerClient;
+ServerClient* server_connect(const char *socket_path);
+void server_close(ServerClient *client);
+// Request line `command` followed, if not NULL, by `path` (escaped). Returns
+// 0, or -1 if it does not fit in `len`.
+int server_format_request(char *out, size_t len, const char *command, const char *path);
+// Send `request` (one line, no newline) and read the reply: *lines gets its
+// n lines (server_free_lines()), or the message for ERR. Returns 0 for OK,
+// 1 for ERR, -1 when the connection failed.
+int server_request(ServerClient *client, const char *request, char ***lines, size_t *count);
+void server_free_lines(char **lines, size_t count);
+
+// The recorded tree of `path` from a server, as a scan of it would have
+// stored it (TREE request); NULL when no server answers or it has no
+// snapshot of `path`.
+DirStore* server_fetch_store(const char *socket_path, const char *path);
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "stream.h"
+
+struct ScanStream {
+    _Atomic(StreamEntry *) head;      // newest first
+    int max_depth;
+    uint64_t min_size;
+};
+
+ScanStream* stream_create(int max_depth, uint64_t min_size) {
+    ScanStream *stream = malloc(sizeof(ScanStream));
+    if (!stream) return NULL;
+    atomic_init(&stream->head, NULL);
+    stream->max_depth = max_depth;
+    stream->min_size = min_size;
+    return stream;
+}
+
+void stream_free(ScanStream *stream) {
+    if (!stream) return;
+    stream_release(atomic_load(&stream->head));
+    free(stream);
+}
+
+int stream_wants(const ScanStream *stream, int depth, uint64_t size) {
+    if (!stream || depth < 1) return 0;
+    return depth <= stream->max_depth || (stream->min_size && size >= stream->min_size);
+}
+
+int stream_push(ScanStream *stream, const char *path, const DirRecord *sums, int depth) {
+    size_t len = strlen(path) + 1;
+    StreamEntry *entry = malloc(sizeof(StreamEntry) + len);
+    if (!entry) return -1;
+    entry->size = sums->size;
+    entry->alloc_size = sums->alloc_size;
+    entry->files = sums->files;
+    entry->dirs = sums->dirs;
+    entry->direct_files = sums->direct_files;
+    entry->direct_dirs = sums->direct_dirs;
+    entry->depth = depth;
+    memcpy(entry->path, path, len);
+
+    // Entries are only ever taken all at once, so a head seen again is
+    // still the same list (no ABA)
+    StreamEntry *head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    do {
+        entry->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&stream->head, &head, entry,
+                                                    memory_order_release, memory_order_relaxed));
+    return 0;
+}
+
+StreamEntry* stream_take(ScanStream *stream) {
+    if (!stream) return NULL;
+    StreamEntry *entry = atomic_exchange_explicit(&stream->head, NULL, memory_order_acquire);
+
+    // Newest first as pushed: reverse
+    StreamEntry *oldest = NULL;
+    while (entry) {
+        StreamEntry *next = entry->next;
+        entry->next = oldest;
+        oldest = entry;
+        entry = next;
+    }
+    return oldest;
+}
+
+void stream_release(StreamEntry *entries) {
+    while (entries) {
+        StreamEntry *next = entries->next;
+        free(entries);
+        entries = next;
+    }
+}
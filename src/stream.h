@@ -0,0 +1,45 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include "scanner.h"
+
+// Directories of a running scan, handed over as they complete so that a
+// viewer can show the tree filling in. Workers push without locking (a
+// Treiber stack); one consumer takes everything pushed so far with a single
+// exchange and gets it oldest first. A directory completes after every
+// directory below it, so a taken entry never comes before one inside it.
+// Only directories down to `max_depth` below the scan root, and deeper ones
+// of at least `min_size` bytes, are pushed; their totals include everything
+// below them either way.
+
+typedef struct StreamEntry {
+    struct StreamEntry *next;         // next one taken (newer)
+    uint64_t size;
+    uint64_t alloc_size;
+    uint64_t files;                   // regular files in the subtree
+    uint64_t dirs;                    // directories in the subtree, itself excluded
+    uint32_t direct_files;
+    uint32_t direct_dirs;
+    int depth;                        // 1 for a child of the scan root
+    char path[];
+} StreamEntry;
+
+ScanStream* stream_create(int max_depth, uint64_t min_size);
+
+// Frees the stream and any entries not taken
+void stream_free(ScanStream *stream);
+
+// Whether a completed directory at `depth` with `size` bytes is pushed
+int stream_wants(const ScanStream *stream, int depth, uint64_t size);
+
+// Push one completed directory (its totals as recorded); any thread.
+// Returns 0, or -1 when out of memory (the entry is lost).
+int stream_push(ScanStream *stream, const char *path, const DirRecord *sums, int depth);
+
+// Everything pushed since the last call, oldest first (NULL when none);
+// one consumer at a time. Free the list with stream_release().
+StreamEntry* stream_take(ScanStream *stream);
+void stream_release(StreamEntry *entries);
+
+#endif
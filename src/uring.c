@@ -0,0 +1,288 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE            // struct statx
+#endif
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_TAG_CLOSE (~0ULL)   // completions nobody waits for (other closes are
+                                  // tagged with their open count, see uring_reap())
+
+// Ring indices are shared with the kernel: acquire what it produced,
+// release what we publish
+#define ring_load_acquire(p)     atomic_load_explicit((_Atomic unsigned *)(p), memory_order_acquire)
+#define ring_store_release(p, v) atomic_store_explicit((_Atomic unsigned *)(p), (v), memory_order_release)
+
+struct Uring {
+    int fd;
+    unsigned entries;           // SQ size
+    unsigned batch;             // statx per batch, the rest is kept for closes
+    unsigned inflight;          // submitted, completion not reaped yet
+    unsigned sq_local_tail;     // SQEs filled so far (published on submit)
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+};
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// The scanner needs STATX and CLOSE (both 5.6+, same as the probe itself)
+static int uring_probe_ops(int fd) {
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (!probe) return 0;
+
+    int ok = 0;
+    if (sys_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        ok = probe->last_op >= IORING_OP_STATX &&
+             (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) &&
+             (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+Uring* uring_create(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = sys_uring_setup(entries, &p);
+    if (fd < 0) return NULL;
+
+    if (!uring_probe_ops(fd)) {
+        close(fd);
+        return NULL;
+    }
+
+    Uring *r = calloc(1, sizeof(Uring));
+    if (!r) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->entries = p.sq_entries;
+    r->batch = p.sq_entries / 2;
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single_map = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map) {
+        if (r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+        r->cq_map_len = r->sq_map_len;
+    }
+
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        uring_destroy(r);
+        return NULL;
+    }
+    if (single_map) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) {
+            r->cq_map = NULL;
+            uring_destroy(r);
+            return NULL;
+        }
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        uring_destroy(r);
+        return NULL;
+    }
+
+    char *sq = r->sq_map;
+    r->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    char *cq = r->cq_map;
+    r->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_local_tail = *r->sq_tail;
+    return r;
+}
+
+unsigned uring_batch_size(const Uring *ring) {
+    return ring->batch;
+}
+
+static struct io_uring_sqe* uring_get_sqe(Uring *r) {
+    unsigned head = ring_load_acquire(r->sq_head);
+    if (r->sq_local_tail - head >= r->entries) return NULL;
+
+    unsigned idx = r->sq_local_tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    return sqe;
+}
+
+// Hand every filled SQE to the kernel
+static int uring_submit(Uring *r) {
+    ring_store_release(r->sq_tail, r->sq_local_tail);
+    unsigned to_submit = r->sq_local_tail - ring_load_acquire(r->sq_head);
+
+    while (to_submit > 0) {
+        int ret = sys_uring_enter(r->fd, to_submit, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return -1;
+        }
+        r->inflight += (unsigned)ret;
+        to_submit -= (unsigned)ret;
+    }
+    return 0;
+}
+
+// Consume ready completions. Results tagged 0..n-1 go to res[];
+// returns how many of those arrived. A close tagged with an open count
+// (an address, never a statx index) releases its descriptor there.
+static unsigned uring_reap(Uring *r, int *res, unsigned n) {
+    unsigned head = *r->cq_head;
+    unsigned tail = ring_load_acquire(r->cq_tail);
+    unsigned done = 0;
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        if (cqe->user_data < n) {
+            res[cqe->user_data] = cqe->res;
+            done++;
+        } else if (cqe->user_data >= r->entries && cqe->user_data != URING_TAG_CLOSE) {
+            atomic_fetch_sub((atomic_int *)(uintptr_t)cqe->user_data, 1);
+        }
+        r->inflight--;
+    }
+    ring_store_release(r->cq_head, head);
+    return done;
+}
+
+// Block until `n` tagged completions (or everything in flight when n == 0)
+static int uring_wait(Uring *r, int *res, unsigned n) {
+    unsigned done = uring_reap(r, res, n);
+    while (n ? done < n : r->inflight > 0) {
+        int ret = sys_uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) return -1;
+        done += uring_reap(r, res, n);
+    }
+    return 0;
+}
+
+int uring_statx_batch(Uring *r, int dirfd, const char *const *names, int n,
+                      int flags, unsigned mask, struct statx *bufs, int *res) {
+    if (n <= 0) return 0;
+    if ((unsigned)n > r->batch) return -1;
+
+    for (int i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe = uring_get_sqe(r);
+        if (!sqe) return -1; // cannot happen: closes never take more than entries - batch
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dirfd;
+        sqe->addr = (uint64_t)(uintptr_t)names[i];
+        sqe->len = mask;
+        sqe->statx_flags = (uint32_t)flags;
+        sqe->addr2 = (uint64_t)(uintptr_t)&bufs[i];
+        sqe->user_data = (uint64_t)i;
+    }
+
+    if (uring_submit(r) != 0) return -1;
+    if (uring_wait(r, res, (unsigned)n) != 0) return -1;
+    for (int i = 0; i < n; i++) {
+        if (res[i] > 0) res[i] = 0;
+    }
+    return 0;
+}
+
+// Synchronous fallback of uring_close_async()
+static void uring_close_now(int fd, atomic_int *open_count) {
+    close(fd);
+    if (open_count) atomic_fetch_sub(open_count, 1);
+}
+
+void uring_close_async(Uring *r, int fd, atomic_int *open_count) {
+    // Keep room for a full statx batch and for their completions
+    unsigned queued = r->sq_local_tail - ring_load_acquire(r->sq_head);
+    if (queued >= r->entries - r->batch || r->inflight >= r->entries) {
+        uring_reap(r, NULL, 0);
+        if (uring_submit(r) != 0 || r->inflight >= r->entries) {
+            uring_close_now(fd, open_count);
+            return;
+        }
+    }
+
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+    if (!sqe) {
+        uring_close_now(fd, open_count);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = open_count ? (uint64_t)(uintptr_t)open_count : URING_TAG_CLOSE;
+}
+
+void uring_destroy(Uring *r) {
+    if (!r) return;
+    if (r->sq_map && r->cq_map && r->sqes) {
+        // Queued closes only happen once submitted
+        if (uring_submit(r) == 0) uring_wait(r, NULL, 0);
+    }
+    if (r->sqes) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map) munmap(r->sq_map, r->sq_map_len);
+    close(r->fd);
+    free(r);
+}
+
+int uring_available(void) {
+    static atomic_int cached = -1;
+    int v = atomic_load(&cached);
+    if (v < 0) {
+        Uring *r = uring_create(8);
+        v = r != NULL;
+        uring_destroy(r);
+        atomic_store(&cached, v);
+    }
+    return v;
+}
+
+#else
+
+int uring_available(void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef URING_H
+#define URING_H
+
+// Minimal io_uring wrapper for the scanner (raw syscalls, no liburing).
+// One ring belongs to one worker thread: it is not safe to share a ring.
+// Used to batch the stat calls of a directory listing so the device sees a
+// queue of requests instead of one blocking stat at a time.
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+typedef struct Uring Uring;
+
+// Create a ring with room for `entries` requests in flight.
+// Returns NULL when io_uring is unavailable (old kernel, disabled by sysctl,
+// seccomp, missing IORING_OP_STATX/IORING_OP_CLOSE...).
+// Destroying a ring flushes its queued closes.
+Uring* uring_create(unsigned entries);
+void uring_destroy(Uring *ring);
+
+// Number of requests uring_statx_batch() accepts at once
+unsigned uring_batch_size(const Uring *ring);
+
+// statx() every names[i] relative to dirfd, all in flight together.
+// res[i] receives 0 or -errno, bufs[i] the result. n <= uring_batch_size().
+// Returns 0, or -1 if the ring itself failed (results are then unreliable).
+int uring_statx_batch(Uring *ring, int dirfd, const char *const *names, int n,
+                      int flags, unsigned mask, struct statx *bufs, int *res);
+
+// Queue a close() without submitting it: it rides along with the next
+// statx batch instead of costing a syscall of its own. `*open_count` (may
+// be NULL, may be shared between threads) drops by one once the descriptor
+// is really closed: when its completion is reaped, or at once if it had to
+// be closed synchronously.
+void uring_close_async(Uring *ring, int fd, atomic_int *open_count);
+#endif
+
+// 1 if io_uring with STATX support can be used on this system
+int uring_available(void);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LEB128 unsigned varints, shared by the file store and the cache format:
+// 7 bits per byte, low bits first, high bit set on all but the last byte.
+
+#define VARINT_MAX 10                 // bytes of the longest 64-bit varint
+
+static inline size_t varint_put(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+// Decode one varint, NULL if it runs past `end`
+static inline const unsigned char* varint_get(const unsigned char *p, const unsigned char *end, uint64_t *v) {
+    uint64_t out = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        out |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = out;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Signed values (differences) as small unsigned ones: 0, -1, 1, -2, ...
+static inline uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+#endif
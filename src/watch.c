@@ -0,0 +1,826 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE            // name_to_handle_at()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "watch.h"
+#include "cache.h"
+#include "format.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+
+#define WATCH_NONE UINT64_MAX
+#define WATCH_HANDLE_MAX 48           // larger file handles: inotify instead
+
+#define WATCH_INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | \
+                            IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+#define WATCH_FANOTIFY_MASK (FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_MOVED_FROM | FAN_MOVED_TO | \
+                             FAN_ONDIR)
+
+// A directory's file handle, as fanotify reports it, and its node
+typedef struct {
+    uint64_t node;                    // WATCH_NONE: free slot
+    int32_t type;
+    uint32_t bytes;
+    unsigned char handle[WATCH_HANDLE_MAX];
+} WatchHandle;
+
+// The store seen as a tree: node 0 is the root, node i + 1 record i.
+// Removed directories keep their records (the store has no delete) and are
+// marked gone until the next checkpoint compacts the store.
+typedef struct {
+    const char *root;
+    ScanOptions opts;
+    DirStore *store;
+    uint64_t nodes;
+    uint64_t cap;
+    uint64_t *parent;
+    uint64_t *first_child;
+    uint64_t *next_sibling;
+    uint64_t *own_size;               // the directory's own files and links,
+    uint64_t *own_alloc;              // its subdirectories left out
+    uint64_t *own_files;
+    uint64_t *own_inodes;             // itself included
+    int *wd;                          // inotify watch, -1 if none
+    unsigned char *gone;
+    unsigned char *dirty;             // queued to be listed again
+    uint64_t gone_count;
+
+    uint64_t *queue;
+    uint64_t queued;
+    uint64_t queue_cap;
+    double batch_start;               // when the first queued directory was marked
+
+    int inotify_fd;
+    uint64_t *by_wd;
+    size_t by_wd_cap;
+    int watch_limit_hit;
+
+    int fanotify_fd;
+    dev_t dev;
+    WatchHandle *handles;
+    size_t handle_cap;
+    size_t handle_count;
+
+    // Since the last report
+    uint64_t listed;
+    uint64_t added;
+    uint64_t removed;
+    int changed;                      // since the last checkpoint
+} Watch;
+
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_on_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+static double watch_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static DirRecord* watch_record(const Watch *w, uint64_t node) {
+    return node == 0 ? dirstore_totals(w->store) : dirstore_get(w->store, node - 1);
+}
+
+// Full path of a node (malloc'd)
+static char* watch_path(const Watch *w, uint64_t node) {
+    return node == 0 ? strdup(dirstore_root(w->store)) : dirstore_path(w->store, node - 1);
+}
+
+static int watch_grow(void **array, size_t elem, uint64_t cap) {
+    void *grown = realloc(*array, cap * elem);
+    if (!grown) return -1;
+    *array = grown;
+    return 0;
+}
+
+static int watch_reserve(Watch *w, uint64_t nodes) {
+    if (nodes <= w->cap) return 0;
+    uint64_t cap = w->cap ? w->cap : 1024;
+    while (cap < nodes) cap *= 2;
+    if (watch_grow((void **)&w->parent, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->first_child, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->next_sibling, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->own_size, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->own_alloc, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->own_files, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->own_inodes, sizeof(uint64_t), cap) != 0 ||
+        watch_grow((void **)&w->wd, sizeof(int), cap) != 0 ||
+        watch_grow((void **)&w->gone, 1, cap) != 0 ||
+        watch_grow((void **)&w->dirty, 1, cap) != 0) {
+        return -1;
+    }
+    w->cap = cap;
+    return 0;
+}
+
+static void watch_link(Watch *w, uint64_t node, uint64_t parent) {
+    w->parent[node] = parent;
+    w->next_sibling[node] = w->first_child[parent];
+    w->first_child[parent] = node;
+}
+
+static void watch_unlink(Watch *w, uint64_t node) {
+    uint64_t *link = &w->first_child[w->parent[node]];
+    while (*link != node) link = &w->next_sibling[*link];
+    *link = w->next_sibling[node];
+}
+
+// Tree and own sizes of nodes first .. end - 1, whose children are all in
+// that range; the first one's parent is already indexed (unless it is the root)
+static void watch_index(Watch *w, uint64_t first, uint64_t end) {
+    for (uint64_t n = first; n < end; n++) {
+        const DirRecord *rec = watch_record(w, n);
+        w->own_size[n] = rec->size;
+        w->own_alloc[n] = rec->alloc_size;
+        w->own_files[n] = rec->files;
+        w->own_inodes[n] = rec->inodes;
+        w->first_child[n] = WATCH_NONE;
+        w->next_sibling[n] = WATCH_NONE;
+        w->parent[n] = 0;
+        w->wd[n] = -1;
+        w->gone[n] = 0;
+        w->dirty[n] = 0;
+    }
+    for (uint64_t n = first > 0 ? first : 1; n < end; n++) {
+        const DirRecord *rec = watch_record(w, n);
+        uint64_t parent = rec->parent == DIRSTORE_NONE ? 0 : rec->parent + 1;
+        if (parent >= first) {
+            w->own_size[parent] -= rec->size;
+            w->own_alloc[parent] -= rec->alloc_size;
+            w->own_files[parent] -= rec->files;
+            w->own_inodes[parent] -= rec->inodes;
+        }
+        watch_link(w, n, parent);
+    }
+    if (end > w->nodes) w->nodes = end;
+}
+
+// Add deltas (two's complement) to a node, its parents and the totals
+static void watch_propagate(Watch *w, uint64_t node, uint64_t size, uint64_t alloc, uint64_t files,
+                            uint64_t dirs, uint64_t inodes) {
+    for (uint64_t n = node;; n = w->parent[n]) {
+        DirRecord *rec = watch_record(w, n);
+        rec->size += size;
+        rec->alloc_size += alloc;
+        rec->files += files;
+        rec->dirs += dirs;
+        rec->inodes += inodes;
+        if (n == 0) break;
+    }
+}
+
+static void watch_mark(Watch *w, uint64_t node) {
+    if (node >= w->nodes || w->gone[node] || w->dirty[node]) return;
+    if (w->queued == w->queue_cap) {
+        uint64_t cap = w->queue_cap ? w->queue_cap * 2 : 256;
+        if (watch_grow((void **)&w->queue, sizeof(uint64_t), cap) != 0) return;
+        w->queue_cap = cap;
+    }
+    if (w->queued == 0) w->batch_start = watch_now();
+    w->dirty[node] = 1;
+    w->queue[w->queued++] = node;
+}
+
+// Events were lost: list every directory again
+static void watch_mark_all(Watch *w) {
+    for (uint64_t n = 0; n < w->nodes; n++) watch_mark(w, n);
+}
+
+static uint64_t watch_handle_hash(int32_t type, const unsigned char *handle, uint32_t bytes) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (uint32_t)type;
+    for (uint32_t i = 0; i < bytes; i++) {
+        hash = (hash ^ handle[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static WatchHandle* watch_handle_slot(WatchHandle *table, size_t cap, int32_t type,
+                                      const unsigned char *handle, uint32_t bytes) {
+    size_t mask = cap - 1;
+    for (size_t i = (size_t)watch_handle_hash(type, handle, bytes) & mask;; i = (i + 1) & mask) {
+        WatchHandle *slot = &table[i];
+        if (slot->node == WATCH_NONE ||
+            (slot->type == type && slot->bytes == bytes && memcmp(slot->handle, handle, bytes) == 0)) {
+            return slot;
+        }
+    }
+}
+
+static uint64_t watch_handle_find(const Watch *w, int32_t type, const unsigned char *handle, uint32_t bytes) {
+    if (w->handle_cap == 0 || bytes > WATCH_HANDLE_MAX) return WATCH_NONE;
+    return watch_handle_slot(w->handles, w->handle_cap, type, handle, bytes)->node;
+}
+
+// Table of `cap` slots (a power of two) holding the handles of live nodes,
+// renumbered through `map` if not NULL
+static int watch_handle_rehash(Watch *w, size_t cap, const uint64_t *map) {
+    WatchHandle *table = malloc(cap * sizeof(WatchHandle));
+    if (!table) return -1;
+    for (size_t i = 0; i < cap; i++) table[i].node = WATCH_NONE;
+    size_t count = 0;
+    for (size_t i = 0; i < w->handle_cap; i++) {
+        WatchHandle *old = &w->handles[i];
+        if (old->node == WATCH_NONE || w->gone[old->node]) continue;
+        WatchHandle *slot = watch_handle_slot(table, cap, old->type, old->handle, old->bytes);
+        *slot = *old;
+        if (map) slot->node = map[old->node];
+        count++;
+    }
+    free(w->handles);
+    w->handles = table;
+    w->handle_cap = cap;
+    w->handle_count = count;
+    return 0;
+}
+
+static int watch_handle_add(Watch *w, uint64_t node, int32_t type, const unsigned char *handle, uint32_t bytes) {
+    if (bytes > WATCH_HANDLE_MAX) return -1;
+    if ((w->handle_count + 1) * 2 > w->handle_cap &&
+        watch_handle_rehash(w, w->handle_cap ? w->handle_cap * 2 : 1024, NULL) != 0) {
+        return -1;
+    }
+    WatchHandle *slot = watch_handle_slot(w->handles, w->handle_cap, type, handle, bytes);
+    if (slot->node == WATCH_NONE) w->handle_count++;
+    slot->node = node;
+    slot->type = type;
+    slot->bytes = bytes;
+    memcpy(slot->handle, handle, bytes);
+    return 0;
+}
+
+// Start receiving the events of a node's directory. Returns 0 or -1.
+static int watch_subscribe(Watch *w, uint64_t node) {
+    char *path = watch_path(w, node);
+    if (!path) return -1;
+    int ok = 0;
+    if (w->fanotify_fd >= 0) {
+        // One mark covers the filesystem; the node is found by its handle
+        union {
+            struct file_handle fh;
+            char bytes[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+        } handle;
+        struct stat st;
+        int mount_id;
+        int follow = w->opts.follow_symlinks ? AT_SYMLINK_FOLLOW : 0;
+        handle.fh.handle_bytes = MAX_HANDLE_SZ;
+        ok = stat(path, &st) == 0 && st.st_dev == w->dev &&
+             name_to_handle_at(AT_FDCWD, path, &handle.fh, &mount_id, follow) == 0 &&
+             watch_handle_add(w, node, handle.fh.handle_type, handle.fh.f_handle,
+                              handle.fh.handle_bytes) == 0;
+    } else if (w->inotify_fd >= 0) {
+        int wd = inotify_add_watch(w->inotify_fd, path, WATCH_INOTIFY_MASK);
+        if (wd < 0 && errno == ENOSPC && !w->watch_limit_hit) {
+            printf("Warning: inotify watch limit reached, some directories are not watched "
+                   "(raise fs.inotify.max_user_watches)\n");
+            w->watch_limit_hit = 1;
+        }
+        if (wd >= 0 && (size_t)wd >= w->by_wd_cap) {
+            size_t cap = w->by_wd_cap ? w->by_wd_cap : 1024;
+            while (cap <= (size_t)wd) cap *= 2;
+            if (watch_grow((void **)&w->by_wd, sizeof(uint64_t), cap) == 0) {
+                for (size_t i = w->by_wd_cap; i < cap; i++) w->by_wd[i] = WATCH_NONE;
+                w->by_wd_cap = cap;
+            }
+        }
+        if (wd >= 0 && (size_t)wd < w->by_wd_cap) {
+            w->by_wd[wd] = node;
+            w->wd[node] = wd;
+            ok = 1;
+        }
+    }
+    free(path);
+    return ok ? 0 : -1;
+}
+
+// Drop a directory and its subtree
+static void watch_remove(Watch *w, uint64_t node) {
+    const DirRecord *rec = watch_record(w, node);
+    watch_propagate(w, w->parent[node], 0 - rec->size, 0 - rec->alloc_size, 0 - rec->files,
+                    0 - (rec->dirs + 1), 0 - rec->inodes);
+    watch_unlink(w, node);
+
+    // Depth-first through the child lists, back up by the parents
+    uint64_t n = node;
+    for (;;) {
+        w->gone[n] = 1;
+        w->gone_count++;
+        int wd = w->wd[n];
+        if (wd >= 0 && w->by_wd[wd] == n) {
+            inotify_rm_watch(w->inotify_fd, wd);
+            w->by_wd[wd] = WATCH_NONE;
+        }
+        w->wd[n] = -1;
+        if (w->first_child[n] != WATCH_NONE) {
+            n = w->first_child[n];
+            continue;
+        }
+        while (n != node && w->next_sibling[n] == WATCH_NONE) n = w->parent[n];
+        if (n == node) break;
+        n = w->next_sibling[n];
+    }
+    w->removed++;
+}
+
+// Scan a new subdirectory `name` of `parent` and graft it in
+static void watch_add(Watch *w, uint64_t parent, const char *name) {
+    char *parent_path = watch_path(w, parent);
+    if (!parent_path) return;
+    size_t len = strlen(parent_path);
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s%s", parent_path, len > 0 && parent_path[len - 1] == '/' ? "" : "/", name);
+    free(parent_path);
+
+    ScanOptions opts = w->opts;
+    opts.retain = SCAN_RETAIN_DIRS;
+    DirStore *sub = NULL;
+    uint64_t dir_count = 0, file_count = 0, total_alloc = 0;
+    scan_directory(path, &opts, &sub, NULL, &dir_count, &file_count, &total_alloc);
+    if (!sub) return;
+
+    // The subdirectory's records follow its own, parents renumbered
+    const DirRecord *totals = dirstore_totals(sub);
+    uint64_t count = dirstore_count(sub);
+    uint64_t top = dirstore_count(w->store);
+    int ok = watch_reserve(w, top + 2 + count) == 0 &&
+             dirstore_add(w->store, parent == 0 ? DIRSTORE_NONE : parent - 1, name,
+                          totals->size, totals->alloc_size) == top;
+    if (ok) {
+        DirRecord *rec = dirstore_get(w->store, top);
+        uint64_t parent_index = rec->parent;
+        uint64_t name_off = rec->name_off;
+        *rec = *totals;
+        rec->parent = parent_index;
+        rec->name_off = name_off;
+    }
+    for (uint64_t i = 0; ok && i < count; i++) {
+        const DirRecord *src = dirstore_get(sub, i);
+        uint64_t index = dirstore_add(w->store, src->parent == DIRSTORE_NONE ? top : top + 1 + src->parent,
+                                      dirstore_name(sub, i), src->size, src->alloc_size);
+        if (index != top + 1 + i) {
+            ok = 0;
+            break;
+        }
+        DirRecord *rec = dirstore_get(w->store, index);
+        rec->files = src->files;
+        rec->dirs = src->dirs;
+        rec->inodes = src->inodes;
+        rec->direct_files = src->direct_files;
+        rec->direct_dirs = src->direct_dirs;
+        rec->stamp = src->stamp;
+    }
+    dirstore_free(sub);
+    if (!ok) {
+        printf("Warning: out of memory, %s is not tracked\n", path);
+        return;
+    }
+
+    uint64_t first = top + 1;
+    watch_index(w, first, first + 1 + count);
+    const DirRecord *rec = watch_record(w, first);
+    watch_propagate(w, parent, rec->size, rec->alloc_size, rec->files, rec->dirs + 1, rec->inodes);
+    for (uint64_t n = first; n < first + 1 + count; n++) {
+        watch_subscribe(w, n);
+    }
+    w->added++;
+}
+
+static int watch_compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Child `node` and its name, for the merge against a listing
+typedef struct {
+    const char *name;
+    uint64_t node;
+} WatchChild;
+
+static int watch_compare_children(const void *a, const void *b) {
+    return strcmp(((const WatchChild *)a)->name, ((const WatchChild *)b)->name);
+}
+
+// List a directory again: its own files' change goes up the tree,
+// subdirectories that appeared are scanned, vanished ones dropped
+static void watch_relist(Watch *w, uint64_t node) {
+    char *path = watch_path(w, node);
+    if (!path) return;
+    DIR *d = opendir(path);
+    free(path);
+    if (!d) return;                   // gone: its parent's listing drops it
+
+    uint64_t size = 0, alloc = 0, files = 0, others = 0;
+    char **names = NULL;
+    size_t num_names = 0, names_cap = 0;
+    int flags = w->opts.follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        const char *name = ent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || should_skip(name)) continue;
+        struct stat st;
+        if (fstatat(dirfd(d), name, &st, flags) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (num_names == names_cap) {
+                names_cap = names_cap ? names_cap * 2 : 16;
+                if (watch_grow((void **)&names, sizeof(char *), names_cap) != 0) break;
+            }
+            names[num_names] = strdup(name);
+            if (names[num_names]) num_names++;
+        } else if (S_ISREG(st.st_mode)) {
+            size += (uint64_t)st.st_size;
+            alloc += (uint64_t)st.st_blocks * 512;
+            files++;
+        } else {
+            others++;
+        }
+    }
+    closedir(d);
+
+    // Merge the sorted listing with the sorted children
+    size_t num_children = 0;
+    for (uint64_t c = w->first_child[node]; c != WATCH_NONE; c = w->next_sibling[c]) num_children++;
+    WatchChild *children = malloc((num_children ? num_children : 1) * sizeof(WatchChild));
+    if (children) {
+        size_t k = 0;
+        for (uint64_t c = w->first_child[node]; c != WATCH_NONE; c = w->next_sibling[c]) {
+            children[k].name = dirstore_name(w->store, c - 1);
+            children[k++].node = c;
+        }
+        if (num_children > 0) qsort(children, num_children, sizeof(WatchChild), watch_compare_children);
+        if (num_names > 0) qsort(names, num_names, sizeof(char *), watch_compare_names);
+
+        // Names only: the store may grow while subtrees are added
+        unsigned char *listed = calloc(num_names ? num_names : 1, 1);
+        uint64_t *vanished = malloc((num_children ? num_children : 1) * sizeof(uint64_t));
+        size_t num_vanished = 0;
+        size_t i = 0, j = 0;
+        while (listed && vanished && j < num_children) {
+            int cmp = i < num_names ? strcmp(names[i], children[j].name) : 1;
+            if (cmp == 0) {
+                listed[i++] = 1;
+                j++;
+            } else if (cmp < 0) {
+                i++;
+            } else {
+                vanished[num_vanished++] = children[j++].node;
+            }
+        }
+        if (listed && vanished) {
+            for (size_t k = 0; k < num_vanished; k++) watch_remove(w, vanished[k]);
+            for (size_t k = 0; k < num_names; k++) {
+                if (!listed[k]) watch_add(w, node, names[k]);
+            }
+        }
+        free(listed);
+        free(vanished);
+        free(children);
+    }
+    for (size_t k = 0; k < num_names; k++) free(names[k]);
+    free(names);
+
+    // The timestamps no longer match what the record holds: stamp unknown,
+    // so a revalidation lists it again
+    uint64_t inodes = files + others + 1;
+    watch_propagate(w, node, size - w->own_size[node], alloc - w->own_alloc[node],
+                    files - w->own_files[node], 0, inodes - w->own_inodes[node]);
+    w->own_size[node] = size;
+    w->own_alloc[node] = alloc;
+    w->own_files[node] = files;
+    w->own_inodes[node] = inodes;
+    DirRecord *rec = watch_record(w, node);
+    rec->direct_files = (uint32_t)files;
+    rec->direct_dirs = (uint32_t)num_names;
+    rec->stamp = 0;
+    w->listed++;
+}
+
+// Drop the gone records: a new store, nodes renumbered in order
+static int watch_compact(Watch *w) {
+    if (w->gone_count == 0) return 0;
+    uint64_t *map = malloc(w->nodes * sizeof(uint64_t));
+    DirStore *store = dirstore_create(dirstore_root(w->store));
+    if (!map || !store) {
+        free(map);
+        dirstore_free(store);
+        return -1;
+    }
+    uint64_t live = 1;
+    map[0] = 0;
+    for (uint64_t n = 1; n < w->nodes; n++) {
+        map[n] = w->gone[n] ? WATCH_NONE : live++;
+    }
+    for (uint64_t n = 1; n < w->nodes; n++) {
+        if (w->gone[n]) continue;
+        const DirRecord *src = watch_record(w, n);
+        uint64_t parent = map[w->parent[n]];
+        uint64_t index = dirstore_add(store, parent == 0 ? DIRSTORE_NONE : parent - 1,
+                                      dirstore_name(w->store, n - 1), src->size, src->alloc_size);
+        if (index == DIRSTORE_NONE) {
+            free(map);
+            dirstore_free(store);
+            return -1;
+        }
+        DirRecord *rec = dirstore_get(store, index);
+        rec->files = src->files;
+        rec->dirs = src->dirs;
+        rec->inodes = src->inodes;
+        rec->direct_files = src->direct_files;
+        rec->direct_dirs = src->direct_dirs;
+        rec->stamp = src->stamp;
+    }
+    *dirstore_totals(store) = *dirstore_totals(w->store);
+    if (w->handle_cap > 0 && watch_handle_rehash(w, w->handle_cap, map) != 0) {
+        free(map);
+        dirstore_free(store);
+        return -1;
+    }
+
+    // Moved down in place: a node's new number is never above its old one
+    for (uint64_t n = 1; n < w->nodes; n++) {
+        uint64_t m = map[n];
+        if (m == WATCH_NONE) continue;
+        w->parent[m] = map[w->parent[n]];
+        w->own_size[m] = w->own_size[n];
+        w->own_alloc[m] = w->own_alloc[n];
+        w->own_files[m] = w->own_files[n];
+        w->own_inodes[m] = w->own_inodes[n];
+        w->wd[m] = w->wd[n];
+        w->dirty[m] = w->dirty[n];
+        w->gone[m] = 0;
+    }
+    uint64_t queued = 0;
+    for (uint64_t i = 0; i < w->queued; i++) {
+        uint64_t m = map[w->queue[i]];
+        if (m != WATCH_NONE) w->queue[queued++] = m;
+    }
+    w->queued = queued;
+    w->nodes = live;
+    for (uint64_t n = 0; n < live; n++) w->first_child[n] = WATCH_NONE;
+    for (uint64_t n = 1; n < live; n++) {
+        watch_link(w, n, w->parent[n]);
+        if (w->wd[n] >= 0) w->by_wd[w->wd[n]] = n;
+    }
+    free(map);
+    dirstore_free(w->store);
+    w->store = store;
+    w->gone_count = 0;
+    return 0;
+}
+
+static void watch_print_time(void) {
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+    printf("[%s] ", stamp);
+}
+
+static void watch_checkpoint(Watch *w, int history) {
+    watch_print_time();
+    if (watch_compact(w) != 0) {
+        printf("Warning: out of memory, checkpoint skipped\n");
+        return;
+    }
+    const DirRecord *totals = dirstore_totals(w->store);
+    cache_set_history(history);
+    int result = cache_save(w->root, &w->opts, w->store, NULL, totals->size, totals->alloc_size,
+                            totals->files, 0);
+    cache_set_history(1);
+    if (result == 0) {
+        printf("Checkpoint saved (%llu directories)\n", (unsigned long long)dirstore_count(w->store));
+    } else {
+        printf("Warning: Failed to save checkpoint\n");
+    }
+    fflush(stdout);
+    w->changed = 0;
+}
+
+// List the queued directories again
+static void watch_flush(Watch *w) {
+    for (uint64_t i = 0; i < w->queued; i++) {
+        uint64_t node = w->queue[i];
+        w->dirty[node] = 0;
+        if (!w->gone[node]) watch_relist(w, node);
+    }
+    w->queued = 0;
+
+    char size_str[32];
+    const DirRecord *totals = dirstore_totals(w->store);
+    format_size(totals->size, size_str);
+    watch_print_time();
+    printf("%llu listed again, %llu added, %llu removed: %s in %llu files\n",
+           (unsigned long long)w->listed, (unsigned long long)w->added,
+           (unsigned long long)w->removed, size_str, (unsigned long long)totals->files);
+    fflush(stdout);
+    w->listed = w->added = w->removed = 0;
+    w->changed = 1;
+}
+
+// Filesystem-wide fanotify mark, when permitted and the whole tree is on
+// the root's filesystem. Returns 0 or -1 (nothing left open).
+static int watch_start_fanotify(Watch *w) {
+    struct stat st;
+    if (stat(w->root, &st) != 0) return -1;
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, WATCH_FANOTIFY_MASK, AT_FDCWD, w->root) != 0) {
+        close(fd);
+        return -1;
+    }
+    w->fanotify_fd = fd;
+    w->dev = st.st_dev;
+    for (uint64_t n = 0; n < w->nodes; n++) {
+        if (watch_subscribe(w, n) != 0) {
+            close(fd);
+            w->fanotify_fd = -1;
+            free(w->handles);
+            w->handles = NULL;
+            w->handle_cap = w->handle_count = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int watch_start_inotify(Watch *w) {
+    w->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (w->inotify_fd < 0) return -1;
+    for (uint64_t n = 0; n < w->nodes; n++) {
+        watch_subscribe(w, n);
+    }
+    return 0;
+}
+
+static void watch_read_inotify(Watch *w) {
+    union {
+        struct inotify_event event;
+        char bytes[64 * 1024];
+    } buf;
+    ssize_t len;
+    while ((len = read(w->inotify_fd, &buf, sizeof(buf))) > 0) {
+        for (char *p = buf.bytes; p < buf.bytes + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                watch_mark_all(w);
+            } else if (ev->wd >= 0 && (size_t)ev->wd < w->by_wd_cap) {
+                watch_mark(w, w->by_wd[ev->wd]);
+            }
+        }
+    }
+}
+
+// Records are only 4-byte aligned: headers are copied out before use
+static void watch_read_fanotify(Watch *w) {
+    static char buf[64 * 1024];
+    ssize_t len;
+    while ((len = read(w->fanotify_fd, buf, sizeof(buf))) > 0) {
+        for (size_t off = 0; off + FAN_EVENT_METADATA_LEN <= (size_t)len; ) {
+            struct fanotify_event_metadata ev;
+            memcpy(&ev, buf + off, sizeof(ev));
+            if (ev.event_len < FAN_EVENT_METADATA_LEN || off + ev.event_len > (size_t)len) break;
+            size_t end = off + ev.event_len;
+            if (ev.mask & FAN_Q_OVERFLOW) {
+                watch_mark_all(w);
+                off = end;
+                continue;
+            }
+
+            // The directory the event happened in, by its handle
+            for (size_t p = off + ev.metadata_len; p + sizeof(struct fanotify_event_info_fid) +
+                                                   sizeof(struct file_handle) <= end; ) {
+                struct fanotify_event_info_fid info;
+                struct file_handle fh;
+                memcpy(&info, buf + p, sizeof(info));
+                if (info.hdr.len == 0 || p + info.hdr.len > end) break;
+                const char *handle = buf + p + sizeof(info);
+                memcpy(&fh, handle, sizeof(fh));
+                if ((info.hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME ||
+                     info.hdr.info_type == FAN_EVENT_INFO_TYPE_DFID) &&
+                    sizeof(info) + sizeof(fh) + fh.handle_bytes <= info.hdr.len) {
+                    watch_mark(w, watch_handle_find(w, fh.handle_type,
+                                                    (const unsigned char *)handle + sizeof(fh),
+                                                    fh.handle_bytes));
+                }
+                p += info.hdr.len;
+            }
+            off = end;
+        }
+    }
+}
+
+int watch_run(const char *path, const ScanOptions *opts, DirStore **store) {
+    int marker = cache_watch_begin(path);
+    if (marker < 0) {
+        printf("Error: %s is already watched by another process\n", path);
+        return -1;
+    }
+
+    Watch w;
+    memset(&w, 0, sizeof(w));
+    w.root = path;
+    w.opts = *opts;
+    w.opts.retain = SCAN_RETAIN_DIRS;
+    w.store = *store;
+    w.inotify_fd = -1;
+    w.fanotify_fd = -1;
+    uint64_t nodes = dirstore_count(w.store) + 1;
+    if (watch_reserve(&w, nodes) != 0) {
+        cache_watch_end(marker);
+        return -1;
+    }
+    watch_index(&w, 0, nodes);
+
+    const char *source = "fanotify";
+    if (watch_start_fanotify(&w) != 0) {
+        source = "inotify";
+        if (watch_start_inotify(&w) != 0) {
+            printf("Error: no change notification available\n");
+            cache_watch_end(marker);
+            return -1;
+        }
+    }
+    printf("\nWatching %s (%s, %llu directories), Ctrl+C to stop...\n", path, source,
+           (unsigned long long)w.nodes);
+    fflush(stdout);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = watch_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct pollfd pfd;
+    pfd.fd = w.fanotify_fd >= 0 ? w.fanotify_fd : w.inotify_fd;
+    pfd.events = POLLIN;
+    // The first change after a quiet spell is saved with its batch
+    double last_checkpoint = watch_now() - WATCH_CHECKPOINT_SECONDS;
+    double last_history = watch_now();
+    while (!watch_stop) {
+        if (poll(&pfd, 1, w.queued ? WATCH_BATCH_MS : 1000) > 0) {
+            if (w.fanotify_fd >= 0) {
+                watch_read_fanotify(&w);
+            } else {
+                watch_read_inotify(&w);
+            }
+        }
+        double now = watch_now();
+        if (w.queued && now - w.batch_start >= WATCH_BATCH_MS / 1000.0) {
+            watch_flush(&w);
+        }
+        if (w.changed && now - last_checkpoint >= WATCH_CHECKPOINT_SECONDS) {
+            int history = now - last_history >= WATCH_HISTORY_SECONDS;
+            watch_checkpoint(&w, history);
+            last_checkpoint = now;
+            if (history) last_history = now;
+        }
+    }
+
+    printf("\nStopping...\n");
+    if (w.queued) watch_flush(&w);
+    if (w.changed) watch_checkpoint(&w, 1);
+    if (w.fanotify_fd >= 0) close(w.fanotify_fd);
+    if (w.inotify_fd >= 0) close(w.inotify_fd);
+    cache_watch_end(marker);
+
+    *store = w.store;
+    free(w.parent);
+    free(w.first_child);
+    free(w.next_sibling);
+    free(w.own_size);
+    free(w.own_alloc);
+    free(w.own_files);
+    free(w.own_inodes);
+    free(w.wd);
+    free(w.gone);
+    free(w.dirty);
+    free(w.queue);
+    free(w.by_wd);
+    free(w.handles);
+    return 0;
+}
+
+#else
+
+int watch_run(const char *path, const ScanOptions *opts, DirStore **store) {
+    (void)opts;
+    (void)store;
+    printf("Error: watching %s needs Linux change notifications\n", path);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "dirstore.h"
+#include "scanner.h"
+
+// Resident upkeep of a root's snapshot (Linux). Change events mark the
+// directories they happened in; every WATCH_BATCH_MS the marked ones are
+// listed again and the difference in their own files' sizes is added to
+// them, their parents and the totals. A new subdirectory is scanned and
+// grafted in, a vanished one dropped with its subtree. Events come from
+// fanotify (FAN_REPORT_DFID_NAME on the whole filesystem) when permitted
+// and the tree is on one filesystem, else from one inotify watch per
+// directory. A lost event queue lists every directory again.
+//
+// The snapshot is checkpointed through cache_save() at most every
+// WATCH_CHECKPOINT_SECONDS while it changes (appending to its history at
+// most every WATCH_HISTORY_SECONDS), and once more on exit. While the
+// daemon runs, cache_view_open() trusts that snapshot instead of asking for
+// a revalidation, so queries are answered straight from the cache.
+//
+// Directories only: files are not tracked one by one, and a file with
+// several names is counted in every directory listed again that holds one.
+
+#define WATCH_BATCH_MS 500
+#define WATCH_CHECKPOINT_SECONDS 10
+#define WATCH_HISTORY_SECONDS 3600
+
+// Keep *store, a scan of `path` that recorded every directory, up to date
+// until SIGINT or SIGTERM. *store may be replaced (tombstoned records are
+// dropped at checkpoints); the caller still frees it. Returns 0, or -1 if
+// watching could not start (another daemon holds `path`, no event source,
+// unsupported system).
+int watch_run(const char *path, const ScanOptions *opts, DirStore **store);
+
+#endif
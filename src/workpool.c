@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "workpool.h"
+
+#define DEQUE_INITIAL_CAPACITY 256
+#define CACHE_LINE 64
+
+typedef struct {
+    WorkFn fn;
+    void *arg;
+} WorkItem;
+
+// One deque per worker. The owner works at the bottom, thieves at the top.
+// Each deque has its own lock, so contention only happens on an actual steal.
+typedef struct {
+    pthread_mutex_t lock;
+    WorkItem *items;            // ring buffer
+    size_t capacity;            // always a power of two
+    size_t top;                 // oldest item (steal end)
+    size_t bottom;              // one past the newest item (owner end)
+    atomic_size_t size;         // lock-free hint for idle workers
+    char pad[CACHE_LINE];       // keep neighbouring deques off this cache line
+} WorkDeque;
+
+typedef struct {
+    WorkPool *pool;
+    int index;
+} WorkerArg;
+
+struct WorkPool {
+    int num_workers;
+    void *ctx;
+    WorkDeque *deques;
+    atomic_long pending;        // queued + running tasks
+    atomic_int sleepers;        // workers parked on idle_cond
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+};
+
+int workpool_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+WorkPool* workpool_create(int num_threads, void *ctx) {
+    if (num_threads <= 0) {
+        num_threads = workpool_cpu_count();
+    }
+
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if (!pool) return NULL;
+
+    pool->deques = calloc((size_t)num_threads, sizeof(WorkDeque));
+    if (!pool->deques) {
+        free(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        WorkDeque *dq = &pool->deques[i];
+        dq->items = malloc(DEQUE_INITIAL_CAPACITY * sizeof(WorkItem));
+        if (!dq->items) {
+            pool->num_workers = i;
+            workpool_destroy(pool);
+            return NULL;
+        }
+        dq->capacity = DEQUE_INITIAL_CAPACITY;
+        pthread_mutex_init(&dq->lock, NULL);
+        atomic_init(&dq->size, 0);
+    }
+
+    pool->num_workers = num_threads;
+    pool->ctx = ctx;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleepers, 0);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    return pool;
+}
+
+void workpool_destroy(WorkPool *pool) {
+    if (!pool) return;
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    free(pool->deques);
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool);
+}
+
+int workpool_size(const WorkPool *pool) {
+    return pool->num_workers;
+}
+
+void* workpool_ctx(const WorkPool *pool) {
+    return pool->ctx;
+}
+
+// Double the ring buffer, unwrapping it so top starts at index 0 (lock held)
+static int deque_grow(WorkDeque *dq) {
+    size_t count = dq->bottom - dq->top;
+    size_t new_capacity = dq->capacity * 2;
+    WorkItem *items = malloc(new_capacity * sizeof(WorkItem));
+    if (!items) return -1;
+
+    for (size_t i = 0; i < count; i++) {
+        items[i] = dq->items[(dq->top + i) & (dq->capacity - 1)];
+    }
+    free(dq->items);
+    dq->items = items;
+    dq->capacity = new_capacity;
+    dq->top = 0;
+    dq->bottom = count;
+    return 0;
+}
+
+static int deque_pop_bottom(WorkDeque *dq, WorkItem *out) {
+    if (atomic_load(&dq->size) == 0) return 0;
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        dq->bottom--;
+        *out = dq->items[dq->bottom & (dq->capacity - 1)];
+        atomic_fetch_sub(&dq->size, 1);
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static int deque_steal_top(WorkDeque *dq, WorkItem *out) {
+    if (atomic_load(&dq->size) == 0) return 0;
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        *out = dq->items[dq->top & (dq->capacity - 1)];
+        dq->top++;
+        atomic_fetch_sub(&dq->size, 1);
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+void workpool_push(WorkPool *pool, int worker, WorkFn fn, void *arg) {
+    WorkDeque *dq = &pool->deques[worker % pool->num_workers];
+    WorkItem item = { fn, arg };
+
+    // Count the task before it becomes visible so `pending` can never hit
+    // zero while work is still queued
+    atomic_fetch_add(&pool->pending, 1);
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom - dq->top == dq->capacity && deque_grow(dq) != 0) {
+        pthread_mutex_unlock(&dq->lock);
+        // Out of memory: run inline rather than losing the task
+        fn(pool, worker, arg);
+        atomic_fetch_sub(&pool->pending, 1);
+        return;
+    }
+    dq->items[dq->bottom & (dq->capacity - 1)] = item;
+    dq->bottom++;
+    atomic_fetch_add(&dq->size, 1);
+    pthread_mutex_unlock(&dq->lock);
+
+    // Wake one parked worker, if any
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+}
+
+static int pool_has_work(WorkPool *pool) {
+    for (int i = 0; i < pool->num_workers; i++) {
+        if (atomic_load(&pool->deques[i].size) > 0) return 1;
+    }
+    return 0;
+}
+
+// Own deque first (newest task), then steal round-robin starting after self
+static int pool_next_task(WorkPool *pool, int self, WorkItem *out) {
+    if (deque_pop_bottom(&pool->deques[self], out)) return 1;
+    for (int i = 1; i < pool->num_workers; i++) {
+        int victim = (self + i) % pool->num_workers;
+        if (deque_steal_top(&pool->deques[victim], out)) return 1;
+    }
+    return 0;
+}
+
+static void pool_worker_loop(WorkPool *pool, int self) {
+    WorkItem item;
+    for (;;) {
+        if (pool_next_task(pool, self, &item)) {
+            item.fn(pool, self, item.arg);
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                // Last task finished: release every parked worker
+                pthread_mutex_lock(&pool->idle_lock);
+                pthread_cond_broadcast(&pool->idle_cond);
+                pthread_mutex_unlock(&pool->idle_lock);
+            }
+            continue;
+        }
+
+        if (atomic_load(&pool->pending) == 0) break;
+
+        // Nothing to steal yet; park until a push or the final completion
+        pthread_mutex_lock(&pool->idle_lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->pending) > 0 && !pool_has_work(pool)) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+}
+
+static void* pool_thread_main(void *arg) {
+    WorkerArg *wa = (WorkerArg *)arg;
+    pool_worker_loop(wa->pool, wa->index);
+    return NULL;
+}
+
+int workpool_run(WorkPool *pool) {
+    int extra = pool->num_workers - 1;
+    pthread_t *threads = NULL;
+    WorkerArg *args = NULL;
+    int started = 0;
+
+    if (extra > 0) {
+        threads = malloc((size_t)extra * sizeof(pthread_t));
+        args = malloc((size_t)extra * sizeof(WorkerArg));
+        if (threads && args) {
+            for (int i = 0; i < extra; i++) {
+                args[i].pool = pool;
+                args[i].index = i + 1;
+                if (pthread_create(&threads[i], NULL, pool_thread_main, &args[i]) != 0) {
+                    break;
+                }
+                started++;
+            }
+        }
+    }
+
+    // The caller is worker 0; tasks queued on workers that failed to start
+    // are simply stolen by the others
+    pool_worker_loop(pool, 0);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(args);
+    return (started == extra) ? 0 : -1;
+}
@@ -0,0 +1,36 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+// Work-stealing thread pool.
+// Every worker owns a deque: it pushes and pops its own tasks at the bottom
+// (depth-first, cache friendly) while idle workers steal from the top of the
+// other deques (oldest task first, which for a directory walk is usually the
+// biggest remaining subtree). Tasks may push more tasks while they run.
+
+typedef struct WorkPool WorkPool;
+
+// Task callback. `worker` is the index of the worker running the task
+// (0 .. workpool_size()-1), handy for indexing per-thread state.
+typedef void (*WorkFn)(WorkPool *pool, int worker, void *arg);
+
+// Number of online CPUs (at least 1)
+int workpool_cpu_count(void);
+
+// Create a pool of num_threads workers (<= 0 means one per online CPU).
+// `ctx` is an opaque pointer handed back by workpool_ctx().
+WorkPool* workpool_create(int num_threads, void *ctx);
+void workpool_destroy(WorkPool *pool);
+
+int workpool_size(const WorkPool *pool);
+void* workpool_ctx(const WorkPool *pool);
+
+// Queue a task on `worker`'s deque. Safe to call from inside a running task
+// (use the worker index it was given) or before workpool_run().
+void workpool_push(WorkPool *pool, int worker, WorkFn fn, void *arg);
+
+// Run until every queued task, including tasks spawned by other tasks, has
+// finished. The calling thread acts as worker 0. Returns 0 on success, -1 if
+// worker threads could not be started (the work is then done by the caller).
+int workpool_run(WorkPool *pool);
+
+#endif